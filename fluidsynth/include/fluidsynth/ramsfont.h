@@ -63,6 +63,9 @@ FLUIDSYNTH_API int fluid_sample_set_name(fluid_sample_t* sample, const char *nam
 FLUIDSYNTH_API 
 int fluid_sample_set_sound_data(fluid_sample_t* sample, short *data, 
 			       unsigned int nbframes, short copy_data, int rootkey);
+FLUIDSYNTH_API 
+int fluid_sample_set_float_data(fluid_sample_t* sample, float *data, 
+			       unsigned int nbframes, short copy_data, int rootkey);
 
 
 #ifdef __cplusplus
@@ -59,10 +59,15 @@ FLUIDSYNTH_API
 int fluid_sequencer_send_at(fluid_sequencer_t* seq, fluid_event_t* evt, 
 			   unsigned int time, int absolute);
 FLUIDSYNTH_API 
+int fluid_sequencer_send_at_batch(fluid_sequencer_t* seq, fluid_event_t** evts,
+				  const unsigned int* times, int count, int absolute);
+FLUIDSYNTH_API 
 void fluid_sequencer_remove_events(fluid_sequencer_t* seq, short source, short dest, int type);
 FLUIDSYNTH_API unsigned int fluid_sequencer_get_tick(fluid_sequencer_t* seq);
 FLUIDSYNTH_API void fluid_sequencer_set_time_scale(fluid_sequencer_t* seq, double scale);
 FLUIDSYNTH_API double fluid_sequencer_get_time_scale(fluid_sequencer_t* seq);
+FLUIDSYNTH_API void fluid_sequencer_get_event_pool_stats(fluid_sequencer_t* seq, int* size,
+						  int* high_water, int* failures);
 
 // Compile in internal traceing functions
 #define FLUID_SEQ_WITH_TRACE 0
@@ -260,6 +260,9 @@ struct _fluid_sample_t
   int (*notify)(fluid_sample_t* sample, int reason);
 
   void* userdata;       /**< User defined data */
+
+  int format;           /**< Storage format of the sample data, see #fluid_sample_format (zero for 16 bit \a data) @since 1.1.7 */
+  void* wide_data;      /**< Sample data for #FLUID_SAMPLE_FORMAT_INT24 and #FLUID_SAMPLE_FORMAT_FLOAT samples, indexed like \a data @since 1.1.7 */
 };
 
 
@@ -270,8 +273,23 @@ struct _fluid_sample_t
 #define FLUID_SAMPLETYPE_RIGHT	2       /**< Flag for #fluid_sample_t \a sampletype field for right samples of a stereo pair */
 #define FLUID_SAMPLETYPE_LEFT	4       /**< Flag for #fluid_sample_t \a sampletype field for left samples of a stereo pair */
 #define FLUID_SAMPLETYPE_LINKED	8       /**< Flag for #fluid_sample_t \a sampletype field, not used currently */
+#define FLUID_SAMPLETYPE_OGG_VORBIS	0x10    /**< Flag for #fluid_sample_t \a sampletype field, compressed sample data of a SoundFont 3 file (Ogg Vorbis or FLAC) @since 1.1.7 */
 #define FLUID_SAMPLETYPE_ROM	0x8000  /**< Flag for #fluid_sample_t \a sampletype field, ROM sample, causes sample to be ignored */
 
+/**
+ * Storage format of the sample data of a #fluid_sample_t (\a format field).
+ * @since 1.1.7
+ *
+ * 16 bit samples are read from \a data, all wider formats from \a wide_data.
+ * Loaders of 24 bit SoundFonts keep the 16 bit \a data valid as well, so code
+ * reading \a data directly still sees the most significant 16 bits.
+ */
+enum fluid_sample_format {
+  FLUID_SAMPLE_FORMAT_INT16 = 0,        /**< Signed 16 bit integers in \a data (default) */
+  FLUID_SAMPLE_FORMAT_INT24,            /**< Signed 24 bit integers, right aligned in 32 bit words */
+  FLUID_SAMPLE_FORMAT_FLOAT             /**< 32 bit floats, full scale is +/-1.0 */
+};
+
 
 
 #ifdef __cplusplus
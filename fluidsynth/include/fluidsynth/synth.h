@@ -125,6 +125,24 @@ FLUIDSYNTH_API
 int fluid_synth_sfload(fluid_synth_t* synth, const char* filename, int reset_presets);
 FLUIDSYNTH_API int fluid_synth_sfreload(fluid_synth_t* synth, unsigned int id);
 FLUIDSYNTH_API int fluid_synth_sfunload(fluid_synth_t* synth, unsigned int id, int reset_presets);
+
+/**
+ * Callback of an asynchronous SoundFont load or reload.
+ * @param data User defined data pointer
+ * @param synth FluidSynth instance
+ * @param sfont_id ID of the loaded SoundFont, #FLUID_FAILED if loading failed
+ * @since 1.1.7
+ *
+ * Called from the loader thread after the SoundFont has been added to the
+ * synthesizer.
+ */
+typedef void (*fluid_sfload_callback_t)(void* data, fluid_synth_t* synth, int sfont_id);
+
+FLUIDSYNTH_API int fluid_synth_sfload_async(fluid_synth_t* synth, const char* filename,
+                                            int reset_presets,
+                                            fluid_sfload_callback_t callback, void* data);
+FLUIDSYNTH_API int fluid_synth_sfreload_async(fluid_synth_t* synth, unsigned int id,
+                                              fluid_sfload_callback_t callback, void* data);
 FLUIDSYNTH_API int fluid_synth_add_sfont(fluid_synth_t* synth, fluid_sfont_t* sfont);
 FLUIDSYNTH_API void fluid_synth_remove_sfont(fluid_synth_t* synth, fluid_sfont_t* sfont);
 FLUIDSYNTH_API int fluid_synth_sfcount(fluid_synth_t* synth);
@@ -134,6 +152,7 @@ FLUIDSYNTH_API fluid_sfont_t *fluid_synth_get_sfont_by_name (fluid_synth_t* synt
                                                              const char *name);
 FLUIDSYNTH_API int fluid_synth_set_bank_offset(fluid_synth_t* synth, int sfont_id, int offset);
 FLUIDSYNTH_API int fluid_synth_get_bank_offset(fluid_synth_t* synth, int sfont_id);
+FLUIDSYNTH_API int fluid_synth_get_sample_dedup_saved(fluid_synth_t* synth, int sfont_id);
 
 
 /* Reverb  */
@@ -184,6 +203,7 @@ FLUIDSYNTH_API int fluid_synth_count_midi_channels(fluid_synth_t* synth);
 FLUIDSYNTH_API int fluid_synth_count_audio_channels(fluid_synth_t* synth);
 FLUIDSYNTH_API int fluid_synth_count_audio_groups(fluid_synth_t* synth);
 FLUIDSYNTH_API int fluid_synth_count_effects_channels(fluid_synth_t* synth);
+FLUIDSYNTH_API int fluid_synth_count_effects_groups(fluid_synth_t* synth);
 
 
 /* Synthesis parameters */
@@ -212,6 +232,9 @@ enum fluid_interp {
 #define FLUID_INTERP_DEFAULT    FLUID_INTERP_4THORDER   /**< Default interpolation method from #fluid_interp. */
 #define FLUID_INTERP_HIGHEST    FLUID_INTERP_7THORDER   /**< Highest interpolation method from #fluid_interp. */
 
+FLUIDSYNTH_API 
+int fluid_synth_set_channel_azimuth(fluid_synth_t* synth, int chan, float azimuth);
+
 
 /* Generator interface */
 
@@ -44,9 +44,27 @@ struct _fluid_file_renderer_t {
 #endif
 
 	int period_size;
-	int buf_size;
+	int buf_frames;
+
+	int channels;		/* Channels in the file, the speakers of a surround layout */
+	float* planar;		/* Synth output of a surround layout, per stereo buffer */
+	float** left;
+	float** right;
+
+	int fx_channels;	/* Effects channels of an effects group */
+	int fx_count;		/* Effects buffers, fx_channels per effects group */
+	float* fx_planar;	/* Effects output of a surround layout */
+	float** fx_left;
+	float** fx_right;
+#if !LIBSNDFILE_SUPPORT
+	int dither_index;
+#endif
 };
 
+/* Largest number of frames rendered with one synth write call, matches
+ * what the synth mixer renders at once */
+#define FLUID_FILE_RENDERER_MAX_FRAMES  8192
+
 #if LIBSNDFILE_SUPPORT
 
 /* Default file type used, if none specified and auto extension search fails */
@@ -226,13 +244,15 @@ new_fluid_file_renderer(fluid_synth_t* synth)
 
 	dev->synth = synth;
 	fluid_settings_getint (synth->settings, "audio.period-size", &dev->period_size);
+	dev->buf_frames = dev->period_size > FLUID_FILE_RENDERER_MAX_FRAMES
+		? dev->period_size : FLUID_FILE_RENDERER_MAX_FRAMES;
+
+	dev->channels = synth->surround.speakers > 2 ? synth->surround.speakers : 2;
 
 #if LIBSNDFILE_SUPPORT
-	dev->buf_size = 2 * dev->period_size * sizeof (float);
-	dev->buf = FLUID_ARRAY(float, 2 * dev->period_size);
+	dev->buf = FLUID_ARRAY(float, dev->channels * dev->buf_frames);
 #else
-	dev->buf_size = 2 * dev->period_size * sizeof (short);
-	dev->buf = FLUID_ARRAY(short, 2 * dev->period_size);
+	dev->buf = FLUID_ARRAY(short, dev->channels * dev->buf_frames);
 #endif
 
 	if (dev->buf == NULL) {
@@ -240,6 +260,40 @@ new_fluid_file_renderer(fluid_synth_t* synth)
 		goto error_recovery;
 	}
 
+	/* A surround layout is rendered to all stereo buffers, then
+	 * interleaved into the file's channels */
+	if (dev->channels > 2) {
+		int i, pairs = synth->audio_channels;
+
+		dev->planar = FLUID_ARRAY(float, 2 * pairs * dev->buf_frames);
+		dev->left = FLUID_ARRAY(float*, pairs);
+		dev->right = FLUID_ARRAY(float*, pairs);
+		if (dev->planar == NULL || dev->left == NULL || dev->right == NULL) {
+			FLUID_LOG(FLUID_ERR, "Out of memory");
+			goto error_recovery;
+		}
+		for (i = 0; i < pairs; i++) {
+			dev->left[i] = &dev->planar[2 * i * dev->buf_frames];
+			dev->right[i] = &dev->planar[(2 * i + 1) * dev->buf_frames];
+		}
+
+		/* nwrite_float keeps the effects apart, they are added to the
+		 * front speakers when writing */
+		dev->fx_channels = fluid_synth_count_effects_channels(synth);
+		dev->fx_count = dev->fx_channels * fluid_synth_count_effects_groups(synth);
+		dev->fx_planar = FLUID_ARRAY(float, 2 * dev->fx_count * dev->buf_frames);
+		dev->fx_left = FLUID_ARRAY(float*, dev->fx_count);
+		dev->fx_right = FLUID_ARRAY(float*, dev->fx_count);
+		if (dev->fx_planar == NULL || dev->fx_left == NULL || dev->fx_right == NULL) {
+			FLUID_LOG(FLUID_ERR, "Out of memory");
+			goto error_recovery;
+		}
+		for (i = 0; i < dev->fx_count; i++) {
+			dev->fx_left[i] = &dev->fx_planar[2 * i * dev->buf_frames];
+			dev->fx_right[i] = &dev->fx_planar[(2 * i + 1) * dev->buf_frames];
+		}
+	}
+
 	fluid_settings_dupstr (synth->settings, "audio.file.name", &filename);
 	if (filename == NULL) {
 		FLUID_LOG(FLUID_ERR, "No file name specified");
@@ -265,7 +319,7 @@ new_fluid_file_renderer(fluid_synth_t* synth)
 
 	fluid_settings_getnum (synth->settings, "synth.sample-rate", &samplerate);
 	info.samplerate = samplerate + 0.5;
-	info.channels = 2;
+	info.channels = dev->channels;
 
 	/* Search for valid format for given file type, if invalid and no format was specified.
 	 * To handle Ogg/Vorbis and possibly future file types with new formats.
@@ -349,28 +403,86 @@ void delete_fluid_file_renderer(fluid_file_renderer_t* dev)
 	if (dev->buf != NULL) {
 		FLUID_FREE(dev->buf);
 	}
+	if (dev->planar != NULL) {
+		FLUID_FREE(dev->planar);
+	}
+	if (dev->left != NULL) {
+		FLUID_FREE(dev->left);
+	}
+	if (dev->right != NULL) {
+		FLUID_FREE(dev->right);
+	}
+	if (dev->fx_planar != NULL) {
+		FLUID_FREE(dev->fx_planar);
+	}
+	if (dev->fx_left != NULL) {
+		FLUID_FREE(dev->fx_left);
+	}
+	if (dev->fx_right != NULL) {
+		FLUID_FREE(dev->fx_right);
+	}
 
 	FLUID_FREE(dev);
 	return;
 }
 
-/**
- * Write period_size samples to file.
- * @param dev File renderer instance
- * @return #FLUID_OK or #FLUID_FAILED if an error occurred
- * @since 1.1.0
+/*
+ * Render len frames of a surround layout into the stereo buffers. The
+ * reverb and chorus of each effects group are added to the front pair of
+ * the audio group the mixer sends them to on the stereo outputs.
  */
-int
-fluid_file_renderer_process_block(fluid_file_renderer_t* dev)
+static void
+fluid_file_renderer_nwrite(fluid_file_renderer_t* dev, int len)
 {
-#if LIBSNDFILE_SUPPORT
-	int n;
+	fluid_synth_t* synth = dev->synth;
+	int pairs = fluid_surround_pairs(&synth->surround);
+	int bufs = synth->audio_channels;
+	int i, fx, out;
+
+	if (synth->audio_groups * pairs > bufs)
+		bufs = synth->audio_groups * pairs;
+
+	fluid_synth_nwrite_float(synth, len, dev->left, dev->right,
+				 dev->fx_left, dev->fx_right);
+
+	for (fx = 0; fx < dev->fx_count; fx++) {
+		/* only the reverb and chorus channels hold an effect output */
+		if (fx % dev->fx_channels > 1)
+			continue;
+		out = (fx / dev->fx_channels * pairs) % bufs;
+		if (out >= synth->audio_channels)
+			continue;
+		for (i = 0; i < len; i++) {
+			dev->left[out][i] += dev->fx_left[fx][i];
+			dev->right[out][i] += dev->fx_right[fx][i];
+		}
+	}
+}
 
-	fluid_synth_write_float(dev->synth, dev->period_size, dev->buf, 0, 2, dev->buf, 1, 2);
+/*
+ * Render len frames (at most buf_frames) and write them to file.
+ */
+static int
+fluid_file_renderer_write(fluid_file_renderer_t* dev, int len)
+{
+#if LIBSNDFILE_SUPPORT
+	int n, i, c;
+
+	if (dev->channels > 2) {
+		fluid_file_renderer_nwrite(dev, len);
+		for (i = 0; i < len; i++) {
+			for (c = 0; c < dev->channels; c++) {
+				float* in = (c & 1) ? dev->right[c / 2] : dev->left[c / 2];
+				dev->buf[i * dev->channels + c] = in[i];
+			}
+		}
+	} else {
+		fluid_synth_write_float(dev->synth, len, dev->buf, 0, 2, dev->buf, 1, 2);
+	}
 
-	n = sf_writef_float (dev->sndfile, dev->buf, dev->period_size);
+	n = sf_writef_float (dev->sndfile, dev->buf, len);
 
-	if (n != dev->period_size) {
+	if (n != len) {
 		FLUID_LOG (FLUID_ERR, "Audio file write error: %s",
 			   sf_strerror (dev->sndfile));
 		return FLUID_FAILED;
@@ -379,13 +491,28 @@ fluid_file_renderer_process_block(fluid_file_renderer_t* dev)
 
 #else   /* No libsndfile support */
 
-	int n, offset;
+	int n, offset, size, c;
 
-	fluid_synth_write_s16(dev->synth, dev->period_size, dev->buf, 0, 2, dev->buf, 1, 2);
+	if (dev->channels > 2) {
+		int di = 0;
+
+		/* every stereo buffer gets the same dither */
+		fluid_file_renderer_nwrite(dev, len);
+		for (c = 0; c < dev->channels; c += 2) {
+			di = dev->dither_index;
+			fluid_synth_dither_s16(&di, len, dev->left[c / 2], dev->right[c / 2],
+					       dev->buf, c, dev->channels,
+					       dev->buf, c + 1, dev->channels);
+		}
+		dev->dither_index = di;
+	} else {
+		fluid_synth_write_s16(dev->synth, len, dev->buf, 0, 2, dev->buf, 1, 2);
+	}
 
-	for (offset = 0; offset < dev->buf_size; offset += n) {
+	size = dev->channels * len * sizeof (short);
+	for (offset = 0; offset < size; offset += n) {
 
-		n = fwrite((char*) dev->buf + offset, 1, dev->buf_size - offset, dev->file);
+		n = fwrite((char*) dev->buf + offset, 1, size - offset, dev->file);
 		if (n < 0) {
 			FLUID_LOG(FLUID_ERR, "Audio output file write error: %s",
 				  strerror (errno));
@@ -396,6 +523,44 @@ fluid_file_renderer_process_block(fluid_file_renderer_t* dev)
 #endif
 }
 
+/**
+ * Write period_size samples to file.
+ * @param dev File renderer instance
+ * @return #FLUID_OK or #FLUID_FAILED if an error occurred
+ * @since 1.1.0
+ */
+int
+fluid_file_renderer_process_block(fluid_file_renderer_t* dev)
+{
+	return fluid_file_renderer_write(dev, dev->period_size);
+}
+
+/**
+ * Write a given number of samples to file.
+ * @param dev File renderer instance
+ * @param frames Number of frames to render
+ * @return #FLUID_OK or #FLUID_FAILED if an error occurred
+ *
+ * Larger amounts are rendered in fewer and longer synth calls than with
+ * fluid_file_renderer_process_block(), see
+ * fluid_player_get_frames_to_next_event().
+ * @since 1.1.7
+ */
+int
+fluid_file_renderer_process_frames(fluid_file_renderer_t* dev, int frames)
+{
+	int n;
+
+	while (frames > 0) {
+		n = frames < dev->buf_frames ? frames : dev->buf_frames;
+		if (fluid_file_renderer_write(dev, n) != FLUID_OK) {
+			return FLUID_FAILED;
+		}
+		frames -= n;
+	}
+	return FLUID_OK;
+}
+
 
 #if LIBSNDFILE_SUPPORT
 
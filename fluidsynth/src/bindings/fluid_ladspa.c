@@ -51,8 +51,12 @@ fluid_LADSPA_FxUnit_t* new_fluid_LADSPA_FxUnit(fluid_synth_t* synth){
   FxUnit->NumberLibs=0;
   FxUnit->NumberCommands=0;
   FxUnit->NumberUserControlNodes=0;
+  FxUnit->NumberInputs=0;
+  FxUnit->NumberSends=0;
+  FxUnit->NumberOutputs=0;
+  FxUnit->GroupBufs=1;
+  FxUnit->NumberSystemPorts=0;
   FxUnit->synth=synth;
-  pthread_cond_init(&FxUnit->cond,NULL);
   return FxUnit;
 };
 
@@ -61,22 +65,38 @@ fluid_LADSPA_FxUnit_t* new_fluid_LADSPA_FxUnit(fluid_synth_t* synth){
  */
 void fluid_LADSPA_CreateSystemNodes(fluid_LADSPA_FxUnit_t* FxUnit){
   char str[99];
-  int nr_input_nodes;
-  int nr_fx_input_nodes;
-  int nr_output_nodes;
-  int temp;
+  int nr_input_nodes=1;
+  int nr_fx_input_nodes=2;
+  int nr_output_nodes=1;
+  int nr_fx_groups=1;
   int i;
 
   /* Retrieve the number of synth / audio out / Fx send nodes */
-  assert(fluid_settings_getint(FxUnit->synth->settings, "synth.audio-groups", &temp));
-  nr_input_nodes=(int) temp;
+  fluid_settings_getint(FxUnit->synth->settings, "synth.audio-groups", &nr_input_nodes);
   printf("%i audio groups\n", nr_input_nodes);
+  fluid_settings_getint(FxUnit->synth->settings, "synth.audio-channels", &nr_output_nodes);
+  fluid_settings_getint(FxUnit->synth->settings, "synth.effects-channels", &nr_fx_input_nodes);
+  fluid_settings_getint(FxUnit->synth->settings, "synth.effects-groups", &nr_fx_groups);
+
+  /* Each effects group has its own sends: those of group g are the nodes
+   * send(g*effects-channels+1) and up, so send1 and send2 stay the reverb
+   * and chorus sends of the first group. */
+  nr_fx_input_nodes *= nr_fx_groups;
+
+  /* With a surround speaker layout, each audio group spans several stereo buffers.
+   * The nodes of a group are bound to its first (front) pair, the other speakers stay dry. */
+  FxUnit->GroupBufs=fluid_surround_pairs(&FxUnit->synth->surround);
+  if (FxUnit->GroupBufs > 1){
+    FLUID_LOG(FLUID_INFO, "LADSPA: Only the front speakers of each audio group pass through the Fx unit");
+    nr_output_nodes /= FxUnit->GroupBufs;
+  };
 
-  assert(fluid_settings_getint(FxUnit->synth->settings, "synth.audio-channels", &temp));
-  nr_output_nodes=temp;
+  /* Output nodes exist once per audio group, but only the audio channels are copied back. */
+  if (nr_output_nodes > nr_input_nodes) nr_output_nodes = nr_input_nodes;
 
-  assert(fluid_settings_getint(FxUnit->synth->settings, "synth.effects-channels", &temp));
-  nr_fx_input_nodes=temp;
+  FxUnit->NumberInputs=nr_input_nodes;
+  FxUnit->NumberSends=nr_fx_input_nodes;
+  FxUnit->NumberOutputs=nr_output_nodes;
 
   /* Create regular input nodes (associated with audio groups) */
   for (i=0; i < nr_input_nodes; i++){
@@ -103,6 +123,141 @@ void fluid_LADSPA_CreateSystemNodes(fluid_LADSPA_FxUnit_t* FxUnit){
   };
 };
 
+/* Purpose:
+ * Returns the synth buffer, which belongs to a system node.
+ * Audio group g starts at buffer g*GroupBufs.
+ */
+static fluid_real_t*
+fluid_LADSPA_SystemBuf(fluid_LADSPA_FxUnit_t* FxUnit, fluid_LADSPA_SystemKind Kind, int Index, fluid_real_t* left_buf[], fluid_real_t* right_buf[], fluid_real_t* fx_left_buf[], fluid_real_t* fx_right_buf[]){
+  int buf;
+  if (Kind == fluid_LADSPA_system_send){
+    return (Index & 1) ? fx_right_buf[Index/2] : fx_left_buf[Index/2];
+  };
+  buf=(Index/2)*FxUnit->GroupBufs;
+  return (Index & 1) ? right_buf[buf] : left_buf[buf];
+};
+
+/* Purpose:
+ * Resolves the system nodes once, after all plugins have been connected.
+ * fluid_LADSPA_run uses the flat arrays filled in here.
+ *
+ * If fluid_real_t and LADSPA_Data are the same type, the plugin ports on the system nodes
+ * are pointed directly at the synth buffers during the run. An output node can only share the
+ * synth buffer with its input node, if the plugin writing it runs after all plugins reading
+ * the input (or is the last reader itself and can process in place). Otherwise it is copied.
+ *
+ * Returns FLUID_FAILED, if a system node is missing.
+ */
+int fluid_LADSPA_BindSystemNodes(fluid_LADSPA_FxUnit_t* FxUnit){
+  static const char* side[2]={"L","R"};
+  fluid_LADSPA_Node_t* InputNodes[FLUID_LADSPA_MaxNodes];
+  fluid_LADSPA_Node_t* SendNodes[FLUID_LADSPA_MaxNodes];
+  fluid_LADSPA_Node_t* OutputNodes[FLUID_LADSPA_MaxNodes];
+  char str[99];
+  fluid_LADSPA_Node_t* n;
+  int i;
+  int ii;
+
+  for (i=0; i < 2*FxUnit->NumberInputs; i++){
+    sprintf(str, "in%i_%s",(i/2+1),side[i%2]);
+    n=fluid_LADSPA_RetrieveNode(FxUnit, str);
+    if (n == NULL) goto error_recovery;
+    InputNodes[i]=n;
+    FxUnit->InputBufs[i]=n->buf;
+  };
+
+  for (i=0; i < 2*FxUnit->NumberSends; i++){
+    sprintf(str, "send%i_%s",(i/2+1),side[i%2]);
+    n=fluid_LADSPA_RetrieveNode(FxUnit, str);
+    if (n == NULL) goto error_recovery;
+    SendNodes[i]=n;
+    FxUnit->SendBufs[i]=n->buf;
+  };
+
+  for (i=0; i < 2*FxUnit->NumberOutputs; i++){
+    sprintf(str, "out%i_%s",(i/2+1),side[i%2]);
+    n=fluid_LADSPA_RetrieveNode(FxUnit, str);
+    if (n == NULL) goto error_recovery;
+    OutputNodes[i]=n;
+    FxUnit->OutputBufs[i]=n->buf;
+    /* Output nodes without a source are cleared on each block */
+    FxUnit->OutputMode[i]=(n->InCount == 0) ? fluid_LADSPA_output_silent : fluid_LADSPA_output_copy;
+  };
+
+  /* Find out, which synth buffer each connected port belongs to.
+   * Output nodes beyond the audio channels are not copied back, they keep their own buffers. */
+  for (ii=0; ii < FxUnit->NumberSystemPorts; ii++){
+    fluid_LADSPA_SystemPort_t* SystemPort=&FxUnit->SystemPorts[ii];
+    for (i=0; i < 2*FxUnit->NumberInputs; i++){
+      if (SystemPort->Node == InputNodes[i]){
+	SystemPort->Kind=fluid_LADSPA_system_input;
+	SystemPort->Index=i;
+      };
+    };
+    for (i=0; i < 2*FxUnit->NumberSends; i++){
+      if (SystemPort->Node == SendNodes[i]){
+	SystemPort->Kind=fluid_LADSPA_system_send;
+	SystemPort->Index=i;
+      };
+    };
+    for (i=0; i < 2*FxUnit->NumberOutputs; i++){
+      if (SystemPort->Node == OutputNodes[i]){
+	SystemPort->Kind=fluid_LADSPA_system_output;
+	SystemPort->Index=i;
+      };
+    };
+  };
+
+#ifdef WITH_FLOAT
+  /* Decide, which output nodes can be written straight into the synth buffers */
+  for (i=0; i < 2*FxUnit->NumberOutputs; i++){
+    int Writer=-1;
+    int LastReader=-1;
+    int InPlaceBroken;
+
+    if (FxUnit->OutputMode[i] == fluid_LADSPA_output_silent){
+      continue;
+    };
+    for (ii=0; ii < FxUnit->NumberSystemPorts; ii++){
+      fluid_LADSPA_SystemPort_t* SystemPort=&FxUnit->SystemPorts[ii];
+      if (SystemPort->Kind == fluid_LADSPA_system_output && SystemPort->Index == i && !SystemPort->IsInput){
+	Writer=SystemPort->Plugin;
+      };
+      if (SystemPort->Kind == fluid_LADSPA_system_input && SystemPort->Index == i
+	  && SystemPort->Plugin > LastReader){
+	LastReader=SystemPort->Plugin;
+      };
+    };
+    assert(Writer >= 0);
+    InPlaceBroken=LADSPA_IS_INPLACE_BROKEN(FxUnit->PluginDescriptorTable[Writer]->Properties);
+    if (Writer > LastReader || (Writer == LastReader && !InPlaceBroken)){
+      FxUnit->OutputMode[i]=fluid_LADSPA_output_direct;
+    };
+  };
+
+  for (ii=0; ii < FxUnit->NumberSystemPorts; ii++){
+    fluid_LADSPA_SystemPort_t* SystemPort=&FxUnit->SystemPorts[ii];
+    switch (SystemPort->Kind){
+    case fluid_LADSPA_system_input:
+    case fluid_LADSPA_system_send:
+      SystemPort->Direct=1;
+      break;
+    case fluid_LADSPA_system_output:
+      SystemPort->Direct=(FxUnit->OutputMode[SystemPort->Index] == fluid_LADSPA_output_direct);
+      break;
+    default:
+      SystemPort->Direct=0;
+      break;
+    };
+  };
+#endif
+  return FLUID_OK;
+
+ error_recovery:
+  L(printf("System node %s does not exist", str));
+  return FLUID_FAILED;
+};
+
 /* Purpose:
  * Creates predeclared nodes for control of the Fx unit during operation.
  */
@@ -580,6 +735,27 @@ fluid_LADSPA_handle_start(fluid_synth_t* synth, int ac, char** av, fluid_ostream
 	 );
       CurrentPlugin_PortConnected[CurrentPort_Index]++;
 
+      /* Remember connections to the system nodes, fluid_LADSPA_BindSystemNodes sorts them out. */
+      if ((Current_Node->flags & fluid_LADSPA_node_is_audio)
+	  && (Current_Node->flags & (fluid_LADSPA_node_is_source | fluid_LADSPA_node_is_sink))){
+	fluid_LADSPA_SystemPort_t* SystemPort;
+	if (FxUnit->NumberSystemPorts>=FLUID_LADSPA_MaxSystemPorts){
+    fluid_ostream_printf(out, "***Error035***\n"
+		 "Too many connections to the system nodes (%i)\n"
+		 "Change FLUID_LADSPA_MaxSystemPorts",FxUnit->NumberSystemPorts);
+	  fluid_LADSPA_clear(FxUnit);
+	  return(PrintErrorMessage);
+	};
+	SystemPort=&FxUnit->SystemPorts[FxUnit->NumberSystemPorts++];
+	SystemPort->Plugin=FxUnit->NumberPlugins;
+	SystemPort->Port=CurrentPort_Index;
+	SystemPort->IsInput=(FLUID_STRCMP(Direction,"<-")==0);
+	SystemPort->Node=Current_Node;
+	SystemPort->Kind=fluid_LADSPA_system_none;
+	SystemPort->Index=0;
+	SystemPort->Direct=0;
+      };
+
     }; /* While Tokensequence (more connections) */
 
     /*
@@ -688,140 +864,116 @@ fluid_LADSPA_handle_start(fluid_synth_t* synth, int ac, char** av, fluid_ostream
 	       "You have not connected anything to the output (out1_L, out1_R).\n");
   };
 
+  /* Resolve the system node buffers for fluid_LADSPA_run */
+  if (fluid_LADSPA_BindSystemNodes(FxUnit) != FLUID_OK){
+    fluid_ostream_printf(out, "***Error034***\n"
+	     "Failed to resolve the system nodes (in1_L, send1_L, out1_L...).\n");
+    fluid_LADSPA_clear(FxUnit);
+    return(PrintErrorMessage);
+  };
+
   /* Finally turn on the Fx unit. */
-  FxUnit->Bypass=fluid_LADSPA_Active;
+  fluid_atomic_int_set(&FxUnit->Bypass, fluid_LADSPA_Active);
   L(fluid_ostream_printf(out,"LADSPA Init OK"));
   return(ReturnVal);
 };
 
 void
-fluid_LADSPA_run(fluid_LADSPA_FxUnit_t* FxUnit, fluid_real_t* left_buf[], fluid_real_t* right_buf[], fluid_real_t* fx_left_buf[], fluid_real_t* fx_right_buf[]){
+fluid_LADSPA_run(fluid_LADSPA_FxUnit_t* FxUnit, fluid_real_t* left_buf[], fluid_real_t* right_buf[], fluid_real_t* fx_left_buf[], fluid_real_t* fx_right_buf[], int count){
   int i;
   int ii;
+  int offset;
+  int len;
+  int state;
 
-
-  int nr_audio_channels;
-  int nr_fx_sends;
-  int nr_groups;
-  int byte_size = FLUID_BUFSIZE * sizeof(fluid_real_t);
-  char str[99];
-  fluid_LADSPA_Node_t* n;
-  int temp;
-
-  /* Retrieve the number of synth / audio out / Fx send nodes */
-  assert(fluid_settings_getint(FxUnit->synth->settings, "synth.audio-groups", &temp));
-  nr_groups=(int) temp;
-
-  assert(fluid_settings_getint(FxUnit->synth->settings, "synth.audio-channels", &temp));
-  nr_audio_channels=temp;
-
-  assert(fluid_settings_getint(FxUnit->synth->settings, "synth.effects-channels", &temp));
-  nr_fx_sends=temp;
-
-  /* Fixme: Retrieving nodes via names is inefficient
-   * (but not that bad, because the interesting nodes are always at the start of the list).
-   */
+  assert(FxUnit);
 
   /* Input and output are processed via the same buffers. Therefore the effect is bypassed by just skipping everything else. */
-  if (FxUnit->Bypass==fluid_LADSPA_Bypassed){
-    return;
-  };
-
-  if (FxUnit->Bypass==fluid_LADSPA_BypassRequest){
-    FxUnit->Bypass=fluid_LADSPA_Bypassed;
-    pthread_mutex_lock(&FxUnit->mutex);
-    pthread_cond_broadcast(&FxUnit->cond);
-    pthread_mutex_unlock(&FxUnit->mutex);
-    L(printf("LADSPA_Run: Command line asked for bypass of Fx unit. Acknowledged."));
+  state=fluid_atomic_int_get(&FxUnit->Bypass);
+  if (state != fluid_LADSPA_Active){
+    if (state == fluid_LADSPA_BypassRequest){
+      fluid_atomic_int_set(&FxUnit->Bypass, fluid_LADSPA_Bypassed);
+      L(printf("LADSPA_Run: Command line asked for bypass of Fx unit. Acknowledged."));
+    };
     return;
   };
 
-  assert(FxUnit);
-
-  /* Clear the output buffers, if they are not connected anywhere */
-  for (ii=0; ii < nr_audio_channels; ii++){
-
-      sprintf(str, "out%i_L",(ii+1));
-      n=fluid_LADSPA_RetrieveNode(FxUnit, str); assert(n);
-      if (n->InCount == 0){
-/*	  printf("Output node %s is not connected -> clear buffer\n", str); */
-	  FLUID_MEMSET(n->buf, 0, byte_size);
-      };
-
-      sprintf(str, "out%i_R",(ii+1));
-      n=fluid_LADSPA_RetrieveNode(FxUnit, str); assert(n);
-      if (n->InCount == 0){
-/*	  printf("Output node %s is not connected -> clear buffer\n", str); */
-	  FLUID_MEMSET(n->buf, 0, byte_size);
-      };
-  };
-
-  /* Prepare the incoming data:
-   * Convert fluid_real_t data type to LADSPA_Data type */
-  for (ii=0; ii < nr_groups; ii++){
-      fluid_real_t* src_buf=left_buf[ii];
-      sprintf(str, "in%i_L",(ii+1));
-      n=fluid_LADSPA_RetrieveNode(FxUnit, str); assert(n);
-
-      assert(FLUID_BUFSIZE % 2 == 0);
+  /* The plugins process the whole span at once, unless it exceeds the node buffers. */
+  assert(count % 2 == 0);
+  for (offset=0; offset < count; offset += len){
+    len=count-offset;
+    if (len > FLUID_LADSPA_MaxBufSize){
+      len=FLUID_LADSPA_MaxBufSize;
+    };
 
-      /* Add a very small high frequency signal. This avoids denormal number problems. */
-      for (i=0; i<FLUID_BUFSIZE;){
-	  n->buf[i]=(LADSPA_Data)(src_buf[i]+1.e-15);
-	  i++;
-	  n->buf[i]=(LADSPA_Data)(src_buf[i]);
-	  i++;
+    /* Prepare the incoming data */
+    for (ii=0; ii < 2*FxUnit->NumberInputs; ii++){
+      fluid_real_t* src_buf=fluid_LADSPA_SystemBuf(FxUnit, fluid_LADSPA_system_input, ii, left_buf, right_buf, fx_left_buf, fx_right_buf)+offset;
+#ifdef WITH_FLOAT
+      /* The plugins read the synth buffer directly.
+       * Add a very small high frequency signal. This avoids denormal number problems. */
+      for (i=0; i<len; i+=2){
+	src_buf[i]+=1.e-15f;
       };
-
-      src_buf=right_buf[ii];
-      sprintf(str, "in%i_R",(ii+1));
-      n=fluid_LADSPA_RetrieveNode(FxUnit, str); assert(n);
+#else
+      /* Convert fluid_real_t data type to LADSPA_Data type */
+      LADSPA_Data* dest_buf=FxUnit->InputBufs[ii];
 
       /* Add a very small high frequency signal. This avoids denormal number problems. */
-      for (i=0; i<FLUID_BUFSIZE;){
-	  n->buf[i]=(LADSPA_Data)(src_buf[i]+1.e-15);
-	  i++;
-	  n->buf[i]=(LADSPA_Data)(src_buf[i]);
-	  i++;
+      for (i=0; i<len;){
+	dest_buf[i]=(LADSPA_Data)(src_buf[i]+1.e-15);
+	i++;
+	dest_buf[i]=(LADSPA_Data)(src_buf[i]);
+	i++;
       };
-  };
+#endif
+    };
 
-  /* Effect send paths */
-  for (ii=0; ii < nr_fx_sends; ii++){
-      sprintf(str, "send%i_L",(ii+1));
-      n=fluid_LADSPA_RetrieveNode(FxUnit, str); assert(n);
-      for (i=0; i<FLUID_BUFSIZE; i++){
-	  n->buf[i]=(LADSPA_Data)(fx_left_buf[ii][i]);
+#ifdef WITH_FLOAT
+    /* Point the ports on the system nodes at the synth buffers */
+    for (i=0; i<FxUnit->NumberSystemPorts; i++){
+      fluid_LADSPA_SystemPort_t* SystemPort=&FxUnit->SystemPorts[i];
+      if (SystemPort->Direct){
+	FxUnit->PluginDescriptorTable[SystemPort->Plugin]->connect_port
+	  (FxUnit->PluginInstanceTable[SystemPort->Plugin], SystemPort->Port,
+	   (LADSPA_Data*)fluid_LADSPA_SystemBuf(FxUnit, SystemPort->Kind, SystemPort->Index,
+						left_buf, right_buf, fx_left_buf, fx_right_buf)+offset);
       };
-
-      sprintf(str, "send%i_R",(ii+1));
-      n=fluid_LADSPA_RetrieveNode(FxUnit, str); assert(n);
-      for (i=0; i<FLUID_BUFSIZE; i++){
-	  n->buf[i]=(LADSPA_Data)(fx_right_buf[ii][i]);
+    };
+#else
+    /* Effect send paths */
+    for (ii=0; ii < 2*FxUnit->NumberSends; ii++){
+      fluid_real_t* src_buf=fluid_LADSPA_SystemBuf(FxUnit, fluid_LADSPA_system_send, ii, left_buf, right_buf, fx_left_buf, fx_right_buf)+offset;
+      LADSPA_Data* dest_buf=FxUnit->SendBufs[ii];
+      for (i=0; i<len; i++){
+	dest_buf[i]=(LADSPA_Data)(src_buf[i]);
       };
-  };
-
-  /* Run each plugin on a block of data.
-   * The execution order has been checked during setup.*/
-  for (i=0; i<FxUnit->NumberPlugins; i++){
-    FxUnit->PluginDescriptorTable[i]->run(FxUnit->PluginInstanceTable[i],FLUID_BUFSIZE);
-  };
+    };
+#endif
 
-  /* Copy the data from the output nodes back to the synth. */
-  for (ii=0; ii < nr_audio_channels; ii++){
-      fluid_real_t* dest_buf=left_buf[ii];
-      sprintf(str, "out%i_L",(ii+1));
-      n=fluid_LADSPA_RetrieveNode(FxUnit, str); assert(n);
-      for (i=0; i<FLUID_BUFSIZE; i++){
-	  dest_buf[i]=(fluid_real_t)n->buf[i];
-      };
+    /* Run each plugin on a block of data.
+     * The execution order has been checked during setup.*/
+    for (i=0; i<FxUnit->NumberPlugins; i++){
+      FxUnit->PluginDescriptorTable[i]->run(FxUnit->PluginInstanceTable[i],len);
+    };
 
-      dest_buf=right_buf[ii];
-      sprintf(str, "out%i_R",(ii+1));
-      n=fluid_LADSPA_RetrieveNode(FxUnit, str); assert(n);
-      for (i=0; i<FLUID_BUFSIZE; i++){
-	  dest_buf[i]=(fluid_real_t)n->buf[i];
+    /* Copy the data from the output nodes back to the synth. */
+    for (ii=0; ii < 2*FxUnit->NumberOutputs; ii++){
+      fluid_real_t* dest_buf=fluid_LADSPA_SystemBuf(FxUnit, fluid_LADSPA_system_output, ii, left_buf, right_buf, fx_left_buf, fx_right_buf)+offset;
+      LADSPA_Data* src_buf=FxUnit->OutputBufs[ii];
+      switch (FxUnit->OutputMode[ii]){
+      case fluid_LADSPA_output_silent:
+	FLUID_MEMSET(dest_buf, 0, len*sizeof(fluid_real_t));
+	break;
+      case fluid_LADSPA_output_copy:
+	for (i=0; i<len; i++){
+	  dest_buf[i]=(fluid_real_t)src_buf[i];
+	};
+	break;
+      default:
+	break;
       };
+    };
   };
 };
 
@@ -875,11 +1027,11 @@ fluid_LADSPA_CreateNode(fluid_LADSPA_FxUnit_t* FxUnit, char * Name, int flags){
     Dummy=1;
   };
   NewNode=FLUID_NEW(fluid_LADSPA_Node_t);assert(NewNode);
-  if (flags && fluid_LADSPA_node_is_audio){
+  if (flags & fluid_LADSPA_node_is_audio){
     /* Audio node contains buffer. */
-    NewNode->buf=FLUID_ARRAY(LADSPA_Data, (FLUID_BUFSIZE));assert(NewNode->buf);
+    NewNode->buf=FLUID_ARRAY(LADSPA_Data, (FLUID_LADSPA_MaxBufSize));assert(NewNode->buf);
     /* It is permitted to use a dummy node without input. Therefore clear all node buffers at startup. */
-    FLUID_MEMSET(NewNode->buf, 0, (FLUID_BUFSIZE*sizeof(LADSPA_Data)));
+    FLUID_MEMSET(NewNode->buf, 0, (FLUID_LADSPA_MaxBufSize*sizeof(LADSPA_Data)));
   } else if (flags & fluid_LADSPA_node_is_control){
     /* Control node contains single value. */
     NewNode->buf=FLUID_ARRAY(LADSPA_Data, 1);assert(NewNode->buf);
@@ -919,15 +1071,22 @@ void fluid_LADSPA_clear(fluid_LADSPA_FxUnit_t* FxUnit){
   L(printf("ladspa_clear"));
   assert(FxUnit);
 
-  if (FxUnit->Bypass==fluid_LADSPA_Active){
+  /* Bypass the Fx unit before anything else.
+   * Reason: Not a good idea to release plugins, while another thread runs them.
+   */
+  if (fluid_atomic_int_compare_and_exchange(&FxUnit->Bypass, fluid_LADSPA_Active, fluid_LADSPA_BypassRequest)){
     L(printf("clear: Requesting bypass from synthesis thread"));
-    /* Bypass the Fx unit before anything else.
-     * Reason: Not a good idea to release plugins, while another thread runs them.
-     */
-    FxUnit->Bypass=fluid_LADSPA_BypassRequest;
-    pthread_mutex_lock(&FxUnit->mutex);
-    pthread_cond_wait(&FxUnit->cond,&FxUnit->mutex);
-    pthread_mutex_unlock(&FxUnit->mutex);
+    for (i=0; fluid_atomic_int_get(&FxUnit->Bypass) != fluid_LADSPA_Bypassed; i++){
+      if (i >= FLUID_LADSPA_BypassTimeout){
+        /* Nothing is rendering (no audio driver or the driver is stalled),
+         * so nobody will acknowledge the request: switch to bypass here. */
+        if (fluid_atomic_int_compare_and_exchange(&FxUnit->Bypass, fluid_LADSPA_BypassRequest, fluid_LADSPA_Bypassed)){
+          FLUID_LOG(FLUID_WARN, "ladspa: synthesis thread did not acknowledge the bypass request within %d ms", FLUID_LADSPA_BypassTimeout);
+        };
+        break;
+      };
+      fluid_msleep(1);
+    };
     L(printf("clear: Synthesis thread has switched to bypass."));
   } else {
     L(printf("clear: Fx unit was already bypassed. No action needed."));
@@ -958,6 +1117,11 @@ void fluid_LADSPA_clear(fluid_LADSPA_FxUnit_t* FxUnit){
     FLUID_FREE(FxUnit->Nodelist[i]);
   };
   FxUnit->NumberNodes=0;
+  FxUnit->NumberInputs=0;
+  FxUnit->NumberSends=0;
+  FxUnit->NumberOutputs=0;
+  FxUnit->GroupBufs=1;
+  FxUnit->NumberSystemPorts=0;
 
 
   L(printf("Clear all plugin libraries"));
@@ -1110,8 +1274,7 @@ int fluid_LADSPA_handle_clear(fluid_synth_t* synth, int ac, char** av, fluid_ost
 void fluid_LADSPA_shutdown(fluid_LADSPA_FxUnit_t* FxUnit){
   /* The synthesis thread is not running anymore.
    * Set the bypass switch, so that fluid_LADSPA_clear can proceed.*/
-  FxUnit->Bypass=fluid_LADSPA_Bypassed;
+  fluid_atomic_int_set(&FxUnit->Bypass, fluid_LADSPA_Bypassed);
   fluid_LADSPA_clear(FxUnit);
-  pthread_cond_destroy(&FxUnit->cond); /* pro forma */
 };
 #endif /*LADSPA*/
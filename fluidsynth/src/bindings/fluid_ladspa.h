@@ -34,7 +34,6 @@
 
 #ifdef LADSPA
 #include "fluid_list.h"
-#include <pthread.h>
 #include <ladspa.h>
 
 /***************************************************************
@@ -52,6 +51,12 @@
 #define FLUID_LADSPA_MaxTokens 152
 /* What is the maximum path length? */
 #define FLUID_LADSPA_MaxPathLength 512
+/* How many samples are processed in one go? (The mixer renders up to 8192 samples at a time.) */
+#define FLUID_LADSPA_MaxBufSize 8192
+/* How many plugin ports may be connected to the system nodes (in, send, out)? */
+#define FLUID_LADSPA_MaxSystemPorts 256
+/* How long (in ms) may fluid_LADSPA_clear wait for the synthesis thread to acknowledge the bypass? */
+#define FLUID_LADSPA_BypassTimeout 1000
 /***************************************************************
  *
  *                         ENUM
@@ -70,6 +75,21 @@ typedef enum {
   fluid_LADSPA_BypassRequest
 } fluid_LADSPA_BypassState;
 
+/* Which synth buffers a system node stands for */
+typedef enum {
+  fluid_LADSPA_system_none,
+  fluid_LADSPA_system_input,
+  fluid_LADSPA_system_send,
+  fluid_LADSPA_system_output
+} fluid_LADSPA_SystemKind;
+
+/* How the synth buffer behind an output node is updated after running the plugins */
+typedef enum {
+  fluid_LADSPA_output_silent,  /* No source: cleared */
+  fluid_LADSPA_output_copy,    /* Copied (converted) from the node buffer */
+  fluid_LADSPA_output_direct   /* Written by the plugin itself, nothing to do */
+} fluid_LADSPA_OutputMode;
+
 typedef enum {
   fluid_LADSPA_node_is_source=1,
   fluid_LADSPA_node_is_sink=2,
@@ -92,6 +112,21 @@ typedef struct {
   int flags;
 } fluid_LADSPA_Node_t;
 
+/* fluid_LADSPA_SystemPort_t
+ * An audio port of a plugin instance, which is connected to a system node.
+ * If 'Direct' is set, the port is pointed straight at the synth buffer on each run
+ * instead of the node buffer (only possible, if fluid_real_t and LADSPA_Data are the same type).
+ */
+typedef struct {
+  int Plugin;               /* Index into the plugin tables */
+  unsigned long Port;       /* Port number on the plugin */
+  int IsInput;              /* The plugin reads from the node */
+  fluid_LADSPA_Node_t * Node;
+  fluid_LADSPA_SystemKind Kind;
+  int Index;                /* Index of the synth buffer, left and right alternating */
+  int Direct;
+} fluid_LADSPA_SystemPort_t;
+
 /*
  * fluid_LADSPA_Fx_t
  * Fx unit using LADSPA.
@@ -136,18 +171,32 @@ typedef struct {
   char * UserControlNodeNames[FLUID_LADSPA_MaxNodes];
   fluid_real_t UserControlNodeValues[FLUID_LADSPA_MaxNodes];
 
-  /* Bypass switch
-   * If set, the LADSPA Fx unit does not touch the signal.*/
-  fluid_LADSPA_BypassState Bypass;
-
-  /* Communication between the 'command line' process and the synthesis process.
+  /* System nodes (in%i_L/R, send%i_L/R, out%i_L/R)
+   * Their buffers are resolved once in fluid_LADSPA_handle_start, so that
+   * fluid_LADSPA_run only walks flat arrays instead of looking up nodes by name.
+   * Left and right channels alternate: [0]=in1_L, [1]=in1_R, [2]=in2_L, ...
+   */
+  int NumberInputs;
+  int NumberSends;
+  int NumberOutputs;
+  int GroupBufs;                /* Stereo synth buffers per audio group (speaker layout) */
+  LADSPA_Data * InputBufs[FLUID_LADSPA_MaxNodes];
+  LADSPA_Data * SendBufs[FLUID_LADSPA_MaxNodes];
+  LADSPA_Data * OutputBufs[FLUID_LADSPA_MaxNodes];
+  fluid_LADSPA_OutputMode OutputMode[FLUID_LADSPA_MaxNodes];
+
+  /* Plugin ports connected to system nodes */
+  int NumberSystemPorts;
+  fluid_LADSPA_SystemPort_t SystemPorts[FLUID_LADSPA_MaxSystemPorts];
+
+  /* Bypass switch (a fluid_LADSPA_BypassState, accessed atomically)
+   * If set, the LADSPA Fx unit does not touch the signal.
    * A possible conflict situation arises, when fluid_clear is called, and starts to destroy
    * the plugins. But the synthesis thread still processes plugins at the same time. The consequences are ugly.
-   * Therefore ladspa_clear waits for acknowledgement from the synthesis thread, that the Fx unit is bypassed.
-   * 'cond' is used for the communication, the mutex is required for changing the condition.
+   * Therefore ladspa_clear requests the bypass and waits until the synthesis thread
+   * acknowledges it by switching the flag to 'bypassed'.
    */
-  pthread_cond_t cond;
-  pthread_mutex_t mutex;
+  int Bypass;
 } fluid_LADSPA_FxUnit_t;
 
 /*
@@ -161,12 +210,11 @@ typedef struct {
 fluid_LADSPA_FxUnit_t* new_fluid_LADSPA_FxUnit(fluid_synth_t* synth);
 
 /* Purpose:
- * Applies the master gain (from command line option --gain or gain command).
- * Processes one block of sound data (generated from the synthesizer) through
+ * Processes 'count' samples of sound data (generated from the synthesizer) through
  * the LADSPA Fx unit.
  * Acknowledges a bypass request.
  */
-void fluid_LADSPA_run(fluid_LADSPA_FxUnit_t* Fx_unit, fluid_real_t* left_buf[], fluid_real_t* right_buf[], fluid_real_t* fx_left_buf[], fluid_real_t* fx_right_buf[]);
+void fluid_LADSPA_run(fluid_LADSPA_FxUnit_t* Fx_unit, fluid_real_t* left_buf[], fluid_real_t* right_buf[], fluid_real_t* fx_left_buf[], fluid_real_t* fx_right_buf[], int count);
 
 /* Purpose:
  * Returns the node belonging to Name or NULL, if not found
@@ -252,12 +252,20 @@ static void
 fast_render_loop(fluid_settings_t* settings, fluid_synth_t* synth, fluid_player_t* player)
 {
   fluid_file_renderer_t* renderer;
+  int frames;
 
   renderer = new_fluid_file_renderer (synth);
   if (!renderer) return;
 
   while (fluid_player_get_status(player) == FLUID_PLAYER_PLAYING) {
-    if (fluid_file_renderer_process_block(renderer) != FLUID_OK) {
+    /* render up to the next MIDI event in one go */
+    frames = fluid_player_get_frames_to_next_event(player);
+    if (frames > 0) {
+      if (fluid_file_renderer_process_frames(renderer, frames) != FLUID_OK) {
+        break;
+      }
+    }
+    else if (fluid_file_renderer_process_block(renderer) != FLUID_OK) {
       break;
     }
   }
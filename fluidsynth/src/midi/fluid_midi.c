@@ -26,13 +26,31 @@
 
 static int fluid_midi_event_length(unsigned char event);
 
-/* Read the entire contents of a file into memory, allocating enough memory
- * for the file, and returning the length and the buffer.
- * Note: This rewinds the file to the start before reading.
- * Returns NULL if there was an error reading or allocating memory.
- */
-static char* fluid_file_read_full(fluid_file fp, size_t* length);
-#define READ_FULL_INITIAL_BUFLEN 1024
+/* Size of the read-ahead buffer used when streaming a MIDI file from disk */
+#define FLUID_MIDI_FILE_READAHEAD 65536
+
+/* Most events reserved up front for a track, the track length is read from
+ * the file and can't be trusted. Longer tracks grow while they are read. */
+#define FLUID_MIDI_TRACK_RESERVE_MAX 65536
+
+/* Tracks of a MIDI file shared by the threads parsing them */
+typedef struct {
+    fluid_midi_file *mf;        /* File being loaded */
+    int ntracks;                /* Number of tracks */
+    long *offsets;              /* Position of each track chunk */
+    long *ends;                 /* End of each track chunk */
+    fluid_track_t **tracks;     /* Parsed tracks */
+    int next;                   /* Next track to parse (atomic) */
+    int failed;                 /* TRUE if parsing a track failed (atomic) */
+    int fallback;               /* TRUE to parse the tracks sequentially instead (atomic) */
+} fluid_midi_track_loader_t;
+
+static int fluid_midi_file_parse_track(fluid_midi_file *mf, int num,
+                                       fluid_track_t **ptrack);
+static int fluid_midi_file_read_tracks(fluid_midi_file *mf, fluid_player_t *player);
+static int fluid_midi_file_load_tracks_parallel(fluid_midi_file *mf,
+                                                fluid_player_t *player,
+                                                int nthreads);
 
 
 /***************************************************************
@@ -75,39 +93,68 @@ new_fluid_midi_file(const char* buffer, size_t length)
     return mf;
 }
 
-static char*
-fluid_file_read_full(fluid_file fp, size_t* length)
+/**
+ * Return a new MIDI file handle for parsing a MIDI file while reading it.
+ * @internal
+ * @param fp File to read, from its current position (borrowed). Only a
+ *  bounded read-ahead buffer is kept in memory, not the whole file.
+ *  The caller must not close fp until after the fluid_midi_file is deleted.
+ * @param filename Name of the file (borrowed), used to open more handles
+ *  on it to parse tracks in parallel. May be NULL.
+ * @return New MIDI file handle or NULL on error.
+ */
+fluid_midi_file *
+new_fluid_midi_file_stream(fluid_file fp, const char* filename)
 {
-    size_t buflen;
-    char* buffer;
-    size_t n;
-    /* Work out the length of the file in advance */
-    if (FLUID_FSEEK(fp, 0, SEEK_END) != 0)
-    {
-        FLUID_LOG(FLUID_ERR, "File load: Could not seek within file");
+    fluid_midi_file *mf;
+
+    mf = FLUID_NEW(fluid_midi_file);
+    if (mf == NULL) {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
         return NULL;
     }
-    buflen = ftell(fp);
-    if (FLUID_FSEEK(fp, 0, SEEK_SET) != 0)
-    {
-        FLUID_LOG(FLUID_ERR, "File load: Could not seek within file");
+    FLUID_MEMSET(mf, 0, sizeof(fluid_midi_file));
+
+    mf->readahead = FLUID_MALLOC(FLUID_MIDI_FILE_READAHEAD);
+    if (mf->readahead == NULL) {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        FLUID_FREE(mf);
         return NULL;
     }
-    FLUID_LOG(FLUID_DBG, "File load: Allocating %d bytes", buflen);
-    buffer = FLUID_MALLOC(buflen);
-    if (buffer == NULL) {
-        FLUID_LOG(FLUID_PANIC, "Out of memory");
+
+    mf->c = -1;
+    mf->running_status = -1;
+
+    mf->fp = fp;
+    mf->filename = filename;
+    mf->buffer = mf->readahead;
+    mf->buf_len = 0;
+    mf->buf_pos = 0;
+    mf->eof = FALSE;
+
+    if (fluid_midi_file_read_mthd(mf) != FLUID_OK) {
+        delete_fluid_midi_file(mf);
         return NULL;
     }
-    n = FLUID_FREAD(buffer, 1, buflen, fp);
-    if (n != buflen) {
-        FLUID_LOG(FLUID_ERR, "Only read %d bytes; expected %d", n,
-                  buflen);
-        FLUID_FREE(buffer);
-        return NULL;
-    };
-    *length = n;
-    return buffer;
+    return mf;
+}
+
+/*
+ * fluid_midi_file_fill
+ *
+ * Refill the read-ahead buffer of a streamed file once it is used up.
+ * Returns the number of bytes available, 0 at the end of the file or
+ * when parsing a buffer.
+ */
+static int
+fluid_midi_file_fill(fluid_midi_file *mf)
+{
+    if (mf->fp == NULL) {
+        return 0;
+    }
+    mf->buf_len = (int) FLUID_FREAD(mf->readahead, 1, FLUID_MIDI_FILE_READAHEAD, mf->fp);
+    mf->buf_pos = 0;
+    return mf->buf_len;
 }
 
 /**
@@ -121,10 +168,103 @@ delete_fluid_midi_file (fluid_midi_file *mf)
     if (mf == NULL) {
         return;
     }
+    if (mf->readahead != NULL) {
+        FLUID_FREE(mf->readahead);
+    }
+    if (mf->own_fp) {
+        FLUID_FCLOSE(mf->fp);
+    }
     FLUID_FREE(mf);
     return;
 }
 
+/*
+ * fluid_midi_file_tell
+ *
+ * Position of the next byte to read, from the start of the file.
+ */
+static long
+fluid_midi_file_tell(fluid_midi_file *mf)
+{
+    if (mf->fp == NULL) {
+        return mf->buf_pos;
+    }
+    return ftell(mf->fp) - mf->buf_len + mf->buf_pos;
+}
+
+/*
+ * fluid_midi_file_seek
+ *
+ * Move to the given position from the start of the file, dropping any
+ * parsing state.
+ */
+static int
+fluid_midi_file_seek(fluid_midi_file *mf, long pos)
+{
+    if (mf->fp == NULL) {
+        mf->buf_pos = pos;
+    } else {
+        if (FLUID_FSEEK(mf->fp, pos, SEEK_SET) != 0) {
+            FLUID_LOG(FLUID_ERR, "Failed to seek position in file");
+            return FLUID_FAILED;
+        }
+        mf->buf_len = 0;
+        mf->buf_pos = 0;
+    }
+    mf->eof = FALSE;
+    mf->c = -1;
+    mf->running_status = -1;
+    return FLUID_OK;
+}
+
+/*
+ * fluid_midi_file_open_at
+ *
+ * Return a new handle on the same MIDI file, positioned at pos, to parse
+ * a track independently of mf.
+ */
+static fluid_midi_file *
+fluid_midi_file_open_at(fluid_midi_file *mf, long pos)
+{
+    fluid_midi_file *sub;
+    fluid_file fp;
+
+    if (mf->fp == NULL) {
+        sub = FLUID_NEW(fluid_midi_file);
+        if (sub == NULL) {
+            FLUID_LOG(FLUID_ERR, "Out of memory");
+            return NULL;
+        }
+        FLUID_MEMCPY(sub, mf, sizeof(fluid_midi_file));
+    } else {
+        fp = FLUID_FOPEN(mf->filename, "rb");
+        if (fp == NULL) {
+            FLUID_LOG(FLUID_ERR, "Couldn't open the MIDI file");
+            return NULL;
+        }
+        sub = FLUID_NEW(fluid_midi_file);
+        if (sub != NULL) {
+            FLUID_MEMCPY(sub, mf, sizeof(fluid_midi_file));
+            sub->readahead = FLUID_MALLOC(FLUID_MIDI_FILE_READAHEAD);
+        }
+        if (sub == NULL || sub->readahead == NULL) {
+            FLUID_LOG(FLUID_ERR, "Out of memory");
+            FLUID_FREE(sub);
+            FLUID_FCLOSE(fp);
+            return NULL;
+        }
+        sub->fp = fp;
+        sub->own_fp = TRUE;
+        sub->buffer = sub->readahead;
+    }
+
+    if (fluid_midi_file_seek(sub, pos) != FLUID_OK) {
+        delete_fluid_midi_file(sub);
+        return NULL;
+    }
+    return sub;
+}
+
 /*
  * Gets the next byte in a MIDI file, taking into account previous running status.
  *
@@ -138,7 +278,7 @@ fluid_midi_file_getc (fluid_midi_file *mf)
         c = mf->c;
         mf->c = -1;
     } else {
-        if (mf->buf_pos >= mf->buf_len) {
+        if (mf->buf_pos >= mf->buf_len && fluid_midi_file_fill(mf) <= 0) {
             mf->eof = TRUE;
             return FLUID_FAILED;
         }
@@ -165,19 +305,25 @@ fluid_midi_file_push(fluid_midi_file *mf, int c)
 int
 fluid_midi_file_read(fluid_midi_file *mf, void *buf, int len)
 {
-    int num = len < mf->buf_len - mf->buf_pos
-        ? len : mf->buf_len - mf->buf_pos;
-    if (num != len) {
-        mf->eof = TRUE;
-    }
-    if (num < 0) {
-        num = 0;
-    }
+    int num = 0;
+    int n;
+
     /* Note: Read bytes, even if there aren't enough, but only increment
      * trackpos if successful (emulates old behaviour of fluid_midi_file_read)
      */
-    FLUID_MEMCPY(buf, mf->buffer+mf->buf_pos, num);
-    mf->buf_pos += num;
+    while (num < len) {
+        if (mf->buf_pos >= mf->buf_len && fluid_midi_file_fill(mf) <= 0) {
+            break;
+        }
+        n = len - num < mf->buf_len - mf->buf_pos
+            ? len - num : mf->buf_len - mf->buf_pos;
+        FLUID_MEMCPY((char *) buf + num, mf->buffer + mf->buf_pos, n);
+        mf->buf_pos += n;
+        num += n;
+    }
+    if (num != len) {
+        mf->eof = TRUE;
+    }
     if (num == len)
         mf->trackpos += num;
 #if DEBUG
@@ -200,6 +346,15 @@ fluid_midi_file_skip (fluid_midi_file *mf, int skip)
         FLUID_LOG(FLUID_ERR, "Failed to seek position in file");
         return FLUID_FAILED;
     }
+    /* Streamed file: seek past the read-ahead buffer in the file itself */
+    if (mf->fp != NULL && new_pos > mf->buf_len) {
+        if (FLUID_FSEEK(mf->fp, new_pos - mf->buf_len, SEEK_CUR) != 0) {
+            FLUID_LOG(FLUID_ERR, "Failed to seek position in file");
+            return FLUID_FAILED;
+        }
+        mf->buf_len = 0;
+        new_pos = 0;
+    }
     /* Clear the EOF flag, even if moved past the end of the file (this is
      * consistent with the behaviour of fseek). */
     mf->eof = FALSE;
@@ -227,28 +382,27 @@ int fluid_midi_file_eof(fluid_midi_file* mf)
 int
 fluid_midi_file_read_mthd(fluid_midi_file *mf)
 {
-    char mthd[15];
+    unsigned char mthd[15];
     if (fluid_midi_file_read(mf, mthd, 14) != FLUID_OK) {
         return FLUID_FAILED;
     }
-    if ((FLUID_STRNCMP(mthd, "MThd", 4) != 0) || (mthd[7] != 6)
+    if ((FLUID_STRNCMP((char *) mthd, "MThd", 4) != 0) || (mthd[7] != 6)
             || (mthd[9] > 2)) {
         FLUID_LOG(FLUID_ERR,
                 "Doesn't look like a MIDI file: invalid MThd header");
         return FLUID_FAILED;
     }
     mf->type = mthd[9];
-    mf->ntracks = (unsigned) mthd[11];
-    mf->ntracks += (unsigned int) (mthd[10]) << 16;
-    if ((mthd[12]) < 0) {
+    mf->ntracks = (mthd[10] << 8) | mthd[11];
+    if (mthd[12] & 0x80) {
         mf->uses_smpte = 1;
-        mf->smpte_fps = -mthd[12];
+        mf->smpte_fps = -(signed char) mthd[12];
         mf->smpte_res = (unsigned) mthd[13];
         FLUID_LOG(FLUID_ERR, "File uses SMPTE timing -- Not implemented yet");
         return FLUID_FAILED;
     } else {
         mf->uses_smpte = 0;
-        mf->division = (mthd[12] << 8) | (mthd[13] & 0xff);
+        mf->division = (mthd[12] << 8) | mthd[13];
         FLUID_LOG(FLUID_DBG, "Division=%d", mf->division);
     }
     return FLUID_OK;
@@ -259,8 +413,24 @@ fluid_midi_file_read_mthd(fluid_midi_file *mf)
  */
 int
 fluid_midi_file_load_tracks(fluid_midi_file *mf, fluid_player_t *player)
+{
+    if (player->load_threads > 1 && mf->ntracks > 1
+        && (mf->fp == NULL || mf->filename != NULL)) {
+        return fluid_midi_file_load_tracks_parallel(mf, player, player->load_threads);
+    }
+    return fluid_midi_file_read_tracks(mf, player);
+}
+
+/*
+ * fluid_midi_file_read_tracks
+ *
+ * Parse the tracks one after the other.
+ */
+static int
+fluid_midi_file_read_tracks(fluid_midi_file *mf, fluid_player_t *player)
 {
     int i;
+
     for (i = 0; i < mf->ntracks; i++) {
         if (fluid_midi_file_read_track(mf, player, i) != FLUID_OK) {
             return FLUID_FAILED;
@@ -269,6 +439,157 @@ fluid_midi_file_load_tracks(fluid_midi_file *mf, fluid_player_t *player)
     return FLUID_OK;
 }
 
+/*
+ * fluid_midi_file_load_worker
+ *
+ * Parse the tracks of a fluid_midi_track_loader_t, taking the next
+ * unparsed one until none are left.
+ */
+static void
+fluid_midi_file_load_worker(void *data)
+{
+    fluid_midi_track_loader_t *loader = (fluid_midi_track_loader_t *) data;
+    fluid_midi_file *sub;
+    int i;
+
+    while (!fluid_atomic_int_get(&loader->fallback)) {
+        i = fluid_atomic_int_exchange_and_add(&loader->next, 1);
+        if (i >= loader->ntracks) {
+            break;
+        }
+
+        sub = fluid_midi_file_open_at(loader->mf, loader->offsets[i]);
+        if (sub == NULL) {
+            fluid_atomic_int_set(&loader->fallback, TRUE);
+            break;
+        }
+        if (fluid_midi_file_parse_track(sub, i, &loader->tracks[i]) != FLUID_OK) {
+            fluid_atomic_int_set(&loader->failed, TRUE);
+        }
+        /* a track that does not end where its chunk does (overrun) would be
+         * followed by different data when parsing sequentially */
+        else if (fluid_midi_file_tell(sub) != loader->ends[i]) {
+            fluid_atomic_int_set(&loader->fallback, TRUE);
+        }
+        delete_fluid_midi_file(sub);
+    }
+}
+
+/*
+ * fluid_midi_file_load_tracks_parallel
+ *
+ * Locate the track chunks, then parse them on nthreads threads (including
+ * the calling one) and add them in file order. Falls back to sequential
+ * parsing if the chunks can't be located, or if the result could differ
+ * from it (a track overrunning its chunk).
+ */
+static int
+fluid_midi_file_load_tracks_parallel(fluid_midi_file *mf, fluid_player_t *player,
+                                     int nthreads)
+{
+    fluid_midi_track_loader_t loader;
+    fluid_thread_t **threads = NULL;
+    unsigned char header[8], id[5];
+    long start, pos;
+    int i, len, base, fallback = TRUE, result = FLUID_FAILED;
+
+    start = fluid_midi_file_tell(mf);
+    base = player->ntracks;
+
+    FLUID_MEMSET(&loader, 0, sizeof(loader));
+    loader.mf = mf;
+    loader.ntracks = mf->ntracks;
+    loader.offsets = FLUID_ARRAY(long, mf->ntracks);
+    loader.ends = FLUID_ARRAY(long, mf->ntracks);
+    loader.tracks = FLUID_ARRAY(fluid_track_t *, mf->ntracks);
+    if (nthreads > mf->ntracks) {
+        nthreads = mf->ntracks;
+    }
+    threads = FLUID_ARRAY(fluid_thread_t *, nthreads);
+    if (loader.offsets == NULL || loader.ends == NULL || loader.tracks == NULL
+        || threads == NULL) {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        goto error_recovery;
+    }
+    FLUID_MEMSET(loader.tracks, 0, mf->ntracks * sizeof(fluid_track_t *));
+
+    /* find the chunks, skipping the ones that aren't tracks */
+    for (i = 0; i < mf->ntracks; ) {
+        pos = fluid_midi_file_tell(mf);
+        if (fluid_midi_file_read(mf, header, 8) != FLUID_OK) {
+            goto error_recovery;
+        }
+        FLUID_MEMCPY(id, header, 4);
+        id[4] = '\0';
+        len = (int) fluid_getlength(header + 4);
+        if (!fluid_isasciistring((char *) id) || len < 0
+            || fluid_midi_file_skip(mf, len) != FLUID_OK) {
+            goto error_recovery;
+        }
+        if (FLUID_STRNCMP((char *) header, "MTrk", 4) == 0) {
+            loader.offsets[i] = pos;
+            loader.ends[i] = pos + 8 + len;
+            i++;
+        }
+    }
+
+    for (i = 0; i < nthreads - 1; i++) {
+        threads[i] = new_fluid_thread("midiload", fluid_midi_file_load_worker,
+                                      &loader, 0, FALSE);
+        if (threads[i] == NULL) {
+            break;
+        }
+    }
+    fluid_midi_file_load_worker(&loader);
+    while (--i >= 0) {
+        fluid_thread_join(threads[i]);
+        delete_fluid_thread(threads[i]);
+    }
+
+    if (!loader.fallback && loader.failed) {
+        /* the error has been reported by the worker */
+        fallback = FALSE;
+    }
+    else if (!loader.fallback) {
+        for (i = 0; i < loader.ntracks; i++) {
+            if (fluid_player_add_track(player, loader.tracks[i]) != FLUID_OK) {
+                break;
+            }
+            loader.tracks[i] = NULL;
+        }
+        if (i == loader.ntracks) {
+            fallback = FALSE;
+            result = FLUID_OK;
+        } else {
+            while (player->ntracks > base) {
+                delete_fluid_track(player->track[--player->ntracks]);
+                player->track[player->ntracks] = NULL;
+            }
+        }
+    }
+
+error_recovery:
+    if (loader.tracks != NULL) {
+        for (i = 0; i < loader.ntracks; i++) {
+            if (loader.tracks[i] != NULL) {
+                delete_fluid_track(loader.tracks[i]);
+            }
+        }
+    }
+    FLUID_FREE(loader.offsets);
+    FLUID_FREE(loader.ends);
+    FLUID_FREE(loader.tracks);
+    FLUID_FREE(threads);
+
+    if (fallback) {
+        if (fluid_midi_file_seek(mf, start) != FLUID_OK) {
+            return FLUID_FAILED;
+        }
+        return fluid_midi_file_read_tracks(mf, player);
+    }
+    return result;
+}
+
 /*
  * fluid_isasciistring
  */
@@ -333,6 +654,26 @@ int
 fluid_midi_file_read_track(fluid_midi_file *mf, fluid_player_t *player, int num)
 {
     fluid_track_t *track;
+
+    if (fluid_midi_file_parse_track(mf, num, &track) != FLUID_OK) {
+        return FLUID_FAILED;
+    }
+    if (fluid_player_add_track(player, track) != FLUID_OK) {
+        delete_fluid_track(track);
+        return FLUID_FAILED;
+    }
+    return FLUID_OK;
+}
+
+/*
+ * fluid_midi_file_parse_track
+ *
+ * Parse the next track chunk of the file, skipping other chunks.
+ */
+static int
+fluid_midi_file_parse_track(fluid_midi_file *mf, int num, fluid_track_t **ptrack)
+{
+    fluid_track_t *track = NULL;
     unsigned char id[5], length[5];
     int found_track = 0;
     int skip;
@@ -354,6 +695,9 @@ fluid_midi_file_read_track(fluid_midi_file *mf, fluid_player_t *player, int num)
 
             found_track = 1;
 
+            /* running status does not carry over from the previous track */
+            mf->running_status = -1;
+
             if (fluid_midi_file_read_tracklen(mf) != FLUID_OK) {
                 return FLUID_FAILED;
             }
@@ -364,6 +708,14 @@ fluid_midi_file_read_track(fluid_midi_file *mf, fluid_player_t *player, int num)
                 return FLUID_FAILED;
             }
 
+            /* Events take at least 2 bytes (delta-time and data byte with
+             * running status), most take 3 or 4: size for the latter */
+            if (fluid_track_reserve(track, (mf->tracklen / 3 < FLUID_MIDI_TRACK_RESERVE_MAX)
+                                    ? mf->tracklen / 3 + 1 : FLUID_MIDI_TRACK_RESERVE_MAX) != FLUID_OK) {
+                delete_fluid_track(track);
+                return FLUID_FAILED;
+            }
+
             while (!fluid_midi_file_eot(mf)) {
                 if (fluid_midi_file_read_event(mf, track) != FLUID_OK) {
                     delete_fluid_track(track);
@@ -371,12 +723,12 @@ fluid_midi_file_read_track(fluid_midi_file *mf, fluid_player_t *player, int num)
                 }
             }
 
+            fluid_track_compact(track);
+
             /* Skip remaining track data, if any */
             if (mf->trackpos < mf->tracklen)
                 fluid_midi_file_skip(mf, mf->tracklen - mf->trackpos);
 
-            fluid_player_add_track(player, track);
-
         } else {
             found_track = 0;
             if (fluid_midi_file_read(mf, length, 4) != FLUID_OK) {
@@ -387,12 +739,18 @@ fluid_midi_file_read_track(fluid_midi_file *mf, fluid_player_t *player, int num)
             if (fluid_midi_file_skip(mf, skip) != FLUID_OK) {
                 return FLUID_FAILED;
             }
+            /* header of the next chunk */
+            if (fluid_midi_file_read(mf, id, 4) != FLUID_OK) {
+                return FLUID_FAILED;
+            }
         }
     }
     if (fluid_midi_file_eof(mf)) {
         FLUID_LOG(FLUID_ERR, "Unexpected end of file");
+        delete_fluid_track(track);
         return FLUID_FAILED;
     }
+    *ptrack = track;
     return FLUID_OK;
 }
 
@@ -439,7 +797,6 @@ fluid_midi_file_read_event(fluid_midi_file *mf, fluid_track_t *track)
     unsigned char *dyn_buf = NULL;
     unsigned char static_buf[256];
     int nominator, denominator, clocks, notes;
-    fluid_midi_event_t *evt;
     int channel = 0;
     int param1 = 0;
     int param2 = 0;
@@ -479,37 +836,24 @@ fluid_midi_file_read_event(fluid_midi_file *mf, fluid_track_t *track)
         }
 
         if (mf->varlen) {
-            FLUID_LOG(FLUID_DBG, "%s: %d: alloc metadata, len = %d", __FILE__,
-                    __LINE__, mf->varlen);
-            metadata = FLUID_MALLOC(mf->varlen + 1);
-
+            /* read the data of the message straight into the track's arena */
+            metadata = fluid_track_sysex_space(track, mf->varlen);
             if (metadata == NULL) {
-                FLUID_LOG(FLUID_PANIC, "Out of memory");
                 return FLUID_FAILED;
             }
 
-            /* read the data of the message */
             if (fluid_midi_file_read(mf, metadata, mf->varlen) != FLUID_OK) {
-                FLUID_FREE (metadata);
                 return FLUID_FAILED;
             }
 
-            evt = new_fluid_midi_event();
-            if (evt == NULL) {
-                FLUID_LOG(FLUID_ERR, "Out of memory");
-                FLUID_FREE (metadata);
-                return FLUID_FAILED;
-            }
-
-            evt->dtime = mf->dtime;
             size = mf->varlen;
 
             if (metadata[mf->varlen - 1] == MIDI_EOX)
                 size--;
 
-            /* Add SYSEX event and indicate that its dynamically allocated and should be freed with event */
-            fluid_midi_event_set_sysex(evt, metadata, size, TRUE);
-            fluid_track_add_event(track, evt);
+            if (fluid_track_add_sysex(track, mf->dtime, size, mf->varlen) != FLUID_OK) {
+                return FLUID_FAILED;
+            }
             mf->dtime = 0;
         }
 
@@ -586,15 +930,10 @@ fluid_midi_file_read_event(fluid_midi_file *mf, fluid_track_t *track)
                     break;
                 }
                 mf->eot = 1;
-                evt = new_fluid_midi_event();
-                if (evt == NULL) {
-                    FLUID_LOG(FLUID_ERR, "Out of memory");
+                if (fluid_track_add_event(track, mf->dtime, MIDI_EOT, 0, 0, 0) != FLUID_OK) {
                     result = FLUID_FAILED;
                     break;
                 }
-                evt->dtime = mf->dtime;
-                evt->type = MIDI_EOT;
-                fluid_track_add_event(track, evt);
                 mf->dtime = 0;
                 break;
 
@@ -606,18 +945,11 @@ fluid_midi_file_read_event(fluid_midi_file *mf, fluid_track_t *track)
                     break;
                 }
                 tempo = (metadata[0] << 16) + (metadata[1] << 8) + metadata[2];
-                evt = new_fluid_midi_event();
-                if (evt == NULL) {
-                    FLUID_LOG(FLUID_ERR, "Out of memory");
+                if (fluid_track_add_event(track, mf->dtime, MIDI_SET_TEMPO, 0,
+                                          tempo, 0) != FLUID_OK) {
                     result = FLUID_FAILED;
                     break;
                 }
-                evt->dtime = mf->dtime;
-                evt->type = MIDI_SET_TEMPO;
-                evt->channel = 0;
-                evt->param1 = tempo;
-                evt->param2 = 0;
-                fluid_track_add_event(track, evt);
                 mf->dtime = 0;
                 break;
 
@@ -736,17 +1068,10 @@ fluid_midi_file_read_event(fluid_midi_file *mf, fluid_track_t *track)
                 FLUID_LOG(FLUID_ERR, "Unrecognized MIDI event");
                 return FLUID_FAILED;
         }
-        evt = new_fluid_midi_event();
-        if (evt == NULL) {
-            FLUID_LOG(FLUID_ERR, "Out of memory");
+        if (fluid_track_add_event(track, mf->dtime, type, channel,
+                                  param1, param2) != FLUID_OK) {
             return FLUID_FAILED;
         }
-        evt->dtime = mf->dtime;
-        evt->type = type;
-        evt->channel = channel;
-        evt->param1 = param1;
-        evt->param2 = param2;
-        fluid_track_add_event(track, evt);
         mf->dtime = 0;
     }
     return FLUID_OK;
@@ -1044,9 +1369,13 @@ new_fluid_track(int num)
     }
     track->name = NULL;
     track->num = num;
-    track->first = NULL;
-    track->cur = NULL;
-    track->last = NULL;
+    track->events = NULL;
+    track->nevents = 0;
+    track->size = 0;
+    track->sysex = NULL;
+    track->sysex_len = 0;
+    track->sysex_size = 0;
+    track->cur = 0;
     track->ticks = 0;
     return track;
 }
@@ -1060,8 +1389,11 @@ delete_fluid_track(fluid_track_t *track)
     if (track->name != NULL) {
         FLUID_FREE(track->name);
     }
-    if (track->first != NULL) {
-        delete_fluid_midi_event(track->first);
+    if (track->events != NULL) {
+        FLUID_FREE(track->events);
+    }
+    if (track->sysex != NULL) {
+        FLUID_FREE(track->sysex);
     }
     FLUID_FREE(track);
     return FLUID_OK;
@@ -1107,10 +1439,9 @@ int
 fluid_track_get_duration(fluid_track_t *track)
 {
     int time = 0;
-    fluid_midi_event_t *evt = track->first;
-    while (evt != NULL) {
-        time += evt->dtime;
-        evt = evt->next;
+    int i;
+    for (i = 0; i < track->nevents; i++) {
+        time += track->events[i].dtime;
     }
     return time;
 }
@@ -1121,132 +1452,184 @@ fluid_track_get_duration(fluid_track_t *track)
 int
 fluid_track_count_events(fluid_track_t *track, int *on, int *off)
 {
-    fluid_midi_event_t *evt = track->first;
-    while (evt != NULL) {
-        if (evt->type == NOTE_ON) {
+    int i;
+    for (i = 0; i < track->nevents; i++) {
+        if (track->events[i].type == NOTE_ON) {
             (*on)++;
-        } else if (evt->type == NOTE_OFF) {
+        } else if (track->events[i].type == NOTE_OFF) {
             (*off)++;
         }
-        evt = evt->next;
     }
     return FLUID_OK;
 }
 
 /*
- * fluid_track_add_event
+ * fluid_track_reserve
+ *
+ * Make room for at least nevents events in the track.
  */
 int
-fluid_track_add_event(fluid_track_t *track, fluid_midi_event_t *evt)
+fluid_track_reserve(fluid_track_t *track, int nevents)
 {
-    evt->next = NULL;
-    if (track->first == NULL) {
-        track->first = evt;
-        track->cur = evt;
-        track->last = evt;
-    } else {
-        track->last->next = evt;
-        track->last = evt;
+    fluid_track_event_t *events;
+
+    if (nevents <= track->size) {
+        return FLUID_OK;
     }
+    events = FLUID_REALLOC(track->events, nevents * sizeof(fluid_track_event_t));
+    if (events == NULL) {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        return FLUID_FAILED;
+    }
+    track->events = events;
+    track->size = nevents;
     return FLUID_OK;
 }
 
 /*
- * fluid_track_first_event
+ * fluid_track_add_event
  */
-fluid_midi_event_t *
-fluid_track_first_event(fluid_track_t *track)
+int
+fluid_track_add_event(fluid_track_t *track, unsigned int dtime, int type,
+                      int channel, unsigned int param1, unsigned int param2)
 {
-    track->cur = track->first;
-    return track->cur;
+    fluid_track_event_t *evt;
+
+    if (track->nevents == track->size
+        && fluid_track_reserve(track, track->size ? 2 * track->size : 64) != FLUID_OK) {
+        return FLUID_FAILED;
+    }
+    evt = &track->events[track->nevents++];
+    evt->dtime = dtime;
+    evt->type = type;
+    evt->channel = channel;
+    evt->param1 = param1;
+    evt->param2 = param2;
+    return FLUID_OK;
 }
 
 /*
- * fluid_track_next_event
+ * fluid_track_sysex_space
+ *
+ * Return room for len bytes of SYSEX data at the end of the arena,
+ * to be claimed with fluid_track_add_sysex().
  */
-fluid_midi_event_t *
-fluid_track_next_event(fluid_track_t *track)
+unsigned char *
+fluid_track_sysex_space(fluid_track_t *track, int len)
 {
-    if (track->cur != NULL) {
-        track->cur = track->cur->next;
+    unsigned char *sysex;
+    int size;
+
+    if (track->sysex_len + len > track->sysex_size) {
+        size = track->sysex_size ? 2 * track->sysex_size : 256;
+        while (size < track->sysex_len + len) {
+            size *= 2;
+        }
+        sysex = FLUID_REALLOC(track->sysex, size);
+        if (sysex == NULL) {
+            FLUID_LOG(FLUID_ERR, "Out of memory");
+            return NULL;
+        }
+        track->sysex = sysex;
+        track->sysex_size = size;
     }
-    return track->cur;
+    return track->sysex + track->sysex_len;
 }
 
 /*
- * fluid_track_reset
+ * fluid_track_add_sysex
+ *
+ * Add a SYSEX event with the first size bytes of the data written
+ * to fluid_track_sysex_space(), claiming len bytes of the arena.
  */
 int
-fluid_track_reset(fluid_track_t *track)
+fluid_track_add_sysex(fluid_track_t *track, unsigned int dtime, int size, int len)
 {
-    track->ticks = 0;
-    track->cur = track->first;
+    if (fluid_track_add_event(track, dtime, MIDI_SYSEX, 0,
+                              size, track->sysex_len) != FLUID_OK) {
+        return FLUID_FAILED;
+    }
+    track->sysex_len += len;
     return FLUID_OK;
 }
 
 /*
- * fluid_track_send_events
+ * fluid_track_compact
+ *
+ * Release the unused room of a track once it is completely loaded.
  */
-int
-fluid_track_send_events(fluid_track_t *track,
-			fluid_synth_t *synth,
-			fluid_player_t *player,
-			unsigned int ticks)
+void
+fluid_track_compact(fluid_track_t *track)
 {
-    int status = FLUID_OK;
-    fluid_midi_event_t *event;
-
-    while (1) {
-
-        event = track->cur;
-        if (event == NULL) {
-            return status;
-        }
+    void *p;
 
-        /* 		printf("track=%02d\tticks=%05u\ttrack=%05u\tdtime=%05u\tnext=%05u\n", */
-        /* 		       track->num, */
-        /* 		       ticks, */
-        /* 		       track->ticks, */
-        /* 		       event->dtime, */
-        /* 		       track->ticks + event->dtime); */
-
-        if (track->ticks + event->dtime > ticks) {
-            return status;
-        }
-
-        track->ticks += event->dtime;
-
-        if (!player || event->type == MIDI_EOT) {
+    if (track->nevents > 0 && track->nevents < track->size) {
+        p = FLUID_REALLOC(track->events, track->nevents * sizeof(fluid_track_event_t));
+        if (p != NULL) {
+            track->events = p;
+            track->size = track->nevents;
         }
-        else if (event->type == MIDI_SET_TEMPO) {
-            fluid_player_set_midi_tempo(player, event->param1);
-        }
-        else {
-            if (player->playback_callback)
-                player->playback_callback(player->playback_userdata, event);
+    }
+    if (track->sysex_len > 0 && track->sysex_len < track->sysex_size) {
+        p = FLUID_REALLOC(track->sysex, track->sysex_len);
+        if (p != NULL) {
+            track->sysex = p;
+            track->sysex_size = track->sysex_len;
         }
-
-        fluid_track_next_event(track);
-
     }
-    return status;
 }
 
-/******************************************************
+/*
+ * fluid_track_get_event
  *
- *     fluid_player
- */
-
-/**
- * Create a new MIDI player.
- * @param synth Fluid synthesizer instance to create player for
- * @return New MIDI player instance or NULL on error (out of memory)
+ * Unpack event i of the track. SYSEX data is not copied, it remains
+ * owned by the track.
  */
-fluid_player_t *
-new_fluid_player(fluid_synth_t *synth)
+void
+fluid_track_get_event(fluid_track_t *track, int i, fluid_midi_event_t *evt)
 {
-    int i;
-    fluid_player_t *player;
+    fluid_track_event_t *packed = &track->events[i];
+
+    evt->next = NULL;
+    evt->dtime = packed->dtime;
+    evt->type = packed->type;
+    evt->channel = packed->channel;
+    evt->param1 = packed->param1;
+    if (packed->type == MIDI_SYSEX) {
+        evt->paramptr = track->sysex + packed->param2;
+        evt->param2 = FALSE;
+    } else {
+        evt->paramptr = NULL;
+        evt->param2 = packed->param2;
+    }
+}
+
+/*
+ * fluid_track_reset
+ */
+int
+fluid_track_reset(fluid_track_t *track)
+{
+    track->ticks = 0;
+    track->cur = 0;
+    return FLUID_OK;
+}
+
+/******************************************************
+ *
+ *     fluid_player
+ */
+
+/**
+ * Create a new MIDI player.
+ * @param synth Fluid synthesizer instance to create player for
+ * @return New MIDI player instance or NULL on error (out of memory)
+ */
+fluid_player_t *
+new_fluid_player(fluid_synth_t *synth)
+{
+    int i;
+    fluid_player_t *player;
     player = FLUID_NEW(fluid_player_t);
     if (player == NULL) {
         FLUID_LOG(FLUID_ERR, "Out of memory");
@@ -1255,9 +1638,8 @@ new_fluid_player(fluid_synth_t *synth)
     player->status = FLUID_PLAYER_READY;
     player->loop = 1;
     player->ntracks = 0;
-    for (i = 0; i < MAX_NUMBER_OF_TRACKS; i++) {
-        player->track[i] = NULL;
-    }
+    player->track_size = 0;
+    player->track = NULL;
     player->synth = synth;
     player->system_timer = NULL;
     player->sample_timer = NULL;
@@ -1269,6 +1651,16 @@ new_fluid_player(fluid_synth_t *synth)
     player->deltatime = 4.0;
     player->cur_msec = 0;
     player->cur_ticks = 0;
+    player->events = NULL;
+    player->nevents = 0;
+    player->cur_event = 0;
+    player->tempo_map = NULL;
+    player->ntempos = 0;
+    player->snapshots = NULL;
+    player->nsnapshots = 0;
+    player->seek_msec = -1;
+    player->next_event_msec = 0;
+    player->timer_start_ticks = 0;
     fluid_player_set_playback_callback(player, fluid_synth_handle_midi_event, synth);
 
     player->use_system_timer = fluid_settings_str_equal(synth->settings,
@@ -1277,6 +1669,9 @@ new_fluid_player(fluid_synth_t *synth)
     fluid_settings_getint(synth->settings, "player.reset-synth", &i);
     player->reset_synth_between_songs = i;
 
+    fluid_settings_getint(synth->settings, "player.load-threads", &i);
+    player->load_threads = i;
+
     return player;
 }
 
@@ -1307,6 +1702,9 @@ delete_fluid_player(fluid_player_t *player)
         player->playlist = q;
     }
 
+    if (player->track != NULL) {
+        FLUID_FREE(player->track);
+    }
     FLUID_FREE(player);
     return FLUID_OK;
 }
@@ -1327,15 +1725,22 @@ fluid_player_settings(fluid_settings_t *settings)
     /* Selects whether the player should reset the synth between songs, or not. */
     fluid_settings_register_int(settings, "player.reset-synth", 1, 0, 1,
             FLUID_HINT_TOGGLED, NULL, NULL);
+
+    /* Number of threads parsing the tracks of a MIDI file when it is loaded. */
+    fluid_settings_register_int(settings, "player.load-threads", 1, 1, 256,
+            0, NULL, NULL);
 }
 
 
+static void fluid_player_free_events(fluid_player_t *player);
+static int fluid_player_build_events(fluid_player_t *player);
+
 int
 fluid_player_reset(fluid_player_t *player)
 {
     int i;
 
-    for (i = 0; i < MAX_NUMBER_OF_TRACKS; i++) {
+    for (i = 0; i < player->ntracks; i++) {
         if (player->track[i] != NULL) {
             delete_fluid_track(player->track[i]);
             player->track[i] = NULL;
@@ -1345,6 +1750,7 @@ fluid_player_reset(fluid_player_t *player)
     /*	player->status = FLUID_PLAYER_READY; */
     /*	player->loop = 1; */
     player->ntracks = 0;
+    fluid_player_free_events(player);
     player->division = 0;
     player->send_program_change = 1;
     player->miditempo = 480000;
@@ -1358,12 +1764,21 @@ fluid_player_reset(fluid_player_t *player)
 int
 fluid_player_add_track(fluid_player_t *player, fluid_track_t *track)
 {
-    if (player->ntracks < MAX_NUMBER_OF_TRACKS) {
-        player->track[player->ntracks++] = track;
-        return FLUID_OK;
-    } else {
-        return FLUID_FAILED;
+    fluid_track_t **tracks;
+    int size;
+
+    if (player->ntracks == player->track_size) {
+        size = player->track_size ? 2 * player->track_size : 16;
+        tracks = FLUID_REALLOC(player->track, size * sizeof(fluid_track_t *));
+        if (tracks == NULL) {
+            FLUID_LOG(FLUID_ERR, "Out of memory");
+            return FLUID_FAILED;
+        }
+        player->track = tracks;
+        player->track_size = size;
     }
+    player->track[player->ntracks++] = track;
+    return FLUID_OK;
 }
 
 /*
@@ -1381,7 +1796,7 @@ fluid_player_count_tracks(fluid_player_t *player)
 fluid_track_t *
 fluid_player_get_track(fluid_player_t *player, int i)
 {
-    if ((i >= 0) && (i < MAX_NUMBER_OF_TRACKS)) {
+    if ((i >= 0) && (i < player->ntracks)) {
         return player->track[i];
     } else {
         return NULL;
@@ -1472,46 +1887,34 @@ int
 fluid_player_load(fluid_player_t *player, fluid_playlist_item *item)
 {
     fluid_midi_file *midifile;
-    char* buffer;
-    size_t buffer_length;
-    int buffer_owned;
+    fluid_file fp = NULL;
+    int result;
 
     if (item->filename != NULL)
     {
-        fluid_file fp;
-        /* This file is specified by filename; load the file from disk */
+        /* This file is specified by filename; parse it while reading it
+         * from disk, so that only the parsed events are kept in memory */
         FLUID_LOG(FLUID_DBG, "%s: %d: Loading midifile %s", __FILE__, __LINE__,
                 item->filename);
-        /* Read the entire contents of the file into the buffer */
         fp = FLUID_FOPEN(item->filename, "rb");
         if (fp == NULL) {
             FLUID_LOG(FLUID_ERR, "Couldn't open the MIDI file");
             return FLUID_FAILED;
         }
-        buffer = fluid_file_read_full(fp, &buffer_length);
-        if (buffer == NULL)
-        {
-            FLUID_FCLOSE(fp);
-            return FLUID_FAILED;
-        }
-        buffer_owned = 1;
-        FLUID_FCLOSE(fp);
+        midifile = new_fluid_midi_file_stream(fp, item->filename);
     }
     else
     {
         /* This file is specified by a pre-loaded buffer; load from memory */
         FLUID_LOG(FLUID_DBG, "%s: %d: Loading midifile from memory (%p)",
                 __FILE__, __LINE__, item->buffer);
-        buffer = (char *) item->buffer;
-        buffer_length = item->buffer_len;
-        /* Do not free the buffer (it is owned by the playlist) */
-        buffer_owned = 0;
+        /* The buffer remains owned by the playlist */
+        midifile = new_fluid_midi_file((char *) item->buffer, item->buffer_len);
     }
 
-    midifile = new_fluid_midi_file(buffer, buffer_length);
     if (midifile == NULL) {
-        if (buffer_owned) {
-            FLUID_FREE(buffer);
+        if (fp != NULL) {
+            FLUID_FCLOSE(fp);
         }
         return FLUID_FAILED;
     }
@@ -1519,18 +1922,484 @@ fluid_player_load(fluid_player_t *player, fluid_playlist_item *item)
     fluid_player_set_midi_tempo(player, player->miditempo); // Update deltatime
     /*FLUID_LOG(FLUID_DBG, "quarter note division=%d\n", player->division); */
 
-    if (fluid_midi_file_load_tracks(midifile, player) != FLUID_OK) {
-        if (buffer_owned) {
-            FLUID_FREE(buffer);
+    result = fluid_midi_file_load_tracks(midifile, player);
+    delete_fluid_midi_file(midifile);
+    if (fp != NULL) {
+        FLUID_FCLOSE(fp);
+    }
+    if (result != FLUID_OK) {
+        return FLUID_FAILED;
+    }
+    return fluid_player_build_events(player);
+}
+
+/*
+ * fluid_player_free_events
+ */
+static void
+fluid_player_free_events(fluid_player_t *player)
+{
+    FLUID_FREE(player->events);
+    FLUID_FREE(player->tempo_map);
+    FLUID_FREE(player->snapshots);
+    player->events = NULL;
+    player->nevents = 0;
+    player->cur_event = 0;
+    player->tempo_map = NULL;
+    player->ntempos = 0;
+    player->snapshots = NULL;
+    player->nsnapshots = 0;
+}
+
+static void
+fluid_player_init_channel_state(fluid_player_channel_state_t *state)
+{
+    int i;
+
+    for (i = 0; i < FLUID_PLAYER_NUM_CHANNELS; i++) {
+        FLUID_MEMSET(&state[i], 0, sizeof(fluid_player_channel_state_t));
+        state[i].program = -1;
+        state[i].pitch_bend = -1;
+        state[i].pressure = -1;
+        state[i].bend_range = -1;
+        state[i].rpn_msb = 127;
+        state[i].rpn_lsb = 127;
+    }
+}
+
+/* Controllers left alone by Reset All Controllers, as in fluid_channel_init_ctrl() */
+static int
+fluid_player_cc_kept_by_reset(int num)
+{
+    return (num >= EFFECTS_DEPTH1 && num <= EFFECTS_DEPTH5)
+        || (num >= SOUND_CTRL1 && num <= SOUND_CTRL10)
+        || num == BANK_SELECT_MSB || num == BANK_SELECT_LSB
+        || num == VOLUME_MSB || num == VOLUME_LSB
+        || num == PAN_MSB || num == PAN_LSB;
+}
+
+/* Value of those controllers after a system reset */
+static int
+fluid_player_cc_default(int num)
+{
+    if ((num >= SOUND_CTRL1 && num <= SOUND_CTRL10) || num == PAN_MSB) {
+        return 64;
+    }
+    return num == VOLUME_MSB ? 100 : 0;
+}
+
+#define FLUID_PLAYER_CC_IS_SET(st, num)  ((st)->cc_set[(num) >> 3] & (1 << ((num) & 7)))
+#define FLUID_PLAYER_CC_SET(st, num)     ((st)->cc_set[(num) >> 3] |= (1 << ((num) & 7)))
+#define FLUID_PLAYER_CC_CLEAR(st, num)   ((st)->cc_set[(num) >> 3] &= ~(1 << ((num) & 7)))
+
+/*
+ * fluid_player_update_channel_state
+ *
+ * Apply an event to the channel states. Only the state that
+ * fluid_player_restore_channel_state() restores is followed.
+ */
+static void
+fluid_player_update_channel_state(fluid_player_channel_state_t *state,
+                                  fluid_track_event_t *evt)
+{
+    fluid_player_channel_state_t *st;
+    int i;
+
+    if (evt->channel >= FLUID_PLAYER_NUM_CHANNELS) {
+        return;
+    }
+    st = &state[evt->channel];
+
+    switch (evt->type) {
+
+        case PROGRAM_CHANGE:
+            st->program = evt->param1;
+            break;
+
+        case PITCH_BEND:
+            st->pitch_bend = evt->param1;
+            break;
+
+        case CHANNEL_PRESSURE:
+            st->pressure = evt->param1;
+            break;
+
+        case CONTROL_CHANGE:
+            switch (evt->param1) {
+
+                case RPN_MSB:
+                    st->rpn_msb = evt->param2;
+                    st->nrpn = FALSE;
+                    break;
+
+                case RPN_LSB:
+                    st->rpn_lsb = evt->param2;
+                    st->nrpn = FALSE;
+                    break;
+
+                case NRPN_MSB:
+                case NRPN_LSB:
+                    st->nrpn = TRUE;
+                    break;
+
+                case DATA_ENTRY_MSB:
+                    if (!st->nrpn && st->rpn_msb == 0
+                        && st->rpn_lsb == RPN_PITCH_BEND_RANGE) {
+                        st->bend_range = evt->param2;
+                    }
+                    break;
+
+                case ALL_CTRL_OFF:
+                    for (i = 0; i < ALL_SOUND_OFF; i++) {
+                        if (!fluid_player_cc_kept_by_reset(i)) {
+                            FLUID_PLAYER_CC_CLEAR(st, i);
+                        }
+                    }
+                    st->pitch_bend = -1;
+                    st->pressure = -1;
+                    st->rpn_msb = 127;
+                    st->rpn_lsb = 127;
+                    st->nrpn = FALSE;
+                    break;
+
+                default:
+                    if (evt->param1 < ALL_SOUND_OFF) {
+                        st->cc[evt->param1] = evt->param2;
+                        FLUID_PLAYER_CC_SET(st, evt->param1);
+                    }
+                    break;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void
+fluid_player_send_event(fluid_player_t *player, int type, int channel,
+                        int param1, int param2)
+{
+    fluid_midi_event_t evt;
+
+    FLUID_MEMSET(&evt, 0, sizeof(fluid_midi_event_t));
+    evt.type = type;
+    evt.channel = channel;
+    evt.param1 = param1;
+    evt.param2 = param2;
+    if (player->playback_callback)
+        player->playback_callback(player->playback_userdata, &evt);
+}
+
+/*
+ * fluid_player_restore_channel_state
+ *
+ * Silence the synth and bring its channels to the given state.
+ */
+static void
+fluid_player_restore_channel_state(fluid_player_t *player,
+                                   fluid_player_channel_state_t *state)
+{
+    fluid_player_channel_state_t *st;
+    int chan, i;
+
+    if (player->reset_synth_between_songs) {
+        fluid_synth_system_reset(player->synth);
+    }
+
+    for (chan = 0; chan < FLUID_PLAYER_NUM_CHANNELS; chan++) {
+        st = &state[chan];
+
+        if (!player->reset_synth_between_songs) {
+            /* without a reset, also bring back what the controller
+               reset leaves alone to its initial value */
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, ALL_SOUND_OFF, 0);
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, ALL_CTRL_OFF, 0);
+
+            for (i = 0; i < ALL_SOUND_OFF; i++) {
+                if (fluid_player_cc_kept_by_reset(i) && !FLUID_PLAYER_CC_IS_SET(st, i)) {
+                    st->cc[i] = fluid_player_cc_default(i);
+                    FLUID_PLAYER_CC_SET(st, i);
+                }
+            }
+            if (st->program < 0) {
+                st->program = 0;
+            }
+            if (st->bend_range < 0) {
+                st->bend_range = 2;
+            }
+        }
+
+        /* bank before program, program before the other controllers */
+        if (FLUID_PLAYER_CC_IS_SET(st, BANK_SELECT_MSB)) {
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, BANK_SELECT_MSB,
+                                    st->cc[BANK_SELECT_MSB]);
+        }
+        if (FLUID_PLAYER_CC_IS_SET(st, BANK_SELECT_LSB)) {
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, BANK_SELECT_LSB,
+                                    st->cc[BANK_SELECT_LSB]);
+        }
+        if (st->program >= 0) {
+            fluid_player_send_event(player, PROGRAM_CHANGE, chan, st->program, 0);
+        }
+
+        for (i = 0; i < ALL_SOUND_OFF; i++) {
+            if (!FLUID_PLAYER_CC_IS_SET(st, i)
+                || i == BANK_SELECT_MSB || i == BANK_SELECT_LSB
+                || i == DATA_ENTRY_MSB || i == DATA_ENTRY_LSB
+                || (i >= DATA_ENTRY_INCR && i <= RPN_MSB)) {
+                continue;
+            }
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, i, st->cc[i]);
+        }
+
+        if (st->bend_range >= 0) {
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, RPN_MSB, 0);
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, RPN_LSB,
+                                    RPN_PITCH_BEND_RANGE);
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, DATA_ENTRY_MSB,
+                                    st->bend_range);
         }
-        delete_fluid_midi_file(midifile);
+        /* leave the (N)RPN selection as it was */
+        if (st->nrpn) {
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, NRPN_MSB,
+                                    FLUID_PLAYER_CC_IS_SET(st, NRPN_MSB) ? st->cc[NRPN_MSB] : 127);
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, NRPN_LSB,
+                                    FLUID_PLAYER_CC_IS_SET(st, NRPN_LSB) ? st->cc[NRPN_LSB] : 127);
+        } else if (st->bend_range >= 0 || st->rpn_msb != 127 || st->rpn_lsb != 127) {
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, RPN_MSB, st->rpn_msb);
+            fluid_player_send_event(player, CONTROL_CHANGE, chan, RPN_LSB, st->rpn_lsb);
+        }
+
+        if (st->pitch_bend >= 0) {
+            fluid_player_send_event(player, PITCH_BEND, chan, st->pitch_bend, 0);
+        }
+        if (st->pressure >= 0) {
+            fluid_player_send_event(player, CHANNEL_PRESSURE, chan, st->pressure, 0);
+        }
+    }
+}
+
+/*
+ * fluid_player_sort_events
+ *
+ * Stable sort of the events by tick: LSD radix sort on the bytes of
+ * the tick, skipping the bytes that are the same for all events.
+ */
+static int
+fluid_player_sort_events(fluid_player_event_t *events, int n)
+{
+    fluid_player_event_t *tmp, *src, *dst, *swap;
+    int count[256];
+    int shift, i, sum, c;
+
+    tmp = FLUID_ARRAY(fluid_player_event_t, n);
+    if (tmp == NULL) {
         return FLUID_FAILED;
     }
-    delete_fluid_midi_file(midifile);
-    if (buffer_owned) {
-        FLUID_FREE(buffer);
+
+    src = events;
+    dst = tmp;
+    for (shift = 0; shift < 32; shift += 8) {
+        FLUID_MEMSET(count, 0, sizeof(count));
+        for (i = 0; i < n; i++) {
+            count[(src[i].ticks >> shift) & 0xff]++;
+        }
+        if (count[(src[0].ticks >> shift) & 0xff] == n) {
+            continue;
+        }
+        for (i = 0, sum = 0; i < 256; i++) {
+            c = count[i];
+            count[i] = sum;
+            sum += c;
+        }
+        for (i = 0; i < n; i++) {
+            dst[count[(src[i].ticks >> shift) & 0xff]++] = src[i];
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != events) {
+        FLUID_MEMCPY(events, src, n * sizeof(fluid_player_event_t));
+    }
+    FLUID_FREE(tmp);
+    return FLUID_OK;
+}
+
+/*
+ * fluid_player_build_events
+ *
+ * Merge the events of all tracks into a single time-ordered list with
+ * absolute timestamps, and build the tempo map and the channel state
+ * snapshots used for seeking. Events at the same tick keep the order
+ * of their tracks.
+ */
+static int
+fluid_player_build_events(fluid_player_t *player)
+{
+    fluid_player_channel_state_t state[FLUID_PLAYER_NUM_CHANNELS];
+    fluid_player_event_t *e;
+    fluid_track_event_t *evt;
+    fluid_track_t *track;
+    unsigned int ticks;
+    int ntempos = 1, total = 0;
+    int i, t, n;
+    double msec, deltatime;
+
+    for (t = 0; t < player->ntracks; t++) {
+        total += player->track[t]->nevents;
+    }
+
+    player->events = FLUID_ARRAY(fluid_player_event_t, total > 0 ? total : 1);
+    player->nsnapshots = total / FLUID_PLAYER_SNAPSHOT_INTERVAL + 1;
+    player->snapshots = FLUID_ARRAY(fluid_player_channel_state_t,
+                                    player->nsnapshots * FLUID_PLAYER_NUM_CHANNELS);
+    if (player->events == NULL || player->snapshots == NULL) {
+        goto error_recovery;
+    }
+
+    /* tracks one after the other, then sorted by tick */
+    for (t = 0, n = 0; t < player->ntracks; t++) {
+        track = player->track[t];
+        ticks = 0;
+        for (i = 0; i < track->nevents; i++, n++) {
+            ticks += track->events[i].dtime;
+            player->events[n].ticks = ticks;
+            player->events[n].index = i;
+            player->events[n].track = t;
+            if (track->events[i].type == MIDI_SET_TEMPO) {
+                ntempos++;
+            }
+        }
     }
+    player->nevents = total;
+
+    if (total > 1 && fluid_player_sort_events(player->events, total) != FLUID_OK) {
+        goto error_recovery;
+    }
+
+    player->tempo_map = FLUID_ARRAY(fluid_player_tempo_t, ntempos);
+    if (player->tempo_map == NULL) {
+        goto error_recovery;
+    }
+    player->tempo_map[0].ticks = 0;
+    player->tempo_map[0].msec = 0.0;
+    player->tempo_map[0].miditempo = player->miditempo;
+    player->ntempos = 1;
+    deltatime = player->deltatime;
+
+    /* tempo map and snapshots */
+    fluid_player_init_channel_state(state);
+
+    for (n = 0; n < total; n++) {
+        e = &player->events[n];
+
+        if (n % FLUID_PLAYER_SNAPSHOT_INTERVAL == 0) {
+            FLUID_MEMCPY(&player->snapshots[n / FLUID_PLAYER_SNAPSHOT_INTERVAL
+                                            * FLUID_PLAYER_NUM_CHANNELS],
+                         state, sizeof(state));
+        }
+
+        evt = fluid_player_event_get(player, e);
+        if (evt->type == MIDI_SET_TEMPO) {
+            msec = player->tempo_map[player->ntempos - 1].msec
+                + (e->ticks - player->tempo_map[player->ntempos - 1].ticks) * deltatime;
+            player->tempo_map[player->ntempos].ticks = e->ticks;
+            player->tempo_map[player->ntempos].msec = msec;
+            player->tempo_map[player->ntempos].miditempo = evt->param1;
+            player->ntempos++;
+            deltatime = (double) evt->param1 / player->division / 1000.0;
+        } else {
+            fluid_player_update_channel_state(state, evt);
+        }
+    }
+
+    if (n % FLUID_PLAYER_SNAPSHOT_INTERVAL == 0) {
+        FLUID_MEMCPY(&player->snapshots[n / FLUID_PLAYER_SNAPSHOT_INTERVAL
+                                        * FLUID_PLAYER_NUM_CHANNELS],
+                     state, sizeof(state));
+    }
+
+    player->cur_event = 0;
     return FLUID_OK;
+
+error_recovery:
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    fluid_player_free_events(player);
+    return FLUID_FAILED;
+}
+
+/*
+ * fluid_player_do_seek
+ *
+ * Move playback to seek_msec of the current file, msec being the
+ * current player time. Called from the player callback.
+ */
+static void
+fluid_player_do_seek(fluid_player_t *player, int seek_msec, unsigned int msec)
+{
+    fluid_player_channel_state_t state[FLUID_PLAYER_NUM_CHANNELS];
+    fluid_player_tempo_t *tempo;
+    unsigned int ticks;
+    double deltatime;
+    int lo, hi, mid, k, i;
+
+    /* the event list of the file couldn't be built: drop the seek */
+    if (player->events == NULL || player->snapshots == NULL
+        || player->tempo_map == NULL) {
+        return;
+    }
+
+    /* tempo in effect at seek_msec */
+    lo = 0;
+    hi = player->ntempos - 1;
+    while (lo < hi) {
+        mid = (lo + hi + 1) / 2;
+        if (player->tempo_map[mid].msec <= seek_msec) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    tempo = &player->tempo_map[lo];
+    deltatime = (double) tempo->miditempo / player->division / 1000.0;
+    ticks = tempo->ticks + (unsigned int) ((seek_msec - tempo->msec) / deltatime);
+
+    /* first event not before seek_msec */
+    lo = 0;
+    hi = player->nevents;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (player->events[mid].ticks < ticks) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    k = lo;
+
+    /* channel state at that event */
+    i = k / FLUID_PLAYER_SNAPSHOT_INTERVAL;
+    FLUID_MEMCPY(state, &player->snapshots[i * FLUID_PLAYER_NUM_CHANNELS], sizeof(state));
+    for (i *= FLUID_PLAYER_SNAPSHOT_INTERVAL; i < k; i++) {
+        fluid_player_update_channel_state(state,
+                                          fluid_player_event_get(player, &player->events[i]));
+    }
+    fluid_player_restore_channel_state(player, state);
+
+    player->cur_event = k;
+    player->begin_msec = msec - seek_msec;
+    player->miditempo = tempo->miditempo;
+    player->deltatime = deltatime;
+    player->cur_msec = msec;
+    player->cur_ticks = ticks;
+    /* ticks was rounded down: anchor it at its own time, not at seek_msec,
+     * so that the following events are not late by a fraction of a tick */
+    player->start_msec = msec - (int) (seek_msec - tempo->msec
+                                       - (ticks - tempo->ticks) * deltatime + 0.5);
+    player->start_ticks = ticks;
 }
 
 void
@@ -1590,19 +2459,105 @@ fluid_player_playlist_load(fluid_player_t *player, unsigned int msec)
 }
 
 
+/*
+ * fluid_player_get_ticks
+ *
+ * MIDI tick reached at the given player time, with the current tempo.
+ */
+static FLUID_INLINE int
+fluid_player_get_ticks(fluid_player_t *player, int msec)
+{
+    return player->start_ticks
+        + (int) ((double) (msec - player->start_msec) / player->deltatime);
+}
+
+/*
+ * fluid_player_get_next_event_msec
+ *
+ * First player time at which the callback has to send the next event,
+ * or 0 if there is none.
+ */
+static int
+fluid_player_get_next_event_msec(fluid_player_t *player)
+{
+    unsigned int ticks;
+    double delta;
+    int msec;
+
+    if (player->cur_event >= player->nevents) {
+        return 0;
+    }
+    ticks = player->events[player->cur_event].ticks;
+
+    delta = ceil((double) (ticks - player->start_ticks) * player->deltatime);
+    msec = player->start_msec + (int) delta;
+    if (msec <= player->cur_msec) {
+        return 0;
+    }
+
+    /* settle rounding, so that the result matches fluid_player_get_ticks() */
+    while (msec - 1 > player->cur_msec
+           && (unsigned int) fluid_player_get_ticks(player, msec - 1) >= ticks) {
+        msec--;
+    }
+    while ((unsigned int) fluid_player_get_ticks(player, msec) < ticks) {
+        msec++;
+    }
+    return msec;
+}
+
+/*
+ * fluid_player_send_events
+ *
+ * Send the events of the current file up to the given tick.
+ */
+static void
+fluid_player_send_events(fluid_player_t *player, unsigned int ticks)
+{
+    fluid_player_event_t *e;
+    fluid_track_event_t *event;
+    fluid_midi_event_t evt;
+
+    while (player->cur_event < player->nevents) {
+        e = &player->events[player->cur_event];
+
+        if (e->ticks > ticks) {
+            return;
+        }
+        player->cur_event++;
+
+        event = fluid_player_event_get(player, e);
+        if (event->type == MIDI_EOT) {
+        }
+        else if (event->type == MIDI_SET_TEMPO) {
+            fluid_player_set_midi_tempo(player, event->param1);
+        }
+        else if (player->playback_callback) {
+            fluid_track_get_event(player->track[e->track], e->index, &evt);
+            player->playback_callback(player->playback_userdata, &evt);
+        }
+    }
+}
+
 /*
  * fluid_player_callback
  */
 int
 fluid_player_callback(void *data, unsigned int msec)
 {
-    int i;
+    int seek;
     int loadnextfile;
     int status = FLUID_PLAYER_DONE;
     fluid_player_t *player;
-    fluid_synth_t *synth;
     player = (fluid_player_t *) data;
-    synth = player->synth;
+
+    /* nothing due yet: skip the tick computation */
+    if (player->currentfile != NULL
+        && (int) msec < player->next_event_msec
+        && fluid_atomic_int_get(&player->seek_msec) < 0) {
+        player->cur_msec = msec;
+        return 1;
+    }
 
     loadnextfile = player->currentfile == NULL ? 1 : 0;
     do {
@@ -1614,19 +2569,17 @@ fluid_player_callback(void *data, unsigned int msec)
             }
         }
 
+        seek = fluid_atomic_int_get(&player->seek_msec);
+        if (seek >= 0 && fluid_atomic_int_compare_and_exchange(&player->seek_msec, seek, -1)) {
+            fluid_player_do_seek(player, seek, msec);
+        }
+
         player->cur_msec = msec;
-        player->cur_ticks = (player->start_ticks
-                + (int) ((double) (player->cur_msec - player->start_msec)
-                        / player->deltatime));
-
-        for (i = 0; i < player->ntracks; i++) {
-            if (!fluid_track_eot(player->track[i])) {
-                status = FLUID_PLAYER_PLAYING;
-                if (fluid_track_send_events(player->track[i], synth, player,
-                        player->cur_ticks) != FLUID_OK) {
-                    /* */
-                }
-            }
+        player->cur_ticks = fluid_player_get_ticks(player, msec);
+
+        if (player->cur_event < player->nevents) {
+            status = FLUID_PLAYER_PLAYING;
+            fluid_player_send_events(player, player->cur_ticks);
         }
 
         if (status == FLUID_PLAYER_DONE) {
@@ -1637,6 +2590,7 @@ fluid_player_callback(void *data, unsigned int msec)
     } while (loadnextfile);
 
     player->status = status;
+    player->next_event_msec = fluid_player_get_next_event_msec(player);
 
     return 1;
 }
@@ -1666,6 +2620,7 @@ fluid_player_play(fluid_player_t *player)
             return FLUID_FAILED;
         }
     } else {
+        player->timer_start_ticks = fluid_synth_get_ticks(player->synth);
         player->sample_timer = new_fluid_sample_timer(player->synth,
                 fluid_player_callback, (void *) player);
 
@@ -1708,6 +2663,81 @@ fluid_player_get_status(fluid_player_t *player)
     return player->status;
 }
 
+/**
+ * Get the number of audio frames that can be rendered before the player
+ * sends its next MIDI event.
+ * @param player MIDI player instance
+ * @return Number of frames, 0 if the next event is due with the next block
+ *   or if it is not known (system timer, file not loaded yet, end of file)
+ *
+ * Meant for offline rendering: writing this many frames with
+ * fluid_synth_write_float() or similar renders everything up to the
+ * next event in one go. Only valid with player.timing-source set to
+ * "sample" and while the synth is not rendered from another thread.
+ * Events of other sample timers, like those of a sequencer, are not
+ * taken into account.
+ * @since 1.1.7
+ */
+int
+fluid_player_get_frames_to_next_event(fluid_player_t *player)
+{
+    fluid_synth_t *synth = player->synth;
+    unsigned int now, target;
+    double start;
+    int msec, blocks;
+
+    msec = player->next_event_msec;
+    if (player->sample_timer == NULL || player->currentfile == NULL || msec <= 0
+        || fluid_atomic_int_get(&player->seek_msec) >= 0) {
+        return 0;
+    }
+
+    /* first block for which the sample timer passes a time of at least
+       msec, see fluid_sample_timer_process() */
+    now = fluid_synth_get_ticks(synth);
+    start = ceil(msec * synth->sample_rate / 1000.0);
+    target = player->timer_start_ticks + (unsigned int) start;
+    blocks = target > now ? (target - now + FLUID_BUFSIZE - 1) / FLUID_BUFSIZE : 0;
+
+    while (blocks > 0
+           && (long) (1000.0 * (now + (blocks - 1) * FLUID_BUFSIZE
+                                - player->timer_start_ticks) / synth->sample_rate) >= msec) {
+        blocks--;
+    }
+    while ((long) (1000.0 * (now + blocks * FLUID_BUFSIZE
+                             - player->timer_start_ticks) / synth->sample_rate) < msec) {
+        blocks++;
+    }
+
+    /* plus what is left of the last rendered block */
+    return blocks * FLUID_BUFSIZE + synth->curmax - synth->cur;
+}
+
+/**
+ * Seek in the MIDI file being played.
+ * @param player MIDI player instance
+ * @param msec Position to seek to, in milliseconds from the start of the file
+ *   (with the tempo changes of the file applied)
+ * @return #FLUID_OK on success, #FLUID_FAILED otherwise
+ *
+ * The seek takes place the next time the player is advanced, in the
+ * thread driving it. Sounding notes are stopped and the program and
+ * controller state that the channels would have at that position is
+ * restored, going through the playback callback. SYSEX messages are
+ * not replayed. If called before the file is loaded, playback starts
+ * at the given position.
+ * @since 1.1.7
+ */
+int
+fluid_player_seek(fluid_player_t *player, int msec)
+{
+    if (msec < 0) {
+        return FLUID_FAILED;
+    }
+    fluid_atomic_int_set(&player->seek_msec, msec);
+    return FLUID_OK;
+}
+
 /**
  * Enable looping of a MIDI player 
  * @param player MIDI player instance
@@ -1732,6 +2762,9 @@ int fluid_player_set_loop(fluid_player_t *player, int loop)
  */
 int fluid_player_set_midi_tempo(fluid_player_t *player, int tempo)
 {
+    /* the callback may have skipped updating cur_ticks */
+    player->cur_ticks = fluid_player_get_ticks(player, player->cur_msec);
+    player->next_event_msec = 0;
     player->miditempo = tempo;
     player->deltatime = (double) tempo / player->division / 1000.0; /* in milliseconds */
     player->start_msec = player->cur_msec;
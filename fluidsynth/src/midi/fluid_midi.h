@@ -38,8 +38,6 @@ fluid_midi_event_t* fluid_midi_parser_parse(fluid_midi_parser_t* parser, unsigne
  */
 
 
-#define MAX_NUMBER_OF_TRACKS 128
-
 enum fluid_midi_event_type {
   /* channel messages */
   NOTE_OFF = 0x80,
@@ -233,15 +231,34 @@ struct _fluid_midi_event_t {
 };
 
 
+/*
+ * fluid_track_event_t
+ *
+ * Packed form of a MIDI file event, as stored in a track. The SYSEX
+ * data of a track is kept in a single arena, param2 of a SYSEX event
+ * is the offset of its data in there (param1 being its size).
+ */
+typedef struct {
+  unsigned int dtime;       /* Delay (ticks) between this and previous event */
+  unsigned int param1;      /* First parameter */
+  unsigned int param2;      /* Second parameter */
+  unsigned char type;       /* MIDI event type */
+  unsigned char channel;    /* MIDI channel */
+} fluid_track_event_t;
+
 /*
  * fluid_track_t
  */
 struct _fluid_track_t {
   char* name;
   int num;
-  fluid_midi_event_t *first;
-  fluid_midi_event_t *cur;
-  fluid_midi_event_t *last;
+  fluid_track_event_t *events;  /* Events of the track, in file order */
+  int nevents;                  /* Number of events */
+  int size;                     /* Allocated size of events */
+  unsigned char *sysex;         /* SYSEX data arena */
+  int sysex_len;                /* Bytes used in the arena */
+  int sysex_size;               /* Allocated size of the arena */
+  int cur;                      /* Index of the next event to send */
   unsigned int ticks;
 };
 
@@ -251,18 +268,17 @@ fluid_track_t* new_fluid_track(int num);
 int delete_fluid_track(fluid_track_t* track);
 int fluid_track_set_name(fluid_track_t* track, char* name);
 char* fluid_track_get_name(fluid_track_t* track);
-int fluid_track_add_event(fluid_track_t* track, fluid_midi_event_t* evt);
-fluid_midi_event_t* fluid_track_first_event(fluid_track_t* track);
-fluid_midi_event_t* fluid_track_next_event(fluid_track_t* track);
+int fluid_track_reserve(fluid_track_t* track, int nevents);
+int fluid_track_add_event(fluid_track_t* track, unsigned int dtime, int type,
+                          int channel, unsigned int param1, unsigned int param2);
+unsigned char* fluid_track_sysex_space(fluid_track_t* track, int len);
+int fluid_track_add_sysex(fluid_track_t* track, unsigned int dtime, int size, int len);
+void fluid_track_compact(fluid_track_t* track);
+void fluid_track_get_event(fluid_track_t* track, int i, fluid_midi_event_t* evt);
 int fluid_track_get_duration(fluid_track_t* track);
 int fluid_track_reset(fluid_track_t* track);
 
-int fluid_track_send_events(fluid_track_t* track,
-			   fluid_synth_t* synth,
-			   fluid_player_t* player,
-			   unsigned int ticks);
-
-#define fluid_track_eot(track)  ((track)->cur == NULL)
+#define fluid_track_eot(track)  ((track)->cur >= (track)->nevents)
 
 
 /**
@@ -278,13 +294,61 @@ typedef struct
     size_t buffer_len;  /** Number of bytes in buffer; 0 if filename */
 } fluid_playlist_item;
 
+/*
+ * fluid_player_event_t
+ *
+ * Entry of the merged, time-ordered event list of all tracks of the
+ * current file, built when the file is loaded.
+ */
+typedef struct {
+  unsigned int ticks;           /* Absolute time in MIDI ticks */
+  int index;                    /* Index of the event in its track */
+  int track;                    /* Number of the track in the player */
+} fluid_player_event_t;
+
+#define fluid_player_event_get(player, e) \
+  (&(player)->track[(e)->track]->events[(e)->index])
+
+/*
+ * fluid_player_tempo_t
+ *
+ * Entry of the tempo map of the current file.
+ */
+typedef struct {
+  unsigned int ticks;           /* Tick of the tempo change */
+  double msec;                  /* Time of the tempo change */
+  int miditempo;                /* Tempo, in microseconds per quarter note */
+} fluid_player_tempo_t;
+
+/*
+ * fluid_player_channel_state_t
+ *
+ * Program and controller state of a MIDI channel, as far as it matters
+ * when playback starts in the middle of a file.
+ */
+typedef struct {
+  unsigned char cc[128];        /* Controller values */
+  unsigned char cc_set[16];     /* Bit mask of the controllers set in cc[] */
+  short program;                /* Program, -1 if not set */
+  short pitch_bend;             /* Pitch bend, -1 if not set */
+  short pressure;               /* Channel pressure, -1 if not set */
+  short bend_range;             /* Pitch bend range (RPN 0) in semitones, -1 if not set */
+  unsigned char rpn_msb;        /* Currently selected (N)RPN */
+  unsigned char rpn_lsb;
+  unsigned char nrpn;           /* TRUE if the selected parameter is a NRPN */
+} fluid_player_channel_state_t;
+
+#define FLUID_PLAYER_NUM_CHANNELS         16   /* MIDI files address 16 channels */
+#define FLUID_PLAYER_SNAPSHOT_INTERVAL    1024 /* Events between two channel state snapshots */
+
 /*
  * fluid_player
  */
 struct _fluid_player_t {
   int status;
   int ntracks;
-  fluid_track_t *track[MAX_NUMBER_OF_TRACKS];
+  int track_size;               /* Allocated size of the track table */
+  fluid_track_t **track;
   fluid_synth_t* synth;
   fluid_timer_t* system_timer;
   fluid_sample_timer_t* sample_timer;
@@ -296,6 +360,7 @@ struct _fluid_player_t {
   char send_program_change; /* should we ignore the program changes? */
   char use_system_timer;   /* if zero, use sample timers, otherwise use system clock timer */
   char reset_synth_between_songs; /* 1 if system reset should be sent to the synth between songs. */
+  int load_threads;         /* number of threads parsing the tracks of a file */
   int start_ticks;          /* the number of tempo ticks passed at the last tempo change */
   int cur_ticks;            /* the number of tempo ticks passed */
   int begin_msec;           /* the time (msec) of the beginning of the file */
@@ -305,6 +370,17 @@ struct _fluid_player_t {
   double deltatime;         /* milliseconds per midi tick. depends on set-tempo */
   unsigned int division;
 
+  fluid_player_event_t *events;  /* Events of all tracks, merged in time order */
+  int nevents;                   /* Number of events */
+  int cur_event;                 /* Index of the next event to send */
+  fluid_player_tempo_t *tempo_map; /* Tempo changes of the file, in time order */
+  int ntempos;                   /* Number of entries in tempo_map */
+  fluid_player_channel_state_t *snapshots; /* Channel states before every FLUID_PLAYER_SNAPSHOT_INTERVAL'th event */
+  int nsnapshots;                /* Number of snapshots (of FLUID_PLAYER_NUM_CHANNELS states each) */
+  int seek_msec;                 /* Pending seek position (atomic), -1 if none */
+  int next_event_msec;           /* Time at which the next event is due, 0 if unknown */
+  unsigned int timer_start_ticks; /* Synth ticks at which the sample timer was started */
+
   handle_midi_event_func_t playback_callback; /* function fired on each midi event as it is played */
   void* playback_userdata; /* pointer to user-defined data passed to playback_callback function */
 };
@@ -323,9 +399,13 @@ void fluid_player_settings(fluid_settings_t* settings);
  * fluid_midi_file
  */
 typedef struct {
-  const char* buffer;           /* Entire contents of MIDI file (borrowed) */
+  const char* buffer;           /* Entire contents of MIDI file (borrowed), or read-ahead buffer */
   int buf_len;                  /* Length of buffer, in bytes */
   int buf_pos;                  /* Current read position in contents buffer */
+  fluid_file fp;                /* File being streamed, NULL when parsing a buffer */
+  const char* filename;         /* Name of the streamed file (borrowed), may be NULL */
+  int own_fp;                   /* TRUE if fp has to be closed with the handle */
+  char* readahead;              /* Read-ahead buffer of a streamed file */
   int eof;                      /* The "end of file" condition */
   int running_status;
   int c;
@@ -345,6 +425,7 @@ typedef struct {
 } fluid_midi_file;
 
 fluid_midi_file* new_fluid_midi_file(const char* buffer, size_t length);
+fluid_midi_file* new_fluid_midi_file_stream(fluid_file fp, const char* filename);
 void delete_fluid_midi_file(fluid_midi_file* mf);
 int fluid_midi_file_read_mthd(fluid_midi_file* midifile);
 int fluid_midi_file_load_tracks(fluid_midi_file* midifile, fluid_player_t* player);
@@ -31,18 +31,22 @@
 #include "fluidsynth_priv.h"	// FLUID_NEW, etc
 #include "fluid_sys.h"	// timer, threads, etc...
 #include "fluid_list.h"
+#include "fluid_hash.h"
 
 /***************************************************************
  *
  *                           SEQUENCER
  */
 
+/* initial size of the event heap, it grows as needed */
 #define FLUID_SEQUENCER_EVENTS_MAX	1000
 
 /* Private data for SEQUENCER */
 struct _fluid_sequencer_t {
 	unsigned int startMs;
 	gint currentMs;
+	gint currentUs;	/* microseconds past currentMs */
+	gint currentSeq;	/* odd while currentMs and currentUs are updated */
 	gboolean useSystemTimer;
 	double scale; // ticks per second
 	fluid_list_t* clients;
@@ -55,8 +59,15 @@ struct _fluid_sequencer_t {
 	short prevCellNb;
 	fluid_evt_entry* queue0[256][2];
 	fluid_evt_entry* queue1[255][2];
-	fluid_evt_entry* queueLater;
+	unsigned int queue2StartTime;
+	fluid_evt_entry* queue2[256][2];
+	unsigned int queue3StartTime;
+	fluid_evt_entry* queue3[256][2];
 	fluid_evt_heap_t* heap;
+	fluid_hashtable_t* eventIndex;	/* client id -> fluid_seq_index_t */
+	int unindexedEvents;
+	fluid_thread_t* processThread;	/* thread in fluid_sequencer_process() */
+	fluid_event_t* queuedEvt;	/* queued event being sent */
 	fluid_mutex_t mutex;
 #if FLUID_SEQ_WITH_TRACE
 	char *tracebuf;
@@ -73,16 +84,27 @@ typedef struct _fluid_sequencer_client_t {
 	void* data;
 } fluid_sequencer_client_t;
 
+/* Queued events of a client, as source and as destination */
+typedef struct _fluid_seq_index_t {
+	fluid_evt_entry* src;
+	fluid_evt_entry* dest;
+} fluid_seq_index_t;
+
 /* prototypes */
 static short _fluid_seq_queue_init(fluid_sequencer_t* seq, int nbEvents);
 static void _fluid_seq_queue_end(fluid_sequencer_t* seq);
 static short _fluid_seq_queue_pre_insert(fluid_sequencer_t* seq, fluid_event_t * evt);
+static int _fluid_seq_queue_pre_insert_batch(fluid_sequencer_t* seq, fluid_event_t** evts,
+					     const unsigned int* times, int count, int absolute);
 static void _fluid_seq_queue_pre_remove(fluid_sequencer_t* seq, short src, short dest, int type);
 static int _fluid_seq_queue_process(void* data, unsigned int msec); // callback from timer
 static void _fluid_seq_queue_insert_entry(fluid_sequencer_t* seq, fluid_evt_entry * evtentry);
 static void _fluid_seq_queue_remove_entries_matching(fluid_sequencer_t* seq, fluid_evt_entry* temp);
+static void _fluid_seq_queue_rebase(fluid_sequencer_t* seq);
+static void _fluid_seq_unindex_entry(fluid_sequencer_t* seq, fluid_evt_entry* entry);
 static void _fluid_seq_queue_send_queued_events(fluid_sequencer_t* seq);
-static void _fluid_free_evt_queue(fluid_evt_entry** first, fluid_evt_entry** last);
+static void _fluid_seq_send_queued(fluid_sequencer_t* seq, fluid_event_t* evt);
+static void _fluid_free_evt_queue(fluid_sequencer_t* seq, fluid_evt_entry** first, fluid_evt_entry** last);
 
 
 /* API implementation */
@@ -447,6 +469,28 @@ fluid_sequencer_send_now(fluid_sequencer_t* seq, fluid_event_t* evt)
 	}
 }
 
+/* Send an event taken from the queue, its time is the time it was due */
+static void
+_fluid_seq_send_queued(fluid_sequencer_t* seq, fluid_event_t* evt)
+{
+	fluid_event_t* prev = seq->queuedEvt;
+
+	seq->queuedEvt = evt;
+	fluid_sequencer_send_now(seq, evt);
+	seq->queuedEvt = prev;
+}
+
+/*
+ * TRUE if the event is being sent from the queue of the sequencer,
+ * FALSE if it was passed to fluid_sequencer_send_now() by the application
+ * and doesn't carry a time. For use by the callbacks of clients.
+ */
+int
+fluid_sequencer_event_is_queued(fluid_sequencer_t* seq, fluid_event_t* evt)
+{
+	return seq->queuedEvt == evt;
+}
+
 /**
  * Schedule an event for sending at a later time.
  * @param seq Sequencer object
@@ -473,6 +517,36 @@ fluid_sequencer_send_at (fluid_sequencer_t* seq, fluid_event_t* evt,
 	return _fluid_seq_queue_pre_insert(seq, evt);
 }
 
+/**
+ * Schedule several events for sending at a later time.
+ * @param seq Sequencer object
+ * @param evts Array of \a count events to send (copied)
+ * @param times Array of \a count time values in ticks, one for each event
+ * @param count Number of events
+ * @param absolute TRUE if \a times are absolute sequencer time (time since sequencer
+ *   creation), FALSE if relative to current time.
+ * @return #FLUID_OK on success, #FLUID_FAILED otherwise (in which case no event
+ *   was scheduled)
+ *
+ * Equivalent to calling fluid_sequencer_send_at() for each event, but much
+ * faster for large numbers of events: the events need not be sorted, they
+ * are sorted once and handed over to the sequencer in one go.  Events with
+ * the same time are sent in array order.
+ * @since 1.1.7
+ */
+int
+fluid_sequencer_send_at_batch (fluid_sequencer_t* seq, fluid_event_t** evts,
+                               const unsigned int* times, int count, int absolute)
+{
+	if (count <= 0)
+		return FLUID_OK;
+
+	if (evts == NULL || times == NULL)
+		return FLUID_FAILED;
+
+	return _fluid_seq_queue_pre_insert_batch(seq, evts, times, count, absolute);
+}
+
 /**
  * Remove events from the event queue.
  * @param seq Sequencer object
@@ -500,10 +574,23 @@ fluid_sequencer_remove_events (fluid_sequencer_t* seq, short source,
 unsigned int
 fluid_sequencer_get_tick (fluid_sequencer_t* seq)
 {
-	unsigned int absMs = seq->useSystemTimer ? (int) fluid_curtime() : g_atomic_int_get(&seq->currentMs);
+	unsigned int absMs;
+	int absUs = 0;
+	int count;
 	double nowFloat;
 	unsigned int now;
-	nowFloat = ((double)(absMs - seq->startMs))*seq->scale/1000.0f;
+
+	if (seq->useSystemTimer) {
+		absMs = fluid_curtime();
+	} else {
+		/* retry while fluid_sequencer_process_exact() updates the time */
+		do {
+			count = fluid_atomic_int_get(&seq->currentSeq);
+			absMs = fluid_atomic_int_get(&seq->currentMs);
+			absUs = fluid_atomic_int_get(&seq->currentUs);
+		} while ((count & 1) || count != fluid_atomic_int_get(&seq->currentSeq));
+	}
+	nowFloat = ((double)(absMs - seq->startMs) + absUs/1000.0)*seq->scale/1000.0f;
 	now = nowFloat;
 	return now;
 }
@@ -512,7 +599,10 @@ fluid_sequencer_get_tick (fluid_sequencer_t* seq)
  * Set the time scale of a sequencer.
  * @param seq Sequencer object
  * @param scale Sequencer scale value in ticks per second
- *   (default is 1000 for 1 tick per millisecond, max is 1000.0)
+ *   (default is 1000 for 1 tick per millisecond, max is 1000.0 with the
+ *   system timer and 1000000.0 otherwise, a sequencer driven by a synth
+ *   through fluid_sequencer_register_fluidsynth() can use its sample rate
+ *   to count in sample frames)
  *
  * If there are already scheduled events in the sequencer and the scale is changed
  * the events are adjusted accordingly.
@@ -525,9 +615,12 @@ fluid_sequencer_set_time_scale (fluid_sequencer_t* seq, double scale)
 		return;
 	}
 
-	if (scale > 1000.0)
+	if (seq->useSystemTimer && scale > 1000.0)
 		// Otherwise : problems with the timer = 0ms...
 		scale = 1000.0;
+	else if (scale > 1000000.0)
+		// fluid_sequencer_get_tick() counts in microseconds
+		scale = 1000000.0;
 
 	if (seq->scale != scale) {
 		double oldScale = seq->scale;
@@ -542,6 +635,7 @@ fluid_sequencer_set_time_scale (fluid_sequencer_t* seq, double scale)
 
 		// change start0 so that cellNb is preserved
 		seq->queue0StartTime =  (seq->queue0StartTime + seq->prevCellNb)*(seq->scale/oldScale) - seq->prevCellNb;
+		_fluid_seq_queue_rebase(seq);
 
 		// change all preQueue events for new scale
 		{
@@ -562,6 +656,28 @@ fluid_sequencer_set_time_scale (fluid_sequencer_t* seq, double scale)
 	}
 }
 
+/**
+ * Get statistics about the pool of event entries of a sequencer.
+ * Every event sent with fluid_sequencer_send_at() or removal request
+ * uses an entry until it is processed.  The pool grows as needed,
+ * normally outside of the thread calling fluid_sequencer_process().
+ * @param seq Sequencer object
+ * @param size Location to store the number of allocated entries or NULL
+ * @param high_water Location to store the highest number of entries in use
+ *   at the same time or NULL
+ * @param failures Location to store the number of events which were dropped
+ *   because no entry could be allocated or NULL
+ * @since 1.1.7
+ */
+void
+fluid_sequencer_get_event_pool_stats(fluid_sequencer_t* seq, int* size,
+				     int* high_water, int* failures)
+{
+	if (size) *size = fluid_atomic_int_get(&seq->heap->size);
+	if (high_water) *high_water = fluid_atomic_int_get(&seq->heap->high_water);
+	if (failures) *failures = fluid_atomic_int_get(&seq->heap->failures);
+}
+
 /**
  * Get a sequencer's time scale.
  * @param seq Sequencer object.
@@ -587,34 +703,51 @@ fluid_sequencer_get_time_scale(fluid_sequencer_t* seq)
 
   There is a heap, allocated at init time, for managing a pool
   of event entries, that is description of an event, its time,
-  and whether it is a normal event or a removal command.
-
-  The queue is separated in two arrays, and a list.  The first
-  array 'queue0' corresponds to the events to be sent in the
-  next 256 ticks (0 to 255), the second array 'queue1' contains
-  the events to be send from now+256 to now+65535. The list
-  called 'queueLater' contains the events to be sent later than
-  that. In each array, one cell contains a list of events having
-  the same time (in the queue0 array), or the same time/256 (in
-  the queue1 array), and a pointer to the last event in the list
-  of the cell so as to be able to insert fast at the end of the
-  list (i.e. a cell = 2 pointers).  The 'queueLater' list is
-  ordered by time and by post time.  This way, inserting 'soon'
-  events is fast (below 65535 ticks, that is about 1 minute if 1
-  tick=1ms).  Inserting later events is more slow, but this is a
-  realtime engine, isn't it ?
+  and whether it is a normal event or a removal command.  The
+  heap grows by chunks when it runs low, see fluid_event.c.
+
+  The queue is a hierarchical timing wheel made of four arrays.
+  The first array 'queue0' corresponds to the events to be sent
+  in the next 256 ticks (0 to 255), the second array 'queue1'
+  contains the events to be send from now+256 to now+65535.  The
+  arrays 'queue2' and 'queue3' contain the later events, with a
+  granularity of 65536 and 16777216 ticks respectively, so that
+  together they cover the whole range of the tick counter. In
+  each array, one cell contains a list of events having the same
+  time (in the queue0 array), or the same time/256 (in the queue1
+  array), etc., and a pointer to the last event in the list of
+  the cell so as to be able to insert fast at the end of the list
+  (i.e. a cell = 2 pointers).  This way, inserting any event is
+  done in constant time, and events having the same time are
+  always sent in the order they were posted.
 
   The queue0 starts at queue0StartTime.  When 256 ticks have
   elapsed, the queue0 array is emptied, and the first cell of
   the queue1 array is expanded in the queue0 array, according to
   the time of each event. The queue1 array is shifted to the
-  left, and the first events of the queueLater list are inserte
-  in the last cell of the queue1 array.
+  left.
+
+  The queue2 array starts at queue2StartTime, which is the first
+  tick not covered by queue1 when it is inserted to. When
+  queue0StartTime reaches queue2StartTime, the first cell of
+  queue2 is expanded in queue0 and queue1, the queue2 array is
+  shifted to the left and queue2StartTime moves 65536 ticks
+  ahead. In the same way, the first cell of queue3 is expanded
+  in queue2 when queue2StartTime reaches queue3StartTime.  Since
+  the lower arrays only ever receive events that are earlier
+  than the start of the upper ones, expanding a cell never puts
+  an event behind a later posted one of the same time.
 
   We remember the previously managed cell in queue0 in the
   prevCellNb variable. When processing the current cell, we
   process the events in between (late events).
 
+  Each queued entry is also linked in the list of the events of
+  its source and in the list of the events of its destination,
+  found in the 'eventIndex' hash table.  Removing the events of a
+  client only walks these lists: the matching entries are marked
+  as cancelled, and are freed when the queue reaches them.
+
   Functions
 
   The main thread functions first get an event entry from the
@@ -638,8 +771,8 @@ fluid_sequencer_get_time_scale(fluid_sequencer_t* seq)
   - the preQueue access.
 
   These are really small and fast sections (merely a pointer or
-  two changing value). They are not protected by a mutex for now
-  (August 2002). Waiting for crossplatform mutex solutions. When
+  two changing value). The heap uses a lock-free free list, the
+  preQueue is protected by a mutex. When
   changing this code, beware that the
   _fluid_seq_queue_pre_insert function may be called by the
   callback of the queue thread (ex : a note event inserts a
@@ -652,6 +785,12 @@ fluid_sequencer_get_time_scale(fluid_sequencer_t* seq)
 /*       API        */
 /********************/
 
+static void
+_fluid_seq_delete_index(void* data)
+{
+	FLUID_FREE(data);
+}
+
 static short
 _fluid_seq_queue_init(fluid_sequencer_t* seq, int maxEvents)
 {
@@ -661,14 +800,27 @@ _fluid_seq_queue_init(fluid_sequencer_t* seq, int maxEvents)
 		return -1;
 	}
 
+	seq->eventIndex = new_fluid_hashtable_full(fluid_direct_hash, fluid_direct_equal,
+						   NULL, _fluid_seq_delete_index);
+	if (seq->eventIndex == NULL) {
+		fluid_log(FLUID_PANIC, "sequencer: Out of memory\n");
+		_fluid_evt_heap_free(seq->heap);
+		seq->heap = NULL;
+		return -1;
+	}
+	seq->unindexedEvents = 0;
+
 	seq->preQueue = NULL;
 	seq->preQueueLast = NULL;
 
 	FLUID_MEMSET(seq->queue0, 0, 2*256*sizeof(fluid_evt_entry *));
 	FLUID_MEMSET(seq->queue1, 0, 2*255*sizeof(fluid_evt_entry *));
+	FLUID_MEMSET(seq->queue2, 0, 2*256*sizeof(fluid_evt_entry *));
+	FLUID_MEMSET(seq->queue3, 0, 2*256*sizeof(fluid_evt_entry *));
 
-	seq->queueLater = NULL;
 	seq->queue0StartTime = fluid_sequencer_get_tick(seq);
+	seq->queue2StartTime = seq->queue0StartTime + 65536;
+	seq->queue3StartTime = seq->queue2StartTime + 16777216;
 	seq->prevCellNb = -1;
 
 	fluid_mutex_init(seq->mutex);
@@ -687,12 +839,15 @@ _fluid_seq_queue_end(fluid_sequencer_t* seq)
 	int i;
 
 	/* free all remaining events */
-	_fluid_free_evt_queue(&seq->preQueue, &seq->preQueueLast);
+	_fluid_free_evt_queue(seq, &seq->preQueue, &seq->preQueueLast);
 	for (i = 0; i < 256; i++) 
-		_fluid_free_evt_queue(&(seq->queue0[i][0]), &(seq->queue0[i][1]));
+		_fluid_free_evt_queue(seq, &(seq->queue0[i][0]), &(seq->queue0[i][1]));
 	for (i = 0; i < 255; i++) 
-		_fluid_free_evt_queue(&(seq->queue1[i][0]), &(seq->queue1[i][1]));
-	_fluid_free_evt_queue(&seq->queueLater, NULL);
+		_fluid_free_evt_queue(seq, &(seq->queue1[i][0]), &(seq->queue1[i][1]));
+	for (i = 0; i < 256; i++) {
+		_fluid_free_evt_queue(seq, &(seq->queue2[i][0]), &(seq->queue2[i][1]));
+		_fluid_free_evt_queue(seq, &(seq->queue3[i][0]), &(seq->queue3[i][1]));
+	}
 
 
 	if (seq->timer) {
@@ -705,6 +860,11 @@ _fluid_seq_queue_end(fluid_sequencer_t* seq)
 		seq->heap = NULL;
 	}
 
+	if (seq->eventIndex) {
+		delete_fluid_hashtable(seq->eventIndex);
+		seq->eventIndex = NULL;
+	}
+
 	fluid_mutex_destroy(seq->mutex);
 }
 
@@ -714,13 +874,22 @@ _fluid_seq_queue_end(fluid_sequencer_t* seq)
 /* queue management */
 /********************/
 
+/* Only grow the heap outside of fluid_sequencer_process(), which is
+ * often called by the audio thread and must not allocate memory. */
+static int
+_fluid_seq_may_grow_heap(fluid_sequencer_t* seq)
+{
+	return fluid_atomic_pointer_get(&seq->processThread) != fluid_thread_get_id();
+}
+
 /* Create event_entry and append to the preQueue.
  * May be called from the main thread (usually) but also recursively
  * from the queue thread, when a callback itself does an insert... */
 static short
 _fluid_seq_queue_pre_insert(fluid_sequencer_t* seq, fluid_event_t * evt)
 {
-	fluid_evt_entry * evtentry = _fluid_seq_heap_get_free(seq->heap);
+	fluid_evt_entry * evtentry = _fluid_seq_heap_get_free(seq->heap,
+				_fluid_seq_may_grow_heap(seq));
 	if (evtentry == NULL) {
 		/* should not happen */
 		fluid_log(FLUID_PANIC, "sequencer: no more free events\n");
@@ -746,13 +915,102 @@ _fluid_seq_queue_pre_insert(fluid_sequencer_t* seq, fluid_event_t * evt)
 	return (0);
 }
 
+typedef struct {
+	unsigned int time;
+	int index;
+} fluid_seq_batch_key_t;
+
+/* Order by time, then by position in the batch, so that the sort is stable */
+static int
+_fluid_seq_batch_key_cmp(const void* a, const void* b)
+{
+	const fluid_seq_batch_key_t* ka = (const fluid_seq_batch_key_t*) a;
+	const fluid_seq_batch_key_t* kb = (const fluid_seq_batch_key_t*) b;
+
+	if (ka->time != kb->time)
+		return ka->time < kb->time ? -1 : 1;
+	return ka->index - kb->index;
+}
+
+/* Create the event_entries of a batch in time order and append them to
+ * the preQueue at once. Either all events are queued, or none. */
+static int
+_fluid_seq_queue_pre_insert_batch(fluid_sequencer_t* seq, fluid_event_t** evts,
+				  const unsigned int* times, int count, int absolute)
+{
+	fluid_evt_entry *first = NULL, *last = NULL, *evtentry;
+	fluid_seq_batch_key_t* keys = NULL;
+	unsigned int now = absolute ? 0 : fluid_sequencer_get_tick(seq);
+	int may_grow = _fluid_seq_may_grow_heap(seq);
+	int i, k;
+
+	/* sort only if needed; if there is no memory for the keys the
+	   events are queued in array order, which the queue copes with */
+	for (i = 1; i < count; i++) {
+		if (times[i] < times[i - 1])
+			break;
+	}
+	if (i < count) {
+		keys = FLUID_ARRAY(fluid_seq_batch_key_t, count);
+		if (keys != NULL) {
+			for (i = 0; i < count; i++) {
+				keys[i].time = times[i];
+				keys[i].index = i;
+			}
+			qsort(keys, count, sizeof(fluid_seq_batch_key_t),
+			      _fluid_seq_batch_key_cmp);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		k = keys ? keys[i].index : i;
+
+		evtentry = _fluid_seq_heap_get_free(seq->heap, may_grow);
+		if (evtentry == NULL) {
+			fluid_log(FLUID_PANIC, "sequencer: no more free events\n");
+			_fluid_free_evt_queue(seq, &first, &last);
+			if (keys) FLUID_FREE(keys);
+			return FLUID_FAILED;
+		}
+
+		evtentry->next = NULL;
+		evtentry->entryType = FLUID_EVT_ENTRY_INSERT;
+		FLUID_MEMCPY(&(evtentry->evt), evts[k], sizeof(fluid_event_t));
+		fluid_event_set_time(&(evtentry->evt), now + times[k]);
+
+		if (last) {
+			last->next = evtentry;
+		} else {
+			first = evtentry;
+		}
+		last = evtentry;
+	}
+
+	if (keys) FLUID_FREE(keys);
+
+	fluid_mutex_lock(seq->mutex);
+
+	/* append to preQueue */
+	if (seq->preQueueLast) {
+		seq->preQueueLast->next = first;
+	} else {
+		seq->preQueue = first;
+	}
+	seq->preQueueLast = last;
+
+	fluid_mutex_unlock(seq->mutex);
+
+	return FLUID_OK;
+}
+
 /* Create event_entry and append to the preQueue.
  * May be called from the main thread (usually) but also recursively
  * from the queue thread, when a callback itself does an insert... */
 static void
 _fluid_seq_queue_pre_remove(fluid_sequencer_t* seq, short src, short dest, int type)
 {
-	fluid_evt_entry * evtentry = _fluid_seq_heap_get_free(seq->heap);
+	fluid_evt_entry * evtentry = _fluid_seq_heap_get_free(seq->heap,
+				_fluid_seq_may_grow_heap(seq));
 	if (evtentry == NULL) {
 		/* should not happen */
 		fluid_log(FLUID_PANIC, "sequencer: no more free events\n");
@@ -784,13 +1042,13 @@ _fluid_seq_queue_pre_remove(fluid_sequencer_t* seq, short src, short dest, int t
 }
 
 static void
-_fluid_free_evt_queue(fluid_evt_entry** first, fluid_evt_entry** last)
+_fluid_free_evt_queue(fluid_sequencer_t* seq, fluid_evt_entry** first, fluid_evt_entry** last)
 {
 	fluid_evt_entry* tmp2;
 	fluid_evt_entry* tmp = *first;
 	while (tmp != NULL) {
 		tmp2 = tmp->next;
-		FLUID_FREE(tmp);
+		_fluid_seq_heap_set_free(seq->heap, tmp);
 		tmp = tmp2;
 	}
 	*first = NULL;
@@ -817,12 +1075,24 @@ _fluid_seq_queue_process(void* data, unsigned int msec)
  */
 void
 fluid_sequencer_process(fluid_sequencer_t* seq, unsigned int msec)
+{
+	fluid_sequencer_process_exact(seq, msec);
+}
+
+/*
+ * Advance a sequencer that isn't using the system timer to a time with
+ * a fractional part, with a resolution of one microsecond.
+ */
+void
+fluid_sequencer_process_exact(fluid_sequencer_t* seq, double msec)
 {
 
 	/* process prequeue */
 	fluid_evt_entry* tmp;
 	fluid_evt_entry* next;
 
+	fluid_atomic_pointer_set(&seq->processThread, fluid_thread_get_id());
+
 	fluid_mutex_lock(seq->mutex);
 
 	/* get the preQueue */
@@ -846,92 +1116,174 @@ fluid_sequencer_process(fluid_sequencer_t* seq, unsigned int msec)
 	}
 
 	/* send queued events */
-	g_atomic_int_set(&seq->currentMs, msec);
+	fluid_atomic_int_inc(&seq->currentSeq);
+	fluid_atomic_int_set(&seq->currentUs, (int) ((msec - (unsigned int) msec) * 1000.0));
+	fluid_atomic_int_set(&seq->currentMs, (unsigned int) msec);
+	fluid_atomic_int_inc(&seq->currentSeq);
 	_fluid_seq_queue_send_queued_events(seq);
 
+	fluid_atomic_pointer_set(&seq->processThread, NULL);
 }
 
 #if 0
 static void
 _fluid_seq_queue_print_later(fluid_sequencer_t* seq)
 {
-	int count = 0;
-	fluid_evt_entry* tmp = seq->queueLater;
+	int i, count = 0;
+	fluid_evt_entry* tmp;
 
 	printf("queueLater:\n");
 
-	while (tmp) {
-		unsigned int delay = tmp->evt.time - seq->queue0StartTime;
-		printf("queueLater: Delay = %i\n", delay);
-		tmp = tmp->next;
-		count++;
+	for (i = 0; i < 256; i++) {
+		for (tmp = seq->queue2[i][0]; tmp; tmp = tmp->next) {
+			unsigned int delay = tmp->evt.time - seq->queue0StartTime;
+			printf("queue2[%i]: Delay = %u\n", i, delay);
+			count++;
+		}
+	}
+	for (i = 0; i < 256; i++) {
+		for (tmp = seq->queue3[i][0]; tmp; tmp = tmp->next) {
+			unsigned int delay = tmp->evt.time - seq->queue0StartTime;
+			printf("queue3[%i]: Delay = %u\n", i, delay);
+			count++;
+		}
 	}
 	printf("queueLater: Total of %i events\n", count);
 }
 #endif
 
+/* append an entry at the end of the list of a cell */
 static void
-_fluid_seq_queue_insert_queue0(fluid_sequencer_t* seq, fluid_evt_entry* tmp, int cell)
+_fluid_seq_queue_append(fluid_evt_entry** cell, fluid_evt_entry* tmp)
 {
-	if (seq->queue0[cell][1] == NULL) {
-		seq->queue0[cell][1] = seq->queue0[cell][0] = tmp;
+	if (cell[1] == NULL) {
+		cell[1] = cell[0] = tmp;
 	} else {
-		seq->queue0[cell][1]->next = tmp;
-		seq->queue0[cell][1] = tmp;
+		cell[1]->next = tmp;
+		cell[1] = tmp;
 	}
 	tmp->next = NULL;
 }
 
+static void
+_fluid_seq_queue_insert_queue0(fluid_sequencer_t* seq, fluid_evt_entry* tmp, int cell)
+{
+	_fluid_seq_queue_append(seq->queue0[cell], tmp);
+}
+
 static void
 _fluid_seq_queue_insert_queue1(fluid_sequencer_t* seq, fluid_evt_entry* tmp, int cell)
 {
-	if (seq->queue1[cell][1] == NULL) {
-		seq->queue1[cell][1] = seq->queue1[cell][0] = tmp;
-	} else {
-		seq->queue1[cell][1]->next = tmp;
-		seq->queue1[cell][1] = tmp;
+	_fluid_seq_queue_append(seq->queue1[cell], tmp);
+}
+
+static void
+_fluid_seq_queue_insert_queue2(fluid_sequencer_t* seq, fluid_evt_entry* tmp, int cell)
+{
+	_fluid_seq_queue_append(seq->queue2[cell], tmp);
+}
+
+static void
+_fluid_seq_queue_insert_queue3(fluid_sequencer_t* seq, fluid_evt_entry* tmp, int cell)
+{
+	_fluid_seq_queue_append(seq->queue3[cell], tmp);
+}
+
+static fluid_seq_index_t*
+_fluid_seq_get_index(fluid_sequencer_t* seq, short id, int create)
+{
+	fluid_seq_index_t* index;
+
+	index = fluid_hashtable_lookup(seq->eventIndex, FLUID_INT_TO_POINTER(id));
+	if (index == NULL && create) {
+		index = FLUID_NEW(fluid_seq_index_t);
+		if (index == NULL) {
+			FLUID_LOG(FLUID_ERR, "Out of memory");
+			return NULL;
+		}
+		index->src = NULL;
+		index->dest = NULL;
+		fluid_hashtable_insert(seq->eventIndex, FLUID_INT_TO_POINTER(id), index);
 	}
-	tmp->next = NULL;
+	return index;
 }
 
+/* Link a queued entry in the lists of its source and destination, so
+ * that removing the events of a client does not walk the whole queue. */
 static void
-_fluid_seq_queue_insert_queue_later(fluid_sequencer_t* seq, fluid_evt_entry* evtentry)
+_fluid_seq_index_entry(fluid_sequencer_t* seq, fluid_evt_entry* entry)
 {
-	fluid_evt_entry* prev;
-	fluid_evt_entry* tmp;
-	unsigned int time = evtentry->evt.time;
+	fluid_seq_index_t* src = _fluid_seq_get_index(seq, entry->evt.src, TRUE);
+	fluid_seq_index_t* dest = _fluid_seq_get_index(seq, entry->evt.dest, TRUE);
+
+	if (src == NULL || dest == NULL) {
+		/* removals walk the whole queue until this entry is gone */
+		entry->indexed = FLUID_EVT_ENTRY_UNINDEXED;
+		seq->unindexedEvents++;
+		return;
+	}
+
+	entry->srcPrev = NULL;
+	entry->srcNext = src->src;
+	if (src->src) src->src->srcPrev = entry;
+	src->src = entry;
+
+	entry->destPrev = NULL;
+	entry->destNext = dest->dest;
+	if (dest->dest) dest->dest->destPrev = entry;
+	dest->dest = entry;
 
-	/* insert in 'queueLater', after the ones that have the same
-	 * time */
+	entry->indexed = FLUID_EVT_ENTRY_LINKED;
+}
 
-	/* first? */
-	if ((seq->queueLater == NULL)
-	    || (seq->queueLater->evt.time > time)) {
-		evtentry->next = seq->queueLater;
-		seq->queueLater = evtentry;
+/* Free the index of a client once it has no queued events left. */
+static void
+_fluid_seq_release_index(fluid_sequencer_t* seq, short id)
+{
+	fluid_seq_index_t* index = _fluid_seq_get_index(seq, id, FALSE);
+
+	if (index != NULL && index->src == NULL && index->dest == NULL) {
+		fluid_hashtable_remove(seq->eventIndex, FLUID_INT_TO_POINTER(id));
+	}
+}
+
+static void
+_fluid_seq_unindex_entry(fluid_sequencer_t* seq, fluid_evt_entry* entry)
+{
+	fluid_seq_index_t* index;
+
+	if (entry->indexed == FLUID_EVT_ENTRY_UNINDEXED) {
+		seq->unindexedEvents--;
+		entry->indexed = FLUID_EVT_ENTRY_UNLINKED;
 		return;
 	}
 
-	/* walk queueLater */
-	/* this is the only slow thing : if the event is more
-	   than 65535 ticks after the current time */
+	if (entry->indexed != FLUID_EVT_ENTRY_LINKED) {
+		return;
+	}
 
-	prev = seq->queueLater;
-	tmp = prev->next;
-	while (tmp) {
-		if (tmp->evt.time > time) {
-			/* insert before tmp */
-			evtentry->next = tmp;
-			prev->next = evtentry;
-			return;
-		}
-		prev = tmp;
-		tmp = prev->next;
+	if (entry->srcPrev) {
+		entry->srcPrev->srcNext = entry->srcNext;
+	} else {
+		index = _fluid_seq_get_index(seq, entry->evt.src, FALSE);
+		index->src = entry->srcNext;
 	}
+	if (entry->srcNext) entry->srcNext->srcPrev = entry->srcPrev;
 
-	/* last */
-	evtentry->next = NULL;
-	prev->next = evtentry;
+	if (entry->destPrev) {
+		entry->destPrev->destNext = entry->destNext;
+	} else {
+		index = _fluid_seq_get_index(seq, entry->evt.dest, FALSE);
+		index->dest = entry->destNext;
+	}
+	if (entry->destNext) entry->destNext->destPrev = entry->destPrev;
+
+	entry->indexed = FLUID_EVT_ENTRY_UNLINKED;
+
+	_fluid_seq_release_index(seq, entry->evt.src);
+	if (entry->evt.dest != entry->evt.src) {
+		_fluid_seq_release_index(seq, entry->evt.dest);
+	}
 }
 
 static void
@@ -948,7 +1300,7 @@ _fluid_seq_queue_insert_entry(fluid_sequencer_t* seq, fluid_evt_entry * evtentry
 		*/
 		if (time < (unsigned int)seq->queue0StartTime) {
 			/* we are late, send now */
-			fluid_sequencer_send_now(seq, evt);
+			_fluid_seq_send_queued(seq, evt);
 
 			_fluid_seq_heap_set_free(seq->heap, evtentry);
 			return;
@@ -961,17 +1313,24 @@ _fluid_seq_queue_insert_entry(fluid_sequencer_t* seq, fluid_evt_entry * evtentry
 		   _fluid_seq_queue_send_queued_events() */
 		if (time <= (unsigned int)(seq->queue0StartTime + seq->prevCellNb)) {
 			/* we are late, send now */
-			fluid_sequencer_send_now(seq, evt);
+			_fluid_seq_send_queued(seq, evt);
 
 			_fluid_seq_heap_set_free(seq->heap, evtentry);
 			return;
 		}
 	}
 
+	_fluid_seq_index_entry(seq, evtentry);
+
 	delay = time - seq->queue0StartTime;
 
-	if (delay > 65535) {
-		_fluid_seq_queue_insert_queue_later(seq, evtentry);
+	if (delay >= seq->queue3StartTime - seq->queue0StartTime) {
+		_fluid_seq_queue_insert_queue3(seq, evtentry,
+					       (time - seq->queue3StartTime) >> 24);
+
+	} else if (delay >= seq->queue2StartTime - seq->queue0StartTime) {
+		_fluid_seq_queue_insert_queue2(seq, evtentry,
+					       (time - seq->queue2StartTime) >> 16);
 
 	} else if (delay > 255) {
 		_fluid_seq_queue_insert_queue1(seq, evtentry, delay/256 - 1);
@@ -1014,10 +1373,62 @@ _fluid_seq_queue_matchevent(fluid_event_t* evt, int templType, short templSrc, s
 	return 0;
 }
 
+static void
+_fluid_seq_queue_remove_cell_matching(fluid_sequencer_t* seq, fluid_evt_entry** cell,
+				      int type, short src, short dest)
+{
+	fluid_evt_entry* tmp = cell[0];
+	fluid_evt_entry* prev = NULL;
+	while (tmp) {
+		/* remove and/or walk */
+		if (_fluid_seq_queue_matchevent((&tmp->evt), type, src, dest)) {
+			/* remove */
+			_fluid_seq_unindex_entry(seq, tmp);
+			if (prev) {
+				prev->next = tmp->next;
+				if (tmp == cell[1]) // last one in list
+					cell[1] = prev;
+
+				_fluid_seq_heap_set_free(seq->heap, tmp);
+				tmp = prev->next;
+			} else {
+				/* first one in list */
+				cell[0] = tmp->next;
+				if (tmp == cell[1]) // last one in list
+					cell[1] = NULL;
+
+				_fluid_seq_heap_set_free(seq->heap, tmp);
+				tmp = cell[0];
+			}
+		} else {
+			prev = tmp;
+			tmp = prev->next;
+		}
+	}
+}
+
+/* Cancel the matching entries of a source (bySrc) or dest list. They
+ * stay in the queue until they are reached or expanded. */
+static void
+_fluid_seq_queue_cancel_matching(fluid_sequencer_t* seq, fluid_evt_entry* tmp,
+				 int bySrc, int type, short src, short dest)
+{
+	fluid_evt_entry* next;
+
+	while (tmp) {
+		next = bySrc ? tmp->srcNext : tmp->destNext;
+		if (_fluid_seq_queue_matchevent((&tmp->evt), type, src, dest)) {
+			_fluid_seq_unindex_entry(seq, tmp);
+			tmp->entryType = FLUID_EVT_ENTRY_CANCELLED;
+		}
+		tmp = next;
+	}
+}
+
 static void
 _fluid_seq_queue_remove_entries_matching(fluid_sequencer_t* seq, fluid_evt_entry* templ)
 {
-	/* we walk everything : this is slow, but that is life */
+	fluid_seq_index_t* index;
 	int i, type;
 	short src, dest;
 
@@ -1028,90 +1439,26 @@ _fluid_seq_queue_remove_entries_matching(fluid_sequencer_t* seq, fluid_evt_entry
 	/* we can set it free now */
 	_fluid_seq_heap_set_free(seq->heap, templ);
 
-	/* queue0 */
-	for (i = 0 ; i < 256 ; i++) {
-		fluid_evt_entry* tmp = seq->queue0[i][0];
-		fluid_evt_entry* prev = NULL;
-		while (tmp) {
-			/* remove and/or walk */
-			if (_fluid_seq_queue_matchevent((&tmp->evt), type, src, dest)) {
-				/* remove */
-				if (prev) {
-					prev->next = tmp->next;
-					if (tmp == seq->queue0[i][1]) // last one in list
-						seq->queue0[i][1] = prev;
-
-					_fluid_seq_heap_set_free(seq->heap, tmp);
-					tmp = prev->next;
-				} else {
-					/* first one in list */
-					seq->queue0[i][0] = tmp->next;
-					if (tmp == seq->queue0[i][1]) // last one in list
-						seq->queue0[i][1] = NULL;
-
-					_fluid_seq_heap_set_free(seq->heap, tmp);
-					tmp = seq->queue0[i][0];
-				}
-			} else {
-				prev = tmp;
-				tmp = prev->next;
-			}
+	/* only walk the events of the source or dest client */
+	if (seq->unindexedEvents == 0 && (src != -1 || dest != -1)) {
+		index = _fluid_seq_get_index(seq, src != -1 ? src : dest, FALSE);
+		if (index != NULL) {
+			_fluid_seq_queue_cancel_matching(seq, src != -1 ? index->src : index->dest,
+							 src != -1, type, src, dest);
 		}
+		return;
 	}
 
-	/* queue1 */
-	for (i = 0 ; i < 255 ; i++) {
-		fluid_evt_entry* tmp = seq->queue1[i][0];
-		fluid_evt_entry* prev = NULL;
-		while (tmp) {
-			if (_fluid_seq_queue_matchevent((&tmp->evt), type, src, dest)) {
-				/* remove */
-				if (prev) {
-					prev->next = tmp->next;
-					if (tmp == seq->queue1[i][1]) // last one in list
-						seq->queue1[i][1] = prev;
-
-					_fluid_seq_heap_set_free(seq->heap, tmp);
-					tmp = prev->next;
-				} else {
-					/* first one in list */
-					seq->queue1[i][0] = tmp->next;
-					if (tmp == seq->queue1[i][1]) // last one in list
-						seq->queue1[i][1] = NULL;
-
-					_fluid_seq_heap_set_free(seq->heap, tmp);
-					tmp = seq->queue1[i][0];
-				}
-			} else {
-				prev = tmp;
-				tmp = prev->next;
-			}
-		}
-	}
+	/* we walk everything : this is slow, but that is life */
+	for (i = 0 ; i < 256 ; i++)
+		_fluid_seq_queue_remove_cell_matching(seq, seq->queue0[i], type, src, dest);
 
-	/* queueLater */
-	{
-		fluid_evt_entry* tmp = seq->queueLater;
-		fluid_evt_entry* prev = NULL;
-		while (tmp) {
-			if (_fluid_seq_queue_matchevent((&tmp->evt), type, src, dest)) {
-				/* remove */
-				if (prev) {
-					prev->next = tmp->next;
-
-					_fluid_seq_heap_set_free(seq->heap, tmp);
-					tmp = prev->next;
-				} else {
-					seq->queueLater = tmp->next;
-
-					_fluid_seq_heap_set_free(seq->heap, tmp);
-					tmp = seq->queueLater;
-				}
-			} else {
-				prev = tmp;
-				tmp = prev->next;
-			}
-		}
+	for (i = 0 ; i < 255 ; i++)
+		_fluid_seq_queue_remove_cell_matching(seq, seq->queue1[i], type, src, dest);
+
+	for (i = 0 ; i < 256 ; i++) {
+		_fluid_seq_queue_remove_cell_matching(seq, seq->queue2[i], type, src, dest);
+		_fluid_seq_queue_remove_cell_matching(seq, seq->queue3[i], type, src, dest);
 	}
 }
 
@@ -1123,7 +1470,10 @@ _fluid_seq_queue_send_cell_events(fluid_sequencer_t* seq, int cellNb)
 
 	tmp = seq->queue0[cellNb][0];
 	while (tmp) {
-		fluid_sequencer_send_now(seq, &(tmp->evt));
+		if (tmp->entryType != FLUID_EVT_ENTRY_CANCELLED) {
+			_fluid_seq_unindex_entry(seq, tmp);
+			_fluid_seq_send_queued(seq, &(tmp->evt));
+		}
 
 		next = tmp->next;
 
@@ -1134,6 +1484,102 @@ _fluid_seq_queue_send_cell_events(fluid_sequencer_t* seq, int cellNb)
 	seq->queue0[cellNb][1] = NULL;
 }
 
+/* Expand the first cell of queue2 in queue0 and queue1, refilling
+ * queue2 from queue3 first if it has been used up. */
+static void
+_fluid_seq_queue_cascade(fluid_sequencer_t* seq)
+{
+	short i;
+	fluid_evt_entry* next;
+	fluid_evt_entry* tmp;
+
+	if (seq->queue2StartTime == seq->queue3StartTime) {
+		tmp = seq->queue3[0][0];
+
+		for (i = 1 ; i < 256 ; i++) {
+			seq->queue3[i-1][0] = seq->queue3[i][0];
+			seq->queue3[i-1][1] = seq->queue3[i][1];
+		}
+		seq->queue3[255][0] = NULL;
+		seq->queue3[255][1] = NULL;
+		seq->queue3StartTime += 16777216;
+
+		while (tmp) {
+			next = tmp->next;
+			if (tmp->entryType == FLUID_EVT_ENTRY_CANCELLED) {
+				_fluid_seq_heap_set_free(seq->heap, tmp);
+			} else {
+				_fluid_seq_queue_insert_queue2(seq, tmp,
+							       (tmp->evt.time - seq->queue2StartTime) >> 16);
+			}
+			tmp = next;
+		}
+	}
+
+	tmp = seq->queue2[0][0];
+
+	for (i = 1 ; i < 256 ; i++) {
+		seq->queue2[i-1][0] = seq->queue2[i][0];
+		seq->queue2[i-1][1] = seq->queue2[i][1];
+	}
+	seq->queue2[255][0] = NULL;
+	seq->queue2[255][1] = NULL;
+	seq->queue2StartTime += 65536;
+
+	while (tmp) {
+		unsigned int delay = tmp->evt.time - seq->queue0StartTime;
+		next = tmp->next;
+		if (tmp->entryType == FLUID_EVT_ENTRY_CANCELLED) {
+			_fluid_seq_heap_set_free(seq->heap, tmp);
+		} else if (delay > 255) {
+			_fluid_seq_queue_insert_queue1(seq, tmp, delay/256 - 1);
+		} else {
+			_fluid_seq_queue_insert_queue0(seq, tmp, delay);
+		}
+		tmp = next;
+	}
+}
+
+/* Re-insert the events of queue2 and queue3 after queue0StartTime
+ * has been moved by a time scale change. */
+static void
+_fluid_seq_queue_rebase(fluid_sequencer_t* seq)
+{
+	fluid_evt_entry* first[2] = { NULL, NULL };
+	fluid_evt_entry* next;
+	fluid_evt_entry* tmp;
+	int i;
+
+	/* collect them in time order */
+	for (i = 0 ; i < 256 ; i++) {
+		for (tmp = seq->queue2[i][0]; tmp; tmp = next) {
+			next = tmp->next;
+			_fluid_seq_queue_append(first, tmp);
+		}
+	}
+	for (i = 0 ; i < 256 ; i++) {
+		for (tmp = seq->queue3[i][0]; tmp; tmp = next) {
+			next = tmp->next;
+			_fluid_seq_queue_append(first, tmp);
+		}
+	}
+	FLUID_MEMSET(seq->queue2, 0, 2*256*sizeof(fluid_evt_entry *));
+	FLUID_MEMSET(seq->queue3, 0, 2*256*sizeof(fluid_evt_entry *));
+
+	seq->queue2StartTime = seq->queue0StartTime + 65536;
+	seq->queue3StartTime = seq->queue2StartTime + 16777216;
+
+	for (tmp = first[0]; tmp; tmp = next) {
+		next = tmp->next;
+		if (tmp->entryType == FLUID_EVT_ENTRY_CANCELLED) {
+			_fluid_seq_heap_set_free(seq->heap, tmp);
+		} else {
+			_fluid_seq_unindex_entry(seq, tmp);
+			_fluid_seq_queue_insert_entry(seq, tmp);
+		}
+	}
+}
+
 static void
 _fluid_seq_queue_slide(fluid_sequencer_t* seq)
 {
@@ -1170,25 +1616,10 @@ _fluid_seq_queue_slide(fluid_sequencer_t* seq)
 	seq->queue1[254][1] = NULL;
 
 
-	/* append queueLater to queue1[254] */
-	count = 0;
-	tmp = seq->queueLater;
-	while (tmp) {
-		unsigned int delay = tmp->evt.time - seq->queue0StartTime;
-
-		if (delay > 65535) {
-			break;
-		}
-
-		next = tmp->next;
-
-		/* append it */
-		_fluid_seq_queue_insert_queue1(seq, tmp, 254);
-		tmp = next;
-		count++;
+	/* queue1 has caught up with queue2 */
+	if ((unsigned int)seq->queue0StartTime == seq->queue2StartTime) {
+		_fluid_seq_queue_cascade(seq);
 	}
-
-	seq->queueLater = tmp;
 }
 
 static void
@@ -41,6 +41,8 @@ struct _fluid_seqbind_t {
 	fluid_synth_t* synth;
 	fluid_sequencer_t* seq;
 	fluid_sample_timer_t* sample_timer;
+	unsigned int start_ticks;	/* synth tick of sequencer time 0 */
+	fluid_thread_t* synth_thread;	/* thread calling the sample timer */
 	short client_id;
 };
 typedef struct _fluid_seqbind_t fluid_seqbind_t;
@@ -91,6 +93,8 @@ fluid_sequencer_register_fluidsynth (fluid_sequencer_t* seq, fluid_synth_t* synt
 	seqbind->synth = synth;
 	seqbind->seq = seq;
 	seqbind->sample_timer = NULL;
+	seqbind->start_ticks = fluid_synth_get_ticks(synth);
+	seqbind->synth_thread = NULL;
 	seqbind->client_id = -1;
 
 	/* set up the sample timer */
@@ -115,27 +119,64 @@ fluid_sequencer_register_fluidsynth (fluid_sequencer_t* seq, fluid_synth_t* synt
 	return seqbind->client_id;
 }
 
-/* Callback for sample timer */
+/* Callback for sample timer, called before each block is rendered.
+ * Process the sequencer up to the last frame of the block: its events
+ * are started at their exact frame by fluid_seq_fluidsynth_callback(). */
 int
 fluid_seqbind_timer_callback(void* data, unsigned int msec)
 {
 	fluid_seqbind_t* seqbind = (fluid_seqbind_t *) data;
-	fluid_sequencer_process(seqbind->seq, msec);
+	unsigned int ticks = fluid_synth_get_ticks(seqbind->synth) - seqbind->start_ticks;
+
+	seqbind->synth_thread = fluid_thread_get_id();
+	fluid_sequencer_process_exact(seqbind->seq,
+		1000.0 * (ticks + FLUID_BUFSIZE - 1) / seqbind->synth->sample_rate);
 	return 1;
 }
 
+/* Synth tick at which an event delivered by the sample timer sounds:
+ * one block after its time, so that its offset within the block is kept. */
+static unsigned int
+fluid_seqbind_event_ticks(fluid_seqbind_t* seqbind, fluid_event_t* evt)
+{
+	double frames = fluid_event_get_time(evt) * seqbind->synth->sample_rate
+		/ fluid_sequencer_get_time_scale(seqbind->seq);
+
+	return seqbind->start_ticks + (unsigned int) frames + FLUID_BUFSIZE;
+}
+
+/* Start a note, at its exact frame if it was sent by the sample timer */
+static void
+fluid_seqbind_noteon(fluid_seqbind_t* seqbind, fluid_event_t* evt, int timed)
+{
+	if (timed)
+		fluid_synth_noteon_at(seqbind->synth, fluid_event_get_channel(evt),
+			fluid_event_get_key(evt), fluid_event_get_velocity(evt),
+			fluid_seqbind_event_ticks(seqbind, evt));
+	else
+		fluid_synth_noteon(seqbind->synth, fluid_event_get_channel(evt),
+			fluid_event_get_key(evt), fluid_event_get_velocity(evt));
+}
+
 /* Callback for midi events */
 void 
 fluid_seq_fluidsynth_callback(unsigned int time, fluid_event_t* evt, fluid_sequencer_t* seq, void* data)
 {
 	fluid_synth_t* synth;
 	fluid_seqbind_t* seqbind = (fluid_seqbind_t *) data;
+	int queued, timed;
 	synth = seqbind->synth;
 
+	/* events passed to fluid_sequencer_send_now() don't carry a time */
+	queued = fluid_sequencer_event_is_queued(seq, evt);
+	/* sample accurate start for events sent by the sample timer */
+	timed = queued && seqbind->sample_timer != NULL
+		&& seqbind->synth_thread == fluid_thread_get_id();
+
   switch (fluid_event_get_type(evt)) {
 
   case FLUID_SEQ_NOTEON:
-  	fluid_synth_noteon(synth, fluid_event_get_channel(evt), fluid_event_get_key(evt), fluid_event_get_velocity(evt));
+  	fluid_seqbind_noteon(seqbind, evt, timed);
   	break;
 
   case FLUID_SEQ_NOTEOFF:
@@ -145,10 +186,14 @@ fluid_seq_fluidsynth_callback(unsigned int time, fluid_event_t* evt, fluid_seque
   case FLUID_SEQ_NOTE:
 	  {
 	  	unsigned int dur;
-	  	fluid_synth_noteon(synth, fluid_event_get_channel(evt), fluid_event_get_key(evt), fluid_event_get_velocity(evt));
+	  	fluid_seqbind_noteon(seqbind, evt, timed);
 	  	dur = fluid_event_get_duration(evt);
 	  	fluid_event_noteoff(evt, fluid_event_get_channel(evt), fluid_event_get_key(evt));
-	  	fluid_sequencer_send_at(seq, evt, dur, 0);
+	  	/* relative to the note, not to the time it was processed */
+	  	if (queued)
+	  		fluid_sequencer_send_at(seq, evt, fluid_event_get_time(evt) + dur, 1);
+	  	else
+	  		fluid_sequencer_send_at(seq, evt, dur, 0);
 	  }
   	break;
 
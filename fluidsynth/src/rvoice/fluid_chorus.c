@@ -74,6 +74,12 @@
 #define MIN_SPEED_HZ	0.29
 #define MAX_SPEED_HZ    5
 
+/* The lookup table is allocated for this sample rate (or the rate the
+ * chorus is created with, if higher), so that changing the sample rate
+ * later on does not need to allocate memory. It is the highest rate
+ * accepted by synth.sample-rate. */
+#define FLUID_CHORUS_MAX_SAMPLE_RATE 96000.0f
+
 /* Length of one delay line in samples:
  * Set through MAX_SAMPLES_LN2.
  * For example:
@@ -102,6 +108,20 @@
 */
 #define INTERPOLATION_SAMPLES 5
 
+/* The input is processed in chunks of up to CHORUS_CHUNK samples. A
+ * whole chunk is written into the circular buffer before the delay
+ * lines read from it, so the buffer has room for a chunk on top of
+ * the longest delay. The first samples of the buffer are repeated
+ * after its end, the interpolation reads consecutive samples without
+ * wrapping the index. */
+#define CHORUS_CHUNK (4 * FLUID_BUFSIZE)
+#define CHORUS_BUF_SAMPLES (2 * MAX_SAMPLES)
+#define CHORUS_BUF_ANDMASK (CHORUS_BUF_SAMPLES-1)
+
+/* Offset in subsamples added to the LFO tables, a multiple of the
+ * buffer length that keeps the read positions positive */
+#define CHORUS_LFO_OFFSET (2 * CHORUS_BUF_SAMPLES * INTERPOLATION_SUBSAMPLES)
+
 /* Private data for SKEL file */
 struct _fluid_chorus_t {
   int type;
@@ -116,9 +136,14 @@ struct _fluid_chorus_t {
   long modulation_period_samples;
   int *lookup_tab;
   fluid_real_t sample_rate;
-
-  /* sinc lookup table */
-  fluid_real_t sinc_table[INTERPOLATION_SAMPLES][INTERPOLATION_SUBSAMPLES];
+  fluid_real_t max_sample_rate;	/* rate the lookup table is allocated for */
+
+  /* Interpolation: the delayed signal is the sum of interp_taps samples,
+   * starting interp_shift subsamples before the read position, weighed
+   * by the row of interp_table for the fractional part of the position. */
+  int interp_taps;
+  int interp_shift;
+  fluid_real_t interp_table[INTERPOLATION_SUBSAMPLES][INTERPOLATION_SAMPLES];
 };
 
 static void fluid_chorus_triangle(int *buf, int len, int depth);
@@ -128,7 +153,6 @@ static void fluid_chorus_sine(int *buf, int len, int depth);
 fluid_chorus_t*
 new_fluid_chorus(fluid_real_t sample_rate)
 {
-  int i; int ii;
   fluid_chorus_t* chorus;
 
   chorus = FLUID_NEW(fluid_chorus_t);
@@ -140,32 +164,13 @@ new_fluid_chorus(fluid_real_t sample_rate)
   FLUID_MEMSET(chorus, 0, sizeof(fluid_chorus_t));
 
   chorus->sample_rate = sample_rate;
+  chorus->max_sample_rate = sample_rate > FLUID_CHORUS_MAX_SAMPLE_RATE
+    ? sample_rate : FLUID_CHORUS_MAX_SAMPLE_RATE;
 
-  /* Lookup table for the SI function (impulse response of an ideal low pass) */
-
-  /* i: Offset in terms of whole samples */
-  for (i = 0; i < INTERPOLATION_SAMPLES; i++){
-
-    /* ii: Offset in terms of fractional samples ('subsamples') */
-    for (ii = 0; ii < INTERPOLATION_SUBSAMPLES; ii++){
-      /* Move the origin into the center of the table */
-      double i_shifted = ((double) i- ((double) INTERPOLATION_SAMPLES) / 2.
-			  + (double) ii / (double) INTERPOLATION_SUBSAMPLES);
-      if (fabs(i_shifted) < 0.000001) {
-	/* sinc(0) cannot be calculated straightforward (limit needed
-	   for 0/0) */
-	chorus->sinc_table[i][ii] = (fluid_real_t)1.;
-
-      } else {
-	chorus->sinc_table[i][ii] = (fluid_real_t)sin(i_shifted * M_PI) / (M_PI * i_shifted);
-	/* Hamming window */
-	chorus->sinc_table[i][ii] *= (fluid_real_t)0.5 * (1.0 + cos(2.0 * M_PI * i_shifted / (fluid_real_t)INTERPOLATION_SAMPLES));
-      };
-    };
-  };
+  fluid_chorus_set_interp(chorus, FLUID_CHORUS_INTERP_SINC);
 
-  /* allocate lookup tables */
-  chorus->lookup_tab = FLUID_ARRAY(int, (int) (chorus->sample_rate / MIN_SPEED_HZ));
+  /* allocate lookup tables, for the slowest LFO at the highest rate */
+  chorus->lookup_tab = FLUID_ARRAY(int, (int) (chorus->max_sample_rate / MIN_SPEED_HZ));
   if (chorus->lookup_tab == NULL) {
     fluid_log(FLUID_PANIC, "chorus: Out of memory");
     goto error_recovery;
@@ -173,7 +178,7 @@ new_fluid_chorus(fluid_real_t sample_rate)
 
   /* allocate sample buffer */
 
-  chorus->chorusbuf = FLUID_ARRAY(fluid_real_t, MAX_SAMPLES);
+  chorus->chorusbuf = FLUID_ARRAY(fluid_real_t, CHORUS_BUF_SAMPLES + INTERPOLATION_SAMPLES - 1);
   if (chorus->chorusbuf == NULL) {
     fluid_log(FLUID_PANIC, "chorus: Out of memory");
     goto error_recovery;
@@ -213,7 +218,7 @@ fluid_chorus_init(fluid_chorus_t* chorus)
 {
   int i;
 
-  for (i = 0; i < MAX_SAMPLES; i++) {
+  for (i = 0; i < CHORUS_BUF_SAMPLES + INTERPOLATION_SAMPLES - 1; i++) {
     chorus->chorusbuf[i] = 0.0;
   }
 
@@ -230,6 +235,122 @@ fluid_chorus_reset(fluid_chorus_t* chorus)
   fluid_chorus_init(chorus);
 }
 
+/**
+ * Adapt the chorus to a new sample rate, keeping its parameters. The
+ * lookup table is rebuilt within the memory allocated by
+ * new_fluid_chorus() and the delay line is cleared, so this is safe to
+ * call from the audio rendering thread.
+ * @param chorus Chorus instance
+ * @param sample_rate New sample rate (Hz), up to 96 kHz or the rate the
+ *   chorus was created with if higher
+ * @return #FLUID_OK, or #FLUID_FAILED if the rate is too high, in which
+ *   case the chorus keeps its current rate
+ */
+int
+fluid_chorus_samplerate_change(fluid_chorus_t* chorus, fluid_real_t sample_rate)
+{
+  int i;
+
+  if (sample_rate > chorus->max_sample_rate) {
+    FLUID_LOG(FLUID_ERR, "chorus: sample rate %.0f Hz is above the maximum of %.0f Hz",
+              (double) sample_rate, (double) chorus->max_sample_rate);
+    return FLUID_FAILED;
+  }
+
+  for (i = 0; i < CHORUS_BUF_SAMPLES + INTERPOLATION_SAMPLES - 1; i++) {
+    chorus->chorusbuf[i] = 0.0;
+  }
+
+  chorus->sample_rate = sample_rate;
+  fluid_chorus_set(chorus, 0, 0, 0.0f, 0.0f, 0.0f, 0);
+  return FLUID_OK;
+}
+
+/**
+ * Get the length of the chorus tail. The chorus has no feedback, so the
+ * output is silent once the input has left the delay line.
+ * @param chorus Chorus instance
+ * @return Tail length in samples
+ */
+int
+fluid_chorus_get_tail(fluid_chorus_t* chorus)
+{
+  return CHORUS_BUF_SAMPLES + INTERPOLATION_SAMPLES;
+}
+
+/**
+ * Select how the modulated delay lines are interpolated.
+ * @param chorus Chorus instance
+ * @param interp Interpolation method (#fluid_chorus_interp)
+ */
+void
+fluid_chorus_set_interp(fluid_chorus_t* chorus, int interp)
+{
+  int i; int ii;
+
+  if (interp != FLUID_CHORUS_INTERP_LINEAR && interp != FLUID_CHORUS_INTERP_CUBIC) {
+    interp = FLUID_CHORUS_INTERP_SINC;
+  }
+  FLUID_MEMSET(chorus->interp_table, 0, sizeof(chorus->interp_table));
+
+  if (interp == FLUID_CHORUS_INTERP_SINC) {
+    /* The sinc taps are centered 2.5 samples before the read position,
+     * the linear and cubic ones are placed to give the same delay. */
+    chorus->interp_taps = INTERPOLATION_SAMPLES;
+    chorus->interp_shift = (INTERPOLATION_SAMPLES - 1) * INTERPOLATION_SUBSAMPLES;
+
+    /* Lookup table for the SI function (impulse response of an ideal low pass) */
+
+    /* i: Offset in terms of whole samples */
+    for (i = 0; i < INTERPOLATION_SAMPLES; i++){
+
+      /* ii: Offset in terms of fractional samples ('subsamples') */
+      for (ii = 0; ii < INTERPOLATION_SUBSAMPLES; ii++){
+        /* Move the origin into the center of the table */
+        double i_shifted = ((double) i- ((double) INTERPOLATION_SAMPLES) / 2.
+                            + (double) ii / (double) INTERPOLATION_SUBSAMPLES);
+        /* The tap for offset i is sample INTERPOLATION_SAMPLES-1-i of the window */
+        fluid_real_t *tap = &chorus->interp_table[ii][INTERPOLATION_SAMPLES - 1 - i];
+
+        if (fabs(i_shifted) < 0.000001) {
+          /* sinc(0) cannot be calculated straightforward (limit needed
+             for 0/0) */
+          *tap = (fluid_real_t)1.;
+
+        } else {
+          *tap = (fluid_real_t)sin(i_shifted * M_PI) / (M_PI * i_shifted);
+          /* Hamming window */
+          *tap *= (fluid_real_t)0.5 * (1.0 + cos(2.0 * M_PI * i_shifted / (fluid_real_t)INTERPOLATION_SAMPLES));
+        };
+      };
+    };
+  } else if (interp == FLUID_CHORUS_INTERP_CUBIC) {
+    chorus->interp_taps = 4;
+    chorus->interp_shift = (INTERPOLATION_SAMPLES * INTERPOLATION_SUBSAMPLES) / 2
+      + INTERPOLATION_SUBSAMPLES;
+
+    /* Same 4-point interpolation as the voices use */
+    for (ii = 0; ii < INTERPOLATION_SUBSAMPLES; ii++) {
+      double x = (double) ii / (double) INTERPOLATION_SUBSAMPLES;
+
+      chorus->interp_table[ii][0] = (fluid_real_t)(x * (-0.5 + x * (1 - 0.5 * x)));
+      chorus->interp_table[ii][1] = (fluid_real_t)(1.0 + x * x * (1.5 * x - 2.5));
+      chorus->interp_table[ii][2] = (fluid_real_t)(x * (0.5 + x * (2.0 - 1.5 * x)));
+      chorus->interp_table[ii][3] = (fluid_real_t)(0.5 * x * x * (x - 1.0));
+    }
+  } else {
+    chorus->interp_taps = 2;
+    chorus->interp_shift = (INTERPOLATION_SAMPLES * INTERPOLATION_SUBSAMPLES) / 2;
+
+    for (ii = 0; ii < INTERPOLATION_SUBSAMPLES; ii++) {
+      double x = (double) ii / (double) INTERPOLATION_SUBSAMPLES;
+
+      chorus->interp_table[ii][0] = (fluid_real_t)(1.0 - x);
+      chorus->interp_table[ii][1] = (fluid_real_t)x;
+    }
+  }
+}
+
 /**
  * Set one or more chorus parameters.
  * @param chorus Chorus instance
@@ -327,148 +448,162 @@ fluid_chorus_set(fluid_chorus_t* chorus, int set, int nr, float level,
 }
 
 
-void fluid_chorus_processmix(fluid_chorus_t* chorus, fluid_real_t *in,
-			    fluid_real_t *left_out, fluid_real_t *right_out)
+/* Add count samples of one delay line to d_out, starting offset samples
+ * into the current chunk, with the LFO at phase. */
+static FLUID_INLINE void
+fluid_chorus_add_delay(fluid_chorus_t* chorus, fluid_real_t *d_out,
+                       int offset, int count, long phase, int taps_n)
 {
-  int sample_index;
-  int i;
-  fluid_real_t d_in, d_out;
-
-  for (sample_index = 0; sample_index < FLUID_BUFSIZE; sample_index++) {
-
-    d_in = in[sample_index];
-    d_out = 0.0f;
-
-# if 0
-    /* Debug: Listen to the chorus signal only */
-    left_out[sample_index]=0;
-    right_out[sample_index]=0;
-#endif
-
-    /* Write the current sample into the circular buffer */
-    chorus->chorusbuf[chorus->counter] = d_in;
+  const fluid_real_t* buf = chorus->chorusbuf;
+  const fluid_real_t* taps;
+  const fluid_real_t* src;
+  fluid_real_t sum;
+  int pos_subsamples, pos_samples;
+  int k, ii;
+
+  for (k = 0; k < count; k++) {
+    /* The value in the lookup table is so, that this expression
+     * will always be positive. Note: The delay in the delay line
+     * moves backwards for increasing delay! */
+    pos_subsamples = (INTERPOLATION_SUBSAMPLES * (chorus->counter + offset + k)
+                      - chorus->lookup_tab[phase + k] - chorus->interp_shift);
+    pos_samples = (pos_subsamples / INTERPOLATION_SUBSAMPLES) & CHORUS_BUF_ANDMASK;
+    taps = chorus->interp_table[pos_subsamples & INTERPOLATION_SUBSAMPLES_ANDMASK];
+
+    /* Sum the taps in pairs rather than in one chain of additions */
+    src = buf + pos_samples;
+    sum = src[0] * taps[0] + src[1] * taps[1];
+    for (ii = 2; ii + 1 < taps_n; ii += 2) {
+      sum += src[ii] * taps[ii] + src[ii + 1] * taps[ii + 1];
+    }
+    if (ii < taps_n) {
+      sum += src[ii] * taps[ii];
+    }
+    d_out[k] += sum;
+  }
+}
 
+static void
+fluid_chorus_process(fluid_chorus_t* chorus, fluid_real_t *in,
+                     fluid_real_t *left_out, fluid_real_t *right_out,
+                     int count, int mix)
+{
+  fluid_real_t d_out[CHORUS_CHUNK];
+  fluid_real_t* buf = chorus->chorusbuf;
+  fluid_real_t sum;
+  long period = chorus->modulation_period_samples;
+  long phase;
+  int counter;
+  int i, k, n, seg;
+
+  while (count > 0) {
+    n = (count < CHORUS_CHUNK) ? count : CHORUS_CHUNK;
+
+    /* Write the chunk into the circular buffer */
+    counter = chorus->counter;
+    for (k = 0; k < n; k++) {
+      buf[counter] = in[k];
+      if (counter < INTERPOLATION_SAMPLES - 1) {
+        buf[counter + CHORUS_BUF_SAMPLES] = in[k];
+      }
+      counter = (counter + 1) & CHORUS_BUF_ANDMASK;
+    }
+
+    for (k = 0; k < n; k++) {
+      d_out[k] = 0.0f;
+    }
+
+    /* Add the delay lines one after the other, over the whole chunk:
+     * the outputs of the chunk's samples don't depend on each other, so
+     * the processor can work on several of them at once. */
     for (i = 0; i < chorus->number_blocks; i++) {
-      int ii;
-      /* Calculate the delay in subsamples for the delay line of chorus block nr. */
-
-      /* The value in the lookup table is so, that this expression
-       * will always be positive.  It will always include a number of
-       * full periods of MAX_SAMPLES*INTERPOLATION_SUBSAMPLES to
-       * remain positive at all times. */
-      int pos_subsamples = (INTERPOLATION_SUBSAMPLES * chorus->counter
-			    - chorus->lookup_tab[chorus->phase[i]]);
-
-      int pos_samples = pos_subsamples/INTERPOLATION_SUBSAMPLES;
-
-      /* modulo divide by INTERPOLATION_SUBSAMPLES */
-      pos_subsamples &= INTERPOLATION_SUBSAMPLES_ANDMASK;
-
-      for (ii = 0; ii < INTERPOLATION_SAMPLES; ii++){
-	/* Add the delayed signal to the chorus sum d_out Note: The
-	 * delay in the delay line moves backwards for increasing
-	 * delay!*/
-
-	/* The & in chorusbuf[...] is equivalent to a division modulo
-	   MAX_SAMPLES, only faster. */
-	d_out += chorus->chorusbuf[pos_samples & MAX_SAMPLES_ANDMASK]
-	  * chorus->sinc_table[ii][pos_subsamples];
-
-	pos_samples--;
-      };
-      /* Cycle the phase of the modulating LFO */
-      chorus->phase[i]++;
-      chorus->phase[i] %= (chorus->modulation_period_samples);
+      phase = chorus->phase[i];
+
+      for (k = 0; k < n; ) {
+        /* Run up to the end of the LFO period at most */
+        seg = n - k;
+        if (period - phase < seg) {
+          seg = (int) (period - phase);
+        }
+
+        /* A constant number of taps lets the compiler unroll the sums */
+        if (chorus->interp_taps == 2) {
+          fluid_chorus_add_delay(chorus, &d_out[k], k, seg, phase, 2);
+        } else if (chorus->interp_taps == 4) {
+          fluid_chorus_add_delay(chorus, &d_out[k], k, seg, phase, 4);
+        } else {
+          fluid_chorus_add_delay(chorus, &d_out[k], k, seg, phase, INTERPOLATION_SAMPLES);
+        }
+        k += seg;
+        phase += seg;
+
+        /* Cycle the phase of the modulating LFO */
+        if (phase >= period) {
+          phase = 0;
+        }
+      }
+      chorus->phase[i] = phase;
     } /* foreach chorus block */
 
-    d_out *= chorus->level;
-
-    /* Add the chorus sum d_out to output */
-    left_out[sample_index] += d_out;
-    right_out[sample_index] += d_out;
-
-    /* Move forward in circular buffer */
-    chorus->counter++;
-    chorus->counter %= MAX_SAMPLES;
+    if (mix) {
+      for (k = 0; k < n; k++) {
+        sum = d_out[k] * chorus->level;
+        left_out[k] += sum;
+        right_out[k] += sum;
+      }
+    } else {
+      for (k = 0; k < n; k++) {
+        sum = d_out[k] * chorus->level;
+        left_out[k] = sum;
+        right_out[k] = sum;
+      }
+    }
+
+    chorus->counter = counter;
+    in += n;
+    left_out += n;
+    right_out += n;
+    count -= n;
+  }
+}
 
-  } /* foreach sample */
+/**
+ * Process chorus, mixing it into the output.
+ * @param chorus Chorus instance
+ * @param in Mono input
+ * @param left_out Left output
+ * @param right_out Right output
+ * @param count Number of samples
+ */
+void fluid_chorus_processmix(fluid_chorus_t* chorus, fluid_real_t *in,
+			    fluid_real_t *left_out, fluid_real_t *right_out,
+			    int count)
+{
+  fluid_chorus_process(chorus, in, left_out, right_out, count, TRUE);
 }
 
-/* Duplication of code ... (replaces sample data instead of mixing) */
+/**
+ * Process chorus, replacing the output.
+ * @param chorus Chorus instance
+ * @param in Mono input, may be the same buffer as left_out
+ * @param left_out Left output
+ * @param right_out Right output
+ * @param count Number of samples
+ */
 void fluid_chorus_processreplace(fluid_chorus_t* chorus, fluid_real_t *in,
-				fluid_real_t *left_out, fluid_real_t *right_out)
+				fluid_real_t *left_out, fluid_real_t *right_out,
+				int count)
 {
-  int sample_index;
-  int i;
-  fluid_real_t d_in, d_out;
-
-  for (sample_index = 0; sample_index < FLUID_BUFSIZE; sample_index++) {
-
-    d_in = in[sample_index];
-    d_out = 0.0f;
-
-# if 0
-    /* Debug: Listen to the chorus signal only */
-    left_out[sample_index]=0;
-    right_out[sample_index]=0;
-#endif
-
-    /* Write the current sample into the circular buffer */
-    chorus->chorusbuf[chorus->counter] = d_in;
-
-    for (i = 0; i < chorus->number_blocks; i++) {
-      int ii;
-      /* Calculate the delay in subsamples for the delay line of chorus block nr. */
-
-      /* The value in the lookup table is so, that this expression
-       * will always be positive.  It will always include a number of
-       * full periods of MAX_SAMPLES*INTERPOLATION_SUBSAMPLES to
-       * remain positive at all times. */
-      int pos_subsamples = (INTERPOLATION_SUBSAMPLES * chorus->counter
-			    - chorus->lookup_tab[chorus->phase[i]]);
-
-      int pos_samples = pos_subsamples / INTERPOLATION_SUBSAMPLES;
-
-      /* modulo divide by INTERPOLATION_SUBSAMPLES */
-      pos_subsamples &= INTERPOLATION_SUBSAMPLES_ANDMASK;
-
-      for (ii = 0; ii < INTERPOLATION_SAMPLES; ii++){
-	/* Add the delayed signal to the chorus sum d_out Note: The
-	 * delay in the delay line moves backwards for increasing
-	 * delay!*/
-
-	/* The & in chorusbuf[...] is equivalent to a division modulo
-	   MAX_SAMPLES, only faster. */
-	d_out += chorus->chorusbuf[pos_samples & MAX_SAMPLES_ANDMASK]
-	  * chorus->sinc_table[ii][pos_subsamples];
-
-	pos_samples--;
-      };
-      /* Cycle the phase of the modulating LFO */
-      chorus->phase[i]++;
-      chorus->phase[i] %= (chorus->modulation_period_samples);
-    } /* foreach chorus block */
-
-    d_out *= chorus->level;
-
-    /* Store the chorus sum d_out to output */
-    left_out[sample_index] = d_out;
-    right_out[sample_index] = d_out;
-
-    /* Move forward in circular buffer */
-    chorus->counter++;
-    chorus->counter %= MAX_SAMPLES;
-
-  } /* foreach sample */
+  fluid_chorus_process(chorus, in, left_out, right_out, count, FALSE);
 }
 
 /* Purpose:
  *
  * Calculates a modulation waveform (sine) Its value ( modulo
- * MAXSAMPLES) varies between 0 and depth*INTERPOLATION_SUBSAMPLES.
+ * CHORUS_BUF_SAMPLES) varies between 0 and depth*INTERPOLATION_SUBSAMPLES.
  * Its period length is len.  The waveform data will be used modulo
- * MAXSAMPLES only.  Since MAXSAMPLES is substracted from the waveform
- * a couple of times here, the resulting (current position in
+ * CHORUS_BUF_SAMPLES only.  Since CHORUS_BUF_SAMPLES is substracted from
+ * the waveform a couple of times here, the resulting (current position in
  * buffer)-(waveform sample) will always be positive.
  */
 static void
@@ -480,7 +615,7 @@ fluid_chorus_sine(int *buf, int len, int depth)
   for (i = 0; i < len; i++) {
     val = sin((double) i / (double)len * 2.0 * M_PI);
     buf[i] = (int) ((1.0 + val) * (double) depth / 2.0 * (double) INTERPOLATION_SUBSAMPLES);
-    buf[i] -= 3* MAX_SAMPLES * INTERPOLATION_SUBSAMPLES;
+    buf[i] -= CHORUS_LFO_OFFSET;
     //    printf("%i %i\n",i,buf[i]);
   }
 }
@@ -499,7 +634,7 @@ fluid_chorus_triangle(int *buf, int len, int depth)
 
   while (i <= ii){
     val = i * 2.0 / len * (double)depth * (double) INTERPOLATION_SUBSAMPLES;
-    val2= (int) (val + 0.5) - 3 * MAX_SAMPLES * INTERPOLATION_SUBSAMPLES;
+    val2= (int) (val + 0.5) - CHORUS_LFO_OFFSET;
     buf[i++] = (int) val2;
     buf[ii--] = (int) val2;
   }
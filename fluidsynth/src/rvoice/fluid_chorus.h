@@ -40,6 +40,14 @@ typedef enum
 /** Value for fluid_chorus_set() which sets all chorus parameters. */
 #define FLUID_CHORUS_SET_ALL    0x1F
 
+/** Interpolation methods for fluid_chorus_set_interp() */
+enum fluid_chorus_interp
+{
+  FLUID_CHORUS_INTERP_SINC,     /**< 5 point windowed sinc (default) */
+  FLUID_CHORUS_INTERP_CUBIC,    /**< 4 point cubic */
+  FLUID_CHORUS_INTERP_LINEAR    /**< Linear */
+};
+
 /*
  * chorus
  */
@@ -47,14 +55,19 @@ fluid_chorus_t* new_fluid_chorus(fluid_real_t sample_rate);
 void delete_fluid_chorus(fluid_chorus_t* chorus);
 int fluid_chorus_init(fluid_chorus_t* chorus);
 void fluid_chorus_reset(fluid_chorus_t* chorus);
+int fluid_chorus_samplerate_change(fluid_chorus_t* chorus, fluid_real_t sample_rate);
 
 void fluid_chorus_set(fluid_chorus_t* chorus, int set, int nr, float level,
                       float speed, float depth_ms, int type);
+void fluid_chorus_set_interp(fluid_chorus_t* chorus, int interp);
+int fluid_chorus_get_tail(fluid_chorus_t* chorus);
 
 void fluid_chorus_processmix(fluid_chorus_t* chorus, fluid_real_t *in,
-			    fluid_real_t *left_out, fluid_real_t *right_out);
+			    fluid_real_t *left_out, fluid_real_t *right_out,
+			    int count);
 void fluid_chorus_processreplace(fluid_chorus_t* chorus, fluid_real_t *in,
-				fluid_real_t *left_out, fluid_real_t *right_out);
+				fluid_real_t *left_out, fluid_real_t *right_out,
+				int count);
 
 
 
@@ -0,0 +1,1069 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+/*
+ * Convolution reverb
+ *
+ * The impulse response is cut into partitions of FLUID_CONVREVERB_BLOCK
+ * samples, each transformed once into the frequency domain. The input
+ * is processed with uniformly partitioned overlap-save: every block the
+ * last two input blocks are transformed, pushed into a frequency domain
+ * delay line and multiplied with all IR partitions. The left and right
+ * channel results are packed into a single complex spectrum, so one
+ * inverse transform yields both outputs.
+ *
+ * The transforms of a block run on a worker thread while the next block
+ * is collected, which gives the reverb a fixed latency of two blocks.
+ * The result does not depend on the scheduling of the worker. A worker
+ * may serve several reverbs, so the effects groups share a few threads.
+ */
+
+#include "fluid_convreverb.h"
+#include "fluid_rev.h"
+#include "fluid_sys.h"
+
+/* Partition size in samples, FFT size and number of distinct bins */
+#define FLUID_CONVREVERB_BLOCK  512
+#define FLUID_CONVREVERB_FFT    (2 * FLUID_CONVREVERB_BLOCK)
+#define FLUID_CONVREVERB_BINS   (FLUID_CONVREVERB_FFT / 2 + 1)
+
+/* Longest impulse response used, in seconds */
+#define FLUID_CONVREVERB_MAX_SECONDS  30
+
+/* Highest sample rate of an impulse response file, which also keeps
+ * FLUID_CONVREVERB_MAX_SECONDS of frames well inside an int */
+#define FLUID_CONVREVERB_MAX_RATE  768000
+
+/* Samples below this level (relative to the peak) are cut off the end
+ * of the impulse response: -120 dB */
+#define FLUID_CONVREVERB_FLOOR  1e-6
+
+/* The impulse response is normalized to unit energy and then scaled by
+ * this gain, which puts a full level convolution reverb roughly at the
+ * loudness of the built-in reverb at its default settings. */
+#define FLUID_CONVREVERB_GAIN   0.2
+
+enum fluid_convreverb_job
+{
+  FLUID_CONVREVERB_JOB_NONE,
+  FLUID_CONVREVERB_JOB_PENDING
+};
+
+struct _fluid_convreverb_ir_t
+{
+  fluid_real_t* data[2];        /**< Impulse response as loaded, per channel */
+  int length;                   /**< Length of data in samples */
+  fluid_real_t file_rate;       /**< Sample rate of data */
+
+  fluid_real_t sample_rate;     /**< Sample rate the spectra are built for */
+  int partitions;               /**< Number of partitions */
+  fluid_real_t* spectrum[2];    /**< partitions * BINS complex values per channel */
+
+  double twiddle[FLUID_CONVREVERB_FFT];     /**< cos/sin pairs of the FFT */
+  int bitrev[FLUID_CONVREVERB_FFT];         /**< Bit reversal permutation */
+
+  fluid_convreverb_ir_t* retired_next;      /**< Next entry of a retired list */
+};
+
+struct _fluid_convreverb_worker_t
+{
+  fluid_thread_t* thread;
+  fluid_cond_mutex_t* mutex;
+  fluid_cond_t* cond;           /**< Signals new jobs, finished jobs and quit */
+  fluid_convreverb_t* revs;     /**< Reverbs served by this worker */
+  int quit;
+};
+
+struct _fluid_convreverb_t
+{
+  fluid_convreverb_ir_t* ir;
+  int partitions;
+  fluid_real_t* fdl;            /**< Frequency domain delay line, partitions * BINS complex */
+  int fdl_pos;                  /**< Newest entry of fdl */
+
+  /* Audio thread side */
+  fluid_real_t input[FLUID_CONVREVERB_FFT];     /**< Previous and current input block */
+  int pos;                                      /**< Position within the current block */
+  fluid_real_t* out[2];                         /**< Output being played */
+
+  /* Worker side, owned by the worker while a job is pending */
+  fluid_real_t job_in[FLUID_CONVREVERB_FFT];
+  fluid_real_t* job_out[2];
+  double work[2 * FLUID_CONVREVERB_FFT];
+  double acc[2][2 * FLUID_CONVREVERB_BINS];
+
+  fluid_real_t outbuf[4][FLUID_CONVREVERB_BLOCK];
+
+  fluid_real_t wet, wet1, wet2, width;
+
+  fluid_convreverb_worker_t* worker;    /**< NULL runs the transforms inline */
+  fluid_convreverb_t* worker_next;      /**< Next reverb of the same worker */
+  int job;                              /**< Protected by the worker mutex */
+};
+
+
+/*
+ * FFT
+ */
+
+static void
+fluid_convreverb_fft_init(fluid_convreverb_ir_t* ir)
+{
+  int i, j, bits = 0;
+
+  while ((1 << bits) < FLUID_CONVREVERB_FFT)
+    bits++;
+
+  for (i = 0; i < FLUID_CONVREVERB_FFT; i++) {
+    int r = 0;
+    for (j = 0; j < bits; j++)
+      if (i & (1 << j))
+        r |= 1 << (bits - 1 - j);
+    ir->bitrev[i] = r;
+  }
+
+  for (i = 0; i < FLUID_CONVREVERB_FFT / 2; i++) {
+    ir->twiddle[2*i] = cos(2.0 * M_PI * i / FLUID_CONVREVERB_FFT);
+    ir->twiddle[2*i+1] = sin(2.0 * M_PI * i / FLUID_CONVREVERB_FFT);
+  }
+}
+
+/* In-place radix-2 FFT of interleaved complex data. sign is -1 for the
+ * forward and +1 for the (unscaled) inverse transform. */
+static void
+fluid_convreverb_fft(fluid_convreverb_ir_t* ir, double* x, int sign)
+{
+  const int n = FLUID_CONVREVERB_FFT;
+  int i, j, len, k;
+
+  for (i = 0; i < n; i++) {
+    j = ir->bitrev[i];
+    if (j > i) {
+      double t;
+      t = x[2*i]; x[2*i] = x[2*j]; x[2*j] = t;
+      t = x[2*i+1]; x[2*i+1] = x[2*j+1]; x[2*j+1] = t;
+    }
+  }
+
+  for (len = 2; len <= n; len <<= 1) {
+    int half = len >> 1;
+    int step = n / len;
+    for (i = 0; i < n; i += len) {
+      for (k = 0; k < half; k++) {
+        double wr = ir->twiddle[2*k*step];
+        double wi = sign * ir->twiddle[2*k*step+1];
+        double* a = &x[2*(i+k)];
+        double* b = &x[2*(i+k+half)];
+        double tr = b[0] * wr - b[1] * wi;
+        double ti = b[0] * wi + b[1] * wr;
+        b[0] = a[0] - tr;
+        b[1] = a[1] - ti;
+        a[0] += tr;
+        a[1] += ti;
+      }
+    }
+  }
+}
+
+
+/*
+ * Impulse response
+ */
+
+static unsigned int
+fluid_convreverb_le(const unsigned char* p, int bytes)
+{
+  unsigned int v = 0;
+  int i;
+
+  for (i = bytes - 1; i >= 0; i--)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+/* Decode one sample of a WAVE data chunk into the range -1..1 */
+static double
+fluid_convreverb_wav_sample(const unsigned char* p, int is_float, int bits)
+{
+  unsigned int v;
+
+  if (is_float) {
+    if (bits == 32) {
+      union { unsigned int i; float f; } u;
+      u.i = fluid_convreverb_le(p, 4);
+      return u.f;
+    }
+    else {
+      union { unsigned long long i; double d; } u;
+      u.i = ((unsigned long long) fluid_convreverb_le(p + 4, 4) << 32)
+        | fluid_convreverb_le(p, 4);
+      return u.d;
+    }
+  }
+
+  switch (bits) {
+  case 8:
+    return (p[0] - 128) / 128.0;
+  case 16:
+    v = fluid_convreverb_le(p, 2);
+    return (short) v / 32768.0;
+  case 24:
+    v = fluid_convreverb_le(p, 3) << 8;
+    return (int) v / 2147483648.0;
+  default:
+    v = fluid_convreverb_le(p, 4);
+    return (int) v / 2147483648.0;
+  }
+}
+
+/* Load a RIFF WAVE file into ir->data, the first two channels are used,
+ * a mono file feeds both channels. */
+static int
+fluid_convreverb_ir_load(fluid_convreverb_ir_t* ir, const char* filename)
+{
+  FILE* file;
+  unsigned char hdr[12], fmt[40];
+  unsigned char* data = NULL;
+  unsigned int size;
+  int have_fmt = FALSE, tag = 0, channels = 0, rate = 0, align = 0, bits = 0;
+  unsigned int maxframes;
+  int is_float, frames, i, c;
+
+  file = FLUID_FOPEN(filename, "rb");
+  if (file == NULL) {
+    FLUID_LOG(FLUID_ERR, "Unable to open impulse response file '%s'", filename);
+    return FLUID_FAILED;
+  }
+
+  if (FLUID_FREAD(hdr, 1, 12, file) != 12
+      || FLUID_MEMCMP(hdr, "RIFF", 4) != 0
+      || FLUID_MEMCMP(hdr + 8, "WAVE", 4) != 0) {
+    FLUID_LOG(FLUID_ERR, "Impulse response '%s' is not a WAVE file", filename);
+    goto error_recovery;
+  }
+
+  /* walk the chunks until the data chunk */
+  for (;;) {
+    if (FLUID_FREAD(hdr, 1, 8, file) != 8) {
+      FLUID_LOG(FLUID_ERR, "Impulse response '%s' has no audio data", filename);
+      goto error_recovery;
+    }
+    size = fluid_convreverb_le(hdr + 4, 4);
+
+    if (FLUID_MEMCMP(hdr, "fmt ", 4) == 0 && size >= 16) {
+      int n = size < sizeof(fmt) ? size : sizeof(fmt);
+      if (FLUID_FREAD(fmt, 1, n, file) != (size_t) n)
+        goto read_error;
+      tag = fluid_convreverb_le(fmt, 2);
+      channels = fluid_convreverb_le(fmt + 2, 2);
+      rate = fluid_convreverb_le(fmt + 4, 4);
+      align = fluid_convreverb_le(fmt + 12, 2);
+      bits = fluid_convreverb_le(fmt + 14, 2);
+      /* WAVE_FORMAT_EXTENSIBLE: the format tag starts the sub format GUID */
+      if (tag == 0xFFFE && n >= 26)
+        tag = fluid_convreverb_le(fmt + 24, 2);
+      have_fmt = TRUE;
+      size -= n;
+    }
+    else if (FLUID_MEMCMP(hdr, "data", 4) == 0) {
+      break;
+    }
+
+    /* skip the rest of the chunk, chunks are padded to even sizes */
+    if (FLUID_FSEEK(file, size + (size & 1), SEEK_CUR) != 0)
+      goto read_error;
+  }
+
+  is_float = (tag == 3);
+  if (!have_fmt || channels < 1 || rate <= 0 || rate > FLUID_CONVREVERB_MAX_RATE
+      || !((tag == 1 && (bits == 8 || bits == 16 || bits == 24 || bits == 32))
+           || (is_float && (bits == 32 || bits == 64)))
+      || align < channels * bits / 8) {
+    FLUID_LOG(FLUID_ERR, "Impulse response '%s' has an unsupported sample format",
+              filename);
+    goto error_recovery;
+  }
+
+  maxframes = FLUID_CONVREVERB_MAX_SECONDS * (unsigned int) rate;
+  if (size / align > maxframes) {
+    FLUID_LOG(FLUID_WARN, "Impulse response '%s' is longer than %d seconds, "
+              "truncating it", filename, FLUID_CONVREVERB_MAX_SECONDS);
+    frames = (int) maxframes;
+  }
+  else
+    frames = (int)(size / align);
+  if (frames == 0) {
+    FLUID_LOG(FLUID_ERR, "Impulse response '%s' is empty", filename);
+    goto error_recovery;
+  }
+
+  if ((size_t) frames > ((size_t) -1) / align) {
+    FLUID_LOG(FLUID_ERR, "Impulse response '%s' is too big", filename);
+    goto error_recovery;
+  }
+  data = FLUID_MALLOC((size_t) frames * align);
+  ir->data[0] = FLUID_ARRAY(fluid_real_t, frames);
+  ir->data[1] = FLUID_ARRAY(fluid_real_t, frames);
+  if (data == NULL || ir->data[0] == NULL || ir->data[1] == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    goto error_recovery;
+  }
+
+  frames = FLUID_FREAD(data, align, frames, file);
+  if (frames == 0)
+    goto read_error;
+
+  for (i = 0; i < frames; i++) {
+    for (c = 0; c < 2; c++) {
+      int ch = c < channels ? c : 0;
+      ir->data[c][i] = (fluid_real_t)
+        fluid_convreverb_wav_sample(data + i * align + ch * bits / 8, is_float, bits);
+    }
+  }
+
+  ir->length = frames;
+  ir->file_rate = (fluid_real_t) rate;
+  FLUID_FREE(data);
+  FLUID_FCLOSE(file);
+  return FLUID_OK;
+
+read_error:
+  FLUID_LOG(FLUID_ERR, "Error reading impulse response '%s'", filename);
+error_recovery:
+  if (data)
+    FLUID_FREE(data);
+  FLUID_FCLOSE(file);
+  return FLUID_FAILED;
+}
+
+/* Cut off the end of the impulse response below FLUID_CONVREVERB_FLOOR */
+static void
+fluid_convreverb_ir_trim(fluid_convreverb_ir_t* ir)
+{
+  fluid_real_t peak = 0.0f, floor;
+  int i, c, length = 1;
+
+  for (c = 0; c < 2; c++)
+    for (i = 0; i < ir->length; i++)
+      if (fabs(ir->data[c][i]) > peak)
+        peak = fabs(ir->data[c][i]);
+
+  floor = peak * FLUID_CONVREVERB_FLOOR;
+  for (c = 0; c < 2; c++)
+    for (i = ir->length - 1; i >= length; i--)
+      if (fabs(ir->data[c][i]) > floor) {
+        length = i + 1;
+        break;
+      }
+
+  ir->length = length;
+}
+
+static int fluid_convreverb_ir_build(fluid_convreverb_ir_t* ir,
+                                     fluid_real_t sample_rate);
+
+/**
+ * Load an impulse response for the convolution reverb.
+ * @param filename WAVE file with a mono or stereo impulse response
+ * @param sample_rate Sample rate the impulse response is used at
+ * @return New impulse response, NULL on error
+ */
+fluid_convreverb_ir_t*
+new_fluid_convreverb_ir(const char* filename, fluid_real_t sample_rate)
+{
+  fluid_convreverb_ir_t* ir;
+
+  ir = FLUID_NEW(fluid_convreverb_ir_t);
+  if (ir == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(ir, 0, sizeof(fluid_convreverb_ir_t));
+  fluid_convreverb_fft_init(ir);
+
+  if (fluid_convreverb_ir_load(ir, filename) != FLUID_OK)
+    goto error_recovery;
+  fluid_convreverb_ir_trim(ir);
+
+  if (fluid_convreverb_ir_build(ir, sample_rate) != FLUID_OK)
+    goto error_recovery;
+
+  return ir;
+
+error_recovery:
+  delete_fluid_convreverb_ir(ir);
+  return NULL;
+}
+
+/**
+ * Create a copy of an impulse response for another sample rate. Only
+ * reads the loaded data of the source, so it can run while a convolution
+ * reverb uses the source.
+ * @param src Impulse response
+ * @param sample_rate Sample rate the copy is used at
+ * @return New impulse response, NULL on error
+ */
+fluid_convreverb_ir_t*
+new_fluid_convreverb_ir_resampled(const fluid_convreverb_ir_t* src,
+                                  fluid_real_t sample_rate)
+{
+  fluid_convreverb_ir_t* ir;
+  int c;
+
+  ir = FLUID_NEW(fluid_convreverb_ir_t);
+  if (ir == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(ir, 0, sizeof(fluid_convreverb_ir_t));
+  fluid_convreverb_fft_init(ir);
+
+  for (c = 0; c < 2; c++) {
+    ir->data[c] = FLUID_ARRAY(fluid_real_t, src->length);
+    if (ir->data[c] == NULL) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      goto error_recovery;
+    }
+    FLUID_MEMCPY(ir->data[c], src->data[c], src->length * sizeof(fluid_real_t));
+  }
+  ir->length = src->length;
+  ir->file_rate = src->file_rate;
+
+  if (fluid_convreverb_ir_build(ir, sample_rate) != FLUID_OK)
+    goto error_recovery;
+
+  return ir;
+
+error_recovery:
+  delete_fluid_convreverb_ir(ir);
+  return NULL;
+}
+
+/**
+ * Free an impulse response. No convolution reverb may use it anymore.
+ * @param ir Impulse response
+ */
+void
+delete_fluid_convreverb_ir(fluid_convreverb_ir_t* ir)
+{
+  int c;
+
+  if (ir == NULL)
+    return;
+
+  for (c = 0; c < 2; c++) {
+    if (ir->data[c])
+      FLUID_FREE(ir->data[c]);
+    if (ir->spectrum[c])
+      FLUID_FREE(ir->spectrum[c]);
+  }
+  FLUID_FREE(ir);
+}
+
+/**
+ * Get the sample rate an impulse response is prepared for.
+ * @param ir Impulse response
+ * @return Sample rate in Hz
+ */
+fluid_real_t
+fluid_convreverb_ir_get_sample_rate(const fluid_convreverb_ir_t* ir)
+{
+  return ir->sample_rate;
+}
+
+/**
+ * Put an impulse response on a retired list, to be freed later by
+ * fluid_convreverb_ir_free_retired(). Lock-free, so the audio thread can
+ * hand a replaced impulse response back without freeing it. Only one
+ * thread may retire on the same list.
+ * @param list Retired list
+ * @param ir Impulse response no convolution reverb uses anymore
+ */
+void
+fluid_convreverb_ir_retire(fluid_convreverb_ir_t** list, fluid_convreverb_ir_t* ir)
+{
+  fluid_convreverb_ir_t* head;
+
+  do {
+    head = fluid_atomic_pointer_get(list);
+    ir->retired_next = head;
+  } while (!fluid_atomic_pointer_compare_and_exchange((void**) list, head, ir));
+}
+
+/**
+ * Free all impulse responses of a retired list.
+ * @param list Retired list
+ */
+void
+fluid_convreverb_ir_free_retired(fluid_convreverb_ir_t** list)
+{
+  fluid_convreverb_ir_t* ir;
+  fluid_convreverb_ir_t* next;
+
+  do {
+    ir = fluid_atomic_pointer_get(list);
+  } while (!fluid_atomic_pointer_compare_and_exchange((void**) list, ir, NULL));
+
+  for (; ir != NULL; ir = next) {
+    next = ir->retired_next;
+    delete_fluid_convreverb_ir(ir);
+  }
+}
+
+/* Resample the loaded data to sample_rate and build the spectra of the
+ * partitions. On failure the impulse response keeps its previous spectra. */
+static int
+fluid_convreverb_ir_build(fluid_convreverb_ir_t* ir, fluid_real_t sample_rate)
+{
+  fluid_real_t* resampled[2] = { NULL, NULL };
+  fluid_real_t* spectrum[2] = { NULL, NULL };
+  double ratio, len, energy[2] = { 0.0, 0.0 }, scale;
+  double work[2 * FLUID_CONVREVERB_FFT];
+  int length, partitions, c, i, p;
+
+  if (ir->spectrum[0] && sample_rate == ir->sample_rate)
+    return FLUID_OK;
+
+  /* Linear interpolation is enough here: the resampled response is only
+   * heard as reverb, never directly. */
+  ratio = (double) ir->file_rate / sample_rate;
+  len = ceil(ir->length / ratio);
+  length = (int) len;
+  if (length < 1)
+    length = 1;
+  partitions = (length + FLUID_CONVREVERB_BLOCK - 1) / FLUID_CONVREVERB_BLOCK;
+
+  for (c = 0; c < 2; c++) {
+    resampled[c] = FLUID_ARRAY(fluid_real_t, partitions * FLUID_CONVREVERB_BLOCK);
+    spectrum[c] = FLUID_ARRAY(fluid_real_t, partitions * 2 * FLUID_CONVREVERB_BINS);
+    if (resampled[c] == NULL || spectrum[c] == NULL) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      goto error_recovery;
+    }
+    FLUID_MEMSET(resampled[c], 0,
+                 partitions * FLUID_CONVREVERB_BLOCK * sizeof(fluid_real_t));
+
+    for (i = 0; i < length; i++) {
+      double pos = i * ratio;
+      int j = (int) pos;
+      double frac = pos - j;
+      double a = j < ir->length ? ir->data[c][j] : 0.0;
+      double b = j + 1 < ir->length ? ir->data[c][j + 1] : 0.0;
+      resampled[c][i] = (fluid_real_t)(a + frac * (b - a));
+      energy[c] += resampled[c][i] * resampled[c][i];
+    }
+  }
+
+  /* normalize the louder channel to unit energy, fold in the gain and
+   * the 1/N of the inverse transform */
+  scale = energy[0] > energy[1] ? energy[0] : energy[1];
+  scale = scale > 0.0 ? FLUID_CONVREVERB_GAIN / sqrt(scale) : 0.0;
+  scale /= FLUID_CONVREVERB_FFT;
+
+  for (c = 0; c < 2; c++) {
+    for (p = 0; p < partitions; p++) {
+      fluid_real_t* src = &resampled[c][p * FLUID_CONVREVERB_BLOCK];
+      fluid_real_t* dst = &spectrum[c][p * 2 * FLUID_CONVREVERB_BINS];
+
+      FLUID_MEMSET(work, 0, sizeof(work));
+      for (i = 0; i < FLUID_CONVREVERB_BLOCK; i++)
+        work[2*i] = src[i] * scale;
+      fluid_convreverb_fft(ir, work, -1);
+      for (i = 0; i < 2 * FLUID_CONVREVERB_BINS; i++)
+        dst[i] = (fluid_real_t) work[i];
+    }
+    FLUID_FREE(resampled[c]);
+    resampled[c] = NULL;
+  }
+
+  for (c = 0; c < 2; c++) {
+    if (ir->spectrum[c])
+      FLUID_FREE(ir->spectrum[c]);
+    ir->spectrum[c] = spectrum[c];
+  }
+  ir->partitions = partitions;
+  ir->sample_rate = sample_rate;
+  return FLUID_OK;
+
+error_recovery:
+  for (c = 0; c < 2; c++) {
+    if (resampled[c])
+      FLUID_FREE(resampled[c]);
+    if (spectrum[c])
+      FLUID_FREE(spectrum[c]);
+  }
+  return FLUID_FAILED;
+}
+
+
+/*
+ * Convolution reverb
+ */
+
+/* Convolve the two input blocks in job_in with the impulse response and
+ * write one block of left and right output to job_out. */
+static void
+fluid_convreverb_run_job(fluid_convreverb_t* rev)
+{
+  fluid_convreverb_ir_t* ir = rev->ir;
+  double* x = rev->work;
+  double* aL = rev->acc[0];
+  double* aR = rev->acc[1];
+  fluid_real_t* fdl;
+  int i, p, k;
+
+  if (ir == NULL || rev->partitions == 0) {
+    FLUID_MEMSET(rev->job_out[0], 0, FLUID_CONVREVERB_BLOCK * sizeof(fluid_real_t));
+    FLUID_MEMSET(rev->job_out[1], 0, FLUID_CONVREVERB_BLOCK * sizeof(fluid_real_t));
+    return;
+  }
+
+  /* transform the input into the newest delay line slot */
+  for (i = 0; i < FLUID_CONVREVERB_FFT; i++) {
+    x[2*i] = rev->job_in[i];
+    x[2*i+1] = 0.0;
+  }
+  fluid_convreverb_fft(ir, x, -1);
+
+  rev->fdl_pos = (rev->fdl_pos + 1) % rev->partitions;
+  fdl = &rev->fdl[rev->fdl_pos * 2 * FLUID_CONVREVERB_BINS];
+  for (i = 0; i < 2 * FLUID_CONVREVERB_BINS; i++)
+    fdl[i] = (fluid_real_t) x[i];
+
+  /* multiply the delay line with the partitions, newest input with the
+   * first partition */
+  FLUID_MEMSET(aL, 0, sizeof(rev->acc[0]));
+  FLUID_MEMSET(aR, 0, sizeof(rev->acc[1]));
+  for (p = 0; p < rev->partitions; p++) {
+    int slot = rev->fdl_pos - p;
+    const fluid_real_t* hL = &ir->spectrum[0][p * 2 * FLUID_CONVREVERB_BINS];
+    const fluid_real_t* hR = &ir->spectrum[1][p * 2 * FLUID_CONVREVERB_BINS];
+
+    if (slot < 0)
+      slot += rev->partitions;
+    fdl = &rev->fdl[slot * 2 * FLUID_CONVREVERB_BINS];
+
+    for (k = 0; k < 2 * FLUID_CONVREVERB_BINS; k += 2) {
+      fluid_real_t xr = fdl[k], xi = fdl[k+1];
+      aL[k]   += xr * hL[k]   - xi * hL[k+1];
+      aL[k+1] += xr * hL[k+1] + xi * hL[k];
+      aR[k]   += xr * hR[k]   - xi * hR[k+1];
+      aR[k+1] += xr * hR[k+1] + xi * hR[k];
+    }
+  }
+
+  /* Both outputs are real, so z = YL + i YR transforms back to yL in the
+   * real and yR in the imaginary part. The upper bins follow from the
+   * conjugate symmetry of YL and YR. */
+  for (k = 0; k < FLUID_CONVREVERB_BINS; k++) {
+    x[2*k]   = aL[2*k]   - aR[2*k+1];
+    x[2*k+1] = aL[2*k+1] + aR[2*k];
+  }
+  for (k = FLUID_CONVREVERB_BINS; k < FLUID_CONVREVERB_FFT; k++) {
+    int m = FLUID_CONVREVERB_FFT - k;
+    x[2*k]   = aL[2*m]    + aR[2*m+1];
+    x[2*k+1] = -aL[2*m+1] + aR[2*m];
+  }
+  fluid_convreverb_fft(ir, x, 1);
+
+  /* overlap-save: the second half is the valid part */
+  for (i = 0; i < FLUID_CONVREVERB_BLOCK; i++) {
+    rev->job_out[0][i] = (fluid_real_t) x[2*(FLUID_CONVREVERB_BLOCK + i)];
+    rev->job_out[1][i] = (fluid_real_t) x[2*(FLUID_CONVREVERB_BLOCK + i) + 1];
+  }
+}
+
+static void
+fluid_convreverb_worker_func(void* data)
+{
+  fluid_convreverb_worker_t* worker = data;
+  fluid_convreverb_t* rev;
+
+  fluid_cond_mutex_lock(worker->mutex);
+  for (;;) {
+    for (rev = worker->revs; rev != NULL; rev = rev->worker_next)
+      if (rev->job == FLUID_CONVREVERB_JOB_PENDING)
+        break;
+
+    if (rev == NULL) {
+      if (worker->quit)
+        break;
+      fluid_cond_wait(worker->cond, worker->mutex);
+      continue;
+    }
+    fluid_cond_mutex_unlock(worker->mutex);
+
+    fluid_convreverb_run_job(rev);
+
+    fluid_cond_mutex_lock(worker->mutex);
+    rev->job = FLUID_CONVREVERB_JOB_NONE;
+    fluid_cond_broadcast(worker->cond);
+  }
+  fluid_cond_mutex_unlock(worker->mutex);
+}
+
+/**
+ * Create a worker thread for convolution reverbs.
+ * @param prio_level Real-time priority of the thread, 0 for none
+ * @return New worker, NULL on error
+ */
+fluid_convreverb_worker_t*
+new_fluid_convreverb_worker(int prio_level)
+{
+  fluid_convreverb_worker_t* worker;
+
+  worker = FLUID_NEW(fluid_convreverb_worker_t);
+  if (worker == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(worker, 0, sizeof(fluid_convreverb_worker_t));
+
+  worker->mutex = new_fluid_cond_mutex();
+  worker->cond = new_fluid_cond();
+  if (worker->mutex == NULL || worker->cond == NULL)
+    goto error_recovery;
+
+  worker->thread = new_fluid_thread("convreverb", fluid_convreverb_worker_func,
+                                    worker, prio_level, 0);
+  if (worker->thread == NULL)
+    goto error_recovery;
+
+  return worker;
+
+error_recovery:
+  delete_fluid_convreverb_worker(worker);
+  return NULL;
+}
+
+/**
+ * Stop and free a worker. The convolution reverbs it serves must be
+ * deleted first.
+ * @param worker Convolution reverb worker
+ */
+void
+delete_fluid_convreverb_worker(fluid_convreverb_worker_t* worker)
+{
+  if (worker == NULL)
+    return;
+
+  if (worker->thread) {
+    fluid_cond_mutex_lock(worker->mutex);
+    worker->quit = TRUE;
+    fluid_cond_broadcast(worker->cond);
+    fluid_cond_mutex_unlock(worker->mutex);
+    fluid_thread_join(worker->thread);
+    delete_fluid_thread(worker->thread);
+  }
+  if (worker->cond)
+    delete_fluid_cond(worker->cond);
+  if (worker->mutex)
+    delete_fluid_cond_mutex(worker->mutex);
+  FLUID_FREE(worker);
+}
+
+/* Wait until the worker has finished the pending job */
+static void
+fluid_convreverb_wait(fluid_convreverb_t* rev)
+{
+  fluid_convreverb_worker_t* worker = rev->worker;
+
+  if (worker == NULL)
+    return;
+
+  fluid_cond_mutex_lock(worker->mutex);
+  while (rev->job == FLUID_CONVREVERB_JOB_PENDING)
+    fluid_cond_wait(worker->cond, worker->mutex);
+  fluid_cond_mutex_unlock(worker->mutex);
+}
+
+/* Hand the job to the worker, or run it right away without one */
+static void
+fluid_convreverb_dispatch(fluid_convreverb_t* rev)
+{
+  fluid_convreverb_worker_t* worker = rev->worker;
+
+  if (worker == NULL) {
+    fluid_convreverb_run_job(rev);
+    return;
+  }
+
+  fluid_cond_mutex_lock(worker->mutex);
+  rev->job = FLUID_CONVREVERB_JOB_PENDING;
+  fluid_cond_broadcast(worker->cond);
+  fluid_cond_mutex_unlock(worker->mutex);
+}
+
+/**
+ * Create a convolution reverb.
+ * @param ir Impulse response, may be NULL (silent until one is set)
+ * @param worker Worker running the transforms, NULL to run them on the
+ *   audio thread (with the same output)
+ * @return New convolution reverb, NULL on error
+ */
+fluid_convreverb_t*
+new_fluid_convreverb(fluid_convreverb_ir_t* ir, fluid_convreverb_worker_t* worker)
+{
+  fluid_convreverb_t* rev;
+
+  rev = FLUID_NEW(fluid_convreverb_t);
+  if (rev == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(rev, 0, sizeof(fluid_convreverb_t));
+
+  rev->out[0] = rev->outbuf[0];
+  rev->out[1] = rev->outbuf[1];
+  rev->job_out[0] = rev->outbuf[2];
+  rev->job_out[1] = rev->outbuf[3];
+  rev->width = 1.0f;
+  rev->wet = 1.0f;
+  fluid_convreverb_set(rev, 0, 0.0f, 0.0f, 1.0f, 1.0f);
+
+  if (fluid_convreverb_set_ir(rev, ir) != FLUID_OK) {
+    delete_fluid_convreverb(rev);
+    return NULL;
+  }
+
+  if (worker) {
+    fluid_cond_mutex_lock(worker->mutex);
+    rev->worker_next = worker->revs;
+    worker->revs = rev;
+    rev->worker = worker;
+    fluid_cond_mutex_unlock(worker->mutex);
+  }
+
+  return rev;
+}
+
+/**
+ * Free a convolution reverb. The impulse response is not freed.
+ * @param rev Convolution reverb
+ */
+void
+delete_fluid_convreverb(fluid_convreverb_t* rev)
+{
+  fluid_convreverb_worker_t* worker;
+  fluid_convreverb_t** prev;
+
+  if (rev == NULL)
+    return;
+
+  worker = rev->worker;
+  if (worker) {
+    fluid_convreverb_wait(rev);
+    fluid_cond_mutex_lock(worker->mutex);
+    for (prev = &worker->revs; *prev != rev; prev = &(*prev)->worker_next);
+    *prev = rev->worker_next;
+    fluid_cond_mutex_unlock(worker->mutex);
+  }
+
+  if (rev->fdl)
+    FLUID_FREE(rev->fdl);
+  FLUID_FREE(rev);
+}
+
+/**
+ * Set the impulse response of a convolution reverb and clear its state.
+ * @param rev Convolution reverb
+ * @param ir Impulse response, NULL to detach the current one
+ * @return FLUID_OK on success, FLUID_FAILED otherwise (the reverb is
+ *   left without impulse response)
+ */
+int
+fluid_convreverb_set_ir(fluid_convreverb_t* rev, fluid_convreverb_ir_t* ir)
+{
+  fluid_convreverb_wait(rev);
+
+  if (rev->fdl)
+    FLUID_FREE(rev->fdl);
+  rev->fdl = NULL;
+  rev->ir = NULL;
+  rev->partitions = 0;
+
+  if (ir != NULL) {
+    rev->fdl = FLUID_ARRAY(fluid_real_t, ir->partitions * 2 * FLUID_CONVREVERB_BINS);
+    if (rev->fdl == NULL) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      return FLUID_FAILED;
+    }
+    rev->ir = ir;
+    rev->partitions = ir->partitions;
+  }
+
+  fluid_convreverb_reset(rev);
+  return FLUID_OK;
+}
+
+/**
+ * Clear the internal state of a convolution reverb.
+ * @param rev Convolution reverb
+ */
+void
+fluid_convreverb_reset(fluid_convreverb_t* rev)
+{
+  int c;
+
+  fluid_convreverb_wait(rev);
+
+  if (rev->fdl)
+    FLUID_MEMSET(rev->fdl, 0,
+                 rev->partitions * 2 * FLUID_CONVREVERB_BINS * sizeof(fluid_real_t));
+  rev->fdl_pos = 0;
+  FLUID_MEMSET(rev->input, 0, sizeof(rev->input));
+  rev->pos = 0;
+  for (c = 0; c < 2; c++) {
+    FLUID_MEMSET(rev->out[c], 0, FLUID_CONVREVERB_BLOCK * sizeof(fluid_real_t));
+    FLUID_MEMSET(rev->job_out[c], 0, FLUID_CONVREVERB_BLOCK * sizeof(fluid_real_t));
+  }
+}
+
+/**
+ * Set one or more reverb parameters. The room size and damping are given
+ * by the impulse response and ignored here.
+ * @param rev Convolution reverb
+ * @param set One or more flags from #fluid_revmodel_set_t
+ * @param roomsize Reverb room size (unused)
+ * @param damping Reverb damping (unused)
+ * @param width Reverb width
+ * @param level Reverb level
+ */
+void
+fluid_convreverb_set(fluid_convreverb_t* rev, int set, float roomsize,
+                     float damping, float width, float level)
+{
+  if (set & FLUID_REVMODEL_SET_WIDTH)
+    rev->width = width;
+
+  if (set & FLUID_REVMODEL_SET_LEVEL)
+  {
+    fluid_clip(level, 0.0f, 1.0f);
+    rev->wet = level;
+  }
+
+  rev->wet1 = rev->wet * (rev->width / 2.0f + 0.5f);
+  rev->wet2 = rev->wet * ((1.0f - rev->width) / 2.0f);
+}
+
+/**
+ * Get the length of the reverb tail: the impulse response plus the
+ * latency of the reverb.
+ * @param rev Convolution reverb
+ * @return Tail length in samples
+ */
+int
+fluid_convreverb_get_tail(fluid_convreverb_t* rev)
+{
+  return (rev->partitions + 3) * FLUID_CONVREVERB_BLOCK;
+}
+
+static void
+fluid_convreverb_process(fluid_convreverb_t* rev, fluid_real_t *in,
+                         fluid_real_t *left_out, fluid_real_t *right_out,
+                         int count, int mix)
+{
+  int i = 0, k, n;
+
+  if (rev->ir == NULL) {
+    if (!mix) {
+      FLUID_MEMSET(left_out, 0, count * sizeof(fluid_real_t));
+      FLUID_MEMSET(right_out, 0, count * sizeof(fluid_real_t));
+    }
+    return;
+  }
+
+  while (i < count) {
+    fluid_real_t* outL = &rev->out[0][rev->pos];
+    fluid_real_t* outR = &rev->out[1][rev->pos];
+
+    n = FLUID_CONVREVERB_BLOCK - rev->pos;
+    if (n > count - i)
+      n = count - i;
+
+    /* in may be the same buffer as left_out, take the input first */
+    FLUID_MEMCPY(&rev->input[FLUID_CONVREVERB_BLOCK + rev->pos], &in[i],
+                 n * sizeof(fluid_real_t));
+
+    if (mix) {
+      for (k = 0; k < n; k++) {
+        left_out[i+k] += outL[k] * rev->wet1 + outR[k] * rev->wet2;
+        right_out[i+k] += outR[k] * rev->wet1 + outL[k] * rev->wet2;
+      }
+    }
+    else {
+      for (k = 0; k < n; k++) {
+        left_out[i+k] = outL[k] * rev->wet1 + outR[k] * rev->wet2;
+        right_out[i+k] = outR[k] * rev->wet1 + outL[k] * rev->wet2;
+      }
+    }
+
+    i += n;
+    rev->pos += n;
+    if (rev->pos < FLUID_CONVREVERB_BLOCK)
+      break;
+
+    /* A block is complete: play the previous job's result, give the
+     * worker the last two input blocks. */
+    fluid_convreverb_wait(rev);
+    for (k = 0; k < 2; k++) {
+      fluid_real_t* t = rev->out[k];
+      rev->out[k] = rev->job_out[k];
+      rev->job_out[k] = t;
+    }
+    FLUID_MEMCPY(rev->job_in, rev->input, sizeof(rev->input));
+    FLUID_MEMCPY(rev->input, &rev->input[FLUID_CONVREVERB_BLOCK],
+                  FLUID_CONVREVERB_BLOCK * sizeof(fluid_real_t));
+    rev->pos = 0;
+    fluid_convreverb_dispatch(rev);
+  }
+}
+
+/**
+ * Process the convolution reverb, replacing the output.
+ * @param rev Convolution reverb
+ * @param in Mono input, may be the same buffer as left_out
+ * @param left_out Left output
+ * @param right_out Right output
+ * @param count Number of samples
+ */
+void
+fluid_convreverb_processreplace(fluid_convreverb_t* rev, fluid_real_t *in,
+                                fluid_real_t *left_out, fluid_real_t *right_out,
+                                int count)
+{
+  fluid_convreverb_process(rev, in, left_out, right_out, count, FALSE);
+}
+
+/**
+ * Process the convolution reverb, mixing it into the output.
+ * @param rev Convolution reverb
+ * @param in Mono input
+ * @param left_out Left output
+ * @param right_out Right output
+ * @param count Number of samples
+ */
+void
+fluid_convreverb_processmix(fluid_convreverb_t* rev, fluid_real_t *in,
+                            fluid_real_t *left_out, fluid_real_t *right_out,
+                            int count)
+{
+  fluid_convreverb_process(rev, in, left_out, right_out, count, TRUE);
+}
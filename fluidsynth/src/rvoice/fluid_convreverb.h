@@ -0,0 +1,69 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+
+#ifndef _FLUID_CONVREVERB_H
+#define _FLUID_CONVREVERB_H
+
+#include "fluidsynth_priv.h"
+
+typedef struct _fluid_convreverb_ir_t fluid_convreverb_ir_t;
+typedef struct _fluid_convreverb_worker_t fluid_convreverb_worker_t;
+typedef struct _fluid_convreverb_t fluid_convreverb_t;
+
+/*
+ * impulse response, shared by the convolution reverb units
+ */
+fluid_convreverb_ir_t* new_fluid_convreverb_ir(const char* filename,
+                                               fluid_real_t sample_rate);
+fluid_convreverb_ir_t* new_fluid_convreverb_ir_resampled(const fluid_convreverb_ir_t* src,
+                                                         fluid_real_t sample_rate);
+void delete_fluid_convreverb_ir(fluid_convreverb_ir_t* ir);
+fluid_real_t fluid_convreverb_ir_get_sample_rate(const fluid_convreverb_ir_t* ir);
+void fluid_convreverb_ir_retire(fluid_convreverb_ir_t** list, fluid_convreverb_ir_t* ir);
+void fluid_convreverb_ir_free_retired(fluid_convreverb_ir_t** list);
+
+/*
+ * worker thread, shared by several convolution reverb units
+ */
+fluid_convreverb_worker_t* new_fluid_convreverb_worker(int prio_level);
+void delete_fluid_convreverb_worker(fluid_convreverb_worker_t* worker);
+
+/*
+ * convolution reverb
+ */
+fluid_convreverb_t* new_fluid_convreverb(fluid_convreverb_ir_t* ir,
+                                         fluid_convreverb_worker_t* worker);
+void delete_fluid_convreverb(fluid_convreverb_t* rev);
+int fluid_convreverb_set_ir(fluid_convreverb_t* rev, fluid_convreverb_ir_t* ir);
+void fluid_convreverb_reset(fluid_convreverb_t* rev);
+
+void fluid_convreverb_set(fluid_convreverb_t* rev, int set, float roomsize,
+                          float damping, float width, float level);
+int fluid_convreverb_get_tail(fluid_convreverb_t* rev);
+
+void fluid_convreverb_processmix(fluid_convreverb_t* rev, fluid_real_t *in,
+                                 fluid_real_t *left_out, fluid_real_t *right_out,
+                                 int count);
+void fluid_convreverb_processreplace(fluid_convreverb_t* rev, fluid_real_t *in,
+                                     fluid_real_t *left_out, fluid_real_t *right_out,
+                                     int count);
+
+#endif /* _FLUID_CONVREVERB_H */
@@ -69,18 +69,31 @@ struct _fluid_allpass {
   fluid_real_t *buffer;
   int bufsize;
   int bufidx;
+  int bufmax;         /* allocated length of buffer, bufsize <= bufmax */
 };
 
+int fluid_allpass_setbuffer(fluid_allpass* allpass, int size);
+void fluid_allpass_setsize(fluid_allpass* allpass, int size);
 void fluid_allpass_init(fluid_allpass* allpass);
 void fluid_allpass_setfeedback(fluid_allpass* allpass, fluid_real_t val);
 fluid_real_t fluid_allpass_getfeedback(fluid_allpass* allpass);
 
-void
+int
 fluid_allpass_setbuffer(fluid_allpass* allpass, int size)
 {
   allpass->bufidx = 0;
   allpass->buffer = FLUID_ARRAY(fluid_real_t,size);
-  allpass->bufsize = size;
+  allpass->bufsize = allpass->buffer ? size : 0;
+  allpass->bufmax = allpass->bufsize;
+  return allpass->buffer ? FLUID_OK : FLUID_FAILED;
+}
+
+/* Change the delay length within the allocated buffer */
+void
+fluid_allpass_setsize(fluid_allpass* allpass, int size)
+{
+  allpass->bufidx = 0;
+  allpass->bufsize = (size < allpass->bufmax) ? size : allpass->bufmax;
 }
 
 void
@@ -112,17 +125,38 @@ fluid_allpass_getfeedback(fluid_allpass* allpass)
   return allpass->feedback;
 }
 
-#define fluid_allpass_process(_allpass, _input) \
-{ \
-  fluid_real_t output; \
-  fluid_real_t bufout; \
-  bufout = _allpass.buffer[_allpass.bufidx]; \
-  output = bufout-_input; \
-  _allpass.buffer[_allpass.bufidx] = _input + (bufout * _allpass.feedback); \
-  if (++_allpass.bufidx >= _allpass.bufsize) { \
-    _allpass.bufidx = 0; \
-  } \
-  _input = output; \
+/* Run count samples of io through the allpass filter, in place. The
+ * block is cut at the points where the delay line wraps around, so the
+ * inner loop has no index checks and no dependency between iterations
+ * (the filter only reads what it wrote bufsize samples ago). */
+static void
+fluid_allpass_process(fluid_allpass* allpass, fluid_real_t *io, int count)
+{
+  fluid_real_t* buf = allpass->buffer;
+  fluid_real_t feedback = allpass->feedback;
+  fluid_real_t bufout, output;
+  int idx = allpass->bufidx;
+  int k, n;
+
+  while (count > 0) {
+    n = allpass->bufsize - idx;
+    if (n > count) {
+      n = count;
+    }
+    for (k = 0; k < n; k++) {
+      bufout = buf[idx + k];
+      output = bufout - io[k];
+      buf[idx + k] = io[k] + (bufout * feedback);
+      io[k] = output;
+    }
+    idx += n;
+    if (idx >= allpass->bufsize) {
+      idx = 0;
+    }
+    io += n;
+    count -= n;
+  }
+  allpass->bufidx = idx;
 }
 
 /*  fluid_real_t fluid_allpass_process(fluid_allpass* allpass, fluid_real_t input) */
@@ -147,9 +181,11 @@ struct _fluid_comb {
   fluid_real_t *buffer;
   int bufsize;
   int bufidx;
+  int bufmax;         /* allocated length of buffer, bufsize <= bufmax */
 };
 
-void fluid_comb_setbuffer(fluid_comb* comb, int size);
+int fluid_comb_setbuffer(fluid_comb* comb, int size);
+void fluid_comb_setsize(fluid_comb* comb, int size);
 void fluid_comb_release(fluid_comb* comb);
 void fluid_comb_init(fluid_comb* comb);
 void fluid_comb_setdamp(fluid_comb* comb, fluid_real_t val);
@@ -157,13 +193,24 @@ fluid_real_t fluid_comb_getdamp(fluid_comb* comb);
 void fluid_comb_setfeedback(fluid_comb* comb, fluid_real_t val);
 fluid_real_t fluid_comb_getfeedback(fluid_comb* comb);
 
-void
+int
 fluid_comb_setbuffer(fluid_comb* comb, int size)
 {
   comb->filterstore = 0;
   comb->bufidx = 0;
   comb->buffer = FLUID_ARRAY(fluid_real_t,size);
-  comb->bufsize = size;
+  comb->bufsize = comb->buffer ? size : 0;
+  comb->bufmax = comb->bufsize;
+  return comb->buffer ? FLUID_OK : FLUID_FAILED;
+}
+
+/* Change the delay length within the allocated buffer */
+void
+fluid_comb_setsize(fluid_comb* comb, int size)
+{
+  comb->filterstore = 0;
+  comb->bufidx = 0;
+  comb->bufsize = (size < comb->bufmax) ? size : comb->bufmax;
 }
 
 void
@@ -208,16 +255,6 @@ fluid_comb_getfeedback(fluid_comb* comb)
   return comb->feedback;
 }
 
-#define fluid_comb_process(_comb, _input, _output) \
-{ \
-  fluid_real_t _tmp = _comb.buffer[_comb.bufidx]; \
-  _comb.filterstore = (_tmp * _comb.damp2) + (_comb.filterstore * _comb.damp1); \
-  _comb.buffer[_comb.bufidx] = _input + (_comb.filterstore * _comb.feedback); \
-  if (++_comb.bufidx >= _comb.bufsize) { \
-    _comb.bufidx = 0; \
-  } \
-  _output += _tmp; \
-}
 
 /* fluid_real_t fluid_comb_process(fluid_comb* comb, fluid_real_t input) */
 /* { */
@@ -237,6 +274,9 @@ fluid_comb_getfeedback(fluid_comb* comb)
 
 #define numcombs 8
 #define numallpasses 4
+
+/* Number of samples processed at once, bounds the scratch buffers */
+#define FLUID_REVMODEL_CHUNK (4 * FLUID_BUFSIZE)
 #define	fixedgain 0.015f
 #define scalewet 3.0f
 #define scaledamp 1.0f
@@ -250,9 +290,8 @@ fluid_comb_getfeedback(fluid_comb* comb)
 #define stereospread 23
 
 /*
- These values assume 44.1KHz sample rate
- they will probably be OK for 48KHz sample rate
- but would need scaling for 96KHz (or other) sample rates.
+ These values assume 44.1KHz sample rate, they are scaled
+ to the actual sample rate in fluid_revmodel_set_buffers().
  The values were obtained by listening tests.
 */
 #define combtuningL1 1116
@@ -280,6 +319,27 @@ fluid_comb_getfeedback(fluid_comb* comb)
 #define allpasstuningL4 225
 #define allpasstuningR4 (225 + stereospread)
 
+/* The delay lines are allocated for this sample rate (or the rate the
+ * reverb is created with, if higher), so that changing the sample rate
+ * later on does not need to allocate memory. It is the highest rate
+ * accepted by synth.sample-rate. */
+#define FLUID_REVMODEL_MAX_SAMPLE_RATE 96000.0f
+
+static const int combtuningL[numcombs] = {
+  combtuningL1, combtuningL2, combtuningL3, combtuningL4,
+  combtuningL5, combtuningL6, combtuningL7, combtuningL8
+};
+static const int combtuningR[numcombs] = {
+  combtuningR1, combtuningR2, combtuningR3, combtuningR4,
+  combtuningR5, combtuningR6, combtuningR7, combtuningR8
+};
+static const int allpasstuningL[numallpasses] = {
+  allpasstuningL1, allpasstuningL2, allpasstuningL3, allpasstuningL4
+};
+static const int allpasstuningR[numallpasses] = {
+  allpasstuningR1, allpasstuningR2, allpasstuningR3, allpasstuningR4
+};
+
 struct _fluid_revmodel_t {
   fluid_real_t roomsize;
   fluid_real_t damp;
@@ -297,32 +357,39 @@ struct _fluid_revmodel_t {
   /* Allpass filters */
   fluid_allpass allpassL[numallpasses];
   fluid_allpass allpassR[numallpasses];
+  fluid_real_t max_sample_rate;	/* rate the delay lines are allocated for */
 };
 
 static void fluid_revmodel_update(fluid_revmodel_t* rev);
 static void fluid_revmodel_init(fluid_revmodel_t* rev);
-void fluid_set_revmodel_buffers(fluid_revmodel_t* rev, fluid_real_t sample_rate);
+static int fluid_revmodel_alloc_buffers(fluid_revmodel_t* rev, fluid_real_t sample_rate);
+static void fluid_revmodel_set_buffers(fluid_revmodel_t* rev, fluid_real_t sample_rate);
 
 fluid_revmodel_t*
 new_fluid_revmodel(fluid_real_t sample_rate)
 {
   fluid_revmodel_t* rev;
+  int i;
+
   rev = FLUID_NEW(fluid_revmodel_t);
   if (rev == NULL) {
     return NULL;
   }
+  FLUID_MEMSET(rev, 0, sizeof(fluid_revmodel_t));
 
-  fluid_set_revmodel_buffers(rev, sample_rate);
+  rev->max_sample_rate = sample_rate > FLUID_REVMODEL_MAX_SAMPLE_RATE
+    ? sample_rate : FLUID_REVMODEL_MAX_SAMPLE_RATE;
+  if (fluid_revmodel_alloc_buffers(rev, rev->max_sample_rate) != FLUID_OK) {
+    delete_fluid_revmodel(rev);
+    return NULL;
+  }
+  fluid_revmodel_set_buffers(rev, sample_rate);
 
   /* Set default values */
-  fluid_allpass_setfeedback(&rev->allpassL[0], 0.5f);
-  fluid_allpass_setfeedback(&rev->allpassR[0], 0.5f);
-  fluid_allpass_setfeedback(&rev->allpassL[1], 0.5f);
-  fluid_allpass_setfeedback(&rev->allpassR[1], 0.5f);
-  fluid_allpass_setfeedback(&rev->allpassL[2], 0.5f);
-  fluid_allpass_setfeedback(&rev->allpassR[2], 0.5f);
-  fluid_allpass_setfeedback(&rev->allpassL[3], 0.5f);
-  fluid_allpass_setfeedback(&rev->allpassR[3], 0.5f);
+  for (i = 0; i < numallpasses; i++) {
+    fluid_allpass_setfeedback(&rev->allpassL[i], 0.5f);
+    fluid_allpass_setfeedback(&rev->allpassR[i], 0.5f);
+  }
 
   rev->gain = fixedgain;
   fluid_revmodel_set(rev,FLUID_REVMODEL_SET_ALL,initialroom,initialdamp,initialwidth,initialwet);
@@ -346,35 +413,44 @@ delete_fluid_revmodel(fluid_revmodel_t* rev)
   FLUID_FREE(rev);
 }
 
-void
-fluid_set_revmodel_buffers(fluid_revmodel_t* rev, fluid_real_t sample_rate) {
+/* Allocate the delay lines, long enough for sample rates up to sample_rate */
+static int
+fluid_revmodel_alloc_buffers(fluid_revmodel_t* rev, fluid_real_t sample_rate)
+{
+  float srfactor = sample_rate/44100.0f;
+  int i;
+
+  for (i = 0; i < numcombs; i++) {
+    if (fluid_comb_setbuffer(&rev->combL[i], combtuningL[i]*srfactor) != FLUID_OK
+        || fluid_comb_setbuffer(&rev->combR[i], combtuningR[i]*srfactor) != FLUID_OK) {
+      return FLUID_FAILED;
+    }
+  }
+  for (i = 0; i < numallpasses; i++) {
+    if (fluid_allpass_setbuffer(&rev->allpassL[i], allpasstuningL[i]*srfactor) != FLUID_OK
+        || fluid_allpass_setbuffer(&rev->allpassR[i], allpasstuningR[i]*srfactor) != FLUID_OK) {
+      return FLUID_FAILED;
+    }
+  }
+  return FLUID_OK;
+}
 
+/* Scale the delay lengths to sample_rate and clear the delay lines.
+ * Does not allocate, sample_rate must not be above rev->max_sample_rate. */
+static void
+fluid_revmodel_set_buffers(fluid_revmodel_t* rev, fluid_real_t sample_rate)
+{
   float srfactor = sample_rate/44100.0f;
+  int i;
 
-  fluid_comb_setbuffer(&rev->combL[0], combtuningL1*srfactor);
-  fluid_comb_setbuffer(&rev->combR[0], combtuningR1*srfactor);
-  fluid_comb_setbuffer(&rev->combL[1], combtuningL2*srfactor);
-  fluid_comb_setbuffer(&rev->combR[1], combtuningR2*srfactor);
-  fluid_comb_setbuffer(&rev->combL[2], combtuningL3*srfactor);
-  fluid_comb_setbuffer(&rev->combR[2], combtuningR3*srfactor);
-  fluid_comb_setbuffer(&rev->combL[3], combtuningL4*srfactor);
-  fluid_comb_setbuffer(&rev->combR[3], combtuningR4*srfactor);
-  fluid_comb_setbuffer(&rev->combL[4], combtuningL5*srfactor);
-  fluid_comb_setbuffer(&rev->combR[4], combtuningR5*srfactor);
-  fluid_comb_setbuffer(&rev->combL[5], combtuningL6*srfactor);
-  fluid_comb_setbuffer(&rev->combR[5], combtuningR6*srfactor);
-  fluid_comb_setbuffer(&rev->combL[6], combtuningL7*srfactor);
-  fluid_comb_setbuffer(&rev->combR[6], combtuningR7*srfactor);
-  fluid_comb_setbuffer(&rev->combL[7], combtuningL8*srfactor);
-  fluid_comb_setbuffer(&rev->combR[7], combtuningR8*srfactor);
-  fluid_allpass_setbuffer(&rev->allpassL[0], allpasstuningL1*srfactor);
-  fluid_allpass_setbuffer(&rev->allpassR[0], allpasstuningR1*srfactor);
-  fluid_allpass_setbuffer(&rev->allpassL[1], allpasstuningL2*srfactor);
-  fluid_allpass_setbuffer(&rev->allpassR[1], allpasstuningR2*srfactor);
-  fluid_allpass_setbuffer(&rev->allpassL[2], allpasstuningL3*srfactor);
-  fluid_allpass_setbuffer(&rev->allpassR[2], allpasstuningR3*srfactor);
-  fluid_allpass_setbuffer(&rev->allpassL[3], allpasstuningL4*srfactor);
-  fluid_allpass_setbuffer(&rev->allpassR[3], allpasstuningR4*srfactor);
+  for (i = 0; i < numcombs; i++) {
+    fluid_comb_setsize(&rev->combL[i], combtuningL[i]*srfactor);
+    fluid_comb_setsize(&rev->combR[i], combtuningR[i]*srfactor);
+  }
+  for (i = 0; i < numallpasses; i++) {
+    fluid_allpass_setsize(&rev->allpassL[i], allpasstuningL[i]*srfactor);
+    fluid_allpass_setsize(&rev->allpassR[i], allpasstuningR[i]*srfactor);
+  }
 
   /* Clear all buffers */
   fluid_revmodel_init(rev);
@@ -401,82 +477,165 @@ fluid_revmodel_reset(fluid_revmodel_t* rev)
   fluid_revmodel_init(rev);
 }
 
-void
-fluid_revmodel_processreplace(fluid_revmodel_t* rev, fluid_real_t *in,
-			     fluid_real_t *left_out, fluid_real_t *right_out)
+/* Run the input through the parallel comb filters of both sides, and
+ * write the sum of each side's outputs. All combs share their feedback
+ * and damping, so they run side by side in one loop over segments where
+ * none of the delay lines wraps around. The state of the left and right
+ * comb of each pair is kept next to each other, as the two lanes of a
+ * vector: the compiler can then process both sides with one instruction.
+ * The combs themselves can't share loads, their delay lines all have
+ * different lengths. */
+static void
+fluid_revmodel_process_combs(fluid_revmodel_t* rev, const fluid_real_t *in,
+                             fluid_real_t *outL, fluid_real_t *outR, int count)
 {
-  int i, k = 0;
-  fluid_real_t outL, outR, input;
+  fluid_real_t* buf[numcombs][2];
+  fluid_real_t store[numcombs][2];
+  fluid_real_t feedback = rev->combL[0].feedback;
+  fluid_real_t damp1 = rev->combL[0].damp1;
+  fluid_real_t damp2 = rev->combL[0].damp2;
+  fluid_real_t tmp[2], sum[2], x;
+  fluid_comb* comb;
+  int i, k, n;
 
-  for (k = 0; k < FLUID_BUFSIZE; k++) {
-
-    outL = outR = 0;
-
-    /* The original Freeverb code expects a stereo signal and 'input'
-     * is set to the sum of the left and right input sample. Since
-     * this code works on a mono signal, 'input' is set to twice the
-     * input sample. */
-    input = (2.0f * in[k] + DC_OFFSET) * rev->gain;
+  for (i = 0; i < numcombs; i++) {
+    store[i][0] = rev->combL[i].filterstore;
+    store[i][1] = rev->combR[i].filterstore;
+  }
 
-    /* Accumulate comb filters in parallel */
+  while (count > 0) {
+    n = count;
+    for (i = 0; i < 2 * numcombs; i++) {
+      comb = i < numcombs ? &rev->combL[i] : &rev->combR[i - numcombs];
+      if (comb->bufsize - comb->bufidx < n) {
+        n = comb->bufsize - comb->bufidx;
+      }
+    }
     for (i = 0; i < numcombs; i++) {
-      fluid_comb_process(rev->combL[i], input, outL);
-      fluid_comb_process(rev->combR[i], input, outR);
+      buf[i][0] = rev->combL[i].buffer + rev->combL[i].bufidx;
+      buf[i][1] = rev->combR[i].buffer + rev->combR[i].bufidx;
     }
-    /* Feed through allpasses in series */
-    for (i = 0; i < numallpasses; i++) {
-      fluid_allpass_process(rev->allpassL[i], outL);
-      fluid_allpass_process(rev->allpassR[i], outR);
+
+    for (k = 0; k < n; k++) {
+      sum[0] = sum[1] = 0;
+      x = in[k];
+      for (i = 0; i < numcombs; i++) {
+        tmp[0] = buf[i][0][k];
+        tmp[1] = buf[i][1][k];
+        store[i][0] = (tmp[0] * damp2) + (store[i][0] * damp1);
+        store[i][1] = (tmp[1] * damp2) + (store[i][1] * damp1);
+        buf[i][0][k] = x + (store[i][0] * feedback);
+        buf[i][1][k] = x + (store[i][1] * feedback);
+        sum[0] += tmp[0];
+        sum[1] += tmp[1];
+      }
+      outL[k] = sum[0];
+      outR[k] = sum[1];
     }
 
-    /* Remove the DC offset */
-    outL -= DC_OFFSET;
-    outR -= DC_OFFSET;
+    for (i = 0; i < 2 * numcombs; i++) {
+      comb = i < numcombs ? &rev->combL[i] : &rev->combR[i - numcombs];
+      comb->bufidx += n;
+      if (comb->bufidx >= comb->bufsize) {
+        comb->bufidx = 0;
+      }
+    }
+    in += n;
+    outL += n;
+    outR += n;
+    count -= n;
+  }
 
-    /* Calculate output REPLACING anything already there */
-    left_out[k] = outL * rev->wet1 + outR * rev->wet2;
-    right_out[k] = outR * rev->wet1 + outL * rev->wet2;
+  for (i = 0; i < numcombs; i++) {
+    rev->combL[i].filterstore = store[i][0];
+    rev->combR[i].filterstore = store[i][1];
   }
 }
 
-void
-fluid_revmodel_processmix(fluid_revmodel_t* rev, fluid_real_t *in,
-			 fluid_real_t *left_out, fluid_real_t *right_out)
+static void
+fluid_revmodel_process(fluid_revmodel_t* rev, fluid_real_t *in,
+                       fluid_real_t *left_out, fluid_real_t *right_out,
+                       int count, int mix)
 {
-  int i, k = 0;
-  fluid_real_t outL, outR, input;
+  fluid_real_t input[FLUID_REVMODEL_CHUNK];
+  fluid_real_t outL[FLUID_REVMODEL_CHUNK];
+  fluid_real_t outR[FLUID_REVMODEL_CHUNK];
+  int i, k, n;
 
-  for (k = 0; k < FLUID_BUFSIZE; k++) {
-
-    outL = outR = 0;
+  for (; count > 0; count -= n, in += n, left_out += n, right_out += n) {
+    n = count < FLUID_REVMODEL_CHUNK ? count : FLUID_REVMODEL_CHUNK;
 
     /* The original Freeverb code expects a stereo signal and 'input'
      * is set to the sum of the left and right input sample. Since
      * this code works on a mono signal, 'input' is set to twice the
      * input sample. */
-    input = (2.0f * in[k] + DC_OFFSET) * rev->gain;
+    for (k = 0; k < n; k++) {
+      input[k] = (2.0f * in[k] + DC_OFFSET) * rev->gain;
+    }
 
     /* Accumulate comb filters in parallel */
-    for (i = 0; i < numcombs; i++) {
-	    fluid_comb_process(rev->combL[i], input, outL);
-	    fluid_comb_process(rev->combR[i], input, outR);
-    }
+    fluid_revmodel_process_combs(rev, input, outL, outR, n);
+
     /* Feed through allpasses in series */
     for (i = 0; i < numallpasses; i++) {
-      fluid_allpass_process(rev->allpassL[i], outL);
-      fluid_allpass_process(rev->allpassR[i], outR);
+      fluid_allpass_process(&rev->allpassL[i], outL, n);
+      fluid_allpass_process(&rev->allpassR[i], outR, n);
     }
 
     /* Remove the DC offset */
-    outL -= DC_OFFSET;
-    outR -= DC_OFFSET;
+    for (k = 0; k < n; k++) {
+      outL[k] -= DC_OFFSET;
+      outR[k] -= DC_OFFSET;
+    }
 
-    /* Calculate output MIXING with anything already there */
-    left_out[k] += outL * rev->wet1 + outR * rev->wet2;
-    right_out[k] += outR * rev->wet1 + outL * rev->wet2;
+    if (mix) {
+      /* Calculate output MIXING with anything already there */
+      for (k = 0; k < n; k++) {
+        left_out[k] += outL[k] * rev->wet1 + outR[k] * rev->wet2;
+        right_out[k] += outR[k] * rev->wet1 + outL[k] * rev->wet2;
+      }
+    } else {
+      /* Calculate output REPLACING anything already there */
+      for (k = 0; k < n; k++) {
+        left_out[k] = outL[k] * rev->wet1 + outR[k] * rev->wet2;
+        right_out[k] = outR[k] * rev->wet1 + outL[k] * rev->wet2;
+      }
+    }
   }
 }
 
+/**
+ * Process reverb, replacing the output.
+ * @param rev Reverb instance
+ * @param in Mono input, may be the same buffer as left_out
+ * @param left_out Left output
+ * @param right_out Right output
+ * @param count Number of samples
+ */
+void
+fluid_revmodel_processreplace(fluid_revmodel_t* rev, fluid_real_t *in,
+			     fluid_real_t *left_out, fluid_real_t *right_out,
+			     int count)
+{
+  fluid_revmodel_process(rev, in, left_out, right_out, count, FALSE);
+}
+
+/**
+ * Process reverb, mixing it into the output.
+ * @param rev Reverb instance
+ * @param in Mono input
+ * @param left_out Left output
+ * @param right_out Right output
+ * @param count Number of samples
+ */
+void
+fluid_revmodel_processmix(fluid_revmodel_t* rev, fluid_real_t *in,
+			 fluid_real_t *left_out, fluid_real_t *right_out,
+			 int count)
+{
+  fluid_revmodel_process(rev, in, left_out, right_out, count, TRUE);
+}
+
 static void
 fluid_revmodel_update(fluid_revmodel_t* rev)
 {
@@ -529,16 +688,70 @@ fluid_revmodel_set(fluid_revmodel_t* rev, int set, float roomsize,
   fluid_revmodel_update (rev);
 }
 
-void
-fluid_revmodel_samplerate_change(fluid_revmodel_t* rev, fluid_real_t sample_rate) {
-  int i;
-  for (i = 0; i < numcombs;i++) {
-    fluid_comb_release(&rev->combL[i]);
-    fluid_comb_release(&rev->combR[i]);
+/* Level (relative to the input) below which the reverb tail is silent: -120 dB */
+#define FLUID_REVMODEL_TAIL_FLOOR 1e-6
+
+/* Number of passes through a feedback loop until the floor is reached */
+static int
+fluid_revmodel_tail_loops(fluid_real_t feedback)
+{
+  double loops;
+
+  if (feedback <= 0.0f)
+    return 1;
+  loops = ceil(log(FLUID_REVMODEL_TAIL_FLOOR) / log(feedback));
+  return (int) loops;
+}
+
+/**
+ * Get the length of the reverb tail, i.e. how long the output takes to
+ * fall below -120 dB once the input has stopped. This is an upper bound,
+ * damping makes the tail decay faster.
+ * @param rev Reverb instance
+ * @return Tail length in samples, -1 if the reverb does not decay
+ */
+int
+fluid_revmodel_get_tail(fluid_revmodel_t* rev)
+{
+  int i, comb = 0, allpassL = 0, allpassR = 0;
+
+  if (rev->roomsize >= 1.0f)
+    return -1;
+
+  for (i = 0; i < numcombs; i++) {
+    if (rev->combL[i].bufsize > comb)
+      comb = rev->combL[i].bufsize;
+    if (rev->combR[i].bufsize > comb)
+      comb = rev->combR[i].bufsize;
   }
   for (i = 0; i < numallpasses; i++) {
-    fluid_allpass_release(&rev->allpassL[i]);
-    fluid_allpass_release(&rev->allpassR[i]);
+    allpassL += rev->allpassL[i].bufsize
+      * fluid_revmodel_tail_loops(rev->allpassL[i].feedback);
+    allpassR += rev->allpassR[i].bufsize
+      * fluid_revmodel_tail_loops(rev->allpassR[i].feedback);
+  }
+
+  return comb * fluid_revmodel_tail_loops(rev->roomsize)
+    + (allpassL > allpassR ? allpassL : allpassR);
+}
+
+/**
+ * Adapt the reverb to a new sample rate. The delay lines are resized
+ * within the memory allocated by new_fluid_revmodel() and cleared, so this
+ * is safe to call from the audio rendering thread.
+ * @param rev Reverb instance
+ * @param sample_rate New sample rate (Hz), up to 96 kHz or the rate the
+ *   reverb was created with if higher
+ * @return #FLUID_OK, or #FLUID_FAILED if the rate is too high, in which
+ *   case the reverb keeps its current rate
+ */
+int
+fluid_revmodel_samplerate_change(fluid_revmodel_t* rev, fluid_real_t sample_rate) {
+  if (sample_rate > rev->max_sample_rate) {
+    FLUID_LOG(FLUID_ERR, "reverb: sample rate %.0f Hz is above the maximum of %.0f Hz",
+              (double) sample_rate, (double) rev->max_sample_rate);
+    return FLUID_FAILED;
   }
-  fluid_set_revmodel_buffers(rev, sample_rate);
+  fluid_revmodel_set_buffers(rev, sample_rate);
+  return FLUID_OK;
 }
@@ -58,16 +58,20 @@ fluid_revmodel_t* new_fluid_revmodel(fluid_real_t sample_rate);
 void delete_fluid_revmodel(fluid_revmodel_t* rev);
 
 void fluid_revmodel_processmix(fluid_revmodel_t* rev, fluid_real_t *in,
-			      fluid_real_t *left_out, fluid_real_t *right_out);
+			      fluid_real_t *left_out, fluid_real_t *right_out,
+			      int count);
 
 void fluid_revmodel_processreplace(fluid_revmodel_t* rev, fluid_real_t *in,
-				  fluid_real_t *left_out, fluid_real_t *right_out);
+				  fluid_real_t *left_out, fluid_real_t *right_out,
+				  int count);
 
 void fluid_revmodel_reset(fluid_revmodel_t* rev);
 
 void fluid_revmodel_set(fluid_revmodel_t* rev, int set, float roomsize,
                         float damping, float width, float level);
 
-void fluid_revmodel_samplerate_change(fluid_revmodel_t* rev, fluid_real_t sample_rate);
+int fluid_revmodel_samplerate_change(fluid_revmodel_t* rev, fluid_real_t sample_rate);
+
+int fluid_revmodel_get_tail(fluid_revmodel_t* rev);
 
 #endif /* _FLUID_REV_H */
@@ -278,6 +278,13 @@ fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf)
   if (voice->dsp.check_sample_sanity_flag)
     fluid_rvoice_check_sample_sanity(voice);
 
+  /******************* start delay ******************/
+
+  if (voice->dsp.start_delay >= FLUID_BUFSIZE) {
+    voice->dsp.start_delay -= FLUID_BUFSIZE;
+    return -1;
+  }
+
   /******************* noteoff check ****************/
 
   if (voice->envlfo.noteoff_ticks != 0 && 
@@ -357,6 +364,13 @@ fluid_rvoice_write (fluid_rvoice_t* voice, fluid_real_t *dsp_buf)
       break;
   }
   fluid_check_fpe ("voice_write interpolation");
+
+  /* the interpolation started at start_delay in the buffer */
+  if (voice->dsp.start_delay > 0) {
+    FLUID_MEMSET(dsp_buf, 0, voice->dsp.start_delay * sizeof(fluid_real_t));
+    voice->dsp.start_delay = 0;
+  }
+
   if (count == 0)
     return count;
 
@@ -394,33 +408,52 @@ fluid_rvoice_buffers_mix(fluid_rvoice_buffers_t* buffers,
                          fluid_real_t* dsp_buf, int samplecount, 
                          fluid_real_t** dest_bufs, int dest_bufcount)
 {
+  fluid_real_t* bufs[FLUID_RVOICE_MAX_BUFS];
+  fluid_real_t amps[FLUID_RVOICE_MAX_BUFS];
   int bufcount = buffers->count;
-  int i, dsp_i;
+  int i, n, dsp_i;
   if (!samplecount || !bufcount || !dest_bufcount) 
     return;
 
-  for (i=0; i < bufcount; i++) {
+  /* Only mix to the buffers the voice is audible in. A panned voice
+     reaches at most two speakers, however many the layout has. */
+  for (i=0, n=0; i < bufcount; i++) {
     fluid_real_t* buf = get_dest_buf(buffers, i, dest_bufs, dest_bufcount);
-    fluid_real_t* next_buf;
     fluid_real_t amp = buffers->bufs[i].amp;
     if (buf == NULL || amp == 0.0f)
       continue;
+    bufs[n] = buf;
+    amps[n] = amp;
+    n++;
+  }
 
-    /* Optimization for centered stereo samples - we can save one 
-       multiplication per sample */
-    next_buf = (i+1 >= bufcount ? NULL : get_dest_buf(buffers, i+1, dest_bufs, dest_bufcount));
-    if (next_buf && buffers->bufs[i+1].amp == amp) {
-      for (dsp_i = 0; dsp_i < samplecount; dsp_i++) {
-        fluid_real_t samp = amp * dsp_buf[dsp_i]; 
-        buf[dsp_i] += samp;
-        next_buf[dsp_i] += samp;
-      }
-      i++;
+  /* Mix to up to four buffers in one pass, so each sample is read once */
+  for (i=0; i + 4 <= n; i += 4) {
+    fluid_real_t *b0 = bufs[i], *b1 = bufs[i+1], *b2 = bufs[i+2], *b3 = bufs[i+3];
+    fluid_real_t a0 = amps[i], a1 = amps[i+1], a2 = amps[i+2], a3 = amps[i+3];
+    for (dsp_i = 0; dsp_i < samplecount; dsp_i++) {
+      fluid_real_t samp = dsp_buf[dsp_i];
+      b0[dsp_i] += a0 * samp;
+      b1[dsp_i] += a1 * samp;
+      b2[dsp_i] += a2 * samp;
+      b3[dsp_i] += a3 * samp;
     }
-    else {
-      for (dsp_i = 0; dsp_i < samplecount; dsp_i++)
-        buf[dsp_i] += amp * dsp_buf[dsp_i];
+  }
+  if (i + 2 <= n) {
+    fluid_real_t *b0 = bufs[i], *b1 = bufs[i+1];
+    fluid_real_t a0 = amps[i], a1 = amps[i+1];
+    for (dsp_i = 0; dsp_i < samplecount; dsp_i++) {
+      fluid_real_t samp = dsp_buf[dsp_i];
+      b0[dsp_i] += a0 * samp;
+      b1[dsp_i] += a1 * samp;
     }
+    i += 2;
+  }
+  if (i < n) {
+    fluid_real_t *b0 = bufs[i];
+    fluid_real_t a0 = amps[i];
+    for (dsp_i = 0; dsp_i < samplecount; dsp_i++)
+      b0[dsp_i] += a0 * dsp_buf[dsp_i];
   }
 }
 
@@ -436,8 +469,8 @@ fluid_rvoice_buffers_check_bufnum(fluid_rvoice_buffers_t* buffers, unsigned int
   if (bufnum >= FLUID_RVOICE_MAX_BUFS) return FLUID_FAILED;
 
   for (i = buffers->count; i <= bufnum; i++) {
-    buffers->bufs[bufnum].amp = 0.0f;  
-    buffers->bufs[bufnum].mapping = i;  
+    buffers->bufs[i].amp = 0.0f;  
+    buffers->bufs[i].mapping = i;  
   }
   buffers->count = bufnum+1;
   return FLUID_OK;
@@ -467,6 +500,7 @@ void
 fluid_rvoice_reset(fluid_rvoice_t* voice)
 {
   voice->dsp.has_looped = 0;
+  voice->dsp.start_delay = 0;
   voice->envlfo.ticks = 0;
   voice->envlfo.noteoff_ticks = 0;
   voice->dsp.amp = 0.0f; /* The last value of the volume envelope, used to
@@ -531,6 +565,16 @@ fluid_rvoice_set_output_rate(fluid_rvoice_t* voice, fluid_real_t value)
   voice->dsp.output_rate = value;
 }
 
+/**
+ * Delay the start of the voice by a number of output frames, to start
+ * it at an exact position within a block.
+ */
+void
+fluid_rvoice_set_start_delay(fluid_rvoice_t* voice, int value)
+{
+  voice->dsp.start_delay = value;
+}
+
 void 
 fluid_rvoice_set_interp_method(fluid_rvoice_t* voice, int value)
 {
@@ -115,6 +115,7 @@ struct _fluid_rvoice_dsp_t
 	/* Dynamic input to the interpolator below */
 
 	fluid_real_t *dsp_buf;		/* buffer to store interpolated sample data to */
+	unsigned int start_delay;	/* output frames to wait before the voice starts */
 
 	fluid_real_t amp;                /* current linear amplitude */
 	fluid_real_t amp_incr;		/* amplitude increment value for the next FLUID_BUFSIZE samples */
@@ -125,9 +126,12 @@ struct _fluid_rvoice_dsp_t
 
 };
 
-/* Currently left, right, reverb, chorus. To be changed if we
-   ever add surround positioning, or stereo reverb/chorus */
-#define FLUID_RVOICE_MAX_BUFS (4)
+/* Left, right, reverb, chorus, then the further speakers of a
+   surround layout (see fluid_surround.h). Speaker n is buffer
+   FLUID_RVOICE_SPEAKER_BUF(n). */
+#define FLUID_RVOICE_MAX_SPEAKERS (8)
+#define FLUID_RVOICE_MAX_BUFS (FLUID_RVOICE_MAX_SPEAKERS + 2)
+#define FLUID_RVOICE_SPEAKER_BUF(n) ((n) < 2 ? (n) : (n) + 2)
 
 /**
  * rvoice mixer-related parameters
@@ -188,6 +192,7 @@ void fluid_rvoice_set_loopstart(fluid_rvoice_t* voice, int value);
 void fluid_rvoice_set_loopend(fluid_rvoice_t* voice, int value);
 void fluid_rvoice_set_sample(fluid_rvoice_t* voice, fluid_sample_t* value);
 void fluid_rvoice_set_samplemode(fluid_rvoice_t* voice, enum fluid_loop value);
+void fluid_rvoice_set_start_delay(fluid_rvoice_t* voice, int value);
 
 /* defined in fluid_rvoice_dsp.c */
 
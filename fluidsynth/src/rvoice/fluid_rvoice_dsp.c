@@ -119,19 +119,63 @@ void fluid_rvoice_dsp_config (void)
   fluid_check_fpe("interpolation table calculation");
 }
 
+/* Sample storage access.
+ *
+ * The interpolation kernels below are written once against
+ * fluid_rvoice_dsp_get_sample() and instantiated for every storage format by
+ * the dispatch functions at the end of this file. Since the format is a
+ * compile time constant in each instantiation, the 16 bit kernels compile to
+ * the same code as before and the wide formats don't cost a branch per point.
+ *
+ * Wide formats are brought to 16 bit full scale by scaling the amplitude
+ * instead of every sample point. The factors are powers of two, so scaling
+ * the amplitude back afterwards is exact.
+ */
+static FLUID_INLINE const void *
+fluid_rvoice_dsp_sample_data (fluid_sample_t *sample, const int format)
+{
+  return (format == FLUID_SAMPLE_FORMAT_INT16) ? (const void *)sample->data : sample->wide_data;
+}
+
+static FLUID_INLINE fluid_real_t
+fluid_rvoice_dsp_sample_scale (const int format)
+{
+  switch (format)
+  {
+    case FLUID_SAMPLE_FORMAT_INT24: return (fluid_real_t)(1.0 / 256.0);
+    case FLUID_SAMPLE_FORMAT_FLOAT: return (fluid_real_t)32768.0;
+    default: return (fluid_real_t)1.0;
+  }
+}
+
+static FLUID_INLINE fluid_real_t
+fluid_rvoice_dsp_get_sample (const void *data, const int format, unsigned int index)
+{
+  switch (format)
+  {
+    case FLUID_SAMPLE_FORMAT_INT24: return (fluid_real_t)((const sint32 *)data)[index];
+    case FLUID_SAMPLE_FORMAT_FLOAT: return (fluid_real_t)((const float *)data)[index];
+    default: return (fluid_real_t)((const short *)data)[index];
+  }
+}
+
+/* Shorthand for the kernels, which all name their locals dsp_data and format */
+#define fluid_dsp_sample(_index)  fluid_rvoice_dsp_get_sample (dsp_data, format, (_index))
+
 /* No interpolation. Just take the sample, which is closest to
   * the playback pointer.  Questionable quality, but very
   * efficient. */
-int
-fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
+static FLUID_INLINE int
+fluid_rvoice_dsp_interpolate_none_fmt (fluid_rvoice_dsp_t *voice, const int format)
 {
   fluid_phase_t dsp_phase = voice->phase;
   fluid_phase_t dsp_phase_incr;
-  short int *dsp_data = voice->sample->data;
+  const void *dsp_data = fluid_rvoice_dsp_sample_data (voice->sample, format);
   fluid_real_t *dsp_buf = voice->dsp_buf;
-  fluid_real_t dsp_amp = voice->amp;
-  fluid_real_t dsp_amp_incr = voice->amp_incr;
-  unsigned int dsp_i = 0;
+  fluid_real_t dsp_scale = fluid_rvoice_dsp_sample_scale (format);
+  fluid_real_t dsp_amp = voice->amp * dsp_scale;
+  fluid_real_t dsp_amp_incr = voice->amp_incr * dsp_scale;
+  unsigned int dsp_i = voice->start_delay;
   unsigned int dsp_phase_index;
   unsigned int end_index;
   int looping;
@@ -151,7 +195,7 @@ fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
     /* interpolate sequence of sample points */
     for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
     {
-      dsp_buf[dsp_i] = dsp_amp * dsp_data[dsp_phase_index];
+      dsp_buf[dsp_i] = dsp_amp * fluid_dsp_sample(dsp_phase_index);
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -174,7 +218,7 @@ fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
   }
 
   voice->phase = dsp_phase;
-  voice->amp = dsp_amp;
+  voice->amp = dsp_amp / dsp_scale;
 
   return (dsp_i);
 }
@@ -183,19 +227,20 @@ fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
  * Returns number of samples processed (usually FLUID_BUFSIZE but could be
  * smaller if end of sample occurs).
  */
-int
-fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
+static FLUID_INLINE int
+fluid_rvoice_dsp_interpolate_linear_fmt (fluid_rvoice_dsp_t *voice, const int format)
 {
   fluid_phase_t dsp_phase = voice->phase;
   fluid_phase_t dsp_phase_incr;
-  short int *dsp_data = voice->sample->data;
+  const void *dsp_data = fluid_rvoice_dsp_sample_data (voice->sample, format);
   fluid_real_t *dsp_buf = voice->dsp_buf;
-  fluid_real_t dsp_amp = voice->amp;
-  fluid_real_t dsp_amp_incr = voice->amp_incr;
-  unsigned int dsp_i = 0;
+  fluid_real_t dsp_scale = fluid_rvoice_dsp_sample_scale (format);
+  fluid_real_t dsp_amp = voice->amp * dsp_scale;
+  fluid_real_t dsp_amp_incr = voice->amp_incr * dsp_scale;
+  unsigned int dsp_i = voice->start_delay;
   unsigned int dsp_phase_index;
   unsigned int end_index;
-  short int point;
+  fluid_real_t point;
   fluid_real_t *coeffs;
   int looping;
 
@@ -209,8 +254,8 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
   end_index = (looping ? voice->loopend - 1 : voice->end) - 1;
 
   /* 2nd interpolation point to use at end of loop or sample */
-  if (looping) point = dsp_data[voice->loopstart];	/* loop start */
-  else point = dsp_data[voice->end];			/* duplicate end for samples no longer looping */
+  if (looping) point = fluid_dsp_sample(voice->loopstart);	/* loop start */
+  else point = fluid_dsp_sample(voice->end);			/* duplicate end for samples no longer looping */
 
   while (1)
   {
@@ -220,8 +265,8 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
     for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
     {
       coeffs = interp_coeff_linear[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index]
-				  + coeffs[1] * dsp_data[dsp_phase_index+1]);
+      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * fluid_dsp_sample(dsp_phase_index)
+				  + coeffs[1] * fluid_dsp_sample(dsp_phase_index+1));
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -238,7 +283,7 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
     for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
     {
       coeffs = interp_coeff_linear[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index]
+      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * fluid_dsp_sample(dsp_phase_index)
 				  + coeffs[1] * point);
 
       /* increment phase and amplitude */
@@ -263,7 +308,7 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
   }
 
   voice->phase = dsp_phase;
-  voice->amp = dsp_amp;
+  voice->amp = dsp_amp / dsp_scale;
 
   return (dsp_i);
 }
@@ -272,19 +317,20 @@ fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
  * Returns number of samples processed (usually FLUID_BUFSIZE but could be
  * smaller if end of sample occurs).
  */
-int
-fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
+static FLUID_INLINE int
+fluid_rvoice_dsp_interpolate_4th_order_fmt (fluid_rvoice_dsp_t *voice, const int format)
 {
   fluid_phase_t dsp_phase = voice->phase;
   fluid_phase_t dsp_phase_incr;
-  short int *dsp_data = voice->sample->data;
+  const void *dsp_data = fluid_rvoice_dsp_sample_data (voice->sample, format);
   fluid_real_t *dsp_buf = voice->dsp_buf;
-  fluid_real_t dsp_amp = voice->amp;
-  fluid_real_t dsp_amp_incr = voice->amp_incr;
-  unsigned int dsp_i = 0;
+  fluid_real_t dsp_scale = fluid_rvoice_dsp_sample_scale (format);
+  fluid_real_t dsp_amp = voice->amp * dsp_scale;
+  fluid_real_t dsp_amp_incr = voice->amp_incr * dsp_scale;
+  unsigned int dsp_i = voice->start_delay;
   unsigned int dsp_phase_index;
   unsigned int start_index, end_index;
-  short int start_point, end_point1, end_point2;
+  fluid_real_t start_point, end_point1, end_point2;
   fluid_real_t *coeffs;
   int looping;
 
@@ -300,23 +346,23 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
   if (voice->has_looped)	/* set start_index and start point if looped or not */
   {
     start_index = voice->loopstart;
-    start_point = dsp_data[voice->loopend - 1];	/* last point in loop (wrap around) */
+    start_point = fluid_dsp_sample(voice->loopend - 1);	/* last point in loop (wrap around) */
   }
   else
   {
     start_index = voice->start;
-    start_point = dsp_data[voice->start];	/* just duplicate the point */
+    start_point = fluid_dsp_sample(voice->start);	/* just duplicate the point */
   }
 
   /* get points off the end (loop start if looping, duplicate point if end) */
   if (looping)
   {
-    end_point1 = dsp_data[voice->loopstart];
-    end_point2 = dsp_data[voice->loopstart + 1];
+    end_point1 = fluid_dsp_sample(voice->loopstart);
+    end_point2 = fluid_dsp_sample(voice->loopstart + 1);
   }
   else
   {
-    end_point1 = dsp_data[voice->end];
+    end_point1 = fluid_dsp_sample(voice->end);
     end_point2 = end_point1;
   }
 
@@ -329,9 +375,9 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
     {
       coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
       dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * start_point
-				  + coeffs[1] * dsp_data[dsp_phase_index]
-				  + coeffs[2] * dsp_data[dsp_phase_index+1]
-				  + coeffs[3] * dsp_data[dsp_phase_index+2]);
+				  + coeffs[1] * fluid_dsp_sample(dsp_phase_index)
+				  + coeffs[2] * fluid_dsp_sample(dsp_phase_index+1)
+				  + coeffs[3] * fluid_dsp_sample(dsp_phase_index+2));
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -343,10 +389,10 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
     for ( ; dsp_i < FLUID_BUFSIZE && dsp_phase_index <= end_index; dsp_i++)
     {
       coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index-1]
-				  + coeffs[1] * dsp_data[dsp_phase_index]
-				  + coeffs[2] * dsp_data[dsp_phase_index+1]
-				  + coeffs[3] * dsp_data[dsp_phase_index+2]);
+      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * fluid_dsp_sample(dsp_phase_index-1)
+				  + coeffs[1] * fluid_dsp_sample(dsp_phase_index)
+				  + coeffs[2] * fluid_dsp_sample(dsp_phase_index+1)
+				  + coeffs[3] * fluid_dsp_sample(dsp_phase_index+2));
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -363,9 +409,9 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
     for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
     {
       coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index-1]
-				  + coeffs[1] * dsp_data[dsp_phase_index]
-				  + coeffs[2] * dsp_data[dsp_phase_index+1]
+      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * fluid_dsp_sample(dsp_phase_index-1)
+				  + coeffs[1] * fluid_dsp_sample(dsp_phase_index)
+				  + coeffs[2] * fluid_dsp_sample(dsp_phase_index+1)
 				  + coeffs[3] * end_point1);
 
       /* increment phase and amplitude */
@@ -380,8 +426,8 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
     for (; dsp_phase_index <= end_index && dsp_i < FLUID_BUFSIZE; dsp_i++)
     {
       coeffs = interp_coeff[fluid_phase_fract_to_tablerow (dsp_phase)];
-      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * dsp_data[dsp_phase_index-1]
-				  + coeffs[1] * dsp_data[dsp_phase_index]
+      dsp_buf[dsp_i] = dsp_amp * (coeffs[0] * fluid_dsp_sample(dsp_phase_index-1)
+				  + coeffs[1] * fluid_dsp_sample(dsp_phase_index)
 				  + coeffs[2] * end_point1
 				  + coeffs[3] * end_point2);
 
@@ -402,7 +448,7 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
       {
 	voice->has_looped = 1;
 	start_index = voice->loopstart;
-	start_point = dsp_data[voice->loopend - 1];
+	start_point = fluid_dsp_sample(voice->loopend - 1);
       }
     }
 
@@ -413,7 +459,7 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
   }
 
   voice->phase = dsp_phase;
-  voice->amp = dsp_amp;
+  voice->amp = dsp_amp / dsp_scale;
 
   return (dsp_i);
 }
@@ -422,20 +468,21 @@ fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
  * Returns number of samples processed (usually FLUID_BUFSIZE but could be
  * smaller if end of sample occurs).
  */
-int
-fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
+static FLUID_INLINE int
+fluid_rvoice_dsp_interpolate_7th_order_fmt (fluid_rvoice_dsp_t *voice, const int format)
 {
   fluid_phase_t dsp_phase = voice->phase;
   fluid_phase_t dsp_phase_incr;
-  short int *dsp_data = voice->sample->data;
+  const void *dsp_data = fluid_rvoice_dsp_sample_data (voice->sample, format);
   fluid_real_t *dsp_buf = voice->dsp_buf;
-  fluid_real_t dsp_amp = voice->amp;
-  fluid_real_t dsp_amp_incr = voice->amp_incr;
-  unsigned int dsp_i = 0;
+  fluid_real_t dsp_scale = fluid_rvoice_dsp_sample_scale (format);
+  fluid_real_t dsp_amp = voice->amp * dsp_scale;
+  fluid_real_t dsp_amp_incr = voice->amp_incr * dsp_scale;
+  unsigned int dsp_i = voice->start_delay;
   unsigned int dsp_phase_index;
   unsigned int start_index, end_index;
-  short int start_points[3];
-  short int end_points[3];
+  fluid_real_t start_points[3];
+  fluid_real_t end_points[3];
   fluid_real_t *coeffs;
   int looping;
 
@@ -455,14 +502,14 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
   if (voice->has_looped)	/* set start_index and start point if looped or not */
   {
     start_index = voice->loopstart;
-    start_points[0] = dsp_data[voice->loopend - 1];
-    start_points[1] = dsp_data[voice->loopend - 2];
-    start_points[2] = dsp_data[voice->loopend - 3];
+    start_points[0] = fluid_dsp_sample(voice->loopend - 1);
+    start_points[1] = fluid_dsp_sample(voice->loopend - 2);
+    start_points[2] = fluid_dsp_sample(voice->loopend - 3);
   }
   else
   {
     start_index = voice->start;
-    start_points[0] = dsp_data[voice->start];	/* just duplicate the start point */
+    start_points[0] = fluid_dsp_sample(voice->start);	/* just duplicate the start point */
     start_points[1] = start_points[0];
     start_points[2] = start_points[0];
   }
@@ -470,13 +517,13 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
   /* get the 3 points off the end (loop start if looping, duplicate point if end) */
   if (looping)
   {
-    end_points[0] = dsp_data[voice->loopstart];
-    end_points[1] = dsp_data[voice->loopstart + 1];
-    end_points[2] = dsp_data[voice->loopstart + 2];
+    end_points[0] = fluid_dsp_sample(voice->loopstart);
+    end_points[1] = fluid_dsp_sample(voice->loopstart + 1);
+    end_points[2] = fluid_dsp_sample(voice->loopstart + 2);
   }
   else
   {
-    end_points[0] = dsp_data[voice->end];
+    end_points[0] = fluid_dsp_sample(voice->end);
     end_points[1] = end_points[0];
     end_points[2] = end_points[0];
   }
@@ -491,13 +538,13 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
       dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)start_points[2]
-	   + coeffs[1] * (fluid_real_t)start_points[1]
-	   + coeffs[2] * (fluid_real_t)start_points[0]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)dsp_data[dsp_phase_index+3]);
+	* (coeffs[0] * start_points[2]
+	   + coeffs[1] * start_points[1]
+	   + coeffs[2] * start_points[0]
+	   + coeffs[3] * fluid_dsp_sample(dsp_phase_index)
+	   + coeffs[4] * fluid_dsp_sample(dsp_phase_index+1)
+	   + coeffs[5] * fluid_dsp_sample(dsp_phase_index+2)
+	   + coeffs[6] * fluid_dsp_sample(dsp_phase_index+3));
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -513,13 +560,13 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
       dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)start_points[1]
-	   + coeffs[1] * (fluid_real_t)start_points[0]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)dsp_data[dsp_phase_index+3]);
+	* (coeffs[0] * start_points[1]
+	   + coeffs[1] * start_points[0]
+	   + coeffs[2] * fluid_dsp_sample(dsp_phase_index-1)
+	   + coeffs[3] * fluid_dsp_sample(dsp_phase_index)
+	   + coeffs[4] * fluid_dsp_sample(dsp_phase_index+1)
+	   + coeffs[5] * fluid_dsp_sample(dsp_phase_index+2)
+	   + coeffs[6] * fluid_dsp_sample(dsp_phase_index+3));
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -535,13 +582,13 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
       dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)start_points[0]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)dsp_data[dsp_phase_index+3]);
+	* (coeffs[0] * start_points[0]
+	   + coeffs[1] * fluid_dsp_sample(dsp_phase_index-2)
+	   + coeffs[2] * fluid_dsp_sample(dsp_phase_index-1)
+	   + coeffs[3] * fluid_dsp_sample(dsp_phase_index)
+	   + coeffs[4] * fluid_dsp_sample(dsp_phase_index+1)
+	   + coeffs[5] * fluid_dsp_sample(dsp_phase_index+2)
+	   + coeffs[6] * fluid_dsp_sample(dsp_phase_index+3));
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -558,13 +605,13 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
       dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)dsp_data[dsp_phase_index-3]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)dsp_data[dsp_phase_index+3]);
+	* (coeffs[0] * fluid_dsp_sample(dsp_phase_index-3)
+	   + coeffs[1] * fluid_dsp_sample(dsp_phase_index-2)
+	   + coeffs[2] * fluid_dsp_sample(dsp_phase_index-1)
+	   + coeffs[3] * fluid_dsp_sample(dsp_phase_index)
+	   + coeffs[4] * fluid_dsp_sample(dsp_phase_index+1)
+	   + coeffs[5] * fluid_dsp_sample(dsp_phase_index+2)
+	   + coeffs[6] * fluid_dsp_sample(dsp_phase_index+3));
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -583,13 +630,13 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
       dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)dsp_data[dsp_phase_index-3]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)dsp_data[dsp_phase_index+2]
-	   + coeffs[6] * (fluid_real_t)end_points[0]);
+	* (coeffs[0] * fluid_dsp_sample(dsp_phase_index-3)
+	   + coeffs[1] * fluid_dsp_sample(dsp_phase_index-2)
+	   + coeffs[2] * fluid_dsp_sample(dsp_phase_index-1)
+	   + coeffs[3] * fluid_dsp_sample(dsp_phase_index)
+	   + coeffs[4] * fluid_dsp_sample(dsp_phase_index+1)
+	   + coeffs[5] * fluid_dsp_sample(dsp_phase_index+2)
+	   + coeffs[6] * end_points[0]);
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -605,13 +652,13 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
       dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)dsp_data[dsp_phase_index-3]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)dsp_data[dsp_phase_index+1]
-	   + coeffs[5] * (fluid_real_t)end_points[0]
-	   + coeffs[6] * (fluid_real_t)end_points[1]);
+	* (coeffs[0] * fluid_dsp_sample(dsp_phase_index-3)
+	   + coeffs[1] * fluid_dsp_sample(dsp_phase_index-2)
+	   + coeffs[2] * fluid_dsp_sample(dsp_phase_index-1)
+	   + coeffs[3] * fluid_dsp_sample(dsp_phase_index)
+	   + coeffs[4] * fluid_dsp_sample(dsp_phase_index+1)
+	   + coeffs[5] * end_points[0]
+	   + coeffs[6] * end_points[1]);
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -627,13 +674,13 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
       coeffs = sinc_table7[fluid_phase_fract_to_tablerow (dsp_phase)];
 
       dsp_buf[dsp_i] = dsp_amp
-	* (coeffs[0] * (fluid_real_t)dsp_data[dsp_phase_index-3]
-	   + coeffs[1] * (fluid_real_t)dsp_data[dsp_phase_index-2]
-	   + coeffs[2] * (fluid_real_t)dsp_data[dsp_phase_index-1]
-	   + coeffs[3] * (fluid_real_t)dsp_data[dsp_phase_index]
-	   + coeffs[4] * (fluid_real_t)end_points[0]
-	   + coeffs[5] * (fluid_real_t)end_points[1]
-	   + coeffs[6] * (fluid_real_t)end_points[2]);
+	* (coeffs[0] * fluid_dsp_sample(dsp_phase_index-3)
+	   + coeffs[1] * fluid_dsp_sample(dsp_phase_index-2)
+	   + coeffs[2] * fluid_dsp_sample(dsp_phase_index-1)
+	   + coeffs[3] * fluid_dsp_sample(dsp_phase_index)
+	   + coeffs[4] * end_points[0]
+	   + coeffs[5] * end_points[1]
+	   + coeffs[6] * end_points[2]);
 
       /* increment phase and amplitude */
       fluid_phase_incr (dsp_phase, dsp_phase_incr);
@@ -652,9 +699,9 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
       {
 	voice->has_looped = 1;
 	start_index = voice->loopstart;
-	start_points[0] = dsp_data[voice->loopend - 1];
-	start_points[1] = dsp_data[voice->loopend - 2];
-	start_points[2] = dsp_data[voice->loopend - 3];
+	start_points[0] = fluid_dsp_sample(voice->loopend - 1);
+	start_points[1] = fluid_dsp_sample(voice->loopend - 2);
+	start_points[2] = fluid_dsp_sample(voice->loopend - 3);
       }
     }
 
@@ -669,7 +716,43 @@ fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
   fluid_phase_decr (dsp_phase, (fluid_phase_t)0x80000000);
 
   voice->phase = dsp_phase;
-  voice->amp = dsp_amp;
+  voice->amp = dsp_amp / dsp_scale;
 
   return (dsp_i);
 }
+
+/* Instantiate an interpolation kernel for the storage format of the voice's sample */
+#define FLUID_RVOICE_DSP_DISPATCH(_kernel, _voice) \
+  switch ((_voice)->sample->format) \
+  { \
+    case FLUID_SAMPLE_FORMAT_INT24: \
+      return _kernel ((_voice), FLUID_SAMPLE_FORMAT_INT24); \
+    case FLUID_SAMPLE_FORMAT_FLOAT: \
+      return _kernel ((_voice), FLUID_SAMPLE_FORMAT_FLOAT); \
+    default: \
+      return _kernel ((_voice), FLUID_SAMPLE_FORMAT_INT16); \
+  }
+
+int
+fluid_rvoice_dsp_interpolate_none (fluid_rvoice_dsp_t *voice)
+{
+  FLUID_RVOICE_DSP_DISPATCH (fluid_rvoice_dsp_interpolate_none_fmt, voice);
+}
+
+int
+fluid_rvoice_dsp_interpolate_linear (fluid_rvoice_dsp_t *voice)
+{
+  FLUID_RVOICE_DSP_DISPATCH (fluid_rvoice_dsp_interpolate_linear_fmt, voice);
+}
+
+int
+fluid_rvoice_dsp_interpolate_4th_order (fluid_rvoice_dsp_t *voice)
+{
+  FLUID_RVOICE_DSP_DISPATCH (fluid_rvoice_dsp_interpolate_4th_order_fmt, voice);
+}
+
+int
+fluid_rvoice_dsp_interpolate_7th_order (fluid_rvoice_dsp_t *voice)
+{
+  FLUID_RVOICE_DSP_DISPATCH (fluid_rvoice_dsp_interpolate_7th_order_fmt, voice);
+}
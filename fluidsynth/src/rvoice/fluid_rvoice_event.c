@@ -110,10 +110,12 @@ fluid_rvoice_event_dispatch(fluid_rvoice_event_t* event)
   EVENTFUNC_I1(fluid_rvoice_mixer_set_reverb_enabled, fluid_rvoice_mixer_t*);
   EVENTFUNC_I1(fluid_rvoice_mixer_set_chorus_enabled, fluid_rvoice_mixer_t*);
   EVENTFUNC_I1(fluid_rvoice_mixer_set_mix_fx, fluid_rvoice_mixer_t*);
+  EVENTFUNC_I1(fluid_rvoice_mixer_set_chorus_interp, fluid_rvoice_mixer_t*);
   EVENTFUNC_0(fluid_rvoice_mixer_reset_fx, fluid_rvoice_mixer_t*);
   EVENTFUNC_0(fluid_rvoice_mixer_reset_reverb, fluid_rvoice_mixer_t*);
   EVENTFUNC_0(fluid_rvoice_mixer_reset_chorus, fluid_rvoice_mixer_t*);
   EVENTFUNC_IR(fluid_rvoice_mixer_set_threads, fluid_rvoice_mixer_t*);
+  EVENTFUNC_PTR(fluid_rvoice_mixer_set_convreverb_ir, fluid_rvoice_mixer_t*, fluid_convreverb_ir_t*);
  
   EVENTFUNC_ALL(fluid_rvoice_mixer_set_chorus_params, fluid_rvoice_mixer_t*);
   EVENTFUNC_R4(fluid_rvoice_mixer_set_reverb_params, fluid_rvoice_mixer_t*);
@@ -223,7 +225,8 @@ finished_voice_callback(void* userdata, fluid_rvoice_t* rvoice)
 
 fluid_rvoice_eventhandler_t* 
 new_fluid_rvoice_eventhandler(int is_threadsafe, int queuesize, 
-  int finished_voices_size, int bufs, int fx_bufs, fluid_real_t sample_rate)
+  int finished_voices_size, int bufs, int fx_bufs, int fx_units, 
+  fluid_real_t sample_rate)
 {
   fluid_rvoice_eventhandler_t* eventhandler = FLUID_NEW(fluid_rvoice_eventhandler_t);
   if (eventhandler == NULL) {
@@ -245,7 +248,7 @@ new_fluid_rvoice_eventhandler(int is_threadsafe, int queuesize,
   if (eventhandler->queue == NULL)
     goto error_recovery;
 
-  eventhandler->mixer = new_fluid_rvoice_mixer(bufs, fx_bufs, sample_rate); 
+  eventhandler->mixer = new_fluid_rvoice_mixer(bufs, fx_bufs, fx_units, sample_rate); 
   if (eventhandler->mixer == NULL)
     goto error_recovery;
   fluid_rvoice_mixer_set_finished_voices_callback(eventhandler->mixer, 
@@ -23,6 +23,7 @@
 #include "fluid_sys.h"
 #include "fluid_rev.h"
 #include "fluid_chorus.h"
+#include "fluid_convreverb.h"
 #include "fluidsynth_priv.h"
 #include "fluid_ladspa.h"
 
@@ -35,6 +36,23 @@
 // so don't activate the thread(s).
 #define VOICES_PER_THREAD 8
 
+// If less than x samples are rendered at once, the effects take less
+// time than waking up a thread, so run them in the calling thread.
+#define FX_SAMPLES_PER_THREAD 1024
+
+// Peak level below which the input and the tail of the effects count
+// as silence (-120 dB, the decay fluid_revmodel_get_tail() measures).
+#define FX_SILENCE 1e-6
+
+// Effects of a single effect unit which can run in parallel once all
+// voices are mixed. With several units, each unit is one task.
+#define FX_TASK_REVERB 0
+#define FX_TASK_CHORUS 1
+
+// The convolution reverbs of all effect units share at most x worker
+// threads, each effects group does not get its own.
+#define CONVREVERB_WORKERS 2
+
 typedef struct _fluid_mixer_buffers_t fluid_mixer_buffers_t;
 
 struct _fluid_mixer_buffers_t {
@@ -63,14 +81,26 @@ typedef struct _fluid_mixer_fx_t fluid_mixer_fx_t;
 
 struct _fluid_mixer_fx_t {
   fluid_revmodel_t* reverb; /**< Reverb unit */
+  fluid_convreverb_t* convreverb; /**< Convolution reverb unit, replaces reverb if set */
   fluid_chorus_t* chorus; /**< Chorus unit */
-  int with_reverb;        /**< Should the synth use the built-in reverb unit? */
-  int with_chorus;        /**< Should the synth use the built-in chorus unit? */
-  int mix_fx_to_out;      /**< Should the effects be mixed in with the primary output? */
+  int active;             /**< Does the unit have to run for the current blocks? */
+  int tail_left;          /**< Samples until the output has died away, -1 if it never does */
 };
 
 struct _fluid_rvoice_mixer_t {
-  fluid_mixer_fx_t fx;
+  fluid_mixer_fx_t* fx;   /**< Effect units, one per effects group */
+  int fx_units;           /**< Number of effect units */
+  int reverb_tail;        /**< Samples for the reverb to decay by 120 dB, -1 if it does not decay */
+  fluid_convreverb_ir_t* convreverb_ir; /**< Impulse response of the convolution reverb units, NULL if not used */
+  fluid_convreverb_ir_t* convreverb_retired; /**< Atomic: replaced impulse responses, freed outside of the rendering thread */
+  fluid_convreverb_worker_t** convreverb_workers; /**< Worker threads shared by the convolution reverb units */
+  int convreverb_worker_count;
+  int chorus_tail;        /**< Length of the chorus delay lines in samples */
+  int with_reverb;        /**< Should the synth use the built-in reverb unit? */
+  int with_chorus;        /**< Should the synth use the built-in chorus unit? */
+  int chorus_interp;      /**< Interpolation of the chorus delay lines (#fluid_chorus_interp) */
+  int mix_fx_to_out;      /**< Should the effects be mixed in with the primary output? */
+  int group_bufs;         /**< Number of stereo buffers of an audio group, effects go to the first one */
 
   fluid_mixer_buffers_t buffers; /**< Used by mixer only: own buffers */
   void (*remove_voice_callback)(void*, fluid_rvoice_t*); /**< Used by mixer only: Receive this callback every time a voice is removed */
@@ -90,6 +120,8 @@ struct _fluid_rvoice_mixer_t {
 //  int active_threads;          /**< Atomic: number of threads in the thread loop */
   int threads_should_terminate; /**< Atomic: Set to TRUE when threads should terminate */
   int current_rvoice;           /**< Atomic: for the threads to know next voice to  */
+  int current_fx_task;          /**< Atomic: for the threads to know next effect to run */
+  int fx_task_count;            /**< Number of effect tasks for the current blocks */
   fluid_cond_t* wakeup_threads; /**< Signalled when the threads should wake up */
   fluid_cond_mutex_t* wakeup_threads_m; /**< wakeup_threads mutex companion */
   fluid_cond_t* thread_ready; /**< Signalled from thread, when the thread has a buffer ready for mixing */
@@ -100,78 +132,229 @@ struct _fluid_rvoice_mixer_t {
 #endif
 };
 
+/* Index of a buffer of an effect unit in fx_left_buf / fx_right_buf */
+static FLUID_INLINE int
+fluid_mixer_fx_buf(fluid_rvoice_mixer_t* mixer, int unit, int channel)
+{
+  return unit * (mixer->buffers.fx_buf_count / mixer->fx_units) + channel;
+}
+
+/* When mixed to the output, each effect unit goes to its audio group */
+static FLUID_INLINE void
+fluid_rvoice_mixer_process_reverb(fluid_rvoice_mixer_t* mixer, int unit)
+{
+  int i = fluid_mixer_fx_buf(mixer, unit, SYNTH_REVERB_CHANNEL);
+  int out = (unit * mixer->group_bufs) % mixer->buffers.buf_count;
+
+  /* the effects take all blocks at once */
+  if (mixer->fx[unit].convreverb) {
+    if (mixer->mix_fx_to_out)
+      fluid_convreverb_processmix(mixer->fx[unit].convreverb,
+                                  mixer->buffers.fx_left_buf[i],
+                                  mixer->buffers.left_buf[out],
+                                  mixer->buffers.right_buf[out],
+                                  mixer->current_blockcount * FLUID_BUFSIZE);
+    else
+      fluid_convreverb_processreplace(mixer->fx[unit].convreverb,
+                                      mixer->buffers.fx_left_buf[i],
+                                      mixer->buffers.fx_left_buf[i],
+                                      mixer->buffers.fx_right_buf[i],
+                                      mixer->current_blockcount * FLUID_BUFSIZE);
+  }
+  else if (mixer->mix_fx_to_out) {
+    fluid_revmodel_processmix(mixer->fx[unit].reverb,
+                              mixer->buffers.fx_left_buf[i],
+                              mixer->buffers.left_buf[out],
+                              mixer->buffers.right_buf[out],
+                              mixer->current_blockcount * FLUID_BUFSIZE);
+  } 
+  else {
+    fluid_revmodel_processreplace(mixer->fx[unit].reverb,
+                                  mixer->buffers.fx_left_buf[i],
+                                  mixer->buffers.fx_left_buf[i],
+                                  mixer->buffers.fx_right_buf[i],
+                                  mixer->current_blockcount * FLUID_BUFSIZE);
+  }
+}
+
+static FLUID_INLINE void
+fluid_rvoice_mixer_process_chorus(fluid_rvoice_mixer_t* mixer, int unit)
+{
+  int i = fluid_mixer_fx_buf(mixer, unit, SYNTH_CHORUS_CHANNEL);
+  int out = (unit * mixer->group_bufs) % mixer->buffers.buf_count;
+
+  if (mixer->mix_fx_to_out) {
+    fluid_chorus_processmix(mixer->fx[unit].chorus,
+                            mixer->buffers.fx_left_buf[i],
+                            mixer->buffers.left_buf[out],
+                            mixer->buffers.right_buf[out],
+                            mixer->current_blockcount * FLUID_BUFSIZE);
+  } 
+  else {
+    fluid_chorus_processreplace(mixer->fx[unit].chorus,
+                                mixer->buffers.fx_left_buf[i],
+                                mixer->buffers.fx_left_buf[i],
+                                mixer->buffers.fx_right_buf[i],
+                                mixer->current_blockcount * FLUID_BUFSIZE);
+  }
+}
+
+static FLUID_INLINE void
+fluid_rvoice_mixer_process_ladspa(fluid_rvoice_mixer_t* mixer)
+{
+#ifdef LADSPA
+  /* Run the signal through the LADSPA Fx unit */
+  if (mixer->LADSPA_FxUnit) {
+    fluid_LADSPA_run(mixer->LADSPA_FxUnit, mixer->buffers.left_buf,
+                     mixer->buffers.right_buf, mixer->buffers.fx_left_buf,
+                     mixer->buffers.fx_right_buf,
+                     mixer->current_blockcount * FLUID_BUFSIZE);
+    fluid_check_fpe("LADSPA");
+  }
+#endif
+}
+
 static FLUID_INLINE void 
 fluid_rvoice_mixer_process_fx(fluid_rvoice_mixer_t* mixer)
 {
   int i;
   fluid_profile_ref_var(prof_ref);
-  if (mixer->fx.with_reverb) {
-    if (mixer->fx.mix_fx_to_out) {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_revmodel_processmix(mixer->fx.reverb, 
-                                  &mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL][i],
-				  &mixer->buffers.left_buf[0][i],
-				  &mixer->buffers.right_buf[0][i]);
-    } 
-    else {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_revmodel_processreplace(mixer->fx.reverb, 
-                                  &mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL][i],
-				  &mixer->buffers.fx_left_buf[SYNTH_REVERB_CHANNEL][i],
-				  &mixer->buffers.fx_right_buf[SYNTH_REVERB_CHANNEL][i]);
+  for (i=0; i < mixer->fx_units; i++) {
+    if (!mixer->fx[i].active)
+      continue;
+
+    if (mixer->with_reverb) {
+      fluid_rvoice_mixer_process_reverb(mixer, i);
+      fluid_profile(FLUID_PROF_ONE_BLOCK_REVERB, prof_ref);
     }
-    fluid_profile(FLUID_PROF_ONE_BLOCK_REVERB, prof_ref);
-  }
   
-  if (mixer->fx.with_chorus) {
-    if (mixer->fx.mix_fx_to_out) {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_chorus_processmix(mixer->fx.chorus, 
-                                &mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL][i],
-			        &mixer->buffers.left_buf[0][i],
-				&mixer->buffers.right_buf[0][i]);
-    } 
-    else {
-      for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE)
-        fluid_chorus_processreplace(mixer->fx.chorus, 
-                                &mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL][i],
-				&mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL][i],
-				&mixer->buffers.fx_right_buf[SYNTH_CHORUS_CHANNEL][i]);
+    if (mixer->with_chorus) {
+      fluid_rvoice_mixer_process_chorus(mixer, i);
+      fluid_profile(FLUID_PROF_ONE_BLOCK_CHORUS, prof_ref);
     }
-    fluid_profile(FLUID_PROF_ONE_BLOCK_CHORUS, prof_ref);
   }
   
-#ifdef LADSPA
-  /* Run the signal through the LADSPA Fx unit */
-  if (mixer->LADSPA_FxUnit) {
-    int j;
-    FLUID_DECLARE_VLA(fluid_real_t*, left_buf, mixer->buffers.buf_count);
-    FLUID_DECLARE_VLA(fluid_real_t*, right_buf, mixer->buffers.buf_count);
-    FLUID_DECLARE_VLA(fluid_real_t*, fx_left_buf, mixer->buffers.fx_buf_count);
-    FLUID_DECLARE_VLA(fluid_real_t*, fx_right_buf, mixer->buffers.fx_buf_count);
-    for (j=0; j < mixer->buffers.buf_count; j++) {
-      left_buf[j] = mixer->buffers.left_buf[j];
-      right_buf[j] = mixer->buffers.right_buf[j];
-    }
-    for (j=0; j < mixer->buffers.fx_buf_count; j++) {
-      fx_left_buf[j] = mixer->buffers.fx_left_buf[j];
-      fx_right_buf[j] = mixer->buffers.fx_right_buf[j];
+  fluid_rvoice_mixer_process_ladspa(mixer);
+}
+
+/**
+ * Samples until the effects output of an input with the given peak
+ * level has fallen below FX_SILENCE, -1 if it never does. The reverb
+ * decays exponentially, so its tail scales with the level in dB. The
+ * convolution reverb always plays its whole (trimmed) impulse response.
+ */
+static int
+fluid_rvoice_mixer_get_fx_tail(fluid_rvoice_mixer_t* mixer, fluid_real_t peak)
+{
+  double reverb;
+
+  if (!mixer->with_reverb)
+    return mixer->chorus_tail;
+  if (mixer->reverb_tail < 0)
+    return -1;
+
+  if (mixer->convreverb_ir)
+    reverb = mixer->reverb_tail;
+  else
+    reverb = mixer->reverb_tail * log(peak / FX_SILENCE) / -log(FX_SILENCE);
+  return (reverb > mixer->chorus_tail) ? (int) reverb : mixer->chorus_tail;
+}
+
+/**
+ * Update the effects tail after the reverb parameters changed. The units
+ * which are still sounding get the tail of a full scale input, so that a
+ * unit which never decayed before can be bypassed again.
+ */
+static void
+fluid_rvoice_mixer_update_fx_tail(fluid_rvoice_mixer_t* mixer)
+{
+  int i, tail;
+
+  if (mixer->fx[0].convreverb)
+    mixer->reverb_tail = fluid_convreverb_get_tail(mixer->fx[0].convreverb);
+  else
+    mixer->reverb_tail = fluid_revmodel_get_tail(mixer->fx[0].reverb);
+  mixer->chorus_tail = fluid_chorus_get_tail(mixer->fx[0].chorus);
+
+  tail = fluid_rvoice_mixer_get_fx_tail(mixer, 1.0f);
+  for (i=0; i < mixer->fx_units; i++)
+    if (mixer->fx[i].tail_left != 0)
+      mixer->fx[i].tail_left = tail;
+}
+
+/* Peak level of a send buffer of an effect unit */
+static fluid_real_t
+fluid_rvoice_mixer_get_fx_peak(fluid_rvoice_mixer_t* mixer, int unit, int channel)
+{
+  fluid_real_t* buf = mixer->buffers.fx_left_buf[fluid_mixer_fx_buf(mixer, unit, channel)];
+  int scount = mixer->current_blockcount * FLUID_BUFSIZE;
+  fluid_real_t peak = 0;
+  int i;
+
+  for (i=0; i < scount; i++) {
+    fluid_real_t v = fabs(buf[i]);
+    if (v > peak)
+      peak = v;
+  }
+  return peak;
+}
+
+/**
+ * Find the effect units which have to run for the current blocks: those
+ * whose input is above the noise floor, and those whose output has not
+ * died away yet. Only the sends of units voices send to are measured.
+ * Idle units cost nothing and resume as soon as input arrives.
+ */
+static void
+fluid_rvoice_mixer_update_fx_units(fluid_rvoice_mixer_t* mixer)
+{
+  int i, unit, tail;
+  unsigned int j;
+  int first = mixer->buffers.buf_count * 2;
+  int scount = mixer->current_blockcount * FLUID_BUFSIZE;
+  fluid_real_t peak, chorus_peak;
+
+  for (i=0; i < mixer->fx_units; i++)
+    mixer->fx[i].active = 0;
+
+  for (i=0; i < mixer->active_voices; i++) {
+    fluid_rvoice_buffers_t* buffers = &mixer->rvoices[i]->buffers;
+    for (j=0; j < buffers->count; j++) {
+      if (buffers->bufs[j].mapping < first || buffers->bufs[j].amp == 0.0f)
+        continue;
+      unit = (buffers->bufs[j].mapping - first) / 2;
+      if (unit < mixer->fx_units)
+        mixer->fx[unit].active = 1;
     }
-    for (i=0; i < mixer->current_blockcount * FLUID_BUFSIZE; i += FLUID_BUFSIZE) {
-      fluid_LADSPA_run(mixer->LADSPA_FxUnit, left_buf, right_buf, fx_left_buf, 
-		       fx_right_buf);
-      for (j=0; j < mixer->buffers.buf_count; j++) {
-        left_buf[j] += FLUID_BUFSIZE;
-        right_buf[j] += FLUID_BUFSIZE;
-      }
-      for (j=0; j < mixer->buffers.fx_buf_count; j++) {
-        fx_left_buf[j] += FLUID_BUFSIZE;
-        fx_right_buf[j] += FLUID_BUFSIZE;
+  }
+
+  for (i=0; i < mixer->fx_units; i++) {
+    fluid_mixer_fx_t* fx = &mixer->fx[i];
+
+    peak = 0;
+    if (fx->active) {
+      if (mixer->with_reverb)
+        peak = fluid_rvoice_mixer_get_fx_peak(mixer, i, SYNTH_REVERB_CHANNEL);
+      if (mixer->with_chorus) {
+        chorus_peak = fluid_rvoice_mixer_get_fx_peak(mixer, i, SYNTH_CHORUS_CHANNEL);
+        if (chorus_peak > peak)
+          peak = chorus_peak;
       }
     }
-    fluid_check_fpe("LADSPA");
+
+    if (fx->tail_left > 0)
+      fx->tail_left = (fx->tail_left > scount) ? fx->tail_left - scount : 0;
+
+    if (peak > FX_SILENCE) {
+      /* A louder input before may still be decaying */
+      tail = fluid_rvoice_mixer_get_fx_tail(mixer, peak);
+      if (tail < 0 || tail > fx->tail_left)
+        fx->tail_left = tail;
+      fx->active = 1;
+    }
+    else
+      fx->active = (fx->tail_left != 0);
   }
-#endif
 }
 
 /**
@@ -225,17 +408,20 @@ fluid_mix_one(fluid_rvoice_t* rvoice, fluid_real_t** bufs, unsigned int bufcount
 static FLUID_INLINE int 
 fluid_mixer_buffers_prepare(fluid_mixer_buffers_t* buffers, fluid_real_t** outbufs)
 {
-  fluid_real_t* reverb_buf, *chorus_buf;
+  fluid_rvoice_mixer_t* mixer = buffers->mixer;
+  fluid_real_t** fx_outbufs = &outbufs[buffers->buf_count*2];
   int i;
 
   /* Set up the reverb / chorus buffers only, when the effect is
    * enabled on synth level.  Nonexisting buffers are detected in the
    * DSP loop. Not sending the reverb / chorus signal saves some time
-   * in that case. */
-  reverb_buf = buffers->mixer->fx.with_reverb ? buffers->fx_left_buf[SYNTH_REVERB_CHANNEL] : NULL;
-  chorus_buf = buffers->mixer->fx.with_chorus ? buffers->fx_left_buf[SYNTH_CHORUS_CHANNEL] : NULL;
-  outbufs[buffers->buf_count*2 + SYNTH_REVERB_CHANNEL] = reverb_buf;
-  outbufs[buffers->buf_count*2 + SYNTH_CHORUS_CHANNEL] = chorus_buf;
+   * in that case. Each effect unit has a reverb and a chorus send. */
+  for (i = 0; i < mixer->fx_units; i++) {
+    fx_outbufs[i*2 + SYNTH_REVERB_CHANNEL] = mixer->with_reverb ?
+      buffers->fx_left_buf[fluid_mixer_fx_buf(mixer, i, SYNTH_REVERB_CHANNEL)] : NULL;
+    fx_outbufs[i*2 + SYNTH_CHORUS_CHANNEL] = mixer->with_chorus ?
+      buffers->fx_left_buf[fluid_mixer_fx_buf(mixer, i, SYNTH_CHORUS_CHANNEL)] : NULL;
+  }
 
       /* The output associated with a MIDI channel is wrapped around
        * using the number of audio groups as modulo divider.  This is
@@ -254,7 +440,7 @@ fluid_mixer_buffers_prepare(fluid_mixer_buffers_t* buffers, fluid_real_t** outbu
     outbufs[i*2] = buffers->left_buf[i];
     outbufs[i*2+1] = buffers->right_buf[i];
   }
-  return buffers->buf_count*2 + 2;
+  return buffers->buf_count*2 + mixer->fx_units*2;
 }
 
 
@@ -510,17 +696,22 @@ fluid_mixer_buffers_init(fluid_mixer_buffers_t* buffers, fluid_rvoice_mixer_t* m
 }
 
 /**
- * Note: Not hard real-time capable (calls malloc)
+ * The convolution reverb keeps its impulse response, a new one for the
+ * rate is built outside of the rendering thread and set with
+ * fluid_rvoice_mixer_set_convreverb_ir().
  */
 void 
 fluid_rvoice_mixer_set_samplerate(fluid_rvoice_mixer_t* mixer, fluid_real_t samplerate)
 {
   int i;
-  if (mixer->fx.chorus)
-    delete_fluid_chorus(mixer->fx.chorus);
-  mixer->fx.chorus = new_fluid_chorus(samplerate);
-  if (mixer->fx.reverb)
-	  fluid_revmodel_samplerate_change(mixer->fx.reverb, samplerate);
+  /* the effects are resized in place, this runs on the rendering thread */
+  for (i=0; i < mixer->fx_units; i++) {
+    if (mixer->fx[i].chorus)
+      fluid_chorus_samplerate_change(mixer->fx[i].chorus, samplerate);
+    if (mixer->fx[i].reverb)
+      fluid_revmodel_samplerate_change(mixer->fx[i].reverb, samplerate);
+  }
+  fluid_rvoice_mixer_update_fx_tail(mixer);
   for (i=0; i < mixer->active_voices; i++)
     fluid_rvoice_set_output_rate(mixer->rvoices[i], samplerate);
 }
@@ -528,11 +719,14 @@ fluid_rvoice_mixer_set_samplerate(fluid_rvoice_mixer_t* mixer, fluid_real_t samp
 
 /**
  * @param buf_count number of primary stereo buffers
- * @param fx_buf_count number of stereo effect buffers
+ * @param fx_buf_count number of stereo effect buffers of each effect unit
+ * @param fx_units number of effect units (reverb and chorus)
  */
 fluid_rvoice_mixer_t* 
-new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, fluid_real_t sample_rate)
+new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, int fx_units,
+                       fluid_real_t sample_rate)
 {
+  int i;
   fluid_rvoice_mixer_t* mixer = FLUID_NEW(fluid_rvoice_mixer_t);
   if (mixer == NULL) {
     FLUID_LOG(FLUID_ERR, "Out of memory");
@@ -540,17 +734,29 @@ new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, fluid_real_t sample_rate
   }
   FLUID_MEMSET(mixer, 0, sizeof(fluid_rvoice_mixer_t));
   mixer->buffers.buf_count = buf_count;
-  mixer->buffers.fx_buf_count = fx_buf_count;
+  mixer->buffers.fx_buf_count = fx_buf_count * fx_units;
   mixer->buffers.buf_blocks = FLUID_MIXER_MAX_BUFFERS_DEFAULT;
+  mixer->group_bufs = 1;
   
-  /* allocate the reverb module */
-  mixer->fx.reverb = new_fluid_revmodel(sample_rate);
-  mixer->fx.chorus = new_fluid_chorus(sample_rate);
-  if (mixer->fx.reverb == NULL) {
+  /* allocate the reverb and chorus modules */
+  mixer->fx_units = fx_units;
+  mixer->fx = FLUID_ARRAY(fluid_mixer_fx_t, fx_units);
+  if (mixer->fx == NULL) {
     FLUID_LOG(FLUID_ERR, "Out of memory");
     delete_fluid_rvoice_mixer(mixer);
     return NULL;
   }
+  FLUID_MEMSET(mixer->fx, 0, fx_units * sizeof(fluid_mixer_fx_t));
+  for (i=0; i < fx_units; i++) {
+    mixer->fx[i].reverb = new_fluid_revmodel(sample_rate);
+    mixer->fx[i].chorus = new_fluid_chorus(sample_rate);
+    if (mixer->fx[i].reverb == NULL || mixer->fx[i].chorus == NULL) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      delete_fluid_rvoice_mixer(mixer);
+      return NULL;
+    }
+  }
+  fluid_rvoice_mixer_update_fx_tail(mixer);
   
   if (!fluid_mixer_buffers_init(&mixer->buffers, mixer)) {
     delete_fluid_rvoice_mixer(mixer);
@@ -617,8 +823,22 @@ fluid_mixer_buffers_free(fluid_mixer_buffers_t* buffers)
   }  
 }
 
+static void
+fluid_rvoice_mixer_free_convreverb_workers(fluid_rvoice_mixer_t* mixer)
+{
+  int i;
+
+  for (i=0; i < mixer->convreverb_worker_count; i++)
+    delete_fluid_convreverb_worker(mixer->convreverb_workers[i]);
+  if (mixer->convreverb_workers)
+    FLUID_FREE(mixer->convreverb_workers);
+  mixer->convreverb_workers = NULL;
+  mixer->convreverb_worker_count = 0;
+}
+
 void delete_fluid_rvoice_mixer(fluid_rvoice_mixer_t* mixer)
 {
+  int i;
   if (!mixer)
     return;
   fluid_rvoice_mixer_set_threads(mixer, 0, 0);
@@ -633,10 +853,20 @@ void delete_fluid_rvoice_mixer(fluid_rvoice_mixer_t* mixer)
     delete_fluid_cond_mutex(mixer->wakeup_threads_m);
 #endif
   fluid_mixer_buffers_free(&mixer->buffers);
-  if (mixer->fx.reverb)
-    delete_fluid_revmodel(mixer->fx.reverb);
-  if (mixer->fx.chorus)
-    delete_fluid_chorus(mixer->fx.chorus);
+  if (mixer->fx) {
+    for (i=0; i < mixer->fx_units; i++) {
+      if (mixer->fx[i].reverb)
+        delete_fluid_revmodel(mixer->fx[i].reverb);
+      if (mixer->fx[i].chorus)
+        delete_fluid_chorus(mixer->fx[i].chorus);
+      if (mixer->fx[i].convreverb)
+        delete_fluid_convreverb(mixer->fx[i].convreverb);
+    }
+    FLUID_FREE(mixer->fx);
+  }
+  fluid_rvoice_mixer_free_convreverb_workers(mixer);
+  delete_fluid_convreverb_ir(mixer->convreverb_ir);
+  fluid_convreverb_ir_free_retired(&mixer->convreverb_retired);
   FLUID_FREE(mixer->rvoices);
   FLUID_FREE(mixer);
 }
@@ -650,48 +880,170 @@ void fluid_rvoice_mixer_set_ladspa(fluid_rvoice_mixer_t* mixer,
 }
 #endif
 
+/**
+ * Replace the reverb of all effect units with convolution reverbs.
+ * Must be called before rendering starts. The units share at most
+ * CONVREVERB_WORKERS worker threads.
+ * @param ir Impulse response, the mixer takes ownership (also on failure)
+ * @param prio_level Real-time priority of the convolution worker threads
+ * @return FLUID_OK on success, FLUID_FAILED otherwise (the built-in reverb
+ *   stays in use)
+ */
+int fluid_rvoice_mixer_set_convreverb(fluid_rvoice_mixer_t* mixer,
+                                      fluid_convreverb_ir_t* ir, int prio_level)
+{
+  int i, count;
+
+  count = mixer->fx_units < CONVREVERB_WORKERS
+    ? mixer->fx_units : CONVREVERB_WORKERS;
+  mixer->convreverb_workers = FLUID_ARRAY(fluid_convreverb_worker_t*, count);
+  if (mixer->convreverb_workers == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    goto error_recovery;
+  }
+  for (i=0; i < count; i++) {
+    mixer->convreverb_workers[i] = new_fluid_convreverb_worker(prio_level);
+    if (mixer->convreverb_workers[i] == NULL)
+      break;
+  }
+  mixer->convreverb_worker_count = i;
+  /* Without a worker the transforms run on the rendering thread, with
+   * the same output. */
+  if (mixer->convreverb_worker_count < count)
+    FLUID_LOG(FLUID_WARN, "Convolution reverb runs with %d of %d worker threads",
+              mixer->convreverb_worker_count, count);
+
+  for (i=0; i < mixer->fx_units; i++) {
+    mixer->fx[i].convreverb = new_fluid_convreverb(ir,
+      mixer->convreverb_worker_count > 0
+      ? mixer->convreverb_workers[i % mixer->convreverb_worker_count] : NULL);
+    if (mixer->fx[i].convreverb == NULL)
+      goto error_recovery;
+  }
+  mixer->convreverb_ir = ir;
+  fluid_rvoice_mixer_update_fx_tail(mixer);
+  return FLUID_OK;
+
+error_recovery:
+  for (i=0; i < mixer->fx_units; i++) {
+    delete_fluid_convreverb(mixer->fx[i].convreverb);
+    mixer->fx[i].convreverb = NULL;
+  }
+  fluid_rvoice_mixer_free_convreverb_workers(mixer);
+  delete_fluid_convreverb_ir(ir);
+  return FLUID_FAILED;
+}
+
+/**
+ * Switch the convolution reverb units to another impulse response, like
+ * one built for a new sample rate. The previous impulse response is
+ * retired, fluid_rvoice_mixer_free_retired_convreverb_irs() frees it.
+ * Note: Not hard real-time capable (allocates the delay lines of the
+ * units, the spectra are already built)
+ * @param ir Impulse response, the mixer takes ownership
+ */
+void fluid_rvoice_mixer_set_convreverb_ir(fluid_rvoice_mixer_t* mixer,
+                                          fluid_convreverb_ir_t* ir)
+{
+  int i;
+
+  for (i=0; i < mixer->fx_units; i++)
+    if (fluid_convreverb_set_ir(mixer->fx[i].convreverb, ir) != FLUID_OK)
+      FLUID_LOG(FLUID_ERR, "Convolution reverb of effects group %d is silent", i);
+
+  if (mixer->convreverb_ir)
+    fluid_convreverb_ir_retire(&mixer->convreverb_retired, mixer->convreverb_ir);
+  mixer->convreverb_ir = ir;
+  fluid_rvoice_mixer_update_fx_tail(mixer);
+}
+
+/**
+ * Free the impulse responses replaced by fluid_rvoice_mixer_set_convreverb_ir().
+ * Can be called in parallel with the rendering thread.
+ */
+void fluid_rvoice_mixer_free_retired_convreverb_irs(fluid_rvoice_mixer_t* mixer)
+{
+  fluid_convreverb_ir_free_retired(&mixer->convreverb_retired);
+}
+
+/**
+ * Set how many stereo buffers each audio group takes (more than one for
+ * surround layouts). Must be called before rendering starts.
+ */
+void fluid_rvoice_mixer_set_group_bufs(fluid_rvoice_mixer_t* mixer, int bufs)
+{
+  mixer->group_bufs = bufs;
+}
+
 void fluid_rvoice_mixer_set_reverb_enabled(fluid_rvoice_mixer_t* mixer, int on)
 {
-  mixer->fx.with_reverb = on;
+  mixer->with_reverb = on;
+  fluid_rvoice_mixer_update_fx_tail(mixer);
 }
 
 void fluid_rvoice_mixer_set_chorus_enabled(fluid_rvoice_mixer_t* mixer, int on)
 {
-  mixer->fx.with_chorus = on;
+  mixer->with_chorus = on;
 }
 
 void fluid_rvoice_mixer_set_mix_fx(fluid_rvoice_mixer_t* mixer, int on)
 {
-  mixer->fx.mix_fx_to_out = on;
+  mixer->mix_fx_to_out = on;
+}
+
+void fluid_rvoice_mixer_set_chorus_interp(fluid_rvoice_mixer_t* mixer, int interp)
+{
+  int i;
+  mixer->chorus_interp = interp;
+  for (i=0; i < mixer->fx_units; i++)
+    if (mixer->fx[i].chorus)
+      fluid_chorus_set_interp(mixer->fx[i].chorus, interp);
 }
 
 void fluid_rvoice_mixer_set_chorus_params(fluid_rvoice_mixer_t* mixer, int set, 
 				         int nr, double level, double speed, 
 				         double depth_ms, int type)
 {
-  fluid_chorus_set(mixer->fx.chorus, set, nr, level, speed, depth_ms, type);
+  int i;
+  for (i=0; i < mixer->fx_units; i++)
+    fluid_chorus_set(mixer->fx[i].chorus, set, nr, level, speed, depth_ms, type);
 }
 void fluid_rvoice_mixer_set_reverb_params(fluid_rvoice_mixer_t* mixer, int set, 
 					 double roomsize, double damping, 
 					 double width, double level)
 {
-  fluid_revmodel_set(mixer->fx.reverb, set, roomsize, damping, width, level); 
+  int i;
+  for (i=0; i < mixer->fx_units; i++)
+  {
+    fluid_revmodel_set(mixer->fx[i].reverb, set, roomsize, damping, width, level); 
+    if (mixer->fx[i].convreverb)
+      fluid_convreverb_set(mixer->fx[i].convreverb, set, roomsize, damping, width, level);
+  }
+  fluid_rvoice_mixer_update_fx_tail(mixer);
 }
 
 void fluid_rvoice_mixer_reset_fx(fluid_rvoice_mixer_t* mixer)
 {
-  fluid_revmodel_reset(mixer->fx.reverb);
-  fluid_chorus_reset(mixer->fx.chorus);
+  fluid_rvoice_mixer_reset_reverb(mixer);
+  fluid_rvoice_mixer_reset_chorus(mixer);
 }
 
 void fluid_rvoice_mixer_reset_reverb(fluid_rvoice_mixer_t* mixer)
 {
-  fluid_revmodel_reset(mixer->fx.reverb);
+  int i;
+  for (i=0; i < mixer->fx_units; i++)
+  {
+    fluid_revmodel_reset(mixer->fx[i].reverb);
+    if (mixer->fx[i].convreverb)
+      fluid_convreverb_reset(mixer->fx[i].convreverb);
+  }
 }
 
 void fluid_rvoice_mixer_reset_chorus(fluid_rvoice_mixer_t* mixer)
 {
-  fluid_chorus_reset(mixer->fx.chorus);
+  int i;
+  for (i=0; i < mixer->fx_units; i++)
+    fluid_chorus_reset(mixer->fx[i].chorus);
 }
 
 int fluid_rvoice_mixer_get_bufs(fluid_rvoice_mixer_t* mixer, 
@@ -702,6 +1054,19 @@ int fluid_rvoice_mixer_get_bufs(fluid_rvoice_mixer_t* mixer,
   return mixer->buffers.buf_count;
 }
 
+/**
+ * Get the effect buffers. Without mixing the effects to the output, they
+ * hold the effect output after rendering: reverb and chorus of the first
+ * effect unit, then those of the next one and so on.
+ */
+int fluid_rvoice_mixer_get_fx_bufs(fluid_rvoice_mixer_t* mixer, 
+				  fluid_real_t*** fx_left, fluid_real_t*** fx_right)
+{
+  *fx_left = mixer->buffers.fx_left_buf;
+  *fx_right = mixer->buffers.fx_right_buf;
+  return mixer->buffers.fx_buf_count;
+}
+
 
 #ifdef ENABLE_MIXER_THREADS
 
@@ -718,6 +1083,47 @@ fluid_mixer_get_mt_rvoice(fluid_rvoice_mixer_t* mixer)
 #define THREAD_BUF_VALID 1
 #define THREAD_BUF_NODATA 2
 #define THREAD_BUF_TERMINATE 3
+#define THREAD_BUF_FX 4
+
+/**
+ * Run one effect task. A single effect unit is split into reverb and
+ * chorus. Both write to the primary output when mix_fx_to_out is set, so
+ * the chorus then goes to the buffers of the first thread, which are unused
+ * at this point, and is added afterwards. Several effect units run one
+ * unit per task.
+ */
+static void
+fluid_mixer_run_fx_task(fluid_rvoice_mixer_t* mixer, int task)
+{
+  if (mixer->fx_units > 1) {
+    if (!mixer->fx[task].active)
+      return;
+    if (mixer->with_reverb)
+      fluid_rvoice_mixer_process_reverb(mixer, task);
+    if (mixer->with_chorus)
+      fluid_rvoice_mixer_process_chorus(mixer, task);
+  }
+  else if (task == FX_TASK_REVERB)
+    fluid_rvoice_mixer_process_reverb(mixer, 0);
+  else if (mixer->mix_fx_to_out)
+    fluid_chorus_processreplace(mixer->fx[0].chorus,
+                                mixer->buffers.fx_left_buf[SYNTH_CHORUS_CHANNEL],
+                                mixer->threads[0].left_buf[0],
+                                mixer->threads[0].right_buf[0],
+                                mixer->current_blockcount * FLUID_BUFSIZE);
+  else
+    fluid_rvoice_mixer_process_chorus(mixer, 0);
+}
+
+/* Run effects until there are none left (called from all threads) */
+static void
+fluid_mixer_run_fx_tasks(fluid_rvoice_mixer_t* mixer)
+{
+  int task;
+  while ((task = fluid_atomic_int_exchange_and_add(&mixer->current_fx_task, 1)) 
+         < mixer->fx_task_count)
+    fluid_mixer_run_fx_task(mixer, task);
+}
 
 /* Core thread function (processes voices in parallel to primary synthesis thread) */
 static void
@@ -743,6 +1149,17 @@ fluid_mixer_thread_func (void* data)
         int j = fluid_atomic_int_get(&buffers->ready); 
         if (j == THREAD_BUF_PROCESSING || j == THREAD_BUF_TERMINATE)
           break;
+        if (j == THREAD_BUF_FX) {
+          // help with the effects, then go back to sleep
+          fluid_cond_mutex_unlock(mixer->wakeup_threads_m);
+          fluid_mixer_run_fx_tasks(mixer);
+          fluid_atomic_int_set(&buffers->ready, THREAD_BUF_NODATA);
+          fluid_cond_mutex_lock(mixer->thread_ready_m);
+          fluid_cond_signal(mixer->thread_ready);
+          fluid_cond_mutex_unlock(mixer->thread_ready_m);
+          fluid_cond_mutex_lock(mixer->wakeup_threads_m);
+          continue;
+        }
         fluid_cond_wait(mixer->wakeup_threads, mixer->wakeup_threads_m);
       }
       fluid_cond_mutex_unlock(mixer->wakeup_threads_m);
@@ -875,6 +1292,80 @@ fluid_render_loop_multithread(fluid_rvoice_mixer_t* mixer)
   //	    mixer->current_blockcount, test, mixer->active_voices, waits);
 }
 
+/**
+ * Is it worth running the effects on several threads? Only if there is
+ * more than one active effect, and when effect units are mixed to the
+ * output, no two of them may share an output buffer.
+ */
+static int
+fluid_mixer_fx_multithread(fluid_rvoice_mixer_t* mixer)
+{
+  int i, active = 0;
+
+  if (mixer->thread_count == 0 
+      || mixer->current_blockcount * FLUID_BUFSIZE < FX_SAMPLES_PER_THREAD)
+    return FALSE;
+
+  if (mixer->fx_units == 1)
+    return mixer->fx[0].active && mixer->with_reverb && mixer->with_chorus;
+
+  if (mixer->mix_fx_to_out && mixer->fx_units > mixer->buffers.buf_count)
+    return FALSE;
+  for (i=0; i < mixer->fx_units; i++)
+    active += mixer->fx[i].active;
+  return active > 1;
+}
+
+/**
+ * Run the effects in parallel on the extra threads. Their input is
+ * complete only once all voices are mixed, and the LADSPA unit reads their
+ * output, so only reverb and chorus can overlap.
+ */
+static void
+fluid_render_fx_multithread(fluid_rvoice_mixer_t* mixer)
+{
+  int i, waiting, threads;
+  int scount = mixer->current_blockcount * FLUID_BUFSIZE;
+  fluid_real_t* left;
+  fluid_real_t* right;
+
+  mixer->fx_task_count = (mixer->fx_units == 1) ? 2 : mixer->fx_units;
+  threads = mixer->fx_task_count - 1;
+  if (threads > mixer->thread_count)
+    threads = mixer->thread_count;
+
+  // Let the threads take whatever effect is left when they wake up
+  fluid_cond_mutex_lock(mixer->wakeup_threads_m);
+  fluid_atomic_int_set(&mixer->current_fx_task, 0);
+  for (i=0; i < threads; i++)
+    fluid_atomic_int_set(&mixer->threads[i].ready, THREAD_BUF_FX);
+  fluid_cond_broadcast(mixer->wakeup_threads);
+  fluid_cond_mutex_unlock(mixer->wakeup_threads_m);
+
+  fluid_mixer_run_fx_tasks(mixer);
+
+  fluid_cond_mutex_lock(mixer->thread_ready_m);
+  do {
+    waiting = 0;
+    for (i=0; i < threads; i++)
+      if (fluid_atomic_int_get(&mixer->threads[i].ready) == THREAD_BUF_FX)
+        waiting = 1;
+    if (waiting)
+      fluid_cond_wait(mixer->thread_ready, mixer->thread_ready_m);
+  } while (waiting);
+  fluid_cond_mutex_unlock(mixer->thread_ready_m);
+
+  if (mixer->fx_units == 1 && mixer->mix_fx_to_out) {
+    left = mixer->threads[0].left_buf[0];
+    right = mixer->threads[0].right_buf[0];
+    for (i=0; i < scount; i++) {
+      mixer->buffers.left_buf[0][i] += left[i];
+      mixer->buffers.right_buf[0][i] += right[i];
+    }
+  }
+  fluid_rvoice_mixer_process_ladspa(mixer);
+}
+
 #endif
 
 /**
@@ -965,7 +1456,13 @@ fluid_rvoice_mixer_render(fluid_rvoice_mixer_t* mixer, int blockcount)
     
 
   // Process reverb & chorus
-  fluid_rvoice_mixer_process_fx(mixer);
+  fluid_rvoice_mixer_update_fx_units(mixer);
+#ifdef ENABLE_MIXER_THREADS
+  if (fluid_mixer_fx_multithread(mixer))
+    fluid_render_fx_multithread(mixer);
+  else
+#endif
+    fluid_rvoice_mixer_process_fx(mixer);
 
   // Call the callback and pack active voice array
   fluid_rvoice_mixer_process_finished_voices(mixer);
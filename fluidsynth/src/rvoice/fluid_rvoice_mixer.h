@@ -25,6 +25,7 @@
 #include "fluidsynth_priv.h"
 #include "fluid_rvoice.h"
 #include "fluid_ladspa.h"
+#include "fluid_convreverb.h"
 
 typedef struct _fluid_rvoice_mixer_t fluid_rvoice_mixer_t;
 
@@ -41,8 +42,11 @@ int fluid_rvoice_mixer_render(fluid_rvoice_mixer_t* mixer, int blockcount);
 int fluid_rvoice_mixer_get_bufs(fluid_rvoice_mixer_t* mixer, 
 				  fluid_real_t*** left, fluid_real_t*** right);
 
+int fluid_rvoice_mixer_get_fx_bufs(fluid_rvoice_mixer_t* mixer, 
+				  fluid_real_t*** fx_left, fluid_real_t*** fx_right);
+
 fluid_rvoice_mixer_t* new_fluid_rvoice_mixer(int buf_count, int fx_buf_count, 
-					     fluid_real_t sample_rate);
+					     int fx_units, fluid_real_t sample_rate);
 
 void delete_fluid_rvoice_mixer(fluid_rvoice_mixer_t*);
 
@@ -50,6 +54,8 @@ void fluid_rvoice_mixer_set_samplerate(fluid_rvoice_mixer_t* mixer, fluid_real_t
 void fluid_rvoice_mixer_set_reverb_enabled(fluid_rvoice_mixer_t* mixer, int on);
 void fluid_rvoice_mixer_set_chorus_enabled(fluid_rvoice_mixer_t* mixer, int on);
 void fluid_rvoice_mixer_set_mix_fx(fluid_rvoice_mixer_t* mixer, int on);
+void fluid_rvoice_mixer_set_group_bufs(fluid_rvoice_mixer_t* mixer, int bufs);
+void fluid_rvoice_mixer_set_chorus_interp(fluid_rvoice_mixer_t* mixer, int interp);
 int fluid_rvoice_mixer_set_polyphony(fluid_rvoice_mixer_t* handler, int value);
 int fluid_rvoice_mixer_add_voice(fluid_rvoice_mixer_t* mixer, fluid_rvoice_t* voice);
 void fluid_rvoice_mixer_set_chorus_params(fluid_rvoice_mixer_t* mixer, int set, 
@@ -64,6 +70,11 @@ void fluid_rvoice_mixer_reset_chorus(fluid_rvoice_mixer_t* mixer);
 
 void fluid_rvoice_mixer_set_threads(fluid_rvoice_mixer_t* mixer, int thread_count, 
 				    int prio_level);
+int fluid_rvoice_mixer_set_convreverb(fluid_rvoice_mixer_t* mixer,
+                                      fluid_convreverb_ir_t* ir, int prio_level);
+void fluid_rvoice_mixer_set_convreverb_ir(fluid_rvoice_mixer_t* mixer,
+                                          fluid_convreverb_ir_t* ir);
+void fluid_rvoice_mixer_free_retired_convreverb_irs(fluid_rvoice_mixer_t* mixer);
 				    
 #ifdef LADSPA				    
 void fluid_rvoice_mixer_set_ladspa(fluid_rvoice_mixer_t* mixer, 
@@ -25,6 +25,11 @@
 #include "fluid_defsfont.h"
 /* Todo: Get rid of that 'include' */
 #include "fluid_sys.h"
+#include "fluid_hash.h"
+
+#if LIBSNDFILE_SUPPORT
+#include <sndfile.h>
+#endif
 
 /***************************************************************
  *
@@ -109,99 +114,1247 @@ char* fluid_defsfont_sfont_get_name(fluid_sfont_t* sfont)
   return fluid_defsfont_get_name((fluid_defsfont_t*) sfont->data);
 }
 
-fluid_sample_t* fluid_defsfont_get_sample(fluid_defsfont_t* sfont, char *s)
+fluid_sample_t* fluid_defsfont_get_sample(fluid_defsfont_t* sfont, char *s)
+{
+  /* This function is here just to avoid an ABI/SONAME bump, see ticket #98. Should never be used. */
+  return NULL;
+}
+
+fluid_preset_t*
+fluid_defsfont_sfont_get_preset(fluid_sfont_t* sfont, unsigned int bank, unsigned int prenum)
+{
+  fluid_preset_t* preset = NULL;
+  fluid_defpreset_t* defpreset;
+  fluid_defsfont_t* defsfont = sfont->data;
+
+  defpreset = fluid_defsfont_get_preset(defsfont, bank, prenum);
+
+  if (defpreset == NULL) {
+    return NULL;
+  }
+
+  if (defsfont->preset_stack_size > 0) {
+    defsfont->preset_stack_size--;
+    preset = defsfont->preset_stack[defsfont->preset_stack_size];
+  }
+  if (!preset)
+    preset = FLUID_NEW(fluid_preset_t);
+  if (!preset) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+
+  preset->sfont = sfont;
+  preset->data = defpreset;
+  preset->free = fluid_defpreset_preset_delete;
+  preset->get_name = fluid_defpreset_preset_get_name;
+  preset->get_banknum = fluid_defpreset_preset_get_banknum;
+  preset->get_num = fluid_defpreset_preset_get_num;
+  preset->noteon = fluid_defpreset_preset_noteon;
+  preset->notify = fluid_defpreset_preset_notify;
+
+  return preset;
+}
+
+void fluid_defsfont_sfont_iteration_start(fluid_sfont_t* sfont)
+{
+  fluid_defsfont_iteration_start((fluid_defsfont_t*) sfont->data);
+}
+
+int fluid_defsfont_sfont_iteration_next(fluid_sfont_t* sfont, fluid_preset_t* preset)
+{
+  preset->free = fluid_defpreset_preset_delete;
+  preset->get_name = fluid_defpreset_preset_get_name;
+  preset->get_banknum = fluid_defpreset_preset_get_banknum;
+  preset->get_num = fluid_defpreset_preset_get_num;
+  preset->noteon = fluid_defpreset_preset_noteon;
+  preset->notify = fluid_defpreset_preset_notify;
+
+  return fluid_defsfont_iteration_next((fluid_defsfont_t*) sfont->data, preset);
+}
+
+int fluid_defpreset_preset_delete(fluid_preset_t* preset)
+{
+  fluid_defpreset_t* defpreset = preset ? preset->data : NULL;
+  fluid_defsfont_t* sfont = defpreset ? defpreset->sfont : NULL;
+
+  if (sfont && sfont->preset_stack_size < sfont->preset_stack_capacity) {
+     sfont->preset_stack[sfont->preset_stack_size] = preset;
+     sfont->preset_stack_size++;
+  }
+  else
+    FLUID_FREE(preset);
+
+  return 0;
+}
+
+char* fluid_defpreset_preset_get_name(fluid_preset_t* preset)
+{
+  return fluid_defpreset_get_name((fluid_defpreset_t*) preset->data);
+}
+
+int fluid_defpreset_preset_get_banknum(fluid_preset_t* preset)
+{
+  return fluid_defpreset_get_banknum((fluid_defpreset_t*) preset->data);
+}
+
+int fluid_defpreset_preset_get_num(fluid_preset_t* preset)
+{
+  return fluid_defpreset_get_num((fluid_defpreset_t*) preset->data);
+}
+
+int fluid_defpreset_preset_noteon(fluid_preset_t* preset, fluid_synth_t* synth,
+				 int chan, int key, int vel)
+{
+  return fluid_defpreset_noteon((fluid_defpreset_t*) preset->data, synth, chan, key, vel);
+}
+
+int fluid_defpreset_preset_notify(fluid_preset_t* preset, int reason, int chan)
+{
+  /* get the compressed samples ready before the first note */
+  if (reason == FLUID_PRESET_SELECTED)
+    fluid_cached_sample_prefetch((fluid_defpreset_t*) preset->data);
+
+  return FLUID_OK;
+}
+
+
+
+
+/***************************************************************
+ *
+ *                    CACHED SAMPLEDATA LOADER
+ */
+
+typedef struct _fluid_cached_sample_t fluid_cached_sample_t;
+
+typedef struct _fluid_cached_sampledata_t {
+  char* filename;               /* canonical file name */
+  time_t modification_time;
+  int num_references;
+  int mlock;
+
+  const short* sampledata;
+  unsigned int samplesize;
+
+  const sint32* sampledata24;   /* combined 24 bit data, NULL for 16 bit fonts */
+
+  /* Set while the first user reads the sample data from file. Other users
+   * of the same file wait on loading_cond instead of reading it again. */
+  int loading;
+  fluid_cond_mutex_t* loading_mutex;
+  fluid_cond_t* loading_cond;
+
+  fluid_hashtable_t* compressed; /* decoded SF3 samples by smpl byte offset, NULL if none */
+} fluid_cached_sampledata_t;
+
+/* The cached sample data by (file name, modification time, size) and by
+ * sample data pointer. The lock only protects the tables and the reference
+ * counts, it is never held while reading from file. */
+static fluid_hashtable_t* cached_sampledata_by_file = NULL;
+static fluid_hashtable_t* cached_sampledata_by_data = NULL;
+static int cached_sampledata_count = 0;   /* entries alive, including failed ones */
+static fluid_mutex_t cached_sampledata_mutex = FLUID_MUTEX_INIT;
+
+static unsigned int fluid_cached_sampledata_hash(const void* key)
+{
+  const fluid_cached_sampledata_t* cached_sampledata = key;
+
+  return fluid_str_hash(cached_sampledata->filename)
+    ^ (unsigned int) cached_sampledata->modification_time
+    ^ (cached_sampledata->samplesize * 31);
+}
+
+static int fluid_cached_sampledata_equal(const void* a, const void* b)
+{
+  const fluid_cached_sampledata_t* ca = a;
+  const fluid_cached_sampledata_t* cb = b;
+
+  return ca->modification_time == cb->modification_time
+    && ca->samplesize == cb->samplesize
+    && FLUID_STRCMP(ca->filename, cb->filename) == 0;
+}
+
+/* Resolve symbolic links and relative paths, so that the same file loaded
+ * through different names shares one cache entry. */
+static char* fluid_get_canonical_filename(const char* filename)
+{
+  char* canonical = NULL;
+  char* result;
+
+#if defined(WIN32)
+  canonical = _fullpath(NULL, filename, 0);
+#elif !defined(__OS2__)
+  canonical = realpath(filename, NULL);
+#endif
+
+  if (canonical == NULL)
+    return FLUID_STRDUP(filename);
+
+  /* realpath() allocates with the system malloc */
+  result = FLUID_STRDUP(canonical);
+  free(canonical);
+  return result;
+}
+
+static int fluid_get_file_modification_time(char *filename, time_t *modification_time)
+{
+#if defined(WIN32) || defined(__OS2__)
+  *modification_time = 0;
+  return FLUID_OK;
+#else
+  struct stat buf;
+
+  if (stat(filename, &buf) == -1) {
+    return FLUID_FAILED;
+  }
+
+  *modification_time = buf.st_mtime;
+  return FLUID_OK;
+#endif
+}
+
+/* Combine the 16 bit smpl data with the least significant bytes of the sm24
+ * chunk into 24 bit integers. Returns NULL on failure, the 16 bit data is
+ * still usable in that case. */
+static sint32* fluid_cached_sampledata_load24(fluid_file fd, unsigned int sample24pos,
+  unsigned int sample24size, const short *sampledata, unsigned int samplesize)
+{
+  unsigned int count = samplesize / 2;
+  unsigned char *lsb;
+  sint32 *data24;
+  unsigned int i;
+
+  if (sample24size < count) {
+    FLUID_LOG(FLUID_WARN, "sm24 chunk too small, using 16 bit sample data");
+    return NULL;
+  }
+
+  lsb = FLUID_ARRAY(unsigned char, count);
+  data24 = FLUID_ARRAY(sint32, count);
+  if (lsb == NULL || data24 == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    goto error_exit;
+  }
+
+  if (FLUID_FSEEK(fd, sample24pos, SEEK_SET) == -1
+      || FLUID_FREAD(lsb, 1, count, fd) < count) {
+    FLUID_LOG(FLUID_WARN, "Failed to read sm24 chunk, using 16 bit sample data");
+    goto error_exit;
+  }
+
+  for (i = 0; i < count; i++)
+    data24[i] = (sint32)sampledata[i] * 256 + lsb[i];
+
+  FLUID_FREE(lsb);
+  return data24;
+
+ error_exit:
+  if (lsb != NULL) FLUID_FREE(lsb);
+  if (data24 != NULL) FLUID_FREE(data24);
+  return NULL;
+}
+
+/* Lock the memory to disable paging. It's okay if this fails. It
+   probably means that the user doesn't have to required permission. */
+static void fluid_cached_sampledata_mlock(fluid_cached_sampledata_t* cached_sampledata,
+                                          int try_mlock)
+{
+  if (!try_mlock || cached_sampledata->mlock)
+    return;
+
+  if (fluid_mlock(cached_sampledata->sampledata, cached_sampledata->samplesize) != 0) {
+    FLUID_LOG(FLUID_WARN, "Failed to pin the sample data to RAM; swapping is possible.");
+    return;
+  }
+
+  cached_sampledata->mlock = try_mlock;
+  if (cached_sampledata->sampledata24 != NULL)
+    fluid_mlock(cached_sampledata->sampledata24, cached_sampledata->samplesize * 2);
+}
+
+/* Byte swap the 16 bit sample points read on a big endian machine. The
+ * compressed streams of SoundFont 3 files are byte streams and are left
+ * alone, 'sfsamples' are the sample headers telling where they are. */
+static int fluid_cached_sampledata_swap(short* data, unsigned int samplesize,
+                                        fluid_list_t* sfsamples)
+{
+  unsigned char* cbuf = (unsigned char*) data;
+  unsigned char* stream = NULL;   /* bit set for each point of a stream */
+  unsigned int points = samplesize / 2;
+  unsigned int i, end;
+  unsigned char hi, lo;
+  fluid_list_t* p;
+  SFSample* sfsample;
+
+  for (p = sfsamples; p; p = fluid_list_next(p)) {
+    sfsample = (SFSample*) fluid_list_get(p);
+    if (!(sfsample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+        || sfsample->start >= samplesize)
+      continue;
+
+    if (stream == NULL) {
+      stream = FLUID_ARRAY(unsigned char, points / 8 + 1);
+      if (stream == NULL) {
+        FLUID_LOG(FLUID_ERR, "Out of memory");
+        return FLUID_FAILED;
+      }
+      FLUID_MEMSET(stream, 0, points / 8 + 1);
+    }
+
+    end = (sfsample->end < samplesize - sfsample->start)
+      ? sfsample->start + sfsample->end : samplesize;
+    for (i = sfsample->start / 2; i < (end + 1) / 2; i++)
+      stream[i / 8] |= 1 << (i % 8);
+  }
+
+  for (i = 0; i < points; i++) {
+    if (stream != NULL && (stream[i / 8] & (1 << (i % 8))))
+      continue;
+    lo = cbuf[2 * i];
+    hi = cbuf[2 * i + 1];
+    data[i] = (hi << 8) | lo;
+  }
+
+  if (stream != NULL)
+    FLUID_FREE(stream);
+  return FLUID_OK;
+}
+
+/* Read the sample data of a new cache entry. Called without holding the
+ * cache lock, the entry isn't visible to other users until loading is reset. */
+static int fluid_cached_sampledata_read(fluid_cached_sampledata_t* cached_sampledata,
+  unsigned int samplepos, unsigned int sample24pos, unsigned int sample24size,
+  fluid_list_t* sfsamples)
+{
+  unsigned int samplesize = cached_sampledata->samplesize;
+  fluid_file fd;
+  short *loaded_sampledata = NULL;
+
+  fd = FLUID_FOPEN(cached_sampledata->filename, "rb");
+  if (fd == NULL) {
+    FLUID_LOG(FLUID_ERR, "Can't open soundfont file");
+    return FLUID_FAILED;
+  }
+  if (FLUID_FSEEK(fd, samplepos, SEEK_SET) == -1) {
+    perror("error");
+    FLUID_LOG(FLUID_ERR, "Failed to seek position in data file");
+    goto error_exit;
+  }
+
+  loaded_sampledata = (short*) FLUID_MALLOC(samplesize);
+  if (loaded_sampledata == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    goto error_exit;
+  }
+  if (FLUID_FREAD(loaded_sampledata, 1, samplesize, fd) < samplesize) {
+    FLUID_LOG(FLUID_ERR, "Failed to read sample data");
+    goto error_exit;
+  }
+
+  /* If this machine is big endian, the sample have to byte swapped  */
+  if (FLUID_IS_BIG_ENDIAN
+      && fluid_cached_sampledata_swap(loaded_sampledata, samplesize, sfsamples) != FLUID_OK)
+    goto error_exit;
+
+  cached_sampledata->sampledata = loaded_sampledata;
+  if (sample24pos != 0) {
+    cached_sampledata->sampledata24 = fluid_cached_sampledata_load24(fd, sample24pos,
+      sample24size, loaded_sampledata, samplesize);
+  }
+
+  FLUID_FCLOSE(fd);
+  return FLUID_OK;
+
+ error_exit:
+  FLUID_FCLOSE(fd);
+  if (loaded_sampledata != NULL) {
+    FLUID_FREE(loaded_sampledata);
+  }
+  return FLUID_FAILED;
+}
+
+/* Must be called with the cache lock held */
+static void fluid_cached_sampledata_unref(fluid_cached_sampledata_t* cached_sampledata)
+{
+  if (--cached_sampledata->num_references > 0)
+    return;
+
+  /* A failed entry has been replaced or removed already */
+  if (fluid_hashtable_lookup(cached_sampledata_by_file, cached_sampledata) == cached_sampledata)
+    fluid_hashtable_remove(cached_sampledata_by_file, cached_sampledata);
+
+  if (cached_sampledata->sampledata != NULL) {
+    fluid_hashtable_remove(cached_sampledata_by_data, cached_sampledata->sampledata);
+
+    if (cached_sampledata->mlock) {
+      fluid_munlock(cached_sampledata->sampledata, cached_sampledata->samplesize);
+      if (cached_sampledata->sampledata24 != NULL)
+        fluid_munlock(cached_sampledata->sampledata24, cached_sampledata->samplesize * 2);
+    }
+    FLUID_FREE((short*) cached_sampledata->sampledata);
+  }
+  if (cached_sampledata->sampledata24 != NULL)
+    FLUID_FREE((sint32*) cached_sampledata->sampledata24);
+  if (cached_sampledata->compressed != NULL)
+    delete_fluid_hashtable(cached_sampledata->compressed);
+
+  delete_fluid_cond(cached_sampledata->loading_cond);
+  delete_fluid_cond_mutex(cached_sampledata->loading_mutex);
+  FLUID_FREE(cached_sampledata->filename);
+  FLUID_FREE(cached_sampledata);
+
+  /* The tables go once no entry is left at all, a failed entry removed
+     from them may still be referenced by threads waiting for its load */
+  if (--cached_sampledata_count == 0) {
+    delete_fluid_hashtable(cached_sampledata_by_file);
+    delete_fluid_hashtable(cached_sampledata_by_data);
+    cached_sampledata_by_file = NULL;
+    cached_sampledata_by_data = NULL;
+  }
+}
+
+static int fluid_cached_sampledata_load(char *filename, unsigned int samplepos,
+  unsigned int samplesize, short **sampledata, unsigned int sample24pos,
+  unsigned int sample24size, sint32 **sampledata24, int try_mlock,
+  fluid_list_t* sfsamples)
+{
+  fluid_cached_sampledata_t key;
+  fluid_cached_sampledata_t* cached_sampledata = NULL;
+  int result;
+
+  *sampledata = NULL;
+  *sampledata24 = NULL;
+
+  key.filename = fluid_get_canonical_filename(filename);
+  if (key.filename == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+  key.samplesize = samplesize;
+
+  if (fluid_get_file_modification_time(key.filename, &key.modification_time) == FLUID_FAILED) {
+    FLUID_LOG(FLUID_WARN, "Unable to read modificaton time of soundfont file.");
+    key.modification_time = 0;
+  }
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+
+  if (cached_sampledata_by_file == NULL) {
+    cached_sampledata_by_file = new_fluid_hashtable(fluid_cached_sampledata_hash,
+                                                    fluid_cached_sampledata_equal);
+    cached_sampledata_by_data = new_fluid_hashtable(fluid_direct_hash, fluid_direct_equal);
+    if (cached_sampledata_by_file == NULL || cached_sampledata_by_data == NULL) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      if (cached_sampledata_by_file != NULL) delete_fluid_hashtable(cached_sampledata_by_file);
+      if (cached_sampledata_by_data != NULL) delete_fluid_hashtable(cached_sampledata_by_data);
+      cached_sampledata_by_file = cached_sampledata_by_data = NULL;
+      fluid_mutex_unlock(cached_sampledata_mutex);
+      FLUID_FREE(key.filename);
+      return FLUID_FAILED;
+    }
+  }
+
+  cached_sampledata = fluid_hashtable_lookup(cached_sampledata_by_file, &key);
+
+  if (cached_sampledata != NULL) {
+    /* Already cached or being loaded by another thread */
+    cached_sampledata->num_references++;
+    fluid_mutex_unlock(cached_sampledata_mutex);
+    FLUID_FREE(key.filename);
+
+    fluid_cond_mutex_lock(cached_sampledata->loading_mutex);
+    while (cached_sampledata->loading)
+      fluid_cond_wait(cached_sampledata->loading_cond, cached_sampledata->loading_mutex);
+    fluid_cond_mutex_unlock(cached_sampledata->loading_mutex);
+
+    fluid_mutex_lock(cached_sampledata_mutex);
+    if (cached_sampledata->sampledata == NULL) {
+      fluid_cached_sampledata_unref(cached_sampledata);
+      fluid_mutex_unlock(cached_sampledata_mutex);
+      return FLUID_FAILED;
+    }
+    fluid_cached_sampledata_mlock(cached_sampledata, try_mlock);
+    fluid_mutex_unlock(cached_sampledata_mutex);
+
+    *sampledata = (short*) cached_sampledata->sampledata;
+    *sampledata24 = (sint32*) cached_sampledata->sampledata24;
+    return FLUID_OK;
+  }
+
+  cached_sampledata = FLUID_NEW(fluid_cached_sampledata_t);
+  if (cached_sampledata == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory.");
+    fluid_mutex_unlock(cached_sampledata_mutex);
+    FLUID_FREE(key.filename);
+    return FLUID_FAILED;
+  }
+
+  FLUID_MEMSET(cached_sampledata, 0, sizeof(fluid_cached_sampledata_t));
+  cached_sampledata_count++;
+  cached_sampledata->filename = key.filename;
+  cached_sampledata->modification_time = key.modification_time;
+  cached_sampledata->samplesize = samplesize;
+  cached_sampledata->num_references = 1;
+  cached_sampledata->loading = TRUE;
+  cached_sampledata->loading_mutex = new_fluid_cond_mutex();
+  cached_sampledata->loading_cond = new_fluid_cond();
+  fluid_hashtable_insert(cached_sampledata_by_file, cached_sampledata, cached_sampledata);
+
+  fluid_mutex_unlock(cached_sampledata_mutex);
+
+  result = fluid_cached_sampledata_read(cached_sampledata, samplepos,
+                                        sample24pos, sample24size, sfsamples);
+  if (result == FLUID_OK)
+    fluid_cached_sampledata_mlock(cached_sampledata, try_mlock);
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+  if (result == FLUID_OK) {
+    fluid_hashtable_insert(cached_sampledata_by_data,
+                           (void*) cached_sampledata->sampledata, cached_sampledata);
+  } else {
+    /* Let the next load try again */
+    fluid_hashtable_remove(cached_sampledata_by_file, cached_sampledata);
+  }
+  fluid_mutex_unlock(cached_sampledata_mutex);
+
+  fluid_cond_mutex_lock(cached_sampledata->loading_mutex);
+  cached_sampledata->loading = FALSE;
+  fluid_cond_broadcast(cached_sampledata->loading_cond);
+  fluid_cond_mutex_unlock(cached_sampledata->loading_mutex);
+
+  if (result != FLUID_OK) {
+    fluid_mutex_lock(cached_sampledata_mutex);
+    fluid_cached_sampledata_unref(cached_sampledata);
+    fluid_mutex_unlock(cached_sampledata_mutex);
+    return FLUID_FAILED;
+  }
+
+  *sampledata = (short*) cached_sampledata->sampledata;
+  *sampledata24 = (sint32*) cached_sampledata->sampledata24;
+  return FLUID_OK;
+}
+
+static int fluid_cached_sampledata_unload(const short *sampledata)
+{
+  fluid_cached_sampledata_t* cached_sampledata = NULL;
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+
+  if (cached_sampledata_by_data != NULL)
+    cached_sampledata = fluid_hashtable_lookup(cached_sampledata_by_data, sampledata);
+
+  if (cached_sampledata == NULL) {
+    fluid_mutex_unlock(cached_sampledata_mutex);
+    FLUID_LOG(FLUID_ERR, "Trying to free sampledata not found in cache.");
+    return FLUID_FAILED;
+  }
+
+  fluid_cached_sampledata_unref(cached_sampledata);
+  fluid_mutex_unlock(cached_sampledata_mutex);
+  return FLUID_OK;
+}
+
+/*
+ * Compressed samples
+ *
+ * SoundFont 3 files store every sample of the smpl chunk as a separate Ogg
+ * Vorbis (or FLAC) stream. The compressed streams stay in the cached sample
+ * data of the file, the decoded data lives in a fluid_cached_sample_t shared
+ * by all SoundFonts using the same cached sample data. Decoded samples which
+ * are not playing are kept in a LRU list and are freed again as soon as the
+ * total size of the decoded data exceeds the sample cache budget.
+ *
+ * The synthesis thread only pins and unpins decoded data, without locking.
+ * Samples which aren't decoded when they are played are handed to the
+ * decoder thread, which also frees the data exceeding the budget.
+ */
+
+struct _fluid_cached_sample_t {
+  fluid_cached_sample_t *prev;        /* LRU list, most recently used first */
+  fluid_cached_sample_t *next;
+  fluid_cached_sampledata_t *owner;   /* the cached sample data holding the stream */
+  unsigned int offset;                /* byte offset of the stream in the smpl chunk */
+  unsigned int size;                  /* byte size of the stream */
+  short* data;                        /* decoded sample data, NULL if not decoded (atomic) */
+  unsigned int frames;                /* number of decoded sample points */
+  int failed;                         /* decoding failed, don't try again */
+  int pins;                           /* number of samples currently playing the data,
+                                         -1 while the data is freed (atomic) */
+  int used;                           /* played since the last eviction (atomic) */
+  int requested;                      /* waiting for the decoder thread (atomic) */
+  fluid_cached_sample_t *request_next; /* next sample waiting for the decoder thread */
+  fluid_list_t* samples;              /* the samples using the decoded data */
+};
+
+typedef struct {
+  fluid_cached_sample_t** jobs;
+  int count;
+  int next;
+} fluid_cached_sample_pool_t;
+
+static fluid_cached_sample_t* cached_sample_lru_head = NULL;
+static fluid_cached_sample_t* cached_sample_lru_tail = NULL;
+static unsigned long cached_sample_budget = 0;  /* in bytes, 0 means unlimited */
+static fluid_list_t* cached_sample_budgets = NULL; /* budgets of the loaded fonts, in MB */
+static unsigned long cached_sample_usage = 0;   /* bytes of decoded sample data */
+
+/* Samples to decode, pushed without locking and popped by the decoder
+ * thread with the cache lock held */
+static fluid_cached_sample_t* cached_sample_requests = NULL;
+
+/* The decoder thread, running while fonts with compressed samples are loaded */
+#define FLUID_CACHED_SAMPLE_DECODER_MSEC 10
+static fluid_timer_t* cached_sample_decoder = NULL;
+static int cached_sample_decoder_users = 0;
+static fluid_mutex_t cached_sample_decoder_mutex = FLUID_MUTEX_INIT;
+
+#if LIBSNDFILE_SUPPORT
+
+/* libsndfile virtual IO reading a compressed stream from memory */
+typedef struct {
+  const char* data;
+  sf_count_t size;
+  sf_count_t pos;
+} fluid_sample_stream_t;
+
+static sf_count_t fluid_sample_stream_get_filelen(void* user_data)
+{
+  return ((fluid_sample_stream_t*) user_data)->size;
+}
+
+static sf_count_t fluid_sample_stream_seek(sf_count_t offset, int whence, void* user_data)
+{
+  fluid_sample_stream_t* stream = (fluid_sample_stream_t*) user_data;
+
+  switch (whence) {
+  case SEEK_SET:
+    break;
+  case SEEK_CUR:
+    offset += stream->pos;
+    break;
+  case SEEK_END:
+    offset += stream->size;
+    break;
+  default:
+    return -1;
+  }
+
+  if (offset < 0 || offset > stream->size)
+    return -1;
+
+  stream->pos = offset;
+  return offset;
+}
+
+static sf_count_t fluid_sample_stream_read(void* ptr, sf_count_t count, void* user_data)
+{
+  fluid_sample_stream_t* stream = (fluid_sample_stream_t*) user_data;
+
+  if (count > stream->size - stream->pos)
+    count = stream->size - stream->pos;
+
+  FLUID_MEMCPY(ptr, stream->data + stream->pos, count);
+  stream->pos += count;
+  return count;
+}
+
+static sf_count_t fluid_sample_stream_write(const void* ptr, sf_count_t count, void* user_data)
+{
+  return 0;
+}
+
+static sf_count_t fluid_sample_stream_tell(void* user_data)
+{
+  return ((fluid_sample_stream_t*) user_data)->pos;
+}
+
+#endif /* LIBSNDFILE_SUPPORT */
+
+/* Decode a compressed sample. Doesn't need the cache lock, the compressed
+ * stream doesn't change as long as the sample is registered. */
+static short* fluid_cached_sample_decode(fluid_cached_sample_t* cs, unsigned int* frames)
+{
+#if LIBSNDFILE_SUPPORT
+  SF_VIRTUAL_IO vio = {
+    fluid_sample_stream_get_filelen,
+    fluid_sample_stream_seek,
+    fluid_sample_stream_read,
+    fluid_sample_stream_write,
+    fluid_sample_stream_tell
+  };
+  fluid_sample_stream_t stream;
+  SF_INFO info;
+  SNDFILE* sndfile;
+  short* data;
+  sf_count_t count;
+
+  stream.data = (const char*) cs->owner->sampledata + cs->offset;
+  stream.size = cs->size;
+  stream.pos = 0;
+
+  FLUID_MEMSET(&info, 0, sizeof(info));
+  sndfile = sf_open_virtual(&vio, SFM_READ, &info, &stream);
+  if (sndfile == NULL) {
+    FLUID_LOG(FLUID_ERR, "Failed to open compressed sample at offset %u: %s",
+              cs->offset, sf_strerror(NULL));
+    return NULL;
+  }
+
+  if (info.channels != 1 || info.frames < 8 || info.frames > 0x7fffffff) {
+    FLUID_LOG(FLUID_ERR, "Compressed sample at offset %u has an unsupported format",
+              cs->offset);
+    sf_close(sndfile);
+    return NULL;
+  }
+
+  data = FLUID_ARRAY(short, info.frames);
+  if (data == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    sf_close(sndfile);
+    return NULL;
+  }
+
+  count = sf_readf_short(sndfile, data, info.frames);
+  sf_close(sndfile);
+
+  if (count < 8) {
+    FLUID_LOG(FLUID_ERR, "Failed to decode compressed sample at offset %u", cs->offset);
+    FLUID_FREE(data);
+    return NULL;
+  }
+
+  *frames = (unsigned int) count;
+  return data;
+#else
+  FLUID_LOG(FLUID_ERR, "Can't decode compressed sample at offset %u: "
+            "FluidSynth was built without libsndfile support", cs->offset);
+  return NULL;
+#endif
+}
+
+static void fluid_cached_sample_lru_unlink(fluid_cached_sample_t* cs)
+{
+  if (cs->prev != NULL)
+    cs->prev->next = cs->next;
+  else
+    cached_sample_lru_head = cs->next;
+
+  if (cs->next != NULL)
+    cs->next->prev = cs->prev;
+  else
+    cached_sample_lru_tail = cs->prev;
+
+  cs->prev = cs->next = NULL;
+}
+
+static void fluid_cached_sample_lru_push(fluid_cached_sample_t* cs)
+{
+  cs->prev = NULL;
+  cs->next = cached_sample_lru_head;
+
+  if (cached_sample_lru_head != NULL)
+    cached_sample_lru_head->prev = cs;
+  else
+    cached_sample_lru_tail = cs;
+
+  cached_sample_lru_head = cs;
+}
+
+/* Point a sample to the decoded data. The sample header is set up on the
+ * first decode, the loop points are relative to the start of the sample. */
+static void fluid_cached_sample_setup(fluid_sample_t* sample, fluid_cached_sample_t* cs,
+                                      short* data)
+{
+  sample->data = data;
+
+  if (sample->valid)
+    return;
+
+  sample->start = 0;
+  sample->end = cs->frames - 1;
+
+  if (sample->loopend > cs->frames || sample->loopstart >= sample->loopend) {
+    if (cs->frames >= 20) {
+      sample->loopstart = 8;
+      sample->loopend = cs->frames - 8;
+    } else {
+      sample->loopstart = 1;
+      sample->loopend = cs->frames - 1;
+    }
+  }
+
+  sample->valid = 1;
+  fluid_voice_optimize_sample(sample);
+}
+
+/* Free the decoded data unless it's playing, must be called with the
+ * cache lock held */
+static void fluid_cached_sample_drop(fluid_cached_sample_t* cs)
+{
+  fluid_list_t* p;
+  short* data;
+
+  if (cs->data == NULL)
+    return;
+
+  /* keep fluid_cached_sample_acquire() from pinning the data meanwhile */
+  if (!fluid_atomic_int_compare_and_exchange(&cs->pins, 0, -1))
+    return;
+
+  for (p = cs->samples; p; p = fluid_list_next(p))
+    ((fluid_sample_t*) fluid_list_get(p))->data = NULL;
+
+  data = cs->data;
+  fluid_atomic_pointer_set(&cs->data, NULL);
+  fluid_atomic_int_set(&cs->pins, 0);
+  FLUID_FREE(data);
+
+  fluid_cached_sample_lru_unlink(cs);
+  cached_sample_usage -= cs->frames * sizeof(short);
+}
+
+/* Free least recently used samples which aren't playing until the decoded
+ * data fits the budget again, must be called with the cache lock held.
+ * Samples played since the last eviction get a second chance. */
+static void fluid_cached_sample_evict(void)
+{
+  fluid_cached_sample_t *cs, *prev;
+
+  for (cs = cached_sample_lru_tail;
+       cs != NULL && cached_sample_budget > 0 && cached_sample_usage > cached_sample_budget;
+       cs = prev) {
+    prev = cs->prev;
+    if (fluid_atomic_int_compare_and_exchange(&cs->used, TRUE, FALSE)) {
+      fluid_cached_sample_lru_unlink(cs);
+      fluid_cached_sample_lru_push(cs);
+    }
+    else fluid_cached_sample_drop(cs);
+  }
+}
+
+/* Make the decoded data available to the samples, must be called with the
+ * cache lock held */
+static void fluid_cached_sample_install(fluid_cached_sample_t* cs, short* data,
+                                        unsigned int frames)
+{
+  fluid_list_t* p;
+
+  cs->frames = frames;
+  cached_sample_usage += frames * sizeof(short);
+  fluid_cached_sample_lru_push(cs);
+
+  for (p = cs->samples; p; p = fluid_list_next(p))
+    fluid_cached_sample_setup((fluid_sample_t*) fluid_list_get(p), cs, data);
+
+  /* published last, the samples are set up once it's seen */
+  fluid_atomic_pointer_set(&cs->data, data);
+}
+
+/* Make sure the sample is decoded. Must be called with the cache lock held,
+ * which is released while decoding. */
+static int fluid_cached_sample_load(fluid_cached_sample_t* cs)
+{
+  unsigned int frames = 0;
+  short* data;
+
+  while (cs->data == NULL && !cs->failed) {
+    fluid_mutex_unlock(cached_sampledata_mutex);
+    data = fluid_cached_sample_decode(cs, &frames);
+    fluid_mutex_lock(cached_sampledata_mutex);
+
+    if (data == NULL) {
+      if (cs->data == NULL)
+        cs->failed = TRUE;
+      break;
+    }
+
+    /* Another thread might have decoded the same sample meanwhile */
+    if (cs->data != NULL) {
+      FLUID_FREE(data);
+      break;
+    }
+
+    fluid_cached_sample_install(cs, data, frames);
+  }
+
+  return (cs->data != NULL) ? FLUID_OK : FLUID_FAILED;
+}
+
+static void fluid_cached_sample_push_request(fluid_cached_sample_t* cs)
+{
+  fluid_cached_sample_t* head;
+
+  do {
+    head = fluid_atomic_pointer_get(&cached_sample_requests);
+    cs->request_next = head;
+  } while (!fluid_atomic_pointer_compare_and_exchange(&cached_sample_requests, head, cs));
+}
+
+/* Ask the decoder thread to decode a sample, doesn't lock */
+static void fluid_cached_sample_request(fluid_cached_sample_t* cs)
+{
+  if (!cs->failed && fluid_atomic_int_compare_and_exchange(&cs->requested, FALSE, TRUE))
+    fluid_cached_sample_push_request(cs);
+}
+
+/* Take a sample off the requests, must be called with the cache lock held
+ * as only one thread may do so */
+static fluid_cached_sample_t* fluid_cached_sample_pop_request(void)
+{
+  fluid_cached_sample_t* head;
+
+  do {
+    head = fluid_atomic_pointer_get(&cached_sample_requests);
+    if (head == NULL)
+      return NULL;
+  } while (!fluid_atomic_pointer_compare_and_exchange(&cached_sample_requests,
+                                                      head, head->request_next));
+
+  fluid_atomic_int_set(&head->requested, FALSE);
+  return head;
+}
+
+/* Remove a sample which is going away from the requests, must be called
+ * with the cache lock held */
+static void fluid_cached_sample_cancel_request(fluid_cached_sample_t* cs)
+{
+  fluid_cached_sample_t *list = NULL, *next;
+
+  if (!fluid_atomic_int_get(&cs->requested))
+    return;
+
+  while ((next = fluid_cached_sample_pop_request()) != NULL) {
+    next->request_next = list;
+    list = next;
+  }
+
+  for (; list != NULL; list = next) {
+    next = list->request_next;
+    if (list != cs && fluid_atomic_int_compare_and_exchange(&list->requested, FALSE, TRUE))
+      fluid_cached_sample_push_request(list);
+  }
+}
+
+/* Decoder thread: decode the requested samples and keep the cache within
+ * its budget. The cache lock is released while decoding, the reference on
+ * the cached sample data keeps the sample and its stream alive meanwhile. */
+static int fluid_cached_sample_decoder_run(void* data, unsigned int msec)
+{
+  fluid_cached_sample_t* cs;
+  fluid_cached_sampledata_t* owner;
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+  while ((cs = fluid_cached_sample_pop_request()) != NULL) {
+    owner = cs->owner;
+    owner->num_references++;
+    fluid_cached_sample_load(cs);
+    fluid_cached_sampledata_unref(owner);
+  }
+  fluid_cached_sample_evict();
+  fluid_mutex_unlock(cached_sampledata_mutex);
+
+  return 1;
+}
+
+static int fluid_cached_sample_decoder_start(void)
+{
+  int result = FLUID_OK;
+
+  fluid_mutex_lock(cached_sample_decoder_mutex);
+  if (cached_sample_decoder == NULL) {
+    cached_sample_decoder = new_fluid_timer(FLUID_CACHED_SAMPLE_DECODER_MSEC,
+      fluid_cached_sample_decoder_run, NULL, TRUE, FALSE, FALSE);
+    if (cached_sample_decoder == NULL) {
+      FLUID_LOG(FLUID_ERR, "Failed to create the sample decoder thread");
+      result = FLUID_FAILED;
+    }
+  }
+  if (result == FLUID_OK)
+    cached_sample_decoder_users++;
+  fluid_mutex_unlock(cached_sample_decoder_mutex);
+
+  return result;
+}
+
+static void fluid_cached_sample_decoder_stop(void)
+{
+  fluid_mutex_lock(cached_sample_decoder_mutex);
+  if (--cached_sample_decoder_users == 0) {
+    delete_fluid_timer(cached_sample_decoder);
+    cached_sample_decoder = NULL;
+  }
+  fluid_mutex_unlock(cached_sample_decoder_mutex);
+}
+
+static void delete_fluid_cached_sample(void* data)
+{
+  fluid_cached_sample_t* cs = (fluid_cached_sample_t*) data;
+
+  fluid_cached_sample_cancel_request(cs);
+  fluid_cached_sample_drop(cs);
+  delete_fluid_list(cs->samples);
+  FLUID_FREE(cs);
+}
+
+static int fluid_cached_sample_notify(fluid_sample_t* sample, int reason)
+{
+  if (reason == FLUID_SAMPLE_DONE)
+    fluid_cached_sample_release(sample);
+
+  return FLUID_OK;
+}
+
+/* Attach a compressed sample of a loaded font to the decoded sample cache */
+static int fluid_cached_sample_register(const short* sampledata, fluid_sample_t* sample,
+                                        unsigned int offset, unsigned int size)
+{
+  fluid_cached_sampledata_t* cached_sampledata = NULL;
+  fluid_cached_sample_t* cs;
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+
+  if (cached_sampledata_by_data != NULL)
+    cached_sampledata = fluid_hashtable_lookup(cached_sampledata_by_data, sampledata);
+
+  if (cached_sampledata == NULL) {
+    FLUID_LOG(FLUID_ERR, "Trying to register a sample of sampledata not found in cache.");
+    goto error_exit;
+  }
+
+  if (cached_sampledata->compressed == NULL) {
+    cached_sampledata->compressed = new_fluid_hashtable_full(fluid_direct_hash,
+      fluid_direct_equal, NULL, delete_fluid_cached_sample);
+    if (cached_sampledata->compressed == NULL) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      goto error_exit;
+    }
+  }
+
+  cs = fluid_hashtable_lookup(cached_sampledata->compressed, FLUID_UINT_TO_POINTER(offset));
+  if (cs == NULL) {
+    cs = FLUID_NEW(fluid_cached_sample_t);
+    if (cs == NULL) {
+      FLUID_LOG(FLUID_ERR, "Out of memory");
+      goto error_exit;
+    }
+    FLUID_MEMSET(cs, 0, sizeof(fluid_cached_sample_t));
+    cs->owner = cached_sampledata;
+    cs->offset = offset;
+    cs->size = size;
+    fluid_hashtable_insert(cached_sampledata->compressed, FLUID_UINT_TO_POINTER(offset), cs);
+  }
+
+  cs->samples = fluid_list_prepend(cs->samples, sample);
+  sample->userdata = cs;
+  sample->notify = fluid_cached_sample_notify;
+
+  if (cs->data != NULL)
+    fluid_cached_sample_setup(sample, cs, cs->data);
+
+  fluid_mutex_unlock(cached_sampledata_mutex);
+  return FLUID_OK;
+
+ error_exit:
+  fluid_mutex_unlock(cached_sampledata_mutex);
+  return FLUID_FAILED;
+}
+
+static void fluid_cached_sample_unregister(fluid_sample_t* sample)
+{
+  fluid_cached_sample_t* cs = (fluid_cached_sample_t*) sample->userdata;
+
+  if (cs == NULL)
+    return;
+
+  fluid_mutex_lock(cached_sampledata_mutex);
+  cs->samples = fluid_list_remove(cs->samples, sample);
+  sample->userdata = NULL;
+  sample->data = NULL;
+  fluid_mutex_unlock(cached_sampledata_mutex);
+}
+
+/* The cache is shared by all fonts, so it gets the largest budget of the
+ * fonts using it, unlimited if any of them asks for that. Must be called
+ * with the cache lock held. */
+static void fluid_cached_sample_update_budget(void)
+{
+  fluid_list_t* p;
+  unsigned long mb = 0;
+
+  for (p = cached_sample_budgets; p; p = fluid_list_next(p)) {
+    if (FLUID_POINTER_TO_UINT(fluid_list_get(p)) == 0) {
+      mb = 0;
+      break;
+    }
+    if (FLUID_POINTER_TO_UINT(fluid_list_get(p)) > mb)
+      mb = FLUID_POINTER_TO_UINT(fluid_list_get(p));
+  }
+
+  cached_sample_budget = mb * 1024 * 1024;
+  fluid_cached_sample_evict();
+}
+
+/* Register the sample cache budget of a font, in MB, 0 means unlimited */
+static void fluid_cached_sample_add_budget(unsigned int mb)
+{
+  fluid_mutex_lock(cached_sampledata_mutex);
+  cached_sample_budgets = fluid_list_prepend(cached_sample_budgets, FLUID_UINT_TO_POINTER(mb));
+  fluid_cached_sample_update_budget();
+  fluid_mutex_unlock(cached_sampledata_mutex);
+}
+
+static void fluid_cached_sample_remove_budget(unsigned int mb)
+{
+  fluid_mutex_lock(cached_sampledata_mutex);
+  cached_sample_budgets = fluid_list_remove(cached_sample_budgets, FLUID_UINT_TO_POINTER(mb));
+  fluid_cached_sample_update_budget();
+  fluid_mutex_unlock(cached_sampledata_mutex);
+}
+
+static void fluid_cached_sample_pool_run(void* data)
 {
-  /* This function is here just to avoid an ABI/SONAME bump, see ticket #98. Should never be used. */
-  return NULL;
+  fluid_cached_sample_pool_t* pool = (fluid_cached_sample_pool_t*) data;
+  int i;
+
+  while ((i = fluid_atomic_int_exchange_and_add(&pool->next, 1)) < pool->count) {
+    fluid_mutex_lock(cached_sampledata_mutex);
+    fluid_cached_sample_load(pool->jobs[i]);
+    fluid_mutex_unlock(cached_sampledata_mutex);
+  }
 }
 
-fluid_preset_t*
-fluid_defsfont_sfont_get_preset(fluid_sfont_t* sfont, unsigned int bank, unsigned int prenum)
+/* Decode all compressed samples of a font, using up to 'threads' threads */
+static void fluid_cached_sample_decode_all(fluid_defsfont_t* sfont, int threads)
 {
-  fluid_preset_t* preset = NULL;
-  fluid_defpreset_t* defpreset;
-  fluid_defsfont_t* defsfont = sfont->data;
-
-  defpreset = fluid_defsfont_get_preset(defsfont, bank, prenum);
+  fluid_cached_sample_pool_t pool;
+  fluid_thread_t** workers = NULL;
+  fluid_sample_t* sample;
+  fluid_list_t* p;
+  int i, count = 0;
 
-  if (defpreset == NULL) {
-    return NULL;
+  pool.jobs = FLUID_ARRAY(fluid_cached_sample_t*, fluid_list_size(sfont->sample));
+  if (pool.jobs == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return;
   }
 
-  if (defsfont->preset_stack_size > 0) {
-    defsfont->preset_stack_size--;
-    preset = defsfont->preset_stack[defsfont->preset_stack_size];
+  for (p = sfont->sample; p; p = fluid_list_next(p)) {
+    sample = (fluid_sample_t*) fluid_list_get(p);
+    if (sample->userdata != NULL)
+      pool.jobs[count++] = (fluid_cached_sample_t*) sample->userdata;
   }
-  if (!preset)
-    preset = FLUID_NEW(fluid_preset_t);
-  if (!preset) {
-    FLUID_LOG(FLUID_ERR, "Out of memory");
-    return NULL;
+  pool.count = count;
+  pool.next = 0;
+
+  /* The calling thread decodes as well */
+  if (threads > count)
+    threads = count;
+  if (--threads > 0)
+    workers = FLUID_ARRAY(fluid_thread_t*, threads);
+  if (workers == NULL)
+    threads = 0;
+
+  for (i = 0; i < threads; i++) {
+    workers[i] = new_fluid_thread("sample-decoder", fluid_cached_sample_pool_run,
+                                  &pool, 0, FALSE);
+    if (workers[i] == NULL)
+      break;
   }
+  threads = i;
 
-  preset->sfont = sfont;
-  preset->data = defpreset;
-  preset->free = fluid_defpreset_preset_delete;
-  preset->get_name = fluid_defpreset_preset_get_name;
-  preset->get_banknum = fluid_defpreset_preset_get_banknum;
-  preset->get_num = fluid_defpreset_preset_get_num;
-  preset->noteon = fluid_defpreset_preset_noteon;
-  preset->notify = NULL;
-
-  return preset;
-}
+  fluid_cached_sample_pool_run(&pool);
 
-void fluid_defsfont_sfont_iteration_start(fluid_sfont_t* sfont)
-{
-  fluid_defsfont_iteration_start((fluid_defsfont_t*) sfont->data);
-}
+  for (i = 0; i < threads; i++) {
+    fluid_thread_join(workers[i]);
+    delete_fluid_thread(workers[i]);
+  }
 
-int fluid_defsfont_sfont_iteration_next(fluid_sfont_t* sfont, fluid_preset_t* preset)
-{
-  preset->free = fluid_defpreset_preset_delete;
-  preset->get_name = fluid_defpreset_preset_get_name;
-  preset->get_banknum = fluid_defpreset_preset_get_banknum;
-  preset->get_num = fluid_defpreset_preset_get_num;
-  preset->noteon = fluid_defpreset_preset_noteon;
-  preset->notify = NULL;
+  if (workers != NULL)
+    FLUID_FREE(workers);
+  FLUID_FREE(pool.jobs);
 
-  return fluid_defsfont_iteration_next((fluid_defsfont_t*) sfont->data, preset);
+  fluid_mutex_lock(cached_sampledata_mutex);
+  fluid_cached_sample_evict();
+  fluid_mutex_unlock(cached_sampledata_mutex);
 }
 
-int fluid_defpreset_preset_delete(fluid_preset_t* preset)
+/*
+ * Make the decoded data of a compressed sample available for a new voice.
+ * The data stays in the cache until the last voice playing the sample is
+ * finished. Returns FLUID_OK if the sample can be played, otherwise it is
+ * decoded by the decoder thread for the next note. Doesn't lock, called from
+ * the synthesis thread.
+ */
+int fluid_cached_sample_acquire(fluid_sample_t* sample)
 {
-  fluid_defpreset_t* defpreset = preset ? preset->data : NULL;
-  fluid_defsfont_t* sfont = defpreset ? defpreset->sfont : NULL;
+  fluid_cached_sample_t* cs = (fluid_cached_sample_t*) sample->userdata;
+  int pins;
 
-  if (sfont && sfont->preset_stack_size < sfont->preset_stack_capacity) {
-     sfont->preset_stack[sfont->preset_stack_size] = preset;
-     sfont->preset_stack_size++;
+  if (cs == NULL)
+    return FLUID_FAILED;
+
+  /* the voices playing the sample already hold a pin */
+  if (fluid_sample_refcount(sample) == 0) {
+    do {
+      pins = fluid_atomic_int_get(&cs->pins);
+      if (pins < 0)
+        goto not_decoded;
+    } while (!fluid_atomic_int_compare_and_exchange(&cs->pins, pins, pins + 1));
+
+    if (fluid_atomic_pointer_get(&cs->data) == NULL) {
+      fluid_atomic_int_add(&cs->pins, -1);
+      goto not_decoded;
+    }
   }
-  else
-    FLUID_FREE(preset);
 
-  return 0;
-}
+  fluid_atomic_int_set(&cs->used, TRUE);
+  return FLUID_OK;
 
-char* fluid_defpreset_preset_get_name(fluid_preset_t* preset)
-{
-  return fluid_defpreset_get_name((fluid_defpreset_t*) preset->data);
+ not_decoded:
+  fluid_cached_sample_request(cs);
+  return FLUID_FAILED;
 }
 
-int fluid_defpreset_preset_get_banknum(fluid_preset_t* preset)
+/*
+ * Release a compressed sample acquired with fluid_cached_sample_acquire().
+ * Called when the last voice using the sample is finished, the data is freed
+ * later by the decoder thread if the cache is full. Doesn't lock.
+ */
+void fluid_cached_sample_release(fluid_sample_t* sample)
 {
-  return fluid_defpreset_get_banknum((fluid_defpreset_t*) preset->data);
-}
+  fluid_cached_sample_t* cs = (fluid_cached_sample_t*) sample->userdata;
 
-int fluid_defpreset_preset_get_num(fluid_preset_t* preset)
-{
-  return fluid_defpreset_get_num((fluid_defpreset_t*) preset->data);
+  if (cs != NULL)
+    fluid_atomic_int_add(&cs->pins, -1);
 }
 
-int fluid_defpreset_preset_noteon(fluid_preset_t* preset, fluid_synth_t* synth,
-				 int chan, int key, int vel)
+/*
+ * Ask the decoder thread to decode the compressed samples of a preset which
+ * aren't decoded, so that they are ready when it's played. Doesn't lock.
+ */
+void fluid_cached_sample_prefetch(fluid_defpreset_t* preset)
 {
-  return fluid_defpreset_noteon((fluid_defpreset_t*) preset->data, synth, chan, key, vel);
+  fluid_preset_zone_t* preset_zone;
+  fluid_inst_zone_t* inst_zone;
+  fluid_inst_t* inst;
+  fluid_sample_t* sample;
+
+  if (preset->sfont == NULL || !preset->sfont->sample_decoder)
+    return;
+
+  for (preset_zone = fluid_defpreset_get_zone(preset); preset_zone;
+       preset_zone = fluid_preset_zone_next(preset_zone)) {
+    inst = fluid_preset_zone_get_inst(preset_zone);
+    for (inst_zone = fluid_inst_get_zone(inst); inst_zone;
+         inst_zone = fluid_inst_zone_next(inst_zone)) {
+      sample = fluid_inst_zone_get_sample(inst_zone);
+      if (sample != NULL && (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+          && sample->userdata != NULL
+          && fluid_atomic_pointer_get(&((fluid_cached_sample_t*) sample->userdata)->data) == NULL)
+        fluid_cached_sample_request((fluid_cached_sample_t*) sample->userdata);
+    }
+  }
 }
 
 
@@ -209,222 +1362,228 @@ int fluid_defpreset_preset_noteon(fluid_preset_t* preset, fluid_synth_t* synth,
 
 /***************************************************************
  *
- *                    CACHED SAMPLEDATA LOADER
+ *                    SAMPLE DEDUPLICATION
  */
 
-typedef struct _fluid_cached_sampledata_t {
-  struct _fluid_cached_sampledata_t *next;
+/*
+ * Derived SoundFonts often contain the very same PCM data as the font they
+ * are based on. With synth.sample-dedup every sample of a font is copied
+ * into a region of its own, and regions with identical content are shared
+ * across all loaded fonts. The sample data block of the font is released
+ * once all samples have been imported.
+ */
 
-  char* filename;
-  time_t modification_time;
-  int num_references;
+typedef struct _fluid_sample_region_t {
+  unsigned int hash;            /* content hash of data and data24 */
+  unsigned int frames;
+  short* data;
+  sint32* data24;               /* 24 bit data or NULL */
+  int refcount;
   int mlock;
+} fluid_sample_region_t;
 
-  const short* sampledata;
-  unsigned int samplesize;
-} fluid_cached_sampledata_t;
-
-static fluid_cached_sampledata_t* all_cached_sampledata = NULL;
-static fluid_mutex_t cached_sampledata_mutex = FLUID_MUTEX_INIT;
+static fluid_hashtable_t* sample_regions = NULL;
+static fluid_mutex_t sample_regions_mutex = FLUID_MUTEX_INIT;
 
-static int fluid_get_file_modification_time(char *filename, time_t *modification_time)
+/* FNV-1a */
+static unsigned int fluid_sample_region_hash_bytes(unsigned int hash,
+                                                   const void* data, unsigned int size)
 {
-#if defined(WIN32) || defined(__OS2__)
-  *modification_time = 0;
-  return FLUID_OK;
-#else
-  struct stat buf;
+  const unsigned char* p = (const unsigned char*) data;
+  unsigned int i;
 
-  if (stat(filename, &buf) == -1) {
-    return FLUID_FAILED;
+  for (i = 0; i < size; i++) {
+    hash ^= p[i];
+    hash *= 16777619;
   }
-
-  *modification_time = buf.st_mtime;
-  return FLUID_OK;
-#endif
+  return hash;
 }
 
-static int fluid_cached_sampledata_load(char *filename, unsigned int samplepos,
-  unsigned int samplesize, short **sampledata, int try_mlock)
+static unsigned int fluid_sample_region_hash(const void* key)
 {
-  fluid_file fd = NULL;
-  short *loaded_sampledata = NULL;
-  fluid_cached_sampledata_t* cached_sampledata = NULL;
-  time_t modification_time;
+  return ((const fluid_sample_region_t*) key)->hash;
+}
 
-  fluid_mutex_lock(cached_sampledata_mutex);
+static int fluid_sample_region_equal(const void* a, const void* b)
+{
+  const fluid_sample_region_t* ra = a;
+  const fluid_sample_region_t* rb = b;
 
-  if (fluid_get_file_modification_time(filename, &modification_time) == FLUID_FAILED) {
-    FLUID_LOG(FLUID_WARN, "Unable to read modificaton time of soundfont file.");
-    modification_time = 0;
-  }
+  if (ra->hash != rb->hash || ra->frames != rb->frames
+      || (ra->data24 == NULL) != (rb->data24 == NULL))
+    return FALSE;
 
-  for (cached_sampledata = all_cached_sampledata; cached_sampledata; cached_sampledata = cached_sampledata->next) {
-    if (strcmp(filename, cached_sampledata->filename))
-      continue;
-    if (cached_sampledata->modification_time != modification_time)
-      continue;
-    if (cached_sampledata->samplesize != samplesize) {
-      FLUID_LOG(FLUID_ERR, "Cached size of soundfont doesn't match actual size of soundfont (cached: %u. actual: %u)",
-        cached_sampledata->samplesize, samplesize);
-      continue;
-    }
+  if (FLUID_MEMCMP(ra->data, rb->data, ra->frames * sizeof(short)) != 0)
+    return FALSE;
 
-    if (try_mlock && !cached_sampledata->mlock) {
-      if (fluid_mlock(cached_sampledata->sampledata, samplesize) != 0)
-        FLUID_LOG(FLUID_WARN, "Failed to pin the sample data to RAM; swapping is possible.");
-      else
-        cached_sampledata->mlock = try_mlock;
-    }
+  return ra->data24 == NULL
+    || FLUID_MEMCMP(ra->data24, rb->data24, ra->frames * sizeof(sint32)) == 0;
+}
 
-    cached_sampledata->num_references++;
-    loaded_sampledata = (short*) cached_sampledata->sampledata;
-    goto success_exit;
+static void delete_fluid_sample_region(fluid_sample_region_t* region)
+{
+  if (region->mlock) {
+    fluid_munlock(region->data, region->frames * sizeof(short));
+    if (region->data24 != NULL)
+      fluid_munlock(region->data24, region->frames * sizeof(sint32));
   }
+  if (region->data != NULL)
+    FLUID_FREE(region->data);
+  if (region->data24 != NULL)
+    FLUID_FREE(region->data24);
+  FLUID_FREE(region);
+}
 
-  fd = FLUID_FOPEN(filename, "rb");
-  if (fd == NULL) {
-    FLUID_LOG(FLUID_ERR, "Can't open soundfont file");
-    goto error_exit;
-  }
-  if (FLUID_FSEEK(fd, samplepos, SEEK_SET) == -1) {
-    perror("error");
-    FLUID_LOG(FLUID_ERR, "Failed to seek position in data file");
-    goto error_exit;
+/* Find or create the shared region with the given content. 'shared' is set
+ * to TRUE if an existing region was found. */
+static fluid_sample_region_t* fluid_sample_region_acquire(const short* data,
+  const sint32* data24, unsigned int frames, int try_mlock, int* shared)
+{
+  fluid_sample_region_t key, *region;
+
+  /* Hash outside of the lock, it's the expensive part */
+  key.hash = fluid_sample_region_hash_bytes(2166136261U, data, frames * sizeof(short));
+  if (data24 != NULL)
+    key.hash = fluid_sample_region_hash_bytes(key.hash, data24, frames * sizeof(sint32));
+  key.frames = frames;
+  key.data = (short*) data;
+  key.data24 = (sint32*) data24;
+
+  fluid_mutex_lock(sample_regions_mutex);
+
+  if (sample_regions == NULL) {
+    sample_regions = new_fluid_hashtable(fluid_sample_region_hash, fluid_sample_region_equal);
+    if (sample_regions == NULL)
+      goto error_exit;
   }
 
-
-  loaded_sampledata = (short*) FLUID_MALLOC(samplesize);
-  if (loaded_sampledata == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory");
-    goto error_exit;
-  }
-  if (FLUID_FREAD(loaded_sampledata, 1, samplesize, fd) < samplesize) {
-    FLUID_LOG(FLUID_ERR, "Failed to read sample data");
-    goto error_exit;
+  region = fluid_hashtable_lookup(sample_regions, &key);
+  if (region != NULL) {
+    region->refcount++;
+    fluid_mutex_unlock(sample_regions_mutex);
+    *shared = TRUE;
+    return region;
   }
 
-  FLUID_FCLOSE(fd);
-  fd = NULL;
-
+  region = FLUID_NEW(fluid_sample_region_t);
+  if (region == NULL)
+    goto error_exit;
 
-  cached_sampledata = (fluid_cached_sampledata_t*) FLUID_MALLOC(sizeof(fluid_cached_sampledata_t));
-  if (cached_sampledata == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory.");
+  FLUID_MEMSET(region, 0, sizeof(fluid_sample_region_t));
+  region->hash = key.hash;
+  region->frames = frames;
+  region->refcount = 1;
+  region->data = FLUID_ARRAY(short, frames);
+  if (data24 != NULL)
+    region->data24 = FLUID_ARRAY(sint32, frames);
+  if (region->data == NULL || (data24 != NULL && region->data24 == NULL)) {
+    delete_fluid_sample_region(region);
     goto error_exit;
   }
 
-  /* Lock the memory to disable paging. It's okay if this fails. It
-     probably means that the user doesn't have to required permission.  */
-  cached_sampledata->mlock = 0;
+  FLUID_MEMCPY(region->data, data, frames * sizeof(short));
+  if (data24 != NULL)
+    FLUID_MEMCPY(region->data24, data24, frames * sizeof(sint32));
+
   if (try_mlock) {
-    if (fluid_mlock(loaded_sampledata, samplesize) != 0)
+    if (fluid_mlock(region->data, frames * sizeof(short)) != 0)
       FLUID_LOG(FLUID_WARN, "Failed to pin the sample data to RAM; swapping is possible.");
-    else
-      cached_sampledata->mlock = try_mlock;
-  }
-
-  /* If this machine is big endian, the sample have to byte swapped  */
-  if (FLUID_IS_BIG_ENDIAN) {
-    unsigned char* cbuf;
-    unsigned char hi, lo;
-    unsigned int i, j;
-    short s;
-    cbuf = (unsigned char*)loaded_sampledata;
-    for (i = 0, j = 0; j < samplesize; i++) {
-      lo = cbuf[j++];
-      hi = cbuf[j++];
-      s = (hi << 8) | lo;
-      loaded_sampledata[i] = s;
-    }
-  }
-
-  cached_sampledata->filename = (char*) FLUID_MALLOC(strlen(filename) + 1);
-  if (cached_sampledata->filename == NULL) {
-    FLUID_LOG(FLUID_ERR, "Out of memory.");
-    goto error_exit;
+    else {
+      region->mlock = TRUE;
+      if (region->data24 != NULL)
+        fluid_mlock(region->data24, frames * sizeof(sint32));
+    }
   }
 
-  sprintf(cached_sampledata->filename, "%s", filename);
-  cached_sampledata->modification_time = modification_time;
-  cached_sampledata->num_references = 1;
-  cached_sampledata->sampledata = loaded_sampledata;
-  cached_sampledata->samplesize = samplesize;
-
-  cached_sampledata->next = all_cached_sampledata;
-  all_cached_sampledata = cached_sampledata;
+  fluid_hashtable_insert(sample_regions, region, region);
+  fluid_mutex_unlock(sample_regions_mutex);
+  *shared = FALSE;
+  return region;
 
+ error_exit:
+  fluid_mutex_unlock(sample_regions_mutex);
+  FLUID_LOG(FLUID_ERR, "Out of memory");
+  return NULL;
+}
 
- success_exit:
-  fluid_mutex_unlock(cached_sampledata_mutex);
-  *sampledata = loaded_sampledata;
-  return FLUID_OK;
+static void fluid_sample_region_release(fluid_sample_region_t* region)
+{
+  fluid_mutex_lock(sample_regions_mutex);
 
- error_exit:
-  if (fd != NULL) {
-    FLUID_FCLOSE(fd);
-  }
-  if (loaded_sampledata != NULL) {
-    FLUID_FREE(loaded_sampledata);
-  }
+  if (--region->refcount == 0) {
+    fluid_hashtable_remove(sample_regions, region);
+    delete_fluid_sample_region(region);
 
-  if (cached_sampledata != NULL) {
-    if (cached_sampledata->filename != NULL) {
-      FLUID_FREE(cached_sampledata->filename);
+    if (fluid_hashtable_size(sample_regions) == 0) {
+      delete_fluid_hashtable(sample_regions);
+      sample_regions = NULL;
     }
-    FLUID_FREE(cached_sampledata);
   }
 
-  fluid_mutex_unlock(cached_sampledata_mutex);
-  *sampledata = NULL;
-  return FLUID_FAILED;
+  fluid_mutex_unlock(sample_regions_mutex);
 }
 
-static int fluid_cached_sampledata_unload(const short *sampledata)
+/* Deduplication needs all samples to be plain PCM within the sample data */
+static int fluid_defsfont_can_dedup(fluid_defsfont_t* sfont, SFData* sfdata)
 {
-  fluid_cached_sampledata_t* prev = NULL;
-  fluid_cached_sampledata_t* cached_sampledata;
+  fluid_list_t* p;
+  SFSample* sfsample;
 
-  fluid_mutex_lock(cached_sampledata_mutex);
-  cached_sampledata = all_cached_sampledata;
+  if (sfont->sampledata == NULL)
+    return FALSE;
 
-  while (cached_sampledata != NULL) {
-    if (sampledata == cached_sampledata->sampledata) {
+  for (p = sfdata->sample; p; p = fluid_list_next(p)) {
+    sfsample = (SFSample*) fluid_list_get(p);
 
-      cached_sampledata->num_references--;
+    if (sfsample->sampletype & FLUID_SAMPLETYPE_ROM)
+      continue;
+    if (sfsample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+      return FALSE;
+    if (sfsample->end >= sfont->samplesize / 2
+        || sfsample->start >= sfont->samplesize / 2 - sfsample->end
+        || sfsample->loopstart > sfsample->end + 1
+        || sfsample->loopend > sfsample->end + 1)
+      return FALSE;
+  }
 
-      if (cached_sampledata->num_references == 0) {
-        if (cached_sampledata->mlock)
-          fluid_munlock(cached_sampledata->sampledata, cached_sampledata->samplesize);
-        FLUID_FREE((short*) cached_sampledata->sampledata);
-        FLUID_FREE(cached_sampledata->filename);
+  return TRUE;
+}
 
-        if (prev != NULL) {
-          prev->next = cached_sampledata->next;
-        } else {
-          all_cached_sampledata = cached_sampledata->next;
-        }
+/* Move an imported sample to a shared region, returns the number of bytes
+ * saved (0 if the region wasn't shared) or -1 on failure */
+static int fluid_sample_dedup(fluid_sample_t* sample, fluid_defsfont_t* sfont)
+{
+  fluid_sample_region_t* region;
+  unsigned int frames;
+  int shared;
 
-        FLUID_FREE(cached_sampledata);
-      }
+  /* ROM samples are never played */
+  if (sample->sampletype & FLUID_SAMPLETYPE_ROM) {
+    sample->data = NULL;
+    sample->wide_data = NULL;
+    return 0;
+  }
 
-      goto success_exit;
-    }
+  frames = sample->end - sample->start + 1;
+  region = fluid_sample_region_acquire(sfont->sampledata + sample->start,
+    (sfont->sampledata24 != NULL) ? sfont->sampledata24 + sample->start : NULL,
+    frames, sfont->mlock, &shared);
+  if (region == NULL)
+    return -1;
 
-    prev = cached_sampledata;
-    cached_sampledata = cached_sampledata->next;
-  }
+  sample->userdata = region;
+  sample->data = region->data;
+  if (region->data24 != NULL)
+    sample->wide_data = region->data24;
+  sample->loopstart -= sample->start;
+  sample->loopend -= sample->start;
+  sample->end -= sample->start;
+  sample->start = 0;
 
-  FLUID_LOG(FLUID_ERR, "Trying to free sampledata not found in cache.");
-  goto error_exit;
-  
- success_exit:
-  fluid_mutex_unlock(cached_sampledata_mutex);
-  return FLUID_OK;
+  if (!shared)
+    return 0;
 
- error_exit:
-  fluid_mutex_unlock(cached_sampledata_mutex);
-  return FLUID_FAILED;
+  return frames * ((region->data24 != NULL) ? sizeof(short) + sizeof(sint32) : sizeof(short));
 }
 
 
@@ -452,10 +1611,20 @@ fluid_defsfont_t* new_fluid_defsfont(fluid_settings_t* settings)
   sfont->filename = NULL;
   sfont->samplepos = 0;
   sfont->samplesize = 0;
+  sfont->sample24pos = 0;
+  sfont->sample24size = 0;
   sfont->sample = NULL;
   sfont->sampledata = NULL;
+  sfont->sampledata24 = NULL;
   sfont->preset = NULL;
   fluid_settings_getint(settings, "synth.lock-memory", &sfont->mlock);
+  fluid_settings_getint(settings, "synth.dynamic-sample-loading", &sfont->dynamic_samples);
+  fluid_settings_getint(settings, "synth.sample-cache-size", &sfont->sample_cache_size);
+  fluid_settings_getint(settings, "synth.cpu-cores", &sfont->decode_threads);
+  sfont->sample_decoder = FALSE;
+  fluid_settings_getint(settings, "synth.sample-dedup", &sfont->sample_dedup);
+  sfont->samples_deduped = FALSE;
+  sfont->dedup_bytes_saved = 0;
 
   /* Initialise preset cache, so we don't have to call malloc on program changes.
      Usually, we have at most one preset per channel plus one temporarily used,
@@ -505,7 +1674,12 @@ int delete_fluid_defsfont(fluid_defsfont_t* sfont)
   }
 
   for (list = sfont->sample; list; list = fluid_list_next(list)) {
-    delete_fluid_sample((fluid_sample_t*) fluid_list_get(list));
+    sample = (fluid_sample_t*) fluid_list_get(list);
+    if (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+      fluid_cached_sample_unregister(sample);
+    else if (sfont->samples_deduped && sample->userdata != NULL)
+      fluid_sample_region_release((fluid_sample_region_t*) sample->userdata);
+    delete_fluid_sample(sample);
   }
 
   if (sfont->sample) {
@@ -516,6 +1690,11 @@ int delete_fluid_defsfont(fluid_defsfont_t* sfont)
     fluid_cached_sampledata_unload(sfont->sampledata);
   }
 
+  if (sfont->sample_decoder) {
+    fluid_cached_sample_remove_budget(sfont->sample_cache_size);
+    fluid_cached_sample_decoder_stop();
+  }
+
   while (sfont->preset_stack_size > 0)
     FLUID_FREE(sfont->preset_stack[--sfont->preset_stack_size]);
   FLUID_FREE(sfont->preset_stack);
@@ -570,11 +1749,16 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, const char* file)
      it's loaded separately (and might be unoaded/reloaded in future) */
   sfont->samplepos = sfdata->samplepos;
   sfont->samplesize = sfdata->samplesize;
+  sfont->sample24pos = sfdata->sample24pos;
+  sfont->sample24size = sfdata->sample24size;
 
   /* load sample data in one block */
-  if (fluid_defsfont_load_sampledata(sfont) != FLUID_OK)
+  if (fluid_defsfont_load_sampledata(sfont, sfdata) != FLUID_OK)
     goto err_exit;
 
+  /* identical samples of different fonts can share their data */
+  sfont->samples_deduped = sfont->sample_dedup && fluid_defsfont_can_dedup(sfont, sfdata);
+
   /* Create all the sample headers */
   p = sfdata->sample;
   while (p != NULL) {
@@ -594,6 +1778,31 @@ int fluid_defsfont_load(fluid_defsfont_t* sfont, const char* file)
     p = fluid_list_next(p);
   }
 
+  /* All samples have been copied to shared regions, the sample data block
+     isn't needed anymore */
+  if (sfont->samples_deduped) {
+    FLUID_LOG(FLUID_INFO, "%s: %u of %u bytes of sample data shared with other SoundFonts",
+              sfont->filename, sfont->dedup_bytes_saved,
+              sfont->samplesize * ((sfont->sampledata24 != NULL) ? 3 : 1));
+    fluid_cached_sampledata_unload(sfont->sampledata);
+    sfont->sampledata = NULL;
+    sfont->sampledata24 = NULL;
+  }
+
+  /* Compressed samples are decoded on first use with dynamic sample loading,
+     and again after they have been evicted from the cache */
+  for (p = sfont->sample; p != NULL && !sfont->sample_decoder; p = fluid_list_next(p)) {
+    sample = (fluid_sample_t*) fluid_list_get(p);
+    if ((sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS) && sample->userdata != NULL) {
+      if (fluid_cached_sample_decoder_start() != FLUID_OK)
+        goto err_exit;
+      sfont->sample_decoder = TRUE;
+      fluid_cached_sample_add_budget(sfont->sample_cache_size);
+    }
+  }
+  if (!sfont->dynamic_samples)
+    fluid_cached_sample_decode_all(sfont, sfont->decode_threads);
+
   /* Load all the presets */
   p = sfdata->preset;
   while (p != NULL) {
@@ -667,10 +1876,11 @@ int fluid_defsfont_add_preset(fluid_defsfont_t* sfont, fluid_defpreset_t* preset
  * fluid_defsfont_load_sampledata
  */
 int
-fluid_defsfont_load_sampledata(fluid_defsfont_t* sfont)
+fluid_defsfont_load_sampledata(fluid_defsfont_t* sfont, SFData* sfdata)
 {
   return fluid_cached_sampledata_load(sfont->filename, sfont->samplepos,
-    sfont->samplesize, &sfont->sampledata, sfont->mlock);
+    sfont->samplesize, &sfont->sampledata, sfont->sample24pos,
+    sfont->sample24size, &sfont->sampledata24, sfont->mlock, sfdata->sample);
 }
 
 /*
@@ -835,11 +2045,21 @@ fluid_defpreset_noteon(fluid_defpreset_t* preset, fluid_synth_t* synth, int chan
 
 	if (fluid_inst_zone_inside_range(inst_zone, key, vel) && (sample != NULL)) {
 
+	  /* compressed samples have to be decoded before use */
+	  if ((sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+	      && fluid_cached_sample_acquire(sample) != FLUID_OK) {
+	    inst_zone = fluid_inst_zone_next(inst_zone);
+	    continue;
+	  }
+
 	  /* this is a good zone. allocate a new synthesis process and
              initialize it */
 
 	  voice = fluid_synth_alloc_voice(synth, sample, chan, key, vel);
 	  if (voice == NULL) {
+	    if ((sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+		&& fluid_sample_refcount(sample) == 0)
+	      fluid_cached_sample_release(sample);
 	    return FLUID_FAILED;
 	  }
 
@@ -1820,16 +3040,38 @@ fluid_sample_in_rom(fluid_sample_t* sample)
 int
 fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defsfont_t* sfont)
 {
+  int saved;
+
   FLUID_STRCPY(sample->name, sfsample->name);
+  sample->samplerate = sfsample->samplerate;
+  sample->origpitch = sfsample->origpitch;
+  sample->pitchadj = sfsample->pitchadj;
+  sample->sampletype = sfsample->sampletype;
+
+  if (sample->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS) {
+    /* start and end are set up when the sample is decoded, the loop
+       points are relative to the start of the sample already */
+    sample->valid = 0;
+    sample->loopstart = sfsample->loopstart;
+    sample->loopend = sfsample->loopend;
+
+    if (sfsample->end == 0) {
+      FLUID_LOG(FLUID_WARN, "Ignoring sample %s: no compressed sample data", sample->name);
+      return FLUID_OK;
+    }
+    return fluid_cached_sample_register(sfont->sampledata, sample,
+                                        sfsample->start, sfsample->end);
+  }
+
   sample->data = sfont->sampledata;
+  if (sfont->sampledata24 != NULL) {
+    sample->format = FLUID_SAMPLE_FORMAT_INT24;
+    sample->wide_data = sfont->sampledata24;
+  }
   sample->start = sfsample->start;
   sample->end = sfsample->start + sfsample->end;
   sample->loopstart = sfsample->start + sfsample->loopstart;
   sample->loopend = sfsample->start + sfsample->loopend;
-  sample->samplerate = sfsample->samplerate;
-  sample->origpitch = sfsample->origpitch;
-  sample->pitchadj = sfsample->pitchadj;
-  sample->sampletype = sfsample->sampletype;
 
   if (sample->sampletype & FLUID_SAMPLETYPE_ROM) {
     sample->valid = 0;
@@ -1848,6 +3090,14 @@ fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defs
 /*        sample->loopend = sample->end - 8; */
 /*      } */
   }
+
+  if (sfont->samples_deduped) {
+    saved = fluid_sample_dedup(sample, sfont);
+    if (saved < 0)
+      return FLUID_FAILED;
+    sfont->dedup_bytes_saved += saved;
+  }
+
   return FLUID_OK;
 }
 
@@ -1975,7 +3225,7 @@ static int fixup_sample (SFData * sf);
 
 char idlist[] = {
   "RIFFLISTsfbkINFOsdtapdtaifilisngINAMiromiverICRDIENGIPRD"
-    "ICOPICMTISFTsnamsmplphdrpbagpmodpgeninstibagimodigenshdr"
+    "ICOPICMTISFTsnamsmplphdrpbagpmodpgeninstibagimodigenshdrsm24"
 };
 
 static unsigned int sdtachunk_size;
@@ -2157,10 +3407,11 @@ process_info (int size, SFData * sf, FILE * fd)
 	    return (FAIL);
 	  }
 
-	  if (sf->version.major > 2) {
+	  /* version 3 is the same format with compressed samples */
+	  if (sf->version.major > 3) {
 	    FLUID_LOG (FLUID_WARN,
 		      _("Sound font version is %d.%d which is newer than"
-			" what this version of FLUID Synth was designed for (v2.0x)"),
+			" what this version of FLUID Synth was designed for (v3.0x)"),
 		      sf->version.major,
 		      sf->version.minor);
 	    return (FAIL);
@@ -2229,9 +3480,8 @@ process_sdta (unsigned int size, SFData * sf, FILE * fd)
     return (gerr (ErrCorr,
 	_("Expected SMPL chunk found invalid id instead")));
 
-  /* SDTA chunk may also contain sm24 chunk for 24 bit samples
-   * (not yet supported), only an error if SMPL chunk size is
-   * greater than SDTA. */
+  /* SDTA chunk may also contain sm24 chunk for 24 bit samples,
+   * only an error if SMPL chunk size is greater than SDTA. */
   if (chunk.size > size)
     return (gerr (ErrCorr, _("SDTA chunk size mismatch")));
 
@@ -2242,6 +3492,28 @@ process_sdta (unsigned int size, SFData * sf, FILE * fd)
   sdtachunk_size = chunk.size;
   sf->samplesize = chunk.size;
 
+  FSKIP (chunk.size, fd);
+  size -= chunk.size;
+
+  /* sm24 holds the least significant byte of every smpl point. It is only
+   * defined from version 2.04 on and must be ignored for older files. */
+  if (sf->version.major == 2 && sf->version.minor >= 4 && size >= 8)
+    {
+      READCHUNK (&chunk, fd);
+      size -= 8;
+
+      if (chunkid (chunk.id) == SM24_ID)
+	{
+	  if (chunk.size > size || chunk.size < sf->samplesize / 2)
+	    FLUID_LOG (FLUID_WARN, _("sm24 chunk size mismatch, ignoring 24 bit sample data"));
+	  else
+	    {
+	      sf->sample24pos = ftell (fd);
+	      sf->sample24size = chunk.size;
+	    }
+	}
+    }
+
   FSKIP (size, fd);
 
   return (OK);
@@ -3165,6 +4437,24 @@ fixup_sample (SFData * sf)
     {
       sam = (SFSample *) (p->data);
 
+      /* compressed samples: start and end are byte positions of the stream
+         in the smpl chunk, the loop points are relative sample offsets
+         and are checked once the sample is decoded */
+      if (sam->sampletype & FLUID_SAMPLETYPE_OGG_VORBIS)
+	{
+	  if (sam->end > sdtachunk_size || sam->start >= sam->end)
+	    {
+	      FLUID_LOG (FLUID_WARN, _("Sample '%s' start/end file positions are invalid,"
+		  " disabling and will not be saved"), sam->name);
+	      sam->start = sam->end = sam->loopstart = sam->loopend = 0;
+	    }
+	  else
+	    sam->end -= sam->start;	/* byte size of the stream */
+
+	  p = fluid_list_next (p);
+	  continue;
+	}
+
       /* if sample is not a ROM sample and end is over the sample data chunk
          or sam start is greater than 4 less than the end (at least 4 samples) */
       if ((!(sam->sampletype & FLUID_SAMPLETYPE_ROM)
@@ -143,6 +143,8 @@ typedef struct _SFData
   SFVersion romver;		/* ROM version */
   unsigned int samplepos;		/* position within sffd of the sample chunk */
   unsigned int samplesize;		/* length within sffd of the sample chunk */
+  unsigned int sample24pos;		/* position within sffd of the sm24 chunk, 0 if none */
+  unsigned int sample24size;		/* length within sffd of the sm24 chunk */
   char *fname;			/* file name */
   FILE *sffd;			/* loaded sfont file descriptor */
   fluid_list_t *info;		     /* linked list of info strings (1st byte is ID) */
@@ -164,7 +166,8 @@ enum
   SNAM_ID, SMPL_ID,		/* sample ids */
   PHDR_ID, PBAG_ID, PMOD_ID, PGEN_ID,	/* preset ids */
   IHDR_ID, IBAG_ID, IMOD_ID, IGEN_ID,	/* instrument ids */
-  SHDR_ID			/* sample info */
+  SHDR_ID,			/* sample info */
+  SM24_ID			/* 24 bit sample extension (SoundFont 2.04) */
 };
 
 /* generator types */
@@ -392,6 +395,7 @@ char* fluid_defpreset_preset_get_name(fluid_preset_t* preset);
 int fluid_defpreset_preset_get_banknum(fluid_preset_t* preset);
 int fluid_defpreset_preset_get_num(fluid_preset_t* preset);
 int fluid_defpreset_preset_noteon(fluid_preset_t* preset, fluid_synth_t* synth, int chan, int key, int vel);
+int fluid_defpreset_preset_notify(fluid_preset_t* preset, int reason, int chan);
 
 
 /*
@@ -403,9 +407,19 @@ struct _fluid_defsfont_t
   unsigned int samplepos;   /* the position in the file at which the sample data starts */
   unsigned int samplesize;  /* the size of the sample data */
   short* sampledata;        /* the sample data, loaded in ram */
+  unsigned int sample24pos;  /* the position in the file of the sm24 chunk, 0 if the font is 16 bit */
+  unsigned int sample24size; /* the size of the sm24 chunk */
+  sint32* sampledata24;      /* 24 bit sample data (smpl and sm24 combined), NULL if the font is 16 bit */
   fluid_list_t* sample;      /* the samples in this soundfont */
   fluid_defpreset_t* preset; /* the presets of this soundfont */
   int mlock;                 /* Should we try memlock (avoid swapping)? */
+  int dynamic_samples;       /* Decode compressed samples on first use instead of when loading? */
+  int sample_cache_size;     /* Budget of the decoded sample cache in MB, 0 for unlimited */
+  int decode_threads;        /* Number of threads decoding compressed samples when loading */
+  int sample_decoder;        /* TRUE if the font uses the sample decoder thread */
+  int sample_dedup;          /* Share identical samples with other fonts? (setting) */
+  int samples_deduped;       /* TRUE if the samples of this font live in shared regions */
+  unsigned int dedup_bytes_saved; /* Bytes of sample data shared with other fonts */
 
   fluid_preset_t iter_preset;        /* preset interface used in the iteration */
   fluid_defpreset_t* iter_cur;       /* the current preset in the iteration */
@@ -423,7 +437,7 @@ char* fluid_defsfont_get_name(fluid_defsfont_t* sfont);
 fluid_defpreset_t* fluid_defsfont_get_preset(fluid_defsfont_t* sfont, unsigned int bank, unsigned int prenum);
 void fluid_defsfont_iteration_start(fluid_defsfont_t* sfont);
 int fluid_defsfont_iteration_next(fluid_defsfont_t* sfont, fluid_preset_t* preset);
-int fluid_defsfont_load_sampledata(fluid_defsfont_t* sfont);
+int fluid_defsfont_load_sampledata(fluid_defsfont_t* sfont, SFData* sfdata);
 int fluid_defsfont_add_sample(fluid_defsfont_t* sfont, fluid_sample_t* sample);
 int fluid_defsfont_add_preset(fluid_defsfont_t* sfont, fluid_defpreset_t* preset);
 
@@ -526,5 +540,9 @@ int delete_fluid_sample(fluid_sample_t* sample);
 int fluid_sample_import_sfont(fluid_sample_t* sample, SFSample* sfsample, fluid_defsfont_t* sfont);
 int fluid_sample_in_rom(fluid_sample_t* sample);
 
+int fluid_cached_sample_acquire(fluid_sample_t* sample);
+void fluid_cached_sample_release(fluid_sample_t* sample);
+void fluid_cached_sample_prefetch(fluid_defpreset_t* preset);
+
 
 #endif  /* _FLUID_SFONT_H */
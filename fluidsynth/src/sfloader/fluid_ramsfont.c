@@ -1122,6 +1122,41 @@ fluid_sample_set_name(fluid_sample_t* sample, const char *name)
   return FLUID_OK;
 }
 
+/*
+ * Copy nbframes frames of framesize bytes into a new buffer, with
+ * SAMPLE_LOOP_MARGIN silent frames on both sides. The sample is padded to
+ * the 48 frames the SoundFont specs require, the stored count is returned
+ * in storedNbFrames.
+ */
+static void *
+fluid_ramsample_copy_data (const void *data, unsigned int nbframes,
+                           unsigned int framesize, unsigned int *storedNbFrames)
+{
+  size_t size;
+  char *stored;
+
+  /* nbframes should be >= 48 (SoundFont specs) */
+  *storedNbFrames = nbframes;
+  if (*storedNbFrames < 48) *storedNbFrames = 48;
+
+  size = ((size_t) *storedNbFrames + 2*SAMPLE_LOOP_MARGIN) * framesize;
+  stored = FLUID_MALLOC(size);
+  if (stored == NULL) {
+    FLUID_LOG(FLUID_ERR, "Out of memory");
+    return NULL;
+  }
+  FLUID_MEMSET(stored, 0, size);
+  FLUID_MEMCPY(stored + SAMPLE_LOOP_MARGIN * framesize, data, (size_t) nbframes * framesize);
+
+#if 0
+  /* this would do the fill of the margins */
+  FLUID_MEMCPY(stored + (SAMPLE_LOOP_MARGIN + *storedNbFrames) * framesize, data, SAMPLE_LOOP_MARGIN * framesize);
+  FLUID_MEMCPY(stored, (const char*)data + (nbframes - SAMPLE_LOOP_MARGIN) * framesize, SAMPLE_LOOP_MARGIN * framesize);
+#endif
+
+  return stored;
+}
+
 /**
  * Assign sample data to a RAM SoundFont sample.
  * @param sample RAM SoundFont sample
@@ -1146,26 +1181,17 @@ fluid_sample_set_sound_data (fluid_sample_t* sample, short *data,
   if (sample->data != NULL) {
   	FLUID_FREE(sample->data);
   }
+  if (sample->wide_data != NULL) {
+  	FLUID_FREE(sample->wide_data);
+  	sample->wide_data = NULL;
+  }
+  sample->format = FLUID_SAMPLE_FORMAT_INT16;
 
 	if (copy_data) {
-
-		/* nbframes should be >= 48 (SoundFont specs) */
-		storedNbFrames = nbframes;
-		if (storedNbFrames < 48) storedNbFrames = 48;
-
-	  sample->data = FLUID_MALLOC(storedNbFrames*2 + 4*SAMPLE_LOOP_MARGIN);
+	  sample->data = fluid_ramsample_copy_data(data, nbframes, sizeof(short), &storedNbFrames);
 	  if (sample->data == NULL) {
-	    FLUID_LOG(FLUID_ERR, "Out of memory");
 	    return FLUID_FAILED;
 	  }
-	  FLUID_MEMSET(sample->data, 0, storedNbFrames*2 + 4*SAMPLE_LOOP_MARGIN);
-	  FLUID_MEMCPY((char*)(sample->data) + 2*SAMPLE_LOOP_MARGIN, data, nbframes*2);
-
-#if 0
-	  /* this would do the fill of the margins */
-	  FLUID_MEMCPY((char*)(sample->data) + 2*SAMPLE_LOOP_MARGIN + storedNbFrames*2, (char*)data, 2*SAMPLE_LOOP_MARGIN);
-	  FLUID_MEMCPY((char*)(sample->data), (char*)data + nbframes*2 - 2*SAMPLE_LOOP_MARGIN, 2*SAMPLE_LOOP_MARGIN);
-#endif
 
 	  /* pointers */
 	  /* all from the start of data */
@@ -1191,6 +1217,66 @@ fluid_sample_set_sound_data (fluid_sample_t* sample, short *data,
   return FLUID_OK;
 }
 
+/**
+ * Assign 32 bit float sample data to a RAM SoundFont sample.
+ * @param sample RAM SoundFont sample
+ * @param data Buffer containing float audio sample data, full scale is +/-1.0
+ * @param nbframes Number of samples in \a data
+ * @param copy_data TRUE to copy the data, FALSE to use it directly
+ * @param rootkey Root MIDI note of sample (0-127)
+ * @return #FLUID_OK on success, #FLUID_FAILED otherwise
+ * @since 1.1.7
+ *
+ * Same as fluid_sample_set_sound_data() but the data is rendered as is,
+ * without conversion to 16 bit.
+ *
+ * WARNING: If \a copy_data is FALSE, data should have 8 unused frames at start
+ * and 8 unused frames at the end.
+ */
+int
+fluid_sample_set_float_data (fluid_sample_t* sample, float *data,
+                             unsigned int nbframes, short copy_data, int rootkey)
+{
+  unsigned int storedNbFrames;
+
+  /* in case we already have some data */
+  if (sample->data != NULL) {
+    FLUID_FREE(sample->data);
+    sample->data = NULL;
+  }
+  if (sample->wide_data != NULL) {
+    FLUID_FREE(sample->wide_data);
+    sample->wide_data = NULL;
+  }
+
+  if (copy_data) {
+    sample->wide_data = fluid_ramsample_copy_data(data, nbframes, sizeof(float), &storedNbFrames);
+    if (sample->wide_data == NULL) {
+      return FLUID_FAILED;
+    }
+    sample->start = SAMPLE_LOOP_MARGIN;
+    sample->end = SAMPLE_LOOP_MARGIN + storedNbFrames;
+  } else {
+    /* we cannot assure the SAMPLE_LOOP_MARGIN */
+    sample->wide_data = data;
+    sample->start = 0;
+    sample->end = nbframes;
+  }
+
+  /* only used as markers for the LOOP generators : set them on the first real frame */
+  sample->loopstart = sample->start;
+  sample->loopend = sample->end;
+
+  sample->samplerate = 44100;
+  sample->origpitch = rootkey;
+  sample->pitchadj = 0;
+  sample->sampletype = FLUID_SAMPLETYPE_MONO;
+  sample->format = FLUID_SAMPLE_FORMAT_FLOAT;
+  sample->valid = 1;
+
+  return FLUID_OK;
+}
+
 /**
  * Create new RAM SoundFont sample.
  * @return New RAM SoundFont sample or NULL if out of memory
@@ -1225,6 +1311,10 @@ delete_fluid_ramsample (fluid_sample_t* sample)
   	FLUID_FREE(sample->data);
   }
   sample->data = NULL;
+  if (sample->wide_data != NULL) {
+  	FLUID_FREE(sample->wide_data);
+  }
+  sample->wide_data = NULL;
   FLUID_FREE(sample);
   return FLUID_OK;
 }
@@ -80,6 +80,7 @@ fluid_channel_init(fluid_channel_t* chan)
   fluid_channel_set_preset(chan, newpreset);
 
   chan->interp_method = FLUID_INTERP_DEFAULT;
+  chan->azimuth = 0.0f;
   chan->tuning_bank = 0;
   chan->tuning_prog = 0;
   chan->nrpn_select = 0;
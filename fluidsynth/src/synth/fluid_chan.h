@@ -54,6 +54,7 @@ struct _fluid_channel_t
    */
   unsigned int  sostenuto_orderid;
   int interp_method;                    /**< Interpolation method (enum fluid_interp) */
+  fluid_real_t azimuth;                 /**< Direction in a surround layout, in degrees */
   fluid_tuning_t* tuning;               /**< Micro tuning */
   int tuning_bank;                      /**< Current tuning bank number */
   int tuning_prog;                      /**< Current tuning program number */
@@ -127,6 +128,10 @@ int fluid_channel_get_interp_method(fluid_channel_t* chan);
   ((chan)->interp_method = (new_method))
 #define fluid_channel_get_interp_method(chan) \
   ((chan)->interp_method);
+#define fluid_channel_set_azimuth(chan, new_azimuth) \
+  ((chan)->azimuth = (new_azimuth))
+#define fluid_channel_get_azimuth(chan) \
+  ((chan)->azimuth)
 #define fluid_channel_set_tuning(_c, _t)        { (_c)->tuning = _t; }
 #define fluid_channel_has_tuning(_c)            ((_c)->tuning != NULL)
 #define fluid_channel_get_tuning(_c)            ((_c)->tuning)
@@ -628,154 +628,204 @@ fluid_event_get_sfont_id(fluid_event_t* evt)
 /* heap management  */
 /********************/
 
-fluid_evt_heap_t*
-_fluid_evt_heap_init(int nbEvents)
+/*
+  The event entries are allocated by chunks which are never freed
+  before the heap itself, so that a free entry can be addressed by
+  its index.  The free list is a lock-free stack: its head holds
+  the index + 1 of the first free entry, and a tag incremented on
+  every change so that a thread preempted in the middle of a pop
+  can not succeed its compare-and-exchange on a recycled entry.
+  The head is as wide as a pointer, which leaves 42 bits for the
+  tag on 64 bit platforms.
+
+  Only producer threads calling fluid_sequencer_send_at() grow the
+  heap, by a chunk when it runs low, so that the thread processing
+  the sequencer never allocates memory.  An event it can not get an
+  entry for is dropped and counted as a failure.
+*/
+
+#define FLUID_EVT_HEAP_INDEX_MASK	(((size_t) 1 << FLUID_EVT_HEAP_INDEX_BITS) - 1)
+#define FLUID_EVT_HEAP_LOW_WATER	(FLUID_EVT_HEAP_CHUNK_SIZE / 4)
+
+/* new free list head pointing to slot, with the tag of head incremented */
+#define FLUID_EVT_HEAP_NEXT_HEAD(_head, _slot) \
+  FLUID_SIZE_TO_POINTER(((FLUID_POINTER_TO_SIZE(_head) + FLUID_EVT_HEAP_INDEX_MASK + 1) \
+			 & ~FLUID_EVT_HEAP_INDEX_MASK) | (size_t)(_slot))
+
+static fluid_evt_entry*
+_fluid_evt_heap_entry(fluid_evt_heap_t* heap, int index)
 {
-#ifdef HEAP_WITH_DYNALLOC
+  return &heap->chunks[index >> FLUID_EVT_HEAP_CHUNK_BITS]
+    [index & (FLUID_EVT_HEAP_CHUNK_SIZE - 1)];
+}
 
-  int i;
-  fluid_evt_heap_t* heap;
-  fluid_evt_entry *tmp;
+/* push the linked entries first..last on the free list */
+static void
+_fluid_evt_heap_push(fluid_evt_heap_t* heap, fluid_evt_entry* first,
+		     fluid_evt_entry* last)
+{
+  void* head;
 
-  heap = FLUID_NEW(fluid_evt_heap_t);
-  if (heap == NULL) {
-    fluid_log(FLUID_PANIC, "sequencer: Out of memory\n");
-    return NULL;
+  do {
+    head = fluid_atomic_pointer_get(&heap->freelist);
+    fluid_atomic_int_set(&last->freenext,
+			 (int)(FLUID_POINTER_TO_SIZE(head) & FLUID_EVT_HEAP_INDEX_MASK));
+  } while (!fluid_atomic_pointer_compare_and_exchange(&heap->freelist, head,
+		FLUID_EVT_HEAP_NEXT_HEAD(head, first->index + 1)));
+}
+
+static fluid_evt_entry*
+_fluid_evt_heap_pop(fluid_evt_heap_t* heap)
+{
+  fluid_evt_entry* evt;
+  void* head;
+  int slot;
+
+  do {
+    head = fluid_atomic_pointer_get(&heap->freelist);
+    slot = (int)(FLUID_POINTER_TO_SIZE(head) & FLUID_EVT_HEAP_INDEX_MASK);
+    if (slot == 0) {
+      return NULL;
+    }
+    evt = _fluid_evt_heap_entry(heap, slot - 1);
+  } while (!fluid_atomic_pointer_compare_and_exchange(&heap->freelist, head,
+		FLUID_EVT_HEAP_NEXT_HEAD(head, fluid_atomic_int_get(&evt->freenext))));
+
+  return evt;
+}
+
+/* Add a chunk of entries to the heap, called with the mutex held */
+static int
+_fluid_evt_heap_add_chunk(fluid_evt_heap_t* heap)
+{
+  fluid_evt_entry* chunk;
+  int i, n;
+
+  n = heap->nchunks;
+  if (n >= FLUID_EVT_HEAP_MAX_CHUNKS) {
+    return FLUID_FAILED;
   }
 
-  heap->freelist = NULL;
-  fluid_mutex_init(heap->mutex);
+  chunk = FLUID_ARRAY(fluid_evt_entry, FLUID_EVT_HEAP_CHUNK_SIZE);
+  if (chunk == NULL) {
+    return FLUID_FAILED;
+  }
+
+  for (i = 0; i < FLUID_EVT_HEAP_CHUNK_SIZE; i++) {
+    chunk[i].next = NULL;
+    chunk[i].index = (n << FLUID_EVT_HEAP_CHUNK_BITS) + i;
+    chunk[i].freenext = chunk[i].index + 2;
+    chunk[i].indexed = FLUID_EVT_ENTRY_UNLINKED;
+  }
+
+  heap->chunks[n] = chunk;
+  fluid_atomic_int_set(&heap->nchunks, n + 1);
+  fluid_atomic_int_add(&heap->size, FLUID_EVT_HEAP_CHUNK_SIZE);
+
+  _fluid_evt_heap_push(heap, &chunk[0], &chunk[FLUID_EVT_HEAP_CHUNK_SIZE - 1]);
+  fluid_atomic_int_add(&heap->nfree, FLUID_EVT_HEAP_CHUNK_SIZE);
+
+  return FLUID_OK;
+}
+
+/* Grow the heap by a chunk, unless another thread did it while we
+ * were waiting for the lock. */
+static int
+_fluid_evt_heap_grow(fluid_evt_heap_t* heap)
+{
+  int retval = FLUID_OK;
 
-  /* LOCK */
   fluid_mutex_lock(heap->mutex);
 
-  /* Allocate the event entries */
-  for (i = 0; i < nbEvents; i++) {
-    tmp = FLUID_NEW(fluid_evt_entry);
-    tmp->next = heap->freelist;
-    heap->freelist = tmp;
+  if (fluid_atomic_int_get(&heap->nfree) < FLUID_EVT_HEAP_LOW_WATER) {
+    retval = _fluid_evt_heap_add_chunk(heap);
   }
 
-  /* UNLOCK */
   fluid_mutex_unlock(heap->mutex);
 
+  return retval;
+}
 
-#else
-	int i;
-	fluid_evt_heap_t* heap;
-	int siz = 2*sizeof(fluid_evt_entry *) + sizeof(fluid_evt_entry)*nbEvents;
+fluid_evt_heap_t*
+_fluid_evt_heap_init(int nbEvents)
+{
+  fluid_evt_heap_t* heap;
 
-	heap = (fluid_evt_heap_t *)FLUID_MALLOC(siz);
+  heap = FLUID_NEW(fluid_evt_heap_t);
   if (heap == NULL) {
     fluid_log(FLUID_PANIC, "sequencer: Out of memory\n");
     return NULL;
   }
-  FLUID_MEMSET(heap, 0, siz);
-
-  /* link all heap events */
-  {
-  	fluid_evt_entry *tmp = &(heap->pool);
-	  for (i = 0 ; i < nbEvents - 1 ; i++)
- 		 	tmp[i].next = &(tmp[i+1]);
- 	 	tmp[nbEvents-1].next = NULL;
-
- 	 	/* set head & tail */
- 	 	heap->tail = &(tmp[nbEvents-1]);
-  	heap->head = &(heap->pool);
+
+  FLUID_MEMSET(heap, 0, sizeof(fluid_evt_heap_t));
+  fluid_mutex_init(heap->mutex);
+
+  /* Allocate the event entries */
+  while (heap->size < nbEvents) {
+    if (_fluid_evt_heap_add_chunk(heap) != FLUID_OK) {
+      fluid_log(FLUID_PANIC, "sequencer: Out of memory\n");
+      _fluid_evt_heap_free(heap);
+      return NULL;
+    }
   }
-#endif
+
   return (heap);
 }
 
 void
 _fluid_evt_heap_free(fluid_evt_heap_t* heap)
 {
-#ifdef HEAP_WITH_DYNALLOC
-  fluid_evt_entry *tmp, *next;
-
-  /* LOCK */
-  fluid_mutex_lock(heap->mutex);
+  int i;
 
-  tmp = heap->freelist;
-  while (tmp) {
-    next = tmp->next;
-    FLUID_FREE(tmp);
-    tmp = next;
+  for (i = 0; i < heap->nchunks; i++) {
+    FLUID_FREE(heap->chunks[i]);
   }
 
-  /* UNLOCK */
-  fluid_mutex_unlock(heap->mutex);
   fluid_mutex_destroy(heap->mutex);
 
   FLUID_FREE(heap);
-
-#else
-	FLUID_FREE(heap);
-#endif
 }
 
+/* Get a free entry.  If may_grow is TRUE, the heap is grown when it
+ * runs low or is exhausted, otherwise NULL is returned when it is
+ * exhausted. */
 fluid_evt_entry*
-_fluid_seq_heap_get_free(fluid_evt_heap_t* heap)
+_fluid_seq_heap_get_free(fluid_evt_heap_t* heap, int may_grow)
 {
-#ifdef HEAP_WITH_DYNALLOC
-  fluid_evt_entry* evt = NULL;
+  fluid_evt_entry* evt;
+  int used, high;
 
-  /* LOCK */
-  fluid_mutex_lock(heap->mutex);
+  evt = _fluid_evt_heap_pop(heap);
 
-#if !defined(MACOS9)
-  if (heap->freelist == NULL) {
-    heap->freelist = FLUID_NEW(fluid_evt_entry);
-    if (heap->freelist != NULL) {
-      heap->freelist->next = NULL;
+  if (evt == NULL) {
+    if (may_grow && _fluid_evt_heap_grow(heap) == FLUID_OK) {
+      evt = _fluid_evt_heap_pop(heap);
+    }
+    if (evt == NULL) {
+      fluid_atomic_int_inc(&heap->failures);
+      return NULL;
     }
   }
-#endif
 
-  evt = heap->freelist;
+  fluid_atomic_int_add(&heap->nfree, -1);
+  evt->next = NULL;
 
-  if (evt != NULL) {
-    heap->freelist = heap->freelist->next;
-    evt->next = NULL;
-  }
+  used = fluid_atomic_int_get(&heap->size) - fluid_atomic_int_get(&heap->nfree);
+  do {
+    high = fluid_atomic_int_get(&heap->high_water);
+  } while (used > high
+	   && !fluid_atomic_int_compare_and_exchange(&heap->high_water, high, used));
 
-  /* UNLOCK */
-  fluid_mutex_unlock(heap->mutex);
+  if (may_grow && fluid_atomic_int_get(&heap->nfree) < FLUID_EVT_HEAP_LOW_WATER) {
+    _fluid_evt_heap_grow(heap);
+  }
 
   return evt;
-
-#else
-	fluid_evt_entry* evt;
-	if (heap->head == NULL) return NULL;
-
-	/* take from head of the heap */
-	/* critical - should threadlock ? */
-	evt = heap->head;
-	heap->head = heap->head->next;
-
-	return evt;
-#endif
 }
 
 void
 _fluid_seq_heap_set_free(fluid_evt_heap_t* heap, fluid_evt_entry* evt)
 {
-#ifdef HEAP_WITH_DYNALLOC
-
-  /* LOCK */
-  fluid_mutex_lock(heap->mutex);
-
-  evt->next = heap->freelist;
-  heap->freelist = evt;
-
-  /* UNLOCK */
-  fluid_mutex_unlock(heap->mutex);
-
-#else
-	/* append to the end of the heap */
-	/* critical - should threadlock ? */
-	heap->tail->next = evt;
-	heap->tail = evt;
-	evt->next = NULL;
-#endif
+  _fluid_evt_heap_push(heap, evt, evt);
+  fluid_atomic_int_add(&heap->nfree, 1);
 }
@@ -51,33 +51,55 @@ void fluid_event_clear(fluid_event_t* evt);
 /* private data for sorter + heap */
 enum fluid_evt_entry_type {
   FLUID_EVT_ENTRY_INSERT = 0,
-  FLUID_EVT_ENTRY_REMOVE
+  FLUID_EVT_ENTRY_REMOVE,
+  FLUID_EVT_ENTRY_CANCELLED	/* removed, freed when reached by the queue */
+};
+
+enum fluid_evt_entry_index {
+  FLUID_EVT_ENTRY_UNLINKED = 0,
+  FLUID_EVT_ENTRY_LINKED,	/* linked in the per client lists */
+  FLUID_EVT_ENTRY_UNINDEXED	/* could not be linked, counted in unindexedEvents */
 };
 
 typedef struct _fluid_evt_entry fluid_evt_entry;
 struct _fluid_evt_entry {
 	fluid_evt_entry *next;
 	short entryType;
+	int index;		/* position in the heap */
+	int freenext;		/* next free entry (index + 1), 0 = none */
+	short indexed;		/* fluid_evt_entry_index, for the lists below */
+	fluid_evt_entry *srcPrev, *srcNext;	/* queued events of the same source */
+	fluid_evt_entry *destPrev, *destNext;	/* queued events of the same dest */
 	fluid_event_t evt;
 };
 
-#define HEAP_WITH_DYNALLOC 1
-/* #undef HEAP_WITH_DYNALLOC */
+/* The heap is grown by chunks of 1 << FLUID_EVT_HEAP_CHUNK_BITS entries.
+ * The pointer sized free list head packs an ABA tag above the
+ * FLUID_EVT_HEAP_INDEX_BITS bits holding the index + 1 of the first free
+ * entry. */
+#define FLUID_EVT_HEAP_CHUNK_BITS	10
+#define FLUID_EVT_HEAP_CHUNK_SIZE	(1 << FLUID_EVT_HEAP_CHUNK_BITS)
+#define FLUID_EVT_HEAP_INDEX_BITS	22
+#define FLUID_EVT_HEAP_MAX_CHUNKS	((1 << (FLUID_EVT_HEAP_INDEX_BITS - FLUID_EVT_HEAP_CHUNK_BITS)) - 1)
 
 typedef struct _fluid_evt_heap_t {
-#ifdef HEAP_WITH_DYNALLOC
-  fluid_evt_entry* freelist;
-  fluid_mutex_t mutex;
-#else
-	fluid_evt_entry* head;
-	fluid_evt_entry* tail;
-	fluid_evt_entry pool;
-#endif
+  void* freelist;		/* tagged head of the lock-free free list */
+  int nfree;			/* number of free entries */
+  int size;			/* number of allocated entries */
+  int high_water;		/* highest number of entries in use */
+  int failures;			/* entries that could not be allocated */
+  int nchunks;
+  fluid_mutex_t mutex;		/* serializes growth */
+  fluid_evt_entry* chunks[FLUID_EVT_HEAP_MAX_CHUNKS];
 } fluid_evt_heap_t;
 
 fluid_evt_heap_t* _fluid_evt_heap_init(int nbEvents);
 void _fluid_evt_heap_free(fluid_evt_heap_t* heap);
-fluid_evt_entry* _fluid_seq_heap_get_free(fluid_evt_heap_t* heap);
+fluid_evt_entry* _fluid_seq_heap_get_free(fluid_evt_heap_t* heap, int may_grow);
 void _fluid_seq_heap_set_free(fluid_evt_heap_t* heap, fluid_evt_entry* evt);
 
+/* defined in fluid_seq.c */
+void fluid_sequencer_process_exact(fluid_sequencer_t* seq, double msec);
+int fluid_sequencer_event_is_queued(fluid_sequencer_t* seq, fluid_event_t* evt);
+
 #endif /* _FLUID_EVENT_PRIV_H */
@@ -0,0 +1,161 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+#include "fluid_surround.h"
+
+/* Marks the LFE channel, which voices are not panned to */
+#define FLUID_SURROUND_LFE 1000.0f
+
+/* Gain of -3 dB, 1/sqrt(2) */
+#define FLUID_SURROUND_MINUS_3DB 0.70710678f
+
+typedef struct
+{
+  const char* name;
+  int speakers;
+  fluid_real_t azimuth[FLUID_RVOICE_MAX_SPEAKERS];
+} fluid_surround_layout_t;
+
+/* Speakers in WAVE channel order */
+static const fluid_surround_layout_t fluid_surround_layouts[] = {
+  { "stereo", 2, { -30.0f, 30.0f } },
+  { "quad", 4, { -45.0f, 45.0f, -135.0f, 135.0f } },
+  { "5.1", 6, { -30.0f, 30.0f, 0.0f, FLUID_SURROUND_LFE, -110.0f, 110.0f } },
+  { "7.1", 8, { -30.0f, 30.0f, 0.0f, FLUID_SURROUND_LFE,
+                -150.0f, 150.0f, -90.0f, 90.0f } },
+  { NULL, 0, { 0.0f } }
+};
+
+/**
+ * Set up a speaker layout.
+ * @param surround Layout to initialize
+ * @param layout Name of the layout: "stereo", "quad", "5.1" or "7.1"
+ * @return FLUID_OK on success, FLUID_FAILED for an unknown name (the
+ *   layout is stereo then)
+ */
+int
+fluid_surround_init(fluid_surround_t* surround, const char* layout)
+{
+  const fluid_surround_layout_t* l;
+  int i, j, found = TRUE;
+
+  for (l = fluid_surround_layouts; l->name; l++)
+    if (FLUID_STRCMP(l->name, layout) == 0)
+      break;
+  if (l->name == NULL) {
+    l = fluid_surround_layouts;
+    found = FALSE;
+  }
+
+  FLUID_MEMSET(surround, 0, sizeof(fluid_surround_t));
+  surround->speakers = l->speakers;
+  surround->pan_width = l->azimuth[1];
+
+  /* stereo downmix as in ITU-R BS.775: the front left and right speakers
+   * at full level, the center on both sides and the side and rear
+   * speakers on their side at -3 dB, the LFE dropped */
+  for (i = 0; i < l->speakers; i++) {
+    fluid_real_t a = l->azimuth[i];
+
+    if (a == FLUID_SURROUND_LFE)
+      continue;
+    if (a == 0.0f) {
+      surround->downmix[i][0] = surround->downmix[i][1] = FLUID_SURROUND_MINUS_3DB;
+      continue;
+    }
+    surround->downmix[i][a < 0.0f ? 0 : 1] = (a >= -45.0f && a <= 45.0f)
+      ? 1.0f : FLUID_SURROUND_MINUS_3DB;
+  }
+
+  /* sort the speakers around the listener, insertion sort */
+  for (i = 0; i < l->speakers; i++) {
+    surround->azimuth[i] = l->azimuth[i];
+    if (l->azimuth[i] == FLUID_SURROUND_LFE)
+      continue;
+    for (j = surround->ring_count; j > 0
+           && l->azimuth[surround->ring[j-1]] > l->azimuth[i]; j--)
+      surround->ring[j] = surround->ring[j-1];
+    surround->ring[j] = i;
+    surround->ring_count++;
+  }
+
+  return found ? FLUID_OK : FLUID_FAILED;
+}
+
+/**
+ * Calculate the speaker gains of a voice with vector base amplitude
+ * panning: the voice sounds from the two speakers enclosing its
+ * direction, at constant power.
+ * @param surround Speaker layout
+ * @param azimuth Direction of the voice in degrees, clockwise from the front
+ * @param gains Gain of each speaker (surround->speakers values)
+ */
+void
+fluid_surround_pan(fluid_surround_t* surround, fluid_real_t azimuth,
+                   fluid_real_t* gains)
+{
+  double a, a1, a2, x1, y1, x2, y2, px, py, det, g1, g2, norm;
+  int i, s1 = 0, s2 = 0;
+
+  for (i = 0; i < surround->speakers; i++)
+    gains[i] = 0.0f;
+
+  /* bring the direction into the range of the ring */
+  a = fmod(azimuth, 360.0);
+  while (a < surround->azimuth[surround->ring[0]])
+    a += 360.0;
+  while (a >= surround->azimuth[surround->ring[0]] + 360.0)
+    a -= 360.0;
+
+  /* find the pair of neighbouring speakers enclosing it, the last pair
+   * wraps around behind the listener */
+  for (i = 0; i < surround->ring_count; i++) {
+    s1 = surround->ring[i];
+    s2 = surround->ring[(i + 1) % surround->ring_count];
+    a2 = surround->azimuth[s2];
+    if (i + 1 == surround->ring_count)
+      a2 += 360.0;
+    if (a <= a2)
+      break;
+  }
+  a1 = surround->azimuth[s1];
+  a2 = surround->azimuth[s2];
+
+  /* solve p = g1 * l1 + g2 * l2 for the speaker direction vectors */
+  x1 = sin(a1 * M_PI / 180.0);
+  y1 = cos(a1 * M_PI / 180.0);
+  x2 = sin(a2 * M_PI / 180.0);
+  y2 = cos(a2 * M_PI / 180.0);
+  px = sin(a * M_PI / 180.0);
+  py = cos(a * M_PI / 180.0);
+  det = x1 * y2 - y1 * x2;
+  g1 = (px * y2 - py * x2) / det;
+  g2 = (x1 * py - y1 * px) / det;
+  if (g1 < 0.0)
+    g1 = 0.0;
+  if (g2 < 0.0)
+    g2 = 0.0;
+
+  norm = sqrt(g1 * g1 + g2 * g2);
+  if (norm > 0.0) {
+    gains[s1] = (fluid_real_t) (g1 / norm);
+    gains[s2] = (fluid_real_t) (g2 / norm);
+  }
+}
@@ -0,0 +1,53 @@
+/* FluidSynth - A Software Synthesizer
+ *
+ * Copyright (C) 2003  Peter Hanappe and others.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public License
+ * as published by the Free Software Foundation; either version 2 of
+ * the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA
+ */
+
+
+#ifndef _FLUID_SURROUND_H
+#define _FLUID_SURROUND_H
+
+#include "fluidsynth_priv.h"
+#include "fluid_rvoice.h"
+
+/*
+ * Speaker layout of the primary outputs. The speakers of an audio group
+ * are laid out over consecutive stereo buffers in WAVE channel order:
+ * speaker 0 is the left and speaker 1 the right of the first buffer,
+ * speaker 2 the left of the second one and so on.
+ */
+typedef struct _fluid_surround_t fluid_surround_t;
+
+struct _fluid_surround_t
+{
+  int speakers;                 /**< Number of speakers, 2 for stereo */
+  fluid_real_t azimuth[FLUID_RVOICE_MAX_SPEAKERS]; /**< Direction of each speaker in degrees, clockwise from the front */
+  int ring[FLUID_RVOICE_MAX_SPEAKERS]; /**< Speakers voices are panned to (all but the LFE), by azimuth */
+  int ring_count;               /**< Number of speakers in ring */
+  fluid_real_t pan_width;       /**< Azimuth reached by a voice panned fully right */
+  fluid_real_t downmix[FLUID_RVOICE_MAX_SPEAKERS][2]; /**< Left and right gain of each speaker on a stereo output */
+};
+
+/** Number of stereo buffers an audio group takes */
+#define fluid_surround_pairs(_s) (((_s)->speakers + 1) / 2)
+
+int fluid_surround_init(fluid_surround_t* surround, const char* layout);
+void fluid_surround_pan(fluid_surround_t* surround, fluid_real_t azimuth,
+                        fluid_real_t* gains);
+
+#endif /* _FLUID_SURROUND_H */
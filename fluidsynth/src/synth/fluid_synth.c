@@ -90,6 +90,13 @@ static void fluid_synth_kill_by_exclusive_class_LOCAL(fluid_synth_t* synth,
 static fluid_sfont_info_t *new_fluid_sfont_info (fluid_synth_t *synth,
                                                  fluid_sfont_t *sfont);
 static int fluid_synth_sfunload_callback(void* data, unsigned int msec);
+static fluid_sfont_t* fluid_synth_load_sfont_file(fluid_synth_t* synth,
+                                                  const char* filename);
+static int fluid_synth_push_sfont(fluid_synth_t* synth, fluid_sfont_t* sfont,
+                                  int reset_presets);
+static int fluid_synth_replace_sfont(fluid_synth_t* synth, unsigned int id,
+                                     fluid_sfont_t* sfont);
+static void fluid_synth_join_sfload_jobs(fluid_synth_t* synth, int wait);
 static void fluid_synth_release_voice_on_same_note_LOCAL(fluid_synth_t* synth,
                                                             int chan, int key);
 static fluid_tuning_t* fluid_synth_get_tuning(fluid_synth_t* synth,
@@ -186,6 +193,11 @@ void fluid_synth_settings(fluid_settings_t* settings)
                               FLUID_HINT_TOGGLED, NULL, NULL);
   fluid_settings_register_int(settings, "synth.lock-memory", 1, 0, 1,
                               FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.dynamic-sample-loading", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.sample-cache-size", 0, 0, 65535, 0, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.sample-dedup", 0, 0, 1,
+                              FLUID_HINT_TOGGLED, NULL, NULL);
   fluid_settings_register_str(settings, "midi.portname", "", 0, NULL, NULL);
 
   fluid_settings_register_str(settings, "synth.default-soundfont",
@@ -204,6 +216,8 @@ void fluid_synth_settings(fluid_settings_t* settings)
 			      1, 1, 128, 0, NULL, NULL);
   fluid_settings_register_int(settings, "synth.effects-channels",
 			      2, 2, 2, 0, NULL, NULL);
+  fluid_settings_register_int(settings, "synth.effects-groups",
+			      1, 1, 128, 0, NULL, NULL);
   fluid_settings_register_num(settings, "synth.sample-rate",
 			      44100.0f, 8000.0f, 96000.0f,
 			      0, NULL, NULL);
@@ -225,6 +239,22 @@ void fluid_synth_settings(fluid_settings_t* settings)
   fluid_settings_add_option(settings, "synth.midi-bank-select", "gs");
   fluid_settings_add_option(settings, "synth.midi-bank-select", "xg");
   fluid_settings_add_option(settings, "synth.midi-bank-select", "mma");
+
+  fluid_settings_register_str(settings, "synth.chorus.interpolation", "sinc", 0, NULL, NULL);
+  fluid_settings_add_option(settings, "synth.chorus.interpolation", "sinc");
+  fluid_settings_add_option(settings, "synth.chorus.interpolation", "cubic");
+  fluid_settings_add_option(settings, "synth.chorus.interpolation", "linear");
+
+  fluid_settings_register_str(settings, "synth.speaker-layout", "stereo", 0, NULL, NULL);
+  fluid_settings_add_option(settings, "synth.speaker-layout", "stereo");
+  fluid_settings_add_option(settings, "synth.speaker-layout", "quad");
+  fluid_settings_add_option(settings, "synth.speaker-layout", "5.1");
+  fluid_settings_add_option(settings, "synth.speaker-layout", "7.1");
+
+  fluid_settings_register_str(settings, "synth.reverb.engine", "freeverb", 0, NULL, NULL);
+  fluid_settings_add_option(settings, "synth.reverb.engine", "freeverb");
+  fluid_settings_add_option(settings, "synth.reverb.engine", "convolution");
+  fluid_settings_register_str(settings, "synth.reverb.impulse-response", "", 0, NULL, NULL);
   
 }
 
@@ -438,14 +468,6 @@ fluid_synth_init(void)
   fluid_mod_set_amount(&default_pitch_bend_mod, 12700.0);                 /* Amount: 12700 cents */
 }
 
-static FLUID_INLINE unsigned int fluid_synth_get_ticks(fluid_synth_t* synth)
-{
-  if (synth->eventhandler->is_threadsafe)
-    return fluid_atomic_int_get(&synth->ticks_since_start);
-  else
-    return synth->ticks_since_start;
-}
-
 static FLUID_INLINE void fluid_synth_add_ticks(fluid_synth_t* synth, int val)
 {
   if (synth->eventhandler->is_threadsafe)
@@ -540,6 +562,65 @@ fluid_synth_update_mixer(fluid_synth_t* synth, void* method, int intparam,
 }
 
 
+/* Replace the built-in reverb by the convolution reverb, keeps the
+ * built-in one if the impulse response cannot be loaded. */
+static void
+fluid_synth_init_convreverb(fluid_synth_t* synth)
+{
+  fluid_convreverb_ir_t* ir;
+  char* filename = NULL;
+  int prio_level = 0;
+
+  fluid_settings_dupstr(synth->settings, "synth.reverb.impulse-response", &filename);
+  if (filename == NULL || filename[0] == '\0') {
+    FLUID_LOG(FLUID_WARN, "No impulse response for the convolution reverb set "
+              "(synth.reverb.impulse-response), using the built-in reverb");
+    goto done;
+  }
+
+  ir = new_fluid_convreverb_ir(filename, synth->sample_rate);
+  fluid_settings_getint(synth->settings, "audio.realtime-prio", &prio_level);
+  if (ir == NULL
+      || fluid_rvoice_mixer_set_convreverb(synth->eventhandler->mixer, ir,
+                                           prio_level) != FLUID_OK)
+    FLUID_LOG(FLUID_WARN, "Failed to set up the convolution reverb, "
+              "using the built-in reverb");
+  else
+    synth->convreverb_ir = ir;
+
+done:
+  if (filename)
+    FLUID_FREE(filename);
+}
+
+/* Build the convolution reverb impulse response for the sample rate here,
+ * the transforms are too slow for the rendering thread. The mixer retires
+ * the previous one, which is freed on the next rate change. */
+static void
+fluid_synth_update_convreverb(fluid_synth_t* synth)
+{
+  fluid_convreverb_ir_t* ir;
+
+  if (synth->convreverb_ir == NULL
+      || fluid_convreverb_ir_get_sample_rate(synth->convreverb_ir) == synth->sample_rate)
+    return;
+
+  fluid_rvoice_mixer_free_retired_convreverb_irs(synth->eventhandler->mixer);
+
+  ir = new_fluid_convreverb_ir_resampled(synth->convreverb_ir, synth->sample_rate);
+  if (ir == NULL
+      || fluid_rvoice_eventhandler_push_ptr(synth->eventhandler,
+                                            fluid_rvoice_mixer_set_convreverb_ir,
+                                            synth->eventhandler->mixer, ir) != FLUID_OK) {
+    FLUID_LOG(FLUID_WARN, "Failed to prepare the convolution reverb for %.0f Hz, "
+              "it keeps playing at %.0f Hz", (double) synth->sample_rate,
+              (double) fluid_convreverb_ir_get_sample_rate(synth->convreverb_ir));
+    delete_fluid_convreverb_ir(ir);
+    return;
+  }
+  synth->convreverb_ir = ir;
+}
+
 /**
  * Create new FluidSynth instance.
  * @param settings Configuration parameters to use (used directly).
@@ -554,7 +635,8 @@ new_fluid_synth(fluid_settings_t *settings)
   fluid_synth_t* synth;
   fluid_sfloader_t* loader;
   double gain;
-  int i, nbuf;
+  int i, nbuf, pairs, chorus_interp;
+  char* layout = NULL;
 
   /* initialize all the conversion tables and other stuff */
   if (fluid_synth_initialized == 0) {
@@ -586,6 +668,7 @@ new_fluid_synth(fluid_settings_t *settings)
   fluid_settings_getint(settings, "synth.audio-channels", &synth->audio_channels);
   fluid_settings_getint(settings, "synth.audio-groups", &synth->audio_groups);
   fluid_settings_getint(settings, "synth.effects-channels", &synth->effects_channels);
+  fluid_settings_getint(settings, "synth.effects-groups", &synth->effects_groups);
   fluid_settings_getnum(settings, "synth.gain", &gain);
   synth->gain = gain;
   fluid_settings_getint(settings, "synth.device-id", &synth->device_id);
@@ -645,19 +728,46 @@ new_fluid_synth(fluid_settings_t *settings)
     synth->effects_channels = 2;
   }
 
+  if (synth->effects_groups < 1) {
+    FLUID_LOG(FLUID_WARN, "Requested number of effects groups is smaller than 1. "
+	     "Changing this setting to 1.");
+    synth->effects_groups = 1;
+  } else if (synth->effects_groups > 128) {
+    FLUID_LOG(FLUID_WARN, "Requested number of effects groups is too big (%d). "
+	     "Limiting this setting to 128.", synth->effects_groups);
+    synth->effects_groups = 128;
+  }
+
 
   /* The number of buffers is determined by the higher number of nr
    * groups / nr audio channels.  If LADSPA is unused, they should be
    * the same. */
+  /* Each audio group takes as many stereo buffers as its speakers
+   * need, the first group is always output. */
+  fluid_settings_dupstr(settings, "synth.speaker-layout", &layout);
+  if (fluid_surround_init(&synth->surround, layout ? layout : "stereo") != FLUID_OK)
+    FLUID_LOG(FLUID_WARN, "Unknown speaker layout '%s', using stereo", layout);
+  if (layout)
+    FLUID_FREE(layout);
+  pairs = fluid_surround_pairs(&synth->surround);
+  if (synth->audio_channels < pairs) {
+    FLUID_LOG(FLUID_WARN, "The speaker layout needs %d audio channels (stereo buffers), "
+	     "increasing synth.audio-channels from %d to %d.",
+	     pairs, synth->audio_channels, pairs);
+    synth->audio_channels = pairs;
+    fluid_settings_setint(settings, "synth.audio-channels", synth->audio_channels);
+  }
+
   nbuf = synth->audio_channels;
-  if (synth->audio_groups > nbuf) {
-    nbuf = synth->audio_groups;
+  if (synth->audio_groups * pairs > nbuf) {
+    nbuf = synth->audio_groups * pairs;
   }
 
   /* as soon as the synth is created it starts playing. */
   synth->state = FLUID_SYNTH_PLAYING;
   synth->sfont_info = NULL;
   synth->sfont_hash = new_fluid_hashtable (NULL, NULL);
+  synth->sfload_jobs = NULL;
   synth->noteid = 0;
   synth->ticks_since_start = 0;
   synth->tuning = NULL;
@@ -667,16 +777,22 @@ new_fluid_synth(fluid_settings_t *settings)
   fluid_settings_getint(settings, "synth.parallel-render", &i);
   /* In an overflow situation, a new voice takes about 50 spaces in the queue! */
   synth->eventhandler = new_fluid_rvoice_eventhandler(i, synth->polyphony*64,
-	synth->polyphony, nbuf, synth->effects_channels, synth->sample_rate);
+	synth->polyphony, nbuf, synth->effects_channels, synth->effects_groups,
+	synth->sample_rate);
 
   if (synth->eventhandler == NULL)
     goto error_recovery; 
 
+  fluid_rvoice_mixer_set_group_bufs(synth->eventhandler->mixer, pairs);
+
 #ifdef LADSPA
   /* Create and initialize the Fx unit.*/
   synth->LADSPA_FxUnit = new_fluid_LADSPA_FxUnit(synth);
   fluid_rvoice_mixer_set_ladspa(synth->eventhandler->mixer, synth->LADSPA_FxUnit);
 #endif
+
+  if (fluid_settings_str_equal (settings, "synth.reverb.engine", "convolution") == 1)
+    fluid_synth_init_convreverb(synth);
   
   /* allocate and add the default sfont loader */
   loader = new_fluid_defsfloader(settings);
@@ -720,6 +836,14 @@ new_fluid_synth(fluid_settings_t *settings)
 			   synth->polyphony, 0.0f);
   fluid_synth_set_reverb_on(synth, synth->with_reverb);
   fluid_synth_set_chorus_on(synth, synth->with_chorus);
+
+  chorus_interp = FLUID_CHORUS_INTERP_SINC;
+  if (fluid_settings_str_equal (settings, "synth.chorus.interpolation", "cubic") == 1)
+    chorus_interp = FLUID_CHORUS_INTERP_CUBIC;
+  else if (fluid_settings_str_equal (settings, "synth.chorus.interpolation", "linear") == 1)
+    chorus_interp = FLUID_CHORUS_INTERP_LINEAR;
+  fluid_synth_update_mixer(synth, fluid_rvoice_mixer_set_chorus_interp,
+			   chorus_interp, 0.0f);
 				 
   synth->cur = FLUID_BUFSIZE;
   synth->curmax = 0;
@@ -792,6 +916,9 @@ delete_fluid_synth(fluid_synth_t* synth)
 
   fluid_profiling_print();
 
+  /* wait for asynchronous SoundFont loads to finish */
+  fluid_synth_join_sfload_jobs(synth, TRUE);
+
   /* turn off all voices, needed to unload SoundFont data */
   if (synth->voice != NULL) {
     for (i = 0; i < synth->nvoice; i++) {
@@ -922,6 +1049,28 @@ fluid_synth_noteon(fluid_synth_t* synth, int chan, int key, int vel)
   FLUID_API_RETURN(result);
 }
 
+/*
+ * fluid_synth_noteon_at - like fluid_synth_noteon(), but the voices are
+ * delayed so that they sound from the given tick on, with sample accuracy.
+ * Called by sample timer callbacks.
+ */
+int
+fluid_synth_noteon_at(fluid_synth_t* synth, int chan, int key, int vel,
+                      unsigned int ticks)
+{
+  int result;
+  fluid_return_val_if_fail (key >= 0 && key <= 127, FLUID_FAILED);
+  fluid_return_val_if_fail (vel >= 0 && vel <= 127, FLUID_FAILED);
+  FLUID_API_ENTRY_CHAN(FLUID_FAILED);
+
+  /* only seen by the voices of this note, the API lock is held */
+  synth->timed_event = TRUE;
+  synth->timed_event_ticks = ticks;
+  result = fluid_synth_noteon_LOCAL (synth, chan, key, vel);
+  synth->timed_event = FALSE;
+  FLUID_API_RETURN(result);
+}
+
 /* Local synthesis thread variant of fluid_synth_noteon */
 static int
 fluid_synth_noteon_LOCAL(fluid_synth_t* synth, int chan, int key, int vel)
@@ -2208,7 +2357,11 @@ fluid_synth_set_sample_rate(fluid_synth_t* synth, float sample_rate)
   int i;
   fluid_return_if_fail (synth != NULL);
   fluid_synth_api_enter(synth);
-  fluid_clip (sample_rate, 8000.0f, 96000.0f);
+  if (sample_rate < 8000.0f || sample_rate > 96000.0f) {
+    FLUID_LOG(FLUID_WARN, "Sample rate %.0f Hz is out of range, using %.0f Hz",
+              (double) sample_rate, sample_rate < 8000.0f ? 8000.0 : 96000.0);
+    fluid_clip (sample_rate, 8000.0f, 96000.0f);
+  }
   synth->sample_rate = sample_rate;
   
   fluid_settings_getint(synth->settings, "synth.min-note-length", &i);
@@ -2218,6 +2371,7 @@ fluid_synth_set_sample_rate(fluid_synth_t* synth, float sample_rate)
     fluid_voice_set_output_rate(synth->voice[i], sample_rate);
   fluid_synth_update_mixer(synth, fluid_rvoice_mixer_set_samplerate, 
 			   0, sample_rate);
+  fluid_synth_update_convreverb(synth);
   fluid_synth_api_exit(synth);
 }
 
@@ -2426,10 +2580,22 @@ fluid_synth_program_reset(fluid_synth_t* synth)
  * @param len Count of audio frames to synthesize
  * @param left Array of floats to store left channel of audio (len in size)
  * @param right Array of floats to store right channel of audio (len in size)
- * @param fx_left Not currently used
- * @param fx_right Not currently used
+ * @param fx_left Array of floats to store left channel of the effects output
+ *   (len in size), or NULL
+ * @param fx_right Array of floats to store right channel of the effects output
+ *   (len in size), or NULL
  * @return FLUID_OK on success, FLUID_FAIL otherwise
  *
+ * The effects are not mixed into the audio channels. If fx_left and
+ * fx_right are given, they receive the reverb and chorus output of each
+ * effects group: they must hold synth.effects-channels times
+ * synth.effects-groups arrays each (see fluid_synth_count_effects_channels()
+ * and fluid_synth_count_effects_groups()), the channels of group 0 first.
+ * With the default single effects group that is 2 arrays.
+ *
+ * Before version 1.1.7, fx_left and fx_right were not used, so callers
+ * passing arrays which don't have that many entries must pass NULL instead.
+ *
  * NOTE: Should only be called from synthesis thread.
  */
 int
@@ -2439,8 +2605,10 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
 {
   fluid_real_t** left_in;
   fluid_real_t** right_in;
+  fluid_real_t** fx_left_in;
+  fluid_real_t** fx_right_in;
   double time = fluid_utime();
-  int i, num, available, count;
+  int i, num, available, count, fx_count;
 #ifdef WITH_FLOAT
   int bytes;
 #endif
@@ -2449,6 +2617,9 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
   if (!synth->eventhandler->is_threadsafe)
     fluid_synth_api_enter(synth);
   
+  fx_count = (fx_left != NULL && fx_right != NULL) ?
+    synth->effects_channels * synth->effects_groups : 0;
+
   /* First, take what's still available in the buffer */
   count = 0;
   num = synth->cur;
@@ -2473,6 +2644,20 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
       }
 #endif //WITH_FLOAT
     }
+
+    fluid_rvoice_mixer_get_fx_bufs(synth->eventhandler->mixer, &fx_left_in, &fx_right_in);
+    for (i = 0; i < fx_count; i++) {
+#ifdef WITH_FLOAT
+      FLUID_MEMCPY(fx_left[i], fx_left_in[i] + synth->cur, bytes);
+      FLUID_MEMCPY(fx_right[i], fx_right_in[i] + synth->cur, bytes);
+#else //WITH_FLOAT
+      int j;
+      for (j = 0; j < num; j++) {
+          fx_left[i][j] = (float) fx_left_in[i][j + synth->cur];
+          fx_right[i][j] = (float) fx_right_in[i][j + synth->cur];
+      }
+#endif //WITH_FLOAT
+    }
     count += num;
     num += synth->cur; /* if we're now done, num becomes the new synth->cur below */
   }
@@ -2501,6 +2686,20 @@ fluid_synth_nwrite_float(fluid_synth_t* synth, int len,
 #endif //WITH_FLOAT
     }
 
+    fluid_rvoice_mixer_get_fx_bufs(synth->eventhandler->mixer, &fx_left_in, &fx_right_in);
+    for (i = 0; i < fx_count; i++) {
+#ifdef WITH_FLOAT
+      FLUID_MEMCPY(fx_left[i] + count, fx_left_in[i], bytes);
+      FLUID_MEMCPY(fx_right[i] + count, fx_right_in[i], bytes);
+#else //WITH_FLOAT
+      int j;
+      for (j = 0; j < num; j++) {
+          fx_left[i][j + count] = (float) fx_left_in[i][j];
+          fx_right[i][j + count] = (float) fx_right_in[i][j];
+      }
+#endif //WITH_FLOAT
+    }
+
     count += num;
   }
 
@@ -2555,6 +2754,32 @@ fluid_synth_process(fluid_synth_t* synth, int len, int nin, float** in,
   }
 }
 
+/*
+ * The stereo outputs only read the front pair of the first audio group:
+ * fold the other speakers of a surround layout into it, so nothing but
+ * the LFE gets lost.
+ */
+static void
+fluid_synth_downmix(fluid_synth_t* synth, fluid_real_t** left,
+                    fluid_real_t** right, int count)
+{
+  fluid_surround_t* surround = &synth->surround;
+  int i, sp;
+
+  for (sp = 2; sp < surround->speakers; sp++) {
+    fluid_real_t* in = (sp & 1) ? right[sp / 2] : left[sp / 2];
+    fluid_real_t gl = surround->downmix[sp][0];
+    fluid_real_t gr = surround->downmix[sp][1];
+
+    if (gl == 0.0f && gr == 0.0f)
+      continue;
+    for (i = 0; i < count; i++) {
+      left[0][i] += gl * in[i];
+      right[0][i] += gr * in[i];
+    }
+  }
+}
+
 /**
  * Synthesize a block of floating point audio samples to audio buffers.
  * @param synth FluidSynth instance
@@ -2570,6 +2795,9 @@ fluid_synth_process(fluid_synth_t* synth, int len, int nin, float** in,
  * Useful for storing interleaved stereo (lout = rout, loff = 0, roff = 1,
  * lincr = 2, rincr = 2).
  *
+ * With a surround synth.speaker-layout, the speakers of the first audio
+ * group are downmixed to stereo (the LFE is dropped).
+ *
  * NOTE: Should only be called from synthesis thread.
  */
 int
@@ -2599,6 +2827,8 @@ fluid_synth_write_float(fluid_synth_t* synth, int len,
 	int blocksleft = (len-i+FLUID_BUFSIZE-1) / FLUID_BUFSIZE;
 	synth->curmax = FLUID_BUFSIZE * fluid_synth_render_blocks(synth, blocksleft);
         fluid_rvoice_mixer_get_bufs(synth->eventhandler->mixer, &left_in, &right_in);
+	if (synth->surround.speakers > 2)
+	  fluid_synth_downmix(synth, left_in, right_in, synth->curmax);
 
 	l = 0;
       }
@@ -2668,6 +2898,9 @@ roundi (float x)
  * Useful for storing interleaved stereo (lout = rout, loff = 0, roff = 1,
  * lincr = 2, rincr = 2).
  *
+ * With a surround synth.speaker-layout, the speakers of the first audio
+ * group are downmixed to stereo (the LFE is dropped).
+ *
  * NOTE: Should only be called from synthesis thread.
  * NOTE: Dithering is performed when converting from internal floating point to
  * 16 bit audio.
@@ -2707,6 +2940,8 @@ fluid_synth_write_s16(fluid_synth_t* synth, int len,
       //prof_ref_on_block = fluid_profile_ref();
       synth->curmax = FLUID_BUFSIZE * fluid_synth_render_blocks(synth, blocksleft);
       fluid_rvoice_mixer_get_bufs(synth->eventhandler->mixer, &left_in, &right_in);
+      if (synth->surround.speakers > 2)
+        fluid_synth_downmix(synth, left_in, right_in, synth->curmax);
       cur = 0;
 
       //fluid_profile(FLUID_PROF_ONE_BLOCK, prof_ref_on_block);
@@ -2845,7 +3080,9 @@ fluid_synth_render_blocks(fluid_synth_t* synth, int blockcount)
   fluid_check_fpe("??? Just starting up ???");
   
   fluid_rvoice_eventhandler_dispatch_all(synth->eventhandler);
-  
+
+  synth->render_ticks = fluid_synth_get_ticks(synth);
+
   for (i=0; i < blockcount; i++) {
     fluid_sample_timer_process(synth);
     fluid_synth_add_ticks(synth, FLUID_BUFSIZE);
@@ -3074,6 +3311,16 @@ fluid_synth_start_voice(fluid_synth_t* synth, fluid_voice_t* voice)
    * voice process created by this noteon event. */
   fluid_synth_kill_by_exclusive_class_LOCAL(synth, voice);
 
+  if (synth->timed_event) {
+    /* With a thread safe event handler, the voice is only added to the
+     * mixer after the blocks of this fluid_synth_render_blocks() call. */
+    unsigned int start = synth->eventhandler->is_threadsafe
+      ? fluid_synth_get_ticks(synth) + FLUID_BUFSIZE : synth->render_ticks;
+    int delay = (int) (synth->timed_event_ticks - start);
+    if (delay > 0)
+      fluid_voice_set_start_delay(voice, delay);
+  }
+
   fluid_voice_start(voice);     /* Start the new voice */
   if (synth->eventhandler->is_threadsafe)
     fluid_voice_lock_rvoice(voice);
@@ -3123,45 +3370,111 @@ fluid_synth_add_sfloader(fluid_synth_t* synth, fluid_sfloader_t* loader)
 int
 fluid_synth_sfload(fluid_synth_t* synth, const char* filename, int reset_presets)
 {
-  fluid_sfont_info_t *sfont_info;
   fluid_sfont_t *sfont;
-  fluid_list_t *list;
-  fluid_sfloader_t *loader;
-  unsigned int sfont_id;
 
   fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
   fluid_return_val_if_fail (filename != NULL, FLUID_FAILED);
   fluid_synth_api_enter(synth);
-  
-  /* MT NOTE: Loaders list should not change. */
+
+  sfont = fluid_synth_load_sfont_file (synth, filename);
+  if (sfont == NULL)
+    FLUID_API_RETURN(FLUID_FAILED);
+
+  FLUID_API_RETURN(fluid_synth_push_sfont (synth, sfont, reset_presets));
+}
+
+/* Try all SoundFont loaders on a file.
+ * MT NOTE: Loaders list should not change, no lock required. */
+static fluid_sfont_t *
+fluid_synth_load_sfont_file (fluid_synth_t *synth, const char *filename)
+{
+  fluid_sfloader_t *loader;
+  fluid_sfont_t *sfont;
+  fluid_list_t *list;
 
   for (list = synth->loaders; list; list = fluid_list_next(list)) {
     loader = (fluid_sfloader_t*) fluid_list_get(list);
 
     sfont = fluid_sfloader_load(loader, filename);
 
-    if (sfont != NULL) {
-      sfont_info = new_fluid_sfont_info (synth, sfont);
+    if (sfont != NULL)
+      return sfont;
+  }
 
-      if (!sfont_info)
-      {
-        delete_fluid_sfont (sfont);
-        FLUID_API_RETURN(FLUID_FAILED);
-      }
+  FLUID_LOG(FLUID_ERR, "Failed to load SoundFont \"%s\"", filename);
+  return NULL;
+}
 
-      sfont->id = sfont_id = ++synth->sfont_id;
-      synth->sfont_info = fluid_list_prepend(synth->sfont_info, sfont_info);   /* prepend to list */
-      fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);       /* Hash sfont->sfont_info */
+/* Put a loaded SoundFont on top of the SoundFont stack.
+ * Must be called with the API lock held. */
+static int
+fluid_synth_push_sfont (fluid_synth_t *synth, fluid_sfont_t *sfont, int reset_presets)
+{
+  fluid_sfont_info_t *sfont_info;
+  unsigned int sfont_id;
 
-      /* reset the presets for all channels if requested */
-      if (reset_presets) fluid_synth_program_reset(synth);
+  sfont_info = new_fluid_sfont_info (synth, sfont);
 
-      FLUID_API_RETURN((int)sfont_id);
-    }
+  if (!sfont_info)
+  {
+    delete_fluid_sfont (sfont);
+    return FLUID_FAILED;
   }
 
-  FLUID_LOG(FLUID_ERR, "Failed to load SoundFont \"%s\"", filename);
-  FLUID_API_RETURN(FLUID_FAILED);
+  sfont->id = sfont_id = ++synth->sfont_id;
+  synth->sfont_info = fluid_list_prepend(synth->sfont_info, sfont_info);   /* prepend to list */
+  fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);       /* Hash sfont->sfont_info */
+
+  /* reset the presets for all channels if requested */
+  if (reset_presets) fluid_synth_program_reset(synth);
+
+  return (int)sfont_id;
+}
+
+/* Replace the SoundFont with the given ID by a freshly loaded one, keeping
+ * its ID, bank offset and stack position. Voices still playing the old
+ * SoundFont keep it alive until they are finished.
+ * Must be called with the API lock held. */
+static int
+fluid_synth_replace_sfont (fluid_synth_t *synth, unsigned int id, fluid_sfont_t *sfont)
+{
+  fluid_sfont_info_t *sfont_info, *old_sfont_info = NULL;
+  fluid_list_t *list;
+  int index;
+
+  for (list = synth->sfont_info, index = 0; list; list = fluid_list_next (list), index++) {
+    old_sfont_info = (fluid_sfont_info_t *)fluid_list_get (list);
+    if (fluid_sfont_get_id (old_sfont_info->sfont) == id) break;
+  }
+
+  if (!list) {
+    FLUID_LOG(FLUID_ERR, "No SoundFont with id = %d", id);
+    delete_fluid_sfont (sfont);
+    return FLUID_FAILED;
+  }
+
+  sfont_info = new_fluid_sfont_info (synth, sfont);
+
+  if (!sfont_info)
+  {
+    delete_fluid_sfont (sfont);
+    return FLUID_FAILED;
+  }
+
+  sfont->id = id;
+  sfont_info->bankofs = old_sfont_info->bankofs;
+
+  synth->sfont_info = fluid_list_remove (synth->sfont_info, old_sfont_info);
+  synth->sfont_info = fluid_list_insert_at(synth->sfont_info, index, sfont_info);  /* insert the sfont at the same index */
+  fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);       /* Hash sfont->sfont_info */
+
+  /* reassign the presets of all channels to the new SoundFont */
+  fluid_synth_update_presets(synth);
+
+  /* -- Remove synth->sfont_info list's reference to the old SoundFont */
+  fluid_synth_sfont_unref (synth, old_sfont_info->sfont);
+
+  return (int)id;
 }
 
 /* Create a new SoundFont info structure, free with FLUID_FREE */
@@ -3277,6 +3590,8 @@ fluid_synth_sfunload_callback(void* data, unsigned int msec)
 
 /**
  * Reload a SoundFont.  The SoundFont retains its ID and index on the SoundFont stack.
+ * Voices still sounding continue to play the old SoundFont, which stays
+ * loaded if the new one fails to load.
  * @param synth SoundFont instance
  * @param id ID of SoundFont to reload
  * @return SoundFont ID on success, FLUID_FAILED on error
@@ -3284,62 +3599,211 @@ fluid_synth_sfunload_callback(void* data, unsigned int msec)
 int
 fluid_synth_sfreload(fluid_synth_t* synth, unsigned int id)
 {
-  char filename[1024];
-  fluid_sfont_info_t *sfont_info, *old_sfont_info;
   fluid_sfont_t* sfont;
-  fluid_sfloader_t* loader;
-  fluid_list_t *list;
-  int index;
 
   fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
   fluid_synth_api_enter(synth);
 
-  /* Search for SoundFont and get its index */
-  for (list = synth->sfont_info, index = 0; list; list = fluid_list_next (list), index++) {
-    old_sfont_info = (fluid_sfont_info_t *)fluid_list_get (list);
-    if (fluid_sfont_get_id (old_sfont_info->sfont) == id) break;
-  }
+  sfont = fluid_synth_get_sfont_by_id (synth, id);
 
-  if (!list) {
+  if (!sfont) {
     FLUID_LOG(FLUID_ERR, "No SoundFont with id = %d", id);
     FLUID_API_RETURN(FLUID_FAILED);
   }
 
-  /* keep a copy of the SoundFont's filename */
-  FLUID_STRCPY (filename, fluid_sfont_get_name (old_sfont_info->sfont));
-
-  if (fluid_synth_sfunload (synth, id, FALSE) != FLUID_OK)
+  /* the old SoundFont is only replaced once the new one is loaded */
+  sfont = fluid_synth_load_sfont_file (synth, fluid_sfont_get_name (sfont));
+  if (sfont == NULL)
     FLUID_API_RETURN(FLUID_FAILED);
 
-  /* MT Note: SoundFont loader list will not change */
+  FLUID_API_RETURN(fluid_synth_replace_sfont (synth, id, sfont));
+}
 
-  for (list = synth->loaders; list; list = fluid_list_next(list)) {
-    loader = (fluid_sfloader_t*) fluid_list_get(list);
+/* An asynchronous SoundFont load, owned by the synth until joined */
+typedef struct _fluid_sfload_job_t
+{
+  fluid_synth_t *synth;
+  char *filename;
+  int reset_presets;
+  int reload;                           /* TRUE to replace the SoundFont 'id' */
+  unsigned int id;
+  fluid_sfload_callback_t callback;
+  void *data;
+  fluid_thread_t *thread;
+  int done;                             /* set by the loader thread when finished */
+} fluid_sfload_job_t;
 
-    sfont = fluid_sfloader_load(loader, filename);
+static void
+fluid_synth_sfload_thread (void *data)
+{
+  fluid_sfload_job_t *job = (fluid_sfload_job_t *)data;
+  fluid_synth_t *synth = job->synth;
+  fluid_sfont_t *sfont;
+  int sfont_id = FLUID_FAILED;
 
-    if (sfont != NULL) {
-      sfont->id = id;
+  /* The expensive part, parsing and loading the sample data, is done
+   * without holding the synth API lock */
+  sfont = fluid_synth_load_sfont_file (synth, job->filename);
 
-      sfont_info = new_fluid_sfont_info (synth, sfont);
+  if (sfont != NULL)
+  {
+    fluid_synth_api_enter(synth);
+    if (job->reload)
+      sfont_id = fluid_synth_replace_sfont (synth, job->id, sfont);
+    else
+      sfont_id = fluid_synth_push_sfont (synth, sfont, job->reset_presets);
+    fluid_synth_api_exit(synth);
+  }
 
-      if (!sfont_info)
-      {
-        delete_fluid_sfont (sfont);
-        FLUID_API_RETURN(FLUID_FAILED);
-      }
+  if (job->callback)
+    job->callback (job->data, synth, sfont_id);
 
-      synth->sfont_info = fluid_list_insert_at(synth->sfont_info, index, sfont_info);  /* insert the sfont at the same index */
-      fluid_hashtable_insert (synth->sfont_hash, sfont, sfont_info);       /* Hash sfont->sfont_info */
+  fluid_atomic_int_set (&job->done, TRUE);
+}
 
-      /* reset the presets for all channels */
-      fluid_synth_update_presets(synth);
-      FLUID_API_RETURN(sfont->id);
-    }
+/* Join and free finished asynchronous loads, or all of them if 'wait' is TRUE */
+static void
+fluid_synth_join_sfload_jobs (fluid_synth_t *synth, int wait)
+{
+  fluid_sfload_job_t *job;
+  fluid_list_t *list, *next;
+
+  for (list = synth->sfload_jobs; list; list = next)
+  {
+    next = fluid_list_next (list);
+    job = (fluid_sfload_job_t *)fluid_list_get (list);
+
+    if (!wait && !fluid_atomic_int_get (&job->done))
+      continue;
+
+    fluid_thread_join (job->thread);
+    delete_fluid_thread (job->thread);
+    synth->sfload_jobs = fluid_list_remove (synth->sfload_jobs, job);
+    FLUID_FREE (job->filename);
+    FLUID_FREE (job);
   }
+}
 
-  FLUID_LOG(FLUID_ERR, "Failed to load SoundFont \"%s\"", filename);
-  FLUID_API_RETURN(FLUID_FAILED);  
+/* Start an asynchronous load, must be called with the API lock held */
+static int
+fluid_synth_start_sfload_job (fluid_synth_t *synth, const char *filename,
+                              int reset_presets, int reload, unsigned int id,
+                              fluid_sfload_callback_t callback, void *data)
+{
+  fluid_sfload_job_t *job;
+
+  if (!synth->use_mutex)
+  {
+    FLUID_LOG (FLUID_ERR, "Asynchronous SoundFont loading requires synth.threadsafe-api");
+    return FLUID_FAILED;
+  }
+
+  fluid_synth_join_sfload_jobs (synth, FALSE);
+
+  job = FLUID_NEW (fluid_sfload_job_t);
+
+  if (job == NULL)
+  {
+    FLUID_LOG (FLUID_ERR, "Out of memory");
+    return FLUID_FAILED;
+  }
+
+  job->synth = synth;
+  job->filename = FLUID_STRDUP (filename);
+  job->reset_presets = reset_presets;
+  job->reload = reload;
+  job->id = id;
+  job->callback = callback;
+  job->data = data;
+  job->done = FALSE;
+
+  if (job->filename == NULL)
+  {
+    FLUID_LOG (FLUID_ERR, "Out of memory");
+    FLUID_FREE (job);
+    return FLUID_FAILED;
+  }
+
+  job->thread = new_fluid_thread ("sfload", fluid_synth_sfload_thread, job, 0, FALSE);
+
+  if (job->thread == NULL)
+  {
+    FLUID_FREE (job->filename);
+    FLUID_FREE (job);
+    return FLUID_FAILED;
+  }
+
+  synth->sfload_jobs = fluid_list_prepend (synth->sfload_jobs, job);
+  return FLUID_OK;
+}
+
+/**
+ * Load a SoundFont file in the background.
+ * @param synth FluidSynth instance
+ * @param filename File to load
+ * @param reset_presets TRUE to re-assign presets for all MIDI channels
+ * @param callback Function called when loading finished or failed (may be NULL)
+ * @param data User data passed to \a callback
+ * @return FLUID_OK if loading was started, FLUID_FAILED otherwise
+ * @since 1.1.7
+ *
+ * Like fluid_synth_sfload(), but the file is parsed and loaded on a separate
+ * thread, so other API calls (such as MIDI events) are not blocked meanwhile.
+ * Once loaded, the SoundFont is put on top of the SoundFont stack and
+ * \a callback is called from the loader thread with the new SoundFont ID.
+ * Requires the synth.threadsafe-api setting to be enabled.  Pending loads are
+ * waited for when the synth is deleted.
+ */
+int
+fluid_synth_sfload_async(fluid_synth_t* synth, const char* filename, int reset_presets,
+                         fluid_sfload_callback_t callback, void* data)
+{
+  int result;
+
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  fluid_return_val_if_fail (filename != NULL, FLUID_FAILED);
+  fluid_synth_api_enter(synth);
+
+  result = fluid_synth_start_sfload_job (synth, filename, reset_presets, FALSE, 0,
+                                         callback, data);
+  FLUID_API_RETURN(result);
+}
+
+/**
+ * Reload a SoundFont in the background.
+ * @param synth FluidSynth instance
+ * @param id ID of SoundFont to reload
+ * @param callback Function called when reloading finished or failed (may be NULL)
+ * @param data User data passed to \a callback
+ * @return FLUID_OK if reloading was started, FLUID_FAILED otherwise
+ * @since 1.1.7
+ *
+ * Like fluid_synth_sfreload(), but the file is loaded on a separate thread.
+ * The old SoundFont stays in use until the new one is loaded, then it is
+ * swapped in place keeping the ID, bank offset and position on the SoundFont
+ * stack.  Voices which are still sounding continue to play the old SoundFont.
+ * Requires the synth.threadsafe-api setting to be enabled.
+ */
+int
+fluid_synth_sfreload_async(fluid_synth_t* synth, unsigned int id,
+                           fluid_sfload_callback_t callback, void* data)
+{
+  fluid_sfont_t *sfont;
+  int result;
+
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  fluid_synth_api_enter(synth);
+
+  sfont = fluid_synth_get_sfont_by_id (synth, id);
+
+  if (!sfont) {
+    FLUID_LOG(FLUID_ERR, "No SoundFont with id = %d", id);
+    FLUID_API_RETURN(FLUID_FAILED);
+  }
+
+  result = fluid_synth_start_sfload_job (synth, fluid_sfont_get_name (sfont), FALSE,
+                                         TRUE, id, callback, data);
+  FLUID_API_RETURN(result);
 }
 
 /**
@@ -4010,6 +4474,36 @@ fluid_synth_set_interp_method(fluid_synth_t* synth, int chan, int interp_method)
   FLUID_API_RETURN(FLUID_OK);
 };
 
+/**
+ * Set the direction of one or all MIDI channels in a surround speaker
+ * layout (synth.speaker-layout). The pan of a voice moves it around this
+ * direction, as far as the front speakers are apart. Applies to notes
+ * started afterwards, has no effect with a stereo layout.
+ * @param synth FluidSynth instance
+ * @param chan MIDI channel number or -1 for all channels
+ * @param azimuth Direction in degrees, clockwise from the front (0 is the
+ *   center speaker, 180 behind the listener)
+ * @return FLUID_OK on success, FLUID_FAILED otherwise
+ * @since 1.1.7
+ */
+int
+fluid_synth_set_channel_azimuth(fluid_synth_t* synth, int chan, float azimuth)
+{
+  int i;
+
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  fluid_synth_api_enter(synth);
+  if (chan < -1 || chan >= synth->midi_channels)
+    FLUID_API_RETURN(FLUID_FAILED);
+
+  for (i = 0; i < synth->midi_channels; i++) {
+    if (chan < 0 || i == chan)
+      fluid_channel_set_azimuth(synth->channel[i], azimuth);
+  }
+
+  FLUID_API_RETURN(FLUID_OK);
+}
+
 /**
  * Get the total count of MIDI channels.
  * @param synth FluidSynth instance
@@ -4076,6 +4570,24 @@ fluid_synth_count_effects_channels(fluid_synth_t* synth)
   FLUID_API_RETURN(result);
 }
 
+/**
+ * Get the number of effects groups, each with its own reverb and chorus.
+ * MIDI channels are assigned to effects groups like to audio groups.
+ * @param synth FluidSynth instance
+ * @return Count of effects groups
+ * @since 1.1.7
+ */
+int
+fluid_synth_count_effects_groups(fluid_synth_t* synth)
+{
+  int result;
+  fluid_return_val_if_fail (synth != NULL, 0);
+  fluid_synth_api_enter(synth);
+
+  result = synth->effects_groups;
+  FLUID_API_RETURN(result);
+}
+
 /**
  * Get the synth CPU load value.
  * @param synth FluidSynth instance
@@ -5007,6 +5519,46 @@ fluid_synth_get_bank_offset(fluid_synth_t* synth, int sfont_id)
   FLUID_API_RETURN(offset);
 }
 
+/**
+ * Get the amount of sample data a SoundFont shares with other SoundFonts.
+ * @param synth FluidSynth instance
+ * @param sfont_id ID of a loaded SoundFont
+ * @return Bytes of sample data the SoundFont didn't have to keep, because
+ *   identical data of another SoundFont is used instead (see the
+ *   synth.sample-dedup setting), #FLUID_FAILED if there is no such SoundFont
+ * @since 1.1.7
+ */
+int
+fluid_synth_get_sample_dedup_saved(fluid_synth_t* synth, int sfont_id)
+{
+  fluid_sfont_t *sfont;
+  fluid_list_t *list;
+  int saved = 0;
+
+  fluid_return_val_if_fail (synth != NULL, FLUID_FAILED);
+  fluid_synth_api_enter(synth);
+
+  for (list = synth->sfont_info; list; list = fluid_list_next(list)) {
+    sfont = ((fluid_sfont_info_t *)fluid_list_get (list))->sfont;
+
+    if (fluid_sfont_get_id (sfont) == (unsigned int)sfont_id)
+    {
+      /* Only the SoundFont loader deduplicates samples */
+      if (sfont->free == fluid_defsfont_sfont_delete)
+        saved = (int) ((fluid_defsfont_t *) sfont->data)->dedup_bytes_saved;
+      break;
+    }
+  }
+
+  if (!list)
+  {
+    FLUID_LOG (FLUID_ERR, "No SoundFont with id = %d", sfont_id);
+    FLUID_API_RETURN(FLUID_FAILED);
+  }
+
+  FLUID_API_RETURN(saved);
+}
+
 void 
 fluid_synth_api_enter(fluid_synth_t* synth)
 {
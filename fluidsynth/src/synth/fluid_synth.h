@@ -37,6 +37,7 @@
 #include "fluid_rev.h"
 #include "fluid_voice.h"
 #include "fluid_chorus.h"
+#include "fluid_surround.h"
 #include "fluid_ladspa.h"
 #include "fluid_midi_router.h"
 #include "fluid_sys.h"
@@ -136,7 +137,10 @@ struct _fluid_synth_t
   int audio_channels;                /**< the number of audio channels (1 channel=left+right) */
   int audio_groups;                  /**< the number of (stereo) 'sub'groups from the synth.
 					  Typically equal to audio_channels. */
+  fluid_surround_t surround;         /**< Speaker layout of each audio group */
   int effects_channels;              /**< the number of effects channels (>= 2) */
+  int effects_groups;                /**< the number of effect units (reverb and chorus),
+					  MIDI channels are assigned like audio groups */
   int state;                         /**< the synthesizer state */
   unsigned int ticks_since_start;    /**< the number of audio samples since the start */
   unsigned int start;                /**< the start in msec, as returned by system clock */
@@ -146,6 +150,7 @@ struct _fluid_synth_t
   fluid_list_t *sfont_info;          /**< List of fluid_sfont_info_t for each loaded SoundFont (remains until SoundFont is unloaded) */
   fluid_hashtable_t *sfont_hash;     /**< Hash of fluid_sfont_t->fluid_sfont_info_t (remains until SoundFont is deleted) */
   unsigned int sfont_id;             /**< Incrementing ID assigned to each loaded SoundFont */
+  fluid_list_t *sfload_jobs;         /**< Pending asynchronous SoundFont loads (fluid_sfload_job_t) */
 
   float gain;                        /**< master gain */
   fluid_channel_t** channel;         /**< the channels */
@@ -160,6 +165,7 @@ struct _fluid_synth_t
   float reverb_damping;              /**< Shadow of reverb damping */
   float reverb_width;                /**< Shadow of reverb width */
   float reverb_level;                /**< Shadow of reverb level */
+  fluid_convreverb_ir_t* convreverb_ir; /**< Shadow of the impulse response last handed to the mixer, NULL without convolution reverb */
 
   int chorus_nr;                     /**< Shadow of chorus number */
   float chorus_level;                /**< Shadow of chorus level */
@@ -179,6 +185,9 @@ struct _fluid_synth_t
 
   fluid_midi_router_t* midi_router;  /**< The midi router. Could be done nicer. */
   fluid_sample_timer_t* sample_timers; /**< List of timers triggered before a block is processed */
+  unsigned int render_ticks;         /**< Tick of the first block rendered by the current fluid_synth_render_blocks() */
+  int timed_event;                   /**< TRUE while fluid_synth_noteon_at() starts voices due at timed_event_ticks */
+  unsigned int timed_event_ticks;    /**< Tick at which the voices of the timed event should sound */
   unsigned int min_note_length_ticks; /**< If note-offs are triggered just after a note-on, they will be delayed */
 
   int cores;                         /**< Number of CPU cores (1 by default) */
@@ -188,6 +197,14 @@ struct _fluid_synth_t
 #endif
 };
 
+static FLUID_INLINE unsigned int fluid_synth_get_ticks(fluid_synth_t* synth)
+{
+  if (synth->eventhandler->is_threadsafe)
+    return fluid_atomic_int_get(&synth->ticks_since_start);
+  else
+    return synth->ticks_since_start;
+}
+
 int fluid_synth_setstr(fluid_synth_t* synth, const char* name, const char* str);
 int fluid_synth_dupstr(fluid_synth_t* synth, const char* name, char** str);
 int fluid_synth_setnum(fluid_synth_t* synth, const char* name, double val);
@@ -222,6 +239,8 @@ int fluid_synth_set_chorus_full(fluid_synth_t* synth, int set, int nr, double le
 
 fluid_sample_timer_t* new_fluid_sample_timer(fluid_synth_t* synth, fluid_timer_callback_t callback, void* data);
 int delete_fluid_sample_timer(fluid_synth_t* synth, fluid_sample_timer_t* timer);
+int fluid_synth_noteon_at(fluid_synth_t* synth, int chan, int key, int vel,
+                          unsigned int ticks);
 
 void fluid_synth_api_enter(fluid_synth_t* synth);
 void fluid_synth_api_exit(fluid_synth_t* synth);
@@ -246,7 +246,7 @@ fluid_voice_init(fluid_voice_t* voice, fluid_sample_t* sample,
    * generators have been retrieved from the sound font. Here, only
    * the 'working memory' of the voice (position in envelopes, history
    * of IIR filters, position in sample etc) is initialized. */
-  int i;
+  int i, pairs;
 
   if (!voice->can_access_rvoice) {
     if (voice->can_access_overflow_rvoice) 
@@ -282,6 +282,7 @@ fluid_voice_init(fluid_voice_t* voice, fluid_sample_t* sample,
 
   i = fluid_channel_get_interp_method(channel);
   UPDATE_RVOICE_I1(fluid_rvoice_set_interp_method, i);
+  voice->azimuth = fluid_channel_get_azimuth(channel);
 
   /* Set all the generators to their default value, according to SF
    * 2.01 section 8.1.3 (page 48). The value of NRPN messages are
@@ -299,13 +300,21 @@ fluid_voice_init(fluid_voice_t* voice, fluid_sample_t* sample,
   }
   UPDATE_RVOICE_R1(fluid_rvoice_set_synth_gain, voice->synth_gain);
 
-  /* Set up buffer mapping, should be done more flexible in the future. */
-  i = channel->synth->audio_groups;
-  UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_mapping, 2, i*2 + SYNTH_REVERB_CHANNEL);
-  UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_mapping, 3, i*2 + SYNTH_CHORUS_CHANNEL);
-  i = 2 * (voice->chan % i);
-  UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_mapping, 0, i);
-  UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_mapping, 1, i+1);
+  /* Set up buffer mapping, should be done more flexible in the future.
+   * Each audio group takes as many stereo buffers as its speakers need.
+   * The effects sends follow the primary buffers (as many as audio
+   * channels or groups, whichever is larger), two for each effects group. */
+  pairs = fluid_surround_pairs(&channel->synth->surround);
+  i = channel->synth->audio_groups * pairs;
+  if (i < channel->synth->audio_channels)
+    i = channel->synth->audio_channels;
+  i = 2 * i + 2 * (voice->chan % channel->synth->effects_groups);
+  UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_mapping, 2, i + SYNTH_REVERB_CHANNEL);
+  UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_mapping, 3, i + SYNTH_CHORUS_CHANNEL);
+  i = 2 * pairs * (voice->chan % channel->synth->audio_groups);
+  for (pairs = 0; pairs < channel->synth->surround.speakers; pairs++)
+    UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_mapping,
+                           FLUID_RVOICE_SPEAKER_BUF(pairs), i + pairs);
 
   return FLUID_OK;
 }
@@ -464,6 +473,17 @@ void fluid_voice_start(fluid_voice_t* voice)
   voice->channel->synth->active_voice_count++;
 }
 
+/*
+ * fluid_voice_set_start_delay
+ *
+ * Delay the start of a voice by a number of output frames, to start
+ * it at an exact frame within the blocks being rendered.
+ */
+void fluid_voice_set_start_delay(fluid_voice_t* voice, unsigned int frames)
+{
+  UPDATE_RVOICE_I1(fluid_rvoice_set_start_delay, frames);
+}
+
 void 
 fluid_voice_calculate_gen_pitch(fluid_voice_t* voice)
 {
@@ -687,6 +707,37 @@ calculate_hold_decay_buffers(fluid_voice_t* voice, int gen_base,
  * NRPN system. _GEN(voice, generator_enumerator) returns the sum
  * of all three.
  */
+/*
+ * Set the gains of the primary outputs from the pan and the gain. In a
+ * surround layout the pan moves the voice around the direction of its
+ * channel, by as far as the front speakers are apart.
+ */
+static void
+fluid_voice_update_pan(fluid_voice_t* voice)
+{
+  fluid_surround_t* surround = &voice->channel->synth->surround;
+  fluid_real_t gains[FLUID_RVOICE_MAX_SPEAKERS];
+  fluid_real_t pan;
+  int i;
+
+  voice->amp_left = fluid_pan(voice->pan, 1) * voice->synth_gain / 32768.0f;
+  voice->amp_right = fluid_pan(voice->pan, 0) * voice->synth_gain / 32768.0f;
+
+  if (surround->speakers <= 2) {
+    UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 0, voice->amp_left);
+    UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 1, voice->amp_right);
+    return;
+  }
+
+  pan = voice->pan;
+  fluid_clip(pan, -500.0f, 500.0f);
+  fluid_surround_pan(surround, voice->azimuth + pan / 500.0f * surround->pan_width,
+                     gains);
+  for (i = 0; i < surround->speakers; i++)
+    UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, FLUID_RVOICE_SPEAKER_BUF(i),
+                           gains[i] * voice->synth_gain / 32768.0f);
+}
+
 /**
  * Update all the synthesis parameters, which depend on generator \a gen.
  * @param voice Voice instance
@@ -710,10 +761,7 @@ fluid_voice_update_param(fluid_voice_t* voice, int gen)
   case GEN_PAN:
     /* range checking is done in the fluid_pan function */
     voice->pan = _GEN(voice, GEN_PAN);
-    voice->amp_left = fluid_pan(voice->pan, 1) * voice->synth_gain / 32768.0f;
-    voice->amp_right = fluid_pan(voice->pan, 0) * voice->synth_gain / 32768.0f;
-    UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 0, voice->amp_left);
-    UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 1, voice->amp_right);
+    fluid_voice_update_pan(voice);
     break;
 
   case GEN_ATTENUATION:
@@ -1483,20 +1531,31 @@ int fluid_voice_set_gain(fluid_voice_t* voice, fluid_real_t gain)
   }
 
   voice->synth_gain = gain;
-  voice->amp_left = fluid_pan(voice->pan, 1) * gain / 32768.0f;
-  voice->amp_right = fluid_pan(voice->pan, 0) * gain / 32768.0f;
   voice->amp_reverb = voice->reverb_send * gain / 32768.0f;
   voice->amp_chorus = voice->chorus_send * gain / 32768.0f;
 
   UPDATE_RVOICE_R1(fluid_rvoice_set_synth_gain, gain);
-  UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 0, voice->amp_left);
-  UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 1, voice->amp_right);
+  fluid_voice_update_pan(voice);
   UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 2, voice->amp_reverb);
   UPDATE_RVOICE_BUFFERS2(fluid_rvoice_buffers_set_amp, 3, voice->amp_chorus);
 
   return FLUID_OK;
 }
 
+/* Sample point of s at index i, scaled to 16 bit full scale */
+static fluid_real_t
+fluid_voice_get_sample_point(fluid_sample_t* s, int i)
+{
+  switch (s->format) {
+  case FLUID_SAMPLE_FORMAT_INT24:
+    return ((const sint32*) s->wide_data)[i] / (fluid_real_t) 256.0;
+  case FLUID_SAMPLE_FORMAT_FLOAT:
+    return ((const float*) s->wide_data)[i] * (fluid_real_t) 32768.0;
+  default:
+    return s->data[i];
+  }
+}
+
 /* - Scan the loop
  * - determine the peak level
  * - Calculate, what factor will make the loop inaudible
@@ -1516,9 +1575,9 @@ int fluid_voice_set_gain(fluid_voice_t* voice, fluid_real_t gain)
 int
 fluid_voice_optimize_sample(fluid_sample_t* s)
 {
-  signed short peak_max = 0;
-  signed short peak_min = 0;
-  signed short peak;
+  fluid_real_t peak_max = 0;
+  fluid_real_t peak_min = 0;
+  fluid_real_t peak;
   fluid_real_t normalized_amplitude_during_loop;
   double result;
   int i;
@@ -1529,7 +1588,7 @@ fluid_voice_optimize_sample(fluid_sample_t* s)
   if (!s->amplitude_that_reaches_noise_floor_is_valid){ /* Only once */
     /* Scan the loop */
     for (i = (int)s->loopstart; i < (int) s->loopend; i ++){
-      signed short val = s->data[i];
+      fluid_real_t val = fluid_voice_get_sample_point(s, i);
       if (val > peak_max) {
 	peak_max = val;
       } else if (val < peak_min) {
@@ -1543,7 +1602,7 @@ fluid_voice_optimize_sample(fluid_sample_t* s)
     } else {
       peak =- peak_min;
     };
-    if (peak == 0){
+    if (peak < 1){
       /* Avoid division by zero */
       peak = 1;
     };
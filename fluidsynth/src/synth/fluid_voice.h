@@ -89,6 +89,7 @@ struct _fluid_voice_t
 
 	/* pan */
 	fluid_real_t pan;
+	fluid_real_t azimuth;            /* direction in a surround layout, degrees */
 	fluid_real_t amp_left;
 	fluid_real_t amp_right;
 
@@ -116,6 +117,7 @@ fluid_voice_t* new_fluid_voice(fluid_real_t output_rate);
 int delete_fluid_voice(fluid_voice_t* voice);
 
 void fluid_voice_start(fluid_voice_t* voice);
+void fluid_voice_set_start_delay(fluid_voice_t* voice, unsigned int frames);
 void  fluid_voice_calculate_gen_pitch(fluid_voice_t* voice);
 
 int fluid_voice_write (fluid_voice_t* voice, fluid_real_t *dsp_buf);
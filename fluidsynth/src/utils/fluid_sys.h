@@ -63,6 +63,8 @@ void fluid_time_config(void);
 #define FLUID_UINT_TO_POINTER     GUINT_TO_POINTER
 #define FLUID_POINTER_TO_INT      GPOINTER_TO_INT
 #define FLUID_INT_TO_POINTER      GINT_TO_POINTER
+#define FLUID_POINTER_TO_SIZE     GPOINTER_TO_SIZE
+#define FLUID_SIZE_TO_POINTER     GSIZE_TO_POINTER
 #define FLUID_N_ELEMENTS(struct)  (sizeof (struct) / sizeof (struct[0]))
 
 #define FLUID_IS_BIG_ENDIAN       (G_BYTE_ORDER == G_BIG_ENDIAN)
@@ -104,6 +106,8 @@ typedef int socklen_t;
 unsigned int fluid_curtime(void);
 double fluid_utime(void);
 
+#define fluid_msleep(_ms)       g_usleep((_ms) * 1000)
+
 
 /**
     Timers
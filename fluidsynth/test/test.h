@@ -0,0 +1,18 @@
+#ifndef _FLUIDSYNTH_TEST_H
+#define _FLUIDSYNTH_TEST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_ASSERT(COND) \
+  do { \
+    if (!(COND)) { \
+      fprintf(stderr, "%s:%d assertion (%s) failed\n", __FILE__, __LINE__, #COND); \
+      exit(EXIT_FAILURE); \
+    } \
+  } while (0)
+
+/* succeeds if the call does not return FLUID_FAILED */
+#define TEST_SUCCESS(FLUID_FUNCT) TEST_ASSERT((FLUID_FUNCT) != FLUID_FAILED)
+
+#endif /* _FLUIDSYNTH_TEST_H */
@@ -0,0 +1,155 @@
+/* Checks the convolution reverb against a direct convolution with its
+ * impulse response, with the transforms run inline and on a worker
+ * thread, and with blocks of any size. */
+
+#include "fluid_convreverb.h"
+#include "fluid_rev.h"
+#include "test.h"
+
+#define IR_LENGTH	20000
+#define INPUT_LENGTH	5000
+#define LENGTH		(IR_LENGTH + INPUT_LENGTH + 2048)
+#define LATENCY		1024	/* two blocks of the reverb */
+#define GAIN		0.2	/* of the loudest channel of the impulse response */
+#define SAMPLE_RATE	44100
+#define TEMP_FILE	"test_convreverb.wav"
+
+static double ir[2][IR_LENGTH];
+static fluid_real_t input[LENGTH];
+static fluid_real_t left[LENGTH];
+static fluid_real_t right[LENGTH];
+
+static unsigned int seed = 1;
+
+static int
+next_random(int range)
+{
+  seed = seed * 1103515245 + 12345;
+  return (int) ((seed >> 16) % (unsigned int) range);
+}
+
+static void
+put_16(FILE* file, int value)
+{
+  fputc(value & 0xff, file);
+  fputc((value >> 8) & 0xff, file);
+}
+
+static void
+put_32(FILE* file, unsigned int value)
+{
+  put_16(file, value & 0xffff);
+  put_16(file, value >> 16);
+}
+
+/* Writes a decaying stereo noise burst as a 16 bit WAV file, keeping the
+ * values it stores in ir */
+static void
+write_ir(void)
+{
+  FILE* file;
+  int i, c, value;
+
+  file = fopen(TEMP_FILE, "wb");
+  TEST_ASSERT(file != NULL);
+
+  fwrite("RIFF", 1, 4, file);
+  put_32(file, 36 + IR_LENGTH * 4);
+  fwrite("WAVEfmt ", 1, 8, file);
+  put_32(file, 16);
+  put_16(file, 1);              /* PCM */
+  put_16(file, 2);
+  put_32(file, SAMPLE_RATE);
+  put_32(file, SAMPLE_RATE * 4);
+  put_16(file, 4);
+  put_16(file, 16);
+  fwrite("data", 1, 4, file);
+  put_32(file, IR_LENGTH * 4);
+
+  for (i = 0; i < IR_LENGTH; i++) {
+    for (c = 0; c < 2; c++) {
+      value = (int) ((next_random(2001) - 1000) * 32.767 * exp(-5.0 * i / IR_LENGTH));
+      ir[c][i] = value / 32768.0;
+      put_16(file, value);
+    }
+  }
+  fclose(file);
+}
+
+/* Runs the reverb on input, in blocks of random sizes, and compares it to
+ * the direct convolution */
+static void
+check_reverb(fluid_convreverb_ir_t* rev_ir, fluid_convreverb_worker_t* worker)
+{
+  fluid_convreverb_t* rev;
+  double energy[2] = { 0.0, 0.0 };
+  double scale, l, r, peak = 0.0, error = 0.0;
+  int i, n, count;
+
+  rev = new_fluid_convreverb(rev_ir, worker);
+  TEST_ASSERT(rev != NULL);
+  fluid_convreverb_set(rev, FLUID_REVMODEL_SET_ALL, 0.0f, 0.0f, 1.0f, 1.0f);
+  TEST_ASSERT(fluid_convreverb_get_tail(rev) >= IR_LENGTH + LATENCY);
+
+  /* in place on the left channel, as the mixer does */
+  memcpy(left, input, sizeof(left));
+  for (i = 0; i < LENGTH; i += count) {
+    count = 64 + next_random(700);
+    if (count > LENGTH - i) {
+      count = LENGTH - i;
+    }
+    fluid_convreverb_processreplace(rev, left + i, left + i, right + i, count);
+  }
+  delete_fluid_convreverb(rev);
+
+  for (i = 0; i < IR_LENGTH; i++) {
+    energy[0] += ir[0][i] * ir[0][i];
+    energy[1] += ir[1][i] * ir[1][i];
+  }
+  scale = GAIN / sqrt(energy[0] > energy[1] ? energy[0] : energy[1]);
+
+  for (n = 0; n < LENGTH; n++) {
+    l = r = 0.0;
+    for (i = 0; i < IR_LENGTH && i <= n - LATENCY; i++) {
+      l += ir[0][i] * input[n - LATENCY - i];
+      r += ir[1][i] * input[n - LATENCY - i];
+    }
+    l *= scale;
+    r *= scale;
+
+    peak = fabs(l) > peak ? fabs(l) : peak;
+    error = fabs(l - left[n]) > error ? fabs(l - left[n]) : error;
+    error = fabs(r - right[n]) > error ? fabs(r - right[n]) : error;
+  }
+
+  TEST_ASSERT(peak > 0.01);
+  TEST_ASSERT(error <= peak * (sizeof(fluid_real_t) == sizeof(double) ? 1e-9 : 1e-4));
+}
+
+int
+main(void)
+{
+  fluid_convreverb_ir_t* rev_ir;
+  fluid_convreverb_worker_t* worker;
+  int i;
+
+  write_ir();
+  rev_ir = new_fluid_convreverb_ir(TEMP_FILE, SAMPLE_RATE);
+  remove(TEMP_FILE);
+  TEST_ASSERT(rev_ir != NULL);
+
+  for (i = 0; i < INPUT_LENGTH; i++) {
+    input[i] = (next_random(2001) - 1000) / 1000.0;
+  }
+
+  check_reverb(rev_ir, NULL);
+
+  worker = new_fluid_convreverb_worker(0);
+  TEST_ASSERT(worker != NULL);
+  check_reverb(rev_ir, worker);
+  delete_fluid_convreverb_worker(worker);
+
+  delete_fluid_convreverb_ir(rev_ir);
+
+  return EXIT_SUCCESS;
+}
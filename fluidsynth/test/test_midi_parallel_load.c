@@ -0,0 +1,229 @@
+/* Checks that the MIDI player plays the same events, at the same times,
+ * whether it parses the tracks of a file on one or on several threads. */
+
+#include <string.h>
+#include <fluidsynth.h>
+#include "test.h"
+
+#define NUM_TRACKS	12
+#define NUM_EVENTS	400
+#define MAX_PLAYED	(NUM_TRACKS * NUM_EVENTS * 2)
+#define BLOCK_SIZE	64
+#define TEMP_FILE	"test_midi_parallel_load.mid"
+
+typedef struct {
+  int block;
+  int type;
+  int channel;
+  int param1;
+  int param2;
+} played_event_t;
+
+typedef struct {
+  played_event_t events[MAX_PLAYED];
+  int count;
+  int block;
+} played_t;
+
+static unsigned char midi[NUM_TRACKS * (NUM_EVENTS * 12 + 64) + 64];
+static int midi_len;
+
+static unsigned int seed = 1;
+
+static int
+next_random(int range)
+{
+  seed = seed * 1103515245 + 12345;
+  return (int) ((seed >> 16) % (unsigned int) range);
+}
+
+static void
+put_byte(int b)
+{
+  midi[midi_len++] = (unsigned char) b;
+}
+
+static void
+put_varlen(unsigned int value)
+{
+  unsigned char buf[4];
+  int n = 0;
+
+  do {
+    buf[n++] = value & 0x7f;
+    value >>= 7;
+  } while (value);
+
+  while (n-- > 1) {
+    put_byte(buf[n] | 0x80);
+  }
+  put_byte(buf[0]);
+}
+
+/* Builds a format 1 file, the first track changing the tempo.  Many
+ * events of different tracks fall on the same tick, and running status
+ * is used, so that the merge order and the parser state both matter. */
+static void
+build_midi_file(void)
+{
+  int t, i, start, len, status, last_status;
+
+  midi_len = 0;
+  memcpy(midi, "MThd\0\0\0\6\0\1", 10);
+  midi_len = 10;
+  put_byte(NUM_TRACKS >> 8);
+  put_byte(NUM_TRACKS & 0xff);
+  put_byte(0);
+  put_byte(96);
+
+  for (t = 0; t < NUM_TRACKS; t++) {
+    memcpy(midi + midi_len, "MTrk\0\0\0\0", 8);
+    midi_len += 8;
+    start = midi_len;
+    last_status = -1;
+
+    for (i = 0; i < NUM_EVENTS; i++) {
+      put_varlen(next_random(4) * 12);
+
+      if (t == 0 && i % 50 == 0) {
+        int tempo = 300000 + next_random(400000);
+        put_byte(0xff);
+        put_byte(0x51);
+        put_byte(3);
+        put_byte(tempo >> 16);
+        put_byte((tempo >> 8) & 0xff);
+        put_byte(tempo & 0xff);
+        last_status = -1;
+        continue;
+      }
+
+      switch (next_random(4)) {
+      case 0:
+        status = 0x90 | (t & 0x0f);
+        break;
+      case 1:
+        status = 0x80 | (t & 0x0f);
+        break;
+      case 2:
+        status = 0xb0 | (t & 0x0f);
+        break;
+      default:
+        status = 0xe0 | (t & 0x0f);
+        break;
+      }
+      if (status != last_status) {
+        put_byte(status);
+        last_status = status;
+      }
+      put_byte(next_random(128));
+      put_byte(next_random(128));
+    }
+
+    put_varlen(0);
+    put_byte(0xff);
+    put_byte(0x2f);
+    put_byte(0);
+
+    len = midi_len - start;
+    midi[start - 4] = (len >> 24) & 0xff;
+    midi[start - 3] = (len >> 16) & 0xff;
+    midi[start - 2] = (len >> 8) & 0xff;
+    midi[start - 1] = len & 0xff;
+  }
+}
+
+static int
+record_event(void *data, fluid_midi_event_t *event)
+{
+  played_t *played = (played_t *) data;
+  played_event_t *e;
+  int type = fluid_midi_event_get_type(event);
+
+  TEST_ASSERT(played->count < MAX_PLAYED);
+  e = &played->events[played->count++];
+  e->block = played->block;
+  e->type = type;
+  e->channel = fluid_midi_event_get_channel(event);
+  if (type == 0xe0) {
+    e->param1 = fluid_midi_event_get_pitch(event);
+    e->param2 = 0;
+  } else {
+    e->param1 = fluid_midi_event_get_key(event);
+    e->param2 = fluid_midi_event_get_velocity(event);
+  }
+  return FLUID_OK;
+}
+
+/* Plays the file with the given number of load threads, from memory or
+ * from TEMP_FILE, and records the events played in each block. */
+static void
+play(played_t *played, int load_threads, int from_file)
+{
+  fluid_settings_t *settings;
+  fluid_synth_t *synth;
+  fluid_player_t *player;
+  float left[BLOCK_SIZE], right[BLOCK_SIZE];
+
+  settings = new_fluid_settings();
+  TEST_ASSERT(settings != NULL);
+  TEST_SUCCESS(fluid_settings_setint(settings, "player.load-threads", load_threads));
+  synth = new_fluid_synth(settings);
+  TEST_ASSERT(synth != NULL);
+  player = new_fluid_player(synth);
+  TEST_ASSERT(player != NULL);
+
+  played->count = 0;
+  played->block = 0;
+  TEST_SUCCESS(fluid_player_set_playback_callback(player, record_event, played));
+  if (from_file) {
+    TEST_SUCCESS(fluid_player_add(player, TEMP_FILE));
+  } else {
+    TEST_SUCCESS(fluid_player_add_mem(player, midi, midi_len));
+  }
+  TEST_SUCCESS(fluid_player_play(player));
+
+  while (fluid_player_get_status(player) == FLUID_PLAYER_PLAYING) {
+    TEST_SUCCESS(fluid_synth_write_float(synth, BLOCK_SIZE, left, 0, 1, right, 0, 1));
+    played->block++;
+    TEST_ASSERT(played->block < 1000000);
+  }
+
+  delete_fluid_player(player);
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+}
+
+static played_t sequential, parallel;
+
+static void
+compare(void)
+{
+  /* every event but the tempo changes and the end of tracks is played */
+  TEST_ASSERT(sequential.count == NUM_TRACKS * NUM_EVENTS - NUM_EVENTS / 50);
+  TEST_ASSERT(parallel.count == sequential.count);
+  TEST_ASSERT(memcmp(parallel.events, sequential.events,
+                     sequential.count * sizeof(played_event_t)) == 0);
+}
+
+int
+main(void)
+{
+  FILE *fp;
+
+  build_midi_file();
+
+  play(&sequential, 1, 0);
+  play(&parallel, 4, 0);
+  compare();
+
+  fp = fopen(TEMP_FILE, "wb");
+  TEST_ASSERT(fp != NULL);
+  TEST_ASSERT(fwrite(midi, 1, midi_len, fp) == (size_t) midi_len);
+  fclose(fp);
+
+  play(&parallel, 3, 1);
+  remove(TEMP_FILE);
+  compare();
+
+  return EXIT_SUCCESS;
+}
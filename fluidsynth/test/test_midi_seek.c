@@ -0,0 +1,361 @@
+/* Checks that fluid_player_seek() lands where playing the file from the
+ * start would: the channels get the same programs, controllers and pitch
+ * bends, and the events that follow are played in the same order and at
+ * the same distance from the seek position. */
+
+#include <math.h>
+#include <string.h>
+#include <fluidsynth.h>
+#include "test.h"
+
+#define NUM_TRACKS	4
+#define NUM_EVENTS	1500	/* per track, so the seeks cross several snapshots */
+#define TEMPO_EVERY	40	/* events of the first track between tempo changes */
+#define DIVISION	96
+#define EVENT_TICKS	12	/* every track has an event every EVENT_TICKS ticks */
+#define SAMPLE_RATE	44100
+#define BLOCK_SIZE	64
+#define MAX_PLAYED	(2 * NUM_TRACKS * NUM_EVENTS + 16 * 128)	/* played, and replayed by seeks */
+#define NUM_SEEKS	5
+
+typedef struct {
+  int block;
+  int type;
+  int channel;
+  int param1;
+  int param2;
+} played_event_t;
+
+typedef struct {
+  played_event_t events[MAX_PLAYED];
+  int count;
+  int block;
+  fluid_synth_t *synth;
+} played_t;
+
+#define NUM_CONTROLLERS	9
+
+typedef struct {
+  unsigned int program[16];
+  int cc[16][NUM_CONTROLLERS];
+  int pitch_bend[16];
+} channel_state_t;
+
+static const int controllers[NUM_CONTROLLERS] = { 1, 7, 10, 11, 64, 71, 74, 91, 93 };
+
+static unsigned char midi[NUM_TRACKS * (NUM_EVENTS * 8 + 64) + 64];
+static int midi_len;
+static int tempos[NUM_EVENTS / TEMPO_EVERY + 1];
+
+static unsigned int seed = 1;
+
+static int
+next_random(int range)
+{
+  seed = seed * 1103515245 + 12345;
+  return (int) ((seed >> 16) % (unsigned int) range);
+}
+
+static void
+put_byte(int b)
+{
+  midi[midi_len++] = (unsigned char) b;
+}
+
+/* Builds a format 1 file, with an event on every track each EVENT_TICKS
+ * ticks, the first track changing the tempo every TEMPO_EVERY events. */
+static void
+build_midi_file(void)
+{
+  int t, i, start, len, channel;
+
+  memcpy(midi, "MThd\0\0\0\6\0\1", 10);
+  midi_len = 10;
+  put_byte(0);
+  put_byte(NUM_TRACKS);
+  put_byte(0);
+  put_byte(DIVISION);
+
+  for (t = 0; t < NUM_TRACKS; t++) {
+    memcpy(midi + midi_len, "MTrk\0\0\0\0", 8);
+    midi_len += 8;
+    start = midi_len;
+
+    for (i = 0; i < NUM_EVENTS; i++) {
+      channel = next_random(16);
+
+      if (t == 0 && i % TEMPO_EVERY == 0) {
+        int tempo = 300000 + next_random(400000);
+        tempos[i / TEMPO_EVERY] = tempo;
+        /* at the same tick as the event that follows */
+        put_byte(i == 0 ? 0 : EVENT_TICKS);
+        put_byte(0xff);
+        put_byte(0x51);
+        put_byte(3);
+        put_byte(tempo >> 16);
+        put_byte((tempo >> 8) & 0xff);
+        put_byte(tempo & 0xff);
+        put_byte(0);
+      } else {
+        put_byte(i == 0 ? 0 : EVENT_TICKS);
+      }
+
+      switch (next_random(5)) {
+      case 0:
+        put_byte(0x90 | channel);
+        put_byte(next_random(128));
+        put_byte(1 + next_random(127));
+        break;
+      case 1:
+        put_byte(0x80 | channel);
+        put_byte(next_random(128));
+        put_byte(0);
+        break;
+      case 2:
+        put_byte(0xb0 | channel);
+        put_byte(controllers[next_random(NUM_CONTROLLERS)]);
+        put_byte(next_random(128));
+        break;
+      case 3:
+        put_byte(0xc0 | channel);
+        put_byte(next_random(128));
+        break;
+      default:
+        put_byte(0xe0 | channel);
+        put_byte(next_random(128));
+        put_byte(next_random(128));
+        break;
+      }
+    }
+
+    put_byte(0);
+    put_byte(0xff);
+    put_byte(0x2f);
+    put_byte(0);
+
+    len = midi_len - start;
+    midi[start - 4] = (len >> 24) & 0xff;
+    midi[start - 3] = (len >> 16) & 0xff;
+    midi[start - 2] = (len >> 8) & 0xff;
+    midi[start - 1] = len & 0xff;
+  }
+}
+
+/* Position in milliseconds of the given tick */
+static double
+tick_msec(int ticks)
+{
+  double msec = 0.0;
+  int i, span = TEMPO_EVERY * EVENT_TICKS;
+
+  for (i = 0; ticks > 0; i++, ticks -= span) {
+    msec += (ticks < span ? ticks : span) * (tempos[i] / 1000.0) / DIVISION;
+  }
+  return msec;
+}
+
+static void
+get_channel_state(fluid_synth_t *synth, channel_state_t *state)
+{
+  unsigned int sfont, bank;
+  int c, i;
+
+  for (c = 0; c < 16; c++) {
+    TEST_SUCCESS(fluid_synth_get_program(synth, c, &sfont, &bank, &state->program[c]));
+    TEST_SUCCESS(fluid_synth_get_pitch_bend(synth, c, &state->pitch_bend[c]));
+    for (i = 0; i < NUM_CONTROLLERS; i++) {
+      TEST_SUCCESS(fluid_synth_get_cc(synth, c, controllers[i], &state->cc[c][i]));
+    }
+  }
+}
+
+static const int seek_events[NUM_SEEKS] = { 0, 255, 600, 1024, NUM_EVENTS - 2 };
+
+static played_t reference, sought;
+static channel_state_t reference_state[NUM_SEEKS];
+static int seek_msec[NUM_SEEKS];
+
+static int
+record_event(void *data, fluid_midi_event_t *event)
+{
+  played_t *played = (played_t *) data;
+  played_event_t *e;
+  int type = fluid_midi_event_get_type(event);
+
+  TEST_ASSERT(played->count < MAX_PLAYED);
+  e = &played->events[played->count++];
+  e->block = played->block;
+  e->type = type;
+  e->channel = fluid_midi_event_get_channel(event);
+  if (type == 0xe0) {
+    e->param1 = fluid_midi_event_get_pitch(event);
+    e->param2 = 0;
+  } else if (type == 0xc0) {
+    e->param1 = fluid_midi_event_get_program(event);
+    e->param2 = 0;
+  } else {
+    e->param1 = fluid_midi_event_get_key(event);
+    e->param2 = fluid_midi_event_get_velocity(event);
+  }
+  /* without a soundfont the notes fail, only the channel state matters */
+  fluid_synth_handle_midi_event(played->synth, event);
+
+  /* every track has played its events up to seek position s */
+  if (played == &reference) {
+    int s;
+
+    for (s = 0; s < NUM_SEEKS; s++) {
+      if (played->count == (seek_events[s] + 1) * NUM_TRACKS) {
+        get_channel_state(played->synth, &reference_state[s]);
+      }
+    }
+  }
+  return FLUID_OK;
+}
+
+static void
+new_player(played_t *played, fluid_settings_t **settings,
+           fluid_synth_t **synth, fluid_player_t **player)
+{
+  *settings = new_fluid_settings();
+  TEST_ASSERT(*settings != NULL);
+  TEST_SUCCESS(fluid_settings_setnum(*settings, "synth.sample-rate", SAMPLE_RATE));
+  *synth = new_fluid_synth(*settings);
+  TEST_ASSERT(*synth != NULL);
+  *player = new_fluid_player(*synth);
+  TEST_ASSERT(*player != NULL);
+
+  played->count = 0;
+  played->block = 0;
+  played->synth = *synth;
+  TEST_SUCCESS(fluid_player_set_playback_callback(*player, record_event, played));
+  TEST_SUCCESS(fluid_player_add_mem(*player, midi, midi_len));
+}
+
+static void
+render_block(played_t *played, fluid_synth_t *synth)
+{
+  float left[BLOCK_SIZE], right[BLOCK_SIZE];
+
+  TEST_SUCCESS(fluid_synth_write_float(synth, BLOCK_SIZE, left, 0, 1, right, 0, 1));
+  played->block++;
+  TEST_ASSERT(played->block < 10000000);
+}
+
+static void
+delete_player(fluid_settings_t *settings, fluid_synth_t *synth,
+              fluid_player_t *player)
+{
+  delete_fluid_player(player);
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+}
+
+/* Plays the file from the start */
+static void
+play_reference(void)
+{
+  fluid_settings_t *settings;
+  fluid_synth_t *synth;
+  fluid_player_t *player;
+
+  new_player(&reference, &settings, &synth, &player);
+  TEST_SUCCESS(fluid_player_play(player));
+
+  while (fluid_player_get_status(player) == FLUID_PLAYER_PLAYING) {
+    render_block(&reference, synth);
+  }
+  TEST_ASSERT(reference.count == NUM_TRACKS * NUM_EVENTS);
+
+  delete_player(settings, synth, player);
+}
+
+/* Plays for play_blocks blocks (none: seek before playing), seeks to seek
+ * position s and plays to the end */
+static void
+play_sought(int play_blocks, int s)
+{
+  fluid_settings_t *settings;
+  fluid_synth_t *synth;
+  fluid_player_t *player;
+  channel_state_t state;
+  int i, seek_block, first, ref_first, ticks, blocks, delay;
+  double due;
+
+  new_player(&sought, &settings, &synth, &player);
+  if (play_blocks == 0) {
+    TEST_SUCCESS(fluid_player_seek(player, seek_msec[s]));
+  }
+  TEST_SUCCESS(fluid_player_play(player));
+  for (i = 0; i < play_blocks; i++) {
+    render_block(&sought, synth);
+  }
+  if (play_blocks > 0) {
+    TEST_SUCCESS(fluid_player_seek(player, seek_msec[s]));
+  }
+
+  seek_block = sought.block;
+  render_block(&sought, synth);
+  get_channel_state(synth, &state);
+  TEST_ASSERT(memcmp(&state, &reference_state[s], sizeof(state)) == 0);
+
+  while (fluid_player_get_status(player) == FLUID_PLAYER_PLAYING) {
+    render_block(&sought, synth);
+  }
+  delete_player(settings, synth, player);
+
+  /* the events after the seek are the ones after the seek position */
+  for (first = 0; first < sought.count && sought.events[first].block <= seek_block; first++);
+  ref_first = (seek_events[s] + 1) * NUM_TRACKS;
+  TEST_ASSERT(sought.count - first == reference.count - ref_first);
+
+  /* the first one comes in the first block starting after the time the
+   * tempo map gives it (the player counts whole milliseconds) */
+  ticks = (seek_events[s] + 1) * EVENT_TICKS;
+  due = ceil((tick_msec(ticks) - seek_msec[s]) * SAMPLE_RATE / 1000.0 / BLOCK_SIZE);
+  blocks = (int) due;
+  delay = sought.events[first].block - seek_block - blocks;
+  TEST_ASSERT(delay >= -1 && delay <= 1);
+
+  /* a tempo change is applied at the start of the block it falls in, so
+   * the two plays only keep the same timing up to the next one */
+  ticks = (seek_events[s] / TEMPO_EVERY + 1) * TEMPO_EVERY * EVENT_TICKS;
+  blocks = (int) ((tick_msec(ticks) - seek_msec[s]) * SAMPLE_RATE / 1000.0 / BLOCK_SIZE);
+
+  for (i = 0; i < sought.count - first; i++) {
+    played_event_t *e = &sought.events[first + i];
+    played_event_t *r = &reference.events[ref_first + i];
+
+    TEST_ASSERT(e->type == r->type && e->channel == r->channel
+                && e->param1 == r->param1 && e->param2 == r->param2);
+    if (e->block - seek_block < blocks) {
+      delay = (e->block - sought.events[first].block)
+        - (r->block - reference.events[ref_first].block);
+      TEST_ASSERT(delay >= -1 && delay <= 1);
+    }
+  }
+}
+
+int
+main(void)
+{
+  int s, ticks;
+
+  build_midi_file();
+
+  /* halfway between two events, so that block boundaries don't matter */
+  for (s = 0; s < NUM_SEEKS; s++) {
+    ticks = seek_events[s] * EVENT_TICKS;
+    seek_msec[s] = (int) ((tick_msec(ticks) + tick_msec(ticks + EVENT_TICKS)) / 2.0);
+  }
+
+  play_reference();
+
+  for (s = 0; s < NUM_SEEKS; s++) {
+    play_sought(0, s);          /* before playing */
+    play_sought(2000, s);       /* from about three seconds in */
+    play_sought(reference.block - 100, s);  /* from near the end, backwards */
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/* Checks fluid_rvoice_buffers_mix(): a stereo voice mixes bit for bit as
+ * one multiply-add per buffer did before, and a surround voice reaches
+ * the speakers with the gains of fluid_surround_pan(). */
+
+#include "fluid_rvoice.h"
+#include "fluid_surround.h"
+#include "test.h"
+
+#define SAMPLES		(FLUID_BUFSIZE + 37)	/* not a multiple of anything */
+#define NUM_BUFS	FLUID_RVOICE_MAX_BUFS
+
+static fluid_real_t dsp_buf[SAMPLES];
+static fluid_real_t out[NUM_BUFS][SAMPLES];
+static fluid_real_t expected[NUM_BUFS][SAMPLES];
+
+static unsigned int seed = 1;
+
+static int
+next_random(int range)
+{
+  seed = seed * 1103515245 + 12345;
+  return (int) ((seed >> 16) % (unsigned int) range);
+}
+
+static fluid_real_t
+next_sample(void)
+{
+  return (fluid_real_t) ((next_random(2001) - 1000) / 1000.0);
+}
+
+static void
+fill_buffers(void)
+{
+  int b, i;
+
+  for (i = 0; i < SAMPLES; i++) {
+    dsp_buf[i] = next_sample();
+  }
+  for (b = 0; b < NUM_BUFS; b++) {
+    for (i = 0; i < SAMPLES; i++) {
+      out[b][i] = expected[b][i] = next_sample();
+    }
+  }
+}
+
+static void
+mix(fluid_rvoice_buffers_t* buffers, int dest_bufcount)
+{
+  fluid_real_t* dest_bufs[NUM_BUFS];
+  int b;
+
+  for (b = 0; b < NUM_BUFS; b++) {
+    dest_bufs[b] = out[b];
+  }
+  fluid_rvoice_buffers_mix(buffers, dsp_buf, SAMPLES, dest_bufs, dest_bufcount);
+}
+
+static void
+check_expected(void)
+{
+  int b, i;
+
+  for (b = 0; b < NUM_BUFS; b++) {
+    for (i = 0; i < SAMPLES; i++) {
+      TEST_ASSERT(out[b][i] == expected[b][i]);
+    }
+  }
+}
+
+/* Left, right, reverb and chorus, some unmapped or silent, mixed the way
+ * every buffer was mixed before surround */
+static void
+test_stereo(void)
+{
+  fluid_rvoice_buffers_t buffers;
+  int mappings[] = { 0, 1, 2, 3, -1, 7, 2 };
+  int count = sizeof(mappings) / sizeof(int);
+  int round, b, i;
+
+  for (round = 0; round < 100; round++) {
+    fill_buffers();
+    FLUID_MEMSET(&buffers, 0, sizeof(buffers));
+
+    for (b = 0; b < count; b++) {
+      fluid_real_t amp = next_random(4) ? next_sample() : 0.0f;
+
+      fluid_rvoice_buffers_set_amp(&buffers, b, amp);
+      fluid_rvoice_buffers_set_mapping(&buffers, b, mappings[b]);
+
+      /* mapping 7 is past the 4 buffers given */
+      if (mappings[b] < 0 || mappings[b] >= 4) {
+        continue;
+      }
+      for (i = 0; i < SAMPLES; i++) {
+        expected[mappings[b]][i] += amp * dsp_buf[i];
+      }
+    }
+
+    mix(&buffers, 4);
+    check_expected();
+  }
+}
+
+/* Each speaker of a layout gets the gain fluid_surround_pan() gives it:
+ * the two speakers around the voice share its power, the others and the
+ * LFE get nothing. Voices are panned within +/- max_azimuth. */
+static void
+test_surround(const char* layout, int speakers, int max_azimuth)
+{
+  fluid_surround_t surround;
+  fluid_rvoice_buffers_t buffers;
+  fluid_real_t gains[FLUID_RVOICE_MAX_SPEAKERS];
+  double power;
+  int azimuth, b, i, audible, on_speaker;
+
+  TEST_SUCCESS(fluid_surround_init(&surround, layout));
+  TEST_ASSERT(surround.speakers == speakers);
+
+  for (azimuth = -max_azimuth; azimuth <= max_azimuth; azimuth += 5) {
+    fluid_surround_pan(&surround, (fluid_real_t) azimuth, gains);
+
+    power = 0.0;
+    audible = 0;
+    on_speaker = FALSE;
+    for (b = 0; b < speakers; b++) {
+      TEST_ASSERT(gains[b] >= 0.0f && gains[b] <= 1.0f);
+      power += gains[b] * gains[b];
+      audible += gains[b] > 0.0f;
+      if (surround.azimuth[b] == azimuth
+          || surround.azimuth[b] == azimuth + 360
+          || surround.azimuth[b] == azimuth - 360) {
+        on_speaker = TRUE;
+        TEST_ASSERT(fabs(gains[b] - 1.0) < 1e-6);
+      }
+    }
+    TEST_ASSERT(fabs(power - 1.0) < 1e-6);
+    TEST_ASSERT(audible == 2 || (audible == 1 && on_speaker));
+
+    fill_buffers();
+    FLUID_MEMSET(&buffers, 0, sizeof(buffers));
+    for (b = 0; b < speakers; b++) {
+      fluid_rvoice_buffers_set_amp(&buffers, b, gains[b]);
+      fluid_rvoice_buffers_set_mapping(&buffers, b, b);
+      for (i = 0; i < SAMPLES; i++) {
+        expected[b][i] += gains[b] * dsp_buf[i];
+      }
+    }
+
+    mix(&buffers, speakers);
+    check_expected();
+  }
+}
+
+/* The stereo downmix gains of ITU-R BS.775 */
+static void
+test_downmix(void)
+{
+  static const float expected_5_1[6][2] = {
+    { 1.0f, 0.0f }, { 0.0f, 1.0f }, { 0.7071068f, 0.7071068f },
+    { 0.0f, 0.0f }, { 0.7071068f, 0.0f }, { 0.0f, 0.7071068f }
+  };
+  fluid_surround_t surround;
+  int s;
+
+  TEST_SUCCESS(fluid_surround_init(&surround, "5.1"));
+  for (s = 0; s < 6; s++) {
+    TEST_ASSERT(fabs(surround.downmix[s][0] - expected_5_1[s][0]) < 1e-6);
+    TEST_ASSERT(fabs(surround.downmix[s][1] - expected_5_1[s][1]) < 1e-6);
+  }
+}
+
+int
+main(void)
+{
+  test_stereo();
+  test_surround("stereo", 2, 30);
+  test_surround("quad", 4, 180);
+  test_surround("5.1", 6, 180);
+  test_surround("7.1", 8, 180);
+  test_downmix();
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,92 @@
+/* Checks that fluid_sequencer_send_at_batch() delivers unsorted events in
+ * time order, and events with the same time in array order. */
+
+#include <fluidsynth.h>
+#include "test.h"
+
+#define NUM_EVENTS	5000
+#define MAX_TIME	3000	/* ms, well past the sequencer's short queue */
+#define NUM_TIMES	97	/* few distinct times, so many events share one */
+
+typedef struct {
+  unsigned int time[NUM_EVENTS];
+  int index[NUM_EVENTS];
+  int count;
+} received_t;
+
+static int indexes[NUM_EVENTS];
+static unsigned int times[NUM_EVENTS];
+
+static unsigned int seed = 1;
+
+static int
+next_random(int range)
+{
+  seed = seed * 1103515245 + 12345;
+  return (int) ((seed >> 16) % (unsigned int) range);
+}
+
+static void
+receive(unsigned int time, fluid_event_t* event, fluid_sequencer_t* seq, void* data)
+{
+  received_t* received = (received_t*) data;
+
+  /* the client also gets FLUID_SEQ_UNREGISTERING when the sequencer goes */
+  if (fluid_event_get_type(event) != FLUID_SEQ_TIMER) {
+    return;
+  }
+
+  TEST_ASSERT(received->count < NUM_EVENTS);
+  received->time[received->count] = time;
+  received->index[received->count] = *(int*) fluid_event_get_data(event);
+  received->count++;
+}
+
+int
+main(void)
+{
+  static received_t received;
+  fluid_sequencer_t* seq;
+  fluid_event_t* evts[NUM_EVENTS];
+  short client;
+  unsigned int now;
+  int i;
+
+  seq = new_fluid_sequencer2(0);
+  TEST_ASSERT(seq != NULL);
+  client = fluid_sequencer_register_client(seq, "receiver", receive, &received);
+  TEST_ASSERT(client != FLUID_FAILED);
+
+  for (i = 0; i < NUM_EVENTS; i++) {
+    indexes[i] = i;
+    times[i] = (unsigned int) (next_random(NUM_TIMES) * (MAX_TIME / NUM_TIMES));
+    evts[i] = new_fluid_event();
+    TEST_ASSERT(evts[i] != NULL);
+    fluid_event_set_dest(evts[i], client);
+    fluid_event_timer(evts[i], &indexes[i]);
+  }
+
+  TEST_SUCCESS(fluid_sequencer_send_at_batch(seq, evts, times, NUM_EVENTS, 0));
+
+  for (now = 0; now <= MAX_TIME + 10; now++) {
+    fluid_sequencer_process(seq, now);
+  }
+
+  TEST_ASSERT(received.count == NUM_EVENTS);
+  for (i = 0; i < NUM_EVENTS; i++) {
+    TEST_ASSERT(received.time[i] == times[received.index[i]]);
+    if (i > 0) {
+      TEST_ASSERT(received.time[i - 1] <= received.time[i]);
+      if (received.time[i - 1] == received.time[i]) {
+        TEST_ASSERT(received.index[i - 1] < received.index[i]);
+      }
+    }
+  }
+
+  for (i = 0; i < NUM_EVENTS; i++) {
+    delete_fluid_event(evts[i]);
+  }
+  delete_fluid_sequencer(seq);
+
+  return EXIT_SUCCESS;
+}
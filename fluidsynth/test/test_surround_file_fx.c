@@ -0,0 +1,121 @@
+/* Checks that a surround file render contains the reverb: a voice panned
+ * to the rear speakers must still be heard through the reverb on the
+ * front left and right channels. */
+
+#include <math.h>
+#include <string.h>
+#include <fluidsynth.h>
+#include "test.h"
+
+#define SAMPLE_RATE	44100
+#define SAMPLE_LEN	(SAMPLE_RATE / 10)
+#define PERIOD_SIZE	64
+#define NOTE_PERIODS	(SAMPLE_RATE / 2 / PERIOD_SIZE)
+#define TOTAL_PERIODS	(2 * SAMPLE_RATE / PERIOD_SIZE)
+#define CHANNELS	4	/* quad: front left, front right, rear left, rear right */
+#define TEMP_FILE	"test_surround_file_fx.raw"
+
+/* looped sine, with the guard points the interpolation reads */
+static short sample_data[SAMPLE_LEN + 2 * 46];
+
+static void
+init_sample(fluid_sample_t* sample)
+{
+  int i;
+
+  for (i = 0; i < SAMPLE_LEN; i++) {
+    /* 100 full periods, so the loop is seamless */
+    sample_data[46 + i] = (short) (16000.0 * sin(2.0 * M_PI * 100.0 * i / SAMPLE_LEN));
+  }
+
+  memset(sample, 0, sizeof(fluid_sample_t));
+  strcpy(sample->name, "sine");
+  sample->data = sample_data;
+  sample->start = 46;
+  sample->end = 46 + SAMPLE_LEN - 1;
+  sample->loopstart = 46;
+  sample->loopend = 46 + SAMPLE_LEN;
+  sample->samplerate = SAMPLE_RATE;
+  sample->origpitch = 60;
+  sample->sampletype = FLUID_SAMPLETYPE_MONO;
+  sample->valid = 1;
+}
+
+/* Renders a rear note to the file, returns the energy of the front pair */
+static double
+render_front_energy(int reverb)
+{
+  fluid_settings_t* settings;
+  fluid_synth_t* synth;
+  fluid_file_renderer_t* renderer;
+  fluid_voice_t* voice;
+  fluid_sample_t sample;
+  short frame[CHANNELS];
+  double energy = 0.0;
+  FILE* file;
+  int i;
+
+  init_sample(&sample);
+
+  settings = new_fluid_settings();
+  TEST_ASSERT(settings != NULL);
+  fluid_settings_setstr(settings, "synth.speaker-layout", "quad");
+  fluid_settings_setnum(settings, "synth.sample-rate", SAMPLE_RATE);
+  fluid_settings_setint(settings, "synth.reverb.active", reverb);
+  fluid_settings_setint(settings, "synth.chorus.active", 0);
+  fluid_settings_setint(settings, "audio.period-size", PERIOD_SIZE);
+  fluid_settings_setstr(settings, "audio.file.name", TEMP_FILE);
+  fluid_settings_setstr(settings, "audio.file.type", "raw");
+  fluid_settings_setstr(settings, "audio.file.format", "s16");
+
+  synth = new_fluid_synth(settings);
+  TEST_ASSERT(synth != NULL);
+  /* straight behind the listener, between the rear speakers */
+  TEST_SUCCESS(fluid_synth_set_channel_azimuth(synth, 0, 180.0f));
+
+  renderer = new_fluid_file_renderer(synth);
+  TEST_ASSERT(renderer != NULL);
+
+  voice = fluid_synth_alloc_voice(synth, &sample, 0, 60, 127);
+  TEST_ASSERT(voice != NULL);
+  fluid_voice_gen_set(voice, GEN_SAMPLEMODE, 1);
+  fluid_voice_gen_set(voice, GEN_REVERBSEND, 1000.0f);
+  fluid_synth_start_voice(synth, voice);
+
+  for (i = 0; i < TOTAL_PERIODS; i++) {
+    if (i == NOTE_PERIODS) {
+      fluid_synth_noteoff(synth, 0, 60);
+    }
+    TEST_SUCCESS(fluid_file_renderer_process_block(renderer));
+  }
+
+  delete_fluid_file_renderer(renderer);
+  delete_fluid_synth(synth);
+  delete_fluid_settings(settings);
+
+  file = fopen(TEMP_FILE, "rb");
+  TEST_ASSERT(file != NULL);
+  for (i = 0; fread(frame, sizeof(short), CHANNELS, file) == CHANNELS; i++) {
+    energy += (double) frame[0] * frame[0] + (double) frame[1] * frame[1];
+  }
+  fclose(file);
+  remove(TEMP_FILE);
+
+  TEST_ASSERT(i == TOTAL_PERIODS * PERIOD_SIZE);
+  return energy;
+}
+
+int
+main(void)
+{
+  double dry, wet;
+
+  dry = render_front_energy(0);
+  wet = render_front_energy(1);
+
+  /* the dither alone stays within one step per sample */
+  TEST_ASSERT(dry <= 2.0 * TOTAL_PERIODS * PERIOD_SIZE);
+  TEST_ASSERT(wet > 1000.0 * dry + 1.0e6);
+
+  return EXIT_SUCCESS;
+}